@@ -0,0 +1,116 @@
+// LAF Base Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/mapped_file.h"
+
+#if LAF_WINDOWS
+  #include "base/string.h"
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace base {
+
+MappedFile::MappedFile()
+  : m_data(nullptr)
+  , m_size(0)
+  , m_handle(nullptr)
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+  close();
+
+#if LAF_WINDOWS
+
+  HANDLE file = CreateFileW(from_utf8(filename).c_str(),
+                            GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  // The mapping keeps its own reference to the file
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping)
+    return false;
+
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!data) {
+    CloseHandle(mapping);
+    return false;
+  }
+
+  m_data = (const uint8_t*)data;
+  m_size = size_t(size.QuadPart);
+  m_handle = mapping;
+
+#else
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat sb;
+  if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  // The mapping is still valid after closing the file descriptor
+  void* data = mmap(nullptr, size_t(sb.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  m_data = (const uint8_t*)data;
+  m_size = size_t(sb.st_size);
+
+#endif
+
+  m_filename = filename;
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (!m_data)
+    return;
+
+#if LAF_WINDOWS
+  UnmapViewOfFile(m_data);
+  CloseHandle((HANDLE)m_handle);
+#else
+  munmap((void*)m_data, m_size);
+#endif
+
+  m_data = nullptr;
+  m_size = 0;
+  m_handle = nullptr;
+  m_filename.clear();
+}
+
+} // namespace base
@@ -0,0 +1,45 @@
+// LAF Base Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_MAPPED_FILE_H_INCLUDED
+#define BASE_MAPPED_FILE_H_INCLUDED
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace base {
+
+  // A whole file mapped in memory in read-only mode.
+  class MappedFile {
+  public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps the given file, returns false if the file cannot be
+    // opened or mapped (e.g. an empty file).
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const std::string& filename() const { return m_filename; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+  private:
+    const uint8_t* m_data;
+    size_t m_size;
+    void* m_handle;             // File mapping handle (Windows only)
+    std::string m_filename;
+  };
+
+} // namespace base
+
+#endif
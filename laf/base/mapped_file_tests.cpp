@@ -0,0 +1,54 @@
+// LAF Base Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/file_content.h"
+#include "base/fs.h"
+#include "base/mapped_file.h"
+
+#include <algorithm>
+
+using namespace base;
+
+TEST(MappedFile, Read)
+{
+  const char* fn = "_test_mapped_.tmp";
+
+  for (size_t s : { 1, 30, 1024*64+7 }) {
+    buffer buf(s);
+    for (int i=0; i<buf.size(); ++i)
+      buf[i] = i;
+    write_file_content(fn, buf);
+
+    MappedFile f;
+    ASSERT_TRUE(f.open(fn));
+    EXPECT_TRUE(f.isOpen());
+    EXPECT_EQ(fn, f.filename());
+    ASSERT_EQ(s, f.size());
+    EXPECT_TRUE(std::equal(buf.begin(), buf.end(), f.data()));
+
+    f.close();
+    EXPECT_FALSE(f.isOpen());
+    EXPECT_EQ(size_t(0), f.size());
+    EXPECT_TRUE(f.filename().empty());
+  }
+
+  delete_file(fn);
+}
+
+TEST(MappedFile, Errors)
+{
+  MappedFile f;
+  EXPECT_FALSE(f.open("_file_that_does_not_exist_.tmp"));
+  EXPECT_FALSE(f.isOpen());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+// LAF Base Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef BASE_PARALLEL_FOR_H_INCLUDED
+#define BASE_PARALLEL_FOR_H_INCLUDED
+#pragma once
+
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace base {
+
+  // Calls func(i) for each i in [begin, end) using the threads of the
+  // given pool. The calling thread processes items too, so this
+  // function can be called from a worker of the same pool (nested
+  // loops) without dead-locking: helpers that didn't start before the
+  // caller finished all the items are just ignored.
+  //
+  // Items are taken in order but can be completed in any order. If
+  // func() throws an exception, the remaining items are skipped and
+  // the first exception is re-thrown in the calling thread.
+  template<typename Func>
+  void parallel_for(thread_pool& pool,
+                    const int begin,
+                    const int end,
+                    Func&& func)
+  {
+    if (begin >= end)
+      return;
+
+    // Shared with helpers that could start after we've returned
+    struct state {
+      std::atomic<int> next;
+      int end;
+      std::mutex mutex;
+      std::condition_variable cv;
+      int running = 0;
+      bool closed = false;
+      std::exception_ptr error;
+    };
+    auto s = std::make_shared<state>();
+    s->next = begin;
+    s->end = end;
+
+    auto run = [s, &func]() {
+      for (int i; (i = s->next++) < s->end; ) {
+        try {
+          func(i);
+        }
+        catch (...) {
+          const std::lock_guard lock(s->mutex);
+          if (!s->error)
+            s->error = std::current_exception();
+          s->next = s->end;
+        }
+      }
+    };
+
+    const int helpers = std::min<int>(int(pool.size()), end-begin-1);
+    for (int j=0; j<helpers; ++j) {
+      pool.execute([s, run]{
+        {
+          const std::lock_guard lock(s->mutex);
+          if (s->closed)
+            return;
+          ++s->running;
+        }
+        run();
+        {
+          const std::lock_guard lock(s->mutex);
+          --s->running;
+        }
+        s->cv.notify_all();
+      });
+    }
+
+    run();
+
+    std::unique_lock lock(s->mutex);
+    s->closed = true;
+    s->cv.wait(lock, [&s]{ return s->running == 0; });
+    if (s->error)
+      std::rethrow_exception(s->error);
+  }
+
+} // namespace base
+
+#endif
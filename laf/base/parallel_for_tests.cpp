@@ -0,0 +1,63 @@
+// LAF Base Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include <gtest/gtest.h>
+
+#include "base/parallel_for.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace base;
+
+TEST(ParallelFor, Basic)
+{
+  thread_pool p(4);
+  std::vector<int> v(10000, 0);
+  parallel_for(p, 0, int(v.size()), [&v](int i){ v[i] += i; });
+
+  for (int i=0; i<int(v.size()); ++i)
+    EXPECT_EQ(i, v[i]);
+}
+
+TEST(ParallelFor, EmptyRange)
+{
+  thread_pool p(2);
+  std::atomic<int> c(0);
+  parallel_for(p, 5, 5, [&c](int){ ++c; });
+  parallel_for(p, 5, 2, [&c](int){ ++c; });
+  EXPECT_EQ(0, c);
+}
+
+TEST(ParallelFor, Nested)
+{
+  // All workers are busy with the outer loop, the inner loops must
+  // be completed by the calling threads themselves.
+  thread_pool p(2);
+  std::atomic<int> c(0);
+  parallel_for(p, 0, 8, [&](int){
+    parallel_for(p, 0, 100, [&c](int){ ++c; });
+  });
+  EXPECT_EQ(800, c);
+}
+
+TEST(ParallelFor, Exception)
+{
+  thread_pool p(3);
+  EXPECT_THROW(
+    parallel_for(p, 0, 1000, [](int i){
+      if (i == 500)
+        throw std::runtime_error("error");
+    }),
+    std::runtime_error);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
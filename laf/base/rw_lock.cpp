@@ -16,9 +16,8 @@
 //#define DEBUG_OBJECT_LOCKS
 
 #include "base/debug.h"
-#include "base/thread.h"
 
-#include <algorithm>
+#include <chrono>
 
 namespace base {
 
@@ -51,74 +50,63 @@ bool RWLock::canWriteLockFromRead() const
 
 RWLock::LockResult RWLock::lock(LockType lockType, int timeout)
 {
+  std::unique_lock lock(m_mutex);
+
   // Check for re-entrant write locks (multiple write-lock in the same
   // thread are allowed).
-  // if (lockType == WriteLock) {
-  {
-    const std::lock_guard lock(m_mutex);
-    if (m_write_lock &&
-        m_write_thread == std::this_thread::get_id()) {
-      return LockResult::Reentrant;
-    }
+  if (m_write_lock &&
+      m_write_thread == std::this_thread::get_id()) {
+    return LockResult::Reentrant;
   }
 
-  while (timeout >= 0) {
-    {
-      const std::lock_guard lock(m_mutex);
-
-      switch (lockType) {
-
-        case ReadLock:
-          // If no body is writing the object...
-          if (!m_write_lock) {
-            // We can read it
-            ++m_read_locks;
-            return LockResult::OK;
-          }
-          break;
-
-        case WriteLock:
-          // Check that there is no weak lock
-          if (m_weak_lock) {
-            if (*m_weak_lock == WeakLocked)
-              *m_weak_lock = WeakUnlocking;
-
-            if (*m_weak_lock == WeakUnlocking)
-              goto go_wait;
-
-            ASSERT(*m_weak_lock == WeakUnlocked);
-          }
-
-          // If no body is reading and writing...
-          if (m_read_locks == 0 && !m_write_lock) {
-            // We can start writing the object...
-            m_write_lock = true;
-            m_write_thread = std::this_thread::get_id();
-
-#ifdef DEBUG_OBJECT_LOCKS
-            TRACE("LCK: lock: Locked <%p> to write\n", this);
-#endif
-            return LockResult::OK;
-          }
-          break;
-
-      }
-
-    go_wait:;
-    }
-
-    if (timeout > 0) {
-      const int delay = std::min(100, timeout);
-      timeout -= delay;
+  auto tryLock = [this, lockType]() -> bool {
+    switch (lockType) {
+
+      case ReadLock:
+        // If no body is writing the object...
+        if (!m_write_lock) {
+          // We can read it
+          ++m_read_locks;
+          return true;
+        }
+        break;
+
+      case WriteLock:
+        // Check that there is no weak lock
+        if (m_weak_lock) {
+          if (*m_weak_lock == WeakLocked)
+            *m_weak_lock = WeakUnlocking;
+
+          // Wait the weakUnlock()
+          if (*m_weak_lock == WeakUnlocking)
+            return false;
+
+          ASSERT(*m_weak_lock == WeakUnlocked);
+        }
+
+        // If no body is reading and writing...
+        if (m_read_locks == 0 && !m_write_lock) {
+          // We can start writing the object...
+          m_write_lock = true;
+          m_write_thread = std::this_thread::get_id();
 
 #ifdef DEBUG_OBJECT_LOCKS
-      TRACE("LCK: lock: wait 100 msecs for <%p>\n", this);
+          TRACE("LCK: lock: Locked <%p> to write\n", this);
 #endif
+          return true;
+        }
+        break;
 
-      base::this_thread::sleep_for(double(delay) / 1000.0);
     }
-    else
-      break;
+    return false;
+  };
+
+  // A negative timeout fails without trying to lock
+  if (timeout >= 0 &&
+      (tryLock() ||
+       (timeout > 0 &&
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeout), tryLock)))) {
+    return LockResult::OK;
   }
 
 #ifdef DEBUG_OBJECT_LOCKS
@@ -134,14 +122,19 @@ void RWLock::downgradeToRead(LockResult lockResult)
   if (lockResult != LockResult::OK)
     return; // Do nothing for failed or reentrant locks
 
-  const std::lock_guard lock(m_mutex);
+  {
+    const std::lock_guard lock(m_mutex);
 
-  ASSERT(m_read_locks == 0);
-  ASSERT(m_write_lock);
+    ASSERT(m_read_locks == 0);
+    ASSERT(m_write_lock);
 
-  m_write_lock = false;
-  m_write_thread = std::thread::id();
-  m_read_locks = 1;
+    m_write_lock = false;
+    m_write_thread = std::thread::id();
+    m_read_locks = 1;
+  }
+
+  // Other readers can continue now
+  m_cond.notify_all();
 }
 
 void RWLock::unlock(LockResult lockResult)
@@ -149,18 +142,23 @@ void RWLock::unlock(LockResult lockResult)
   if (lockResult != LockResult::OK)
     return; // Do nothing for failed or reentrant locks
 
-  const std::lock_guard lock(m_mutex);
+  {
+    const std::lock_guard lock(m_mutex);
 
-  if (m_write_lock) {
-    m_write_lock = false;
-    m_write_thread = std::thread::id();
-  }
-  else if (m_read_locks > 0) {
-    --m_read_locks;
-  }
-  else {
-    ASSERT(false);
+    if (m_write_lock) {
+      m_write_lock = false;
+      m_write_thread = std::thread::id();
+    }
+    else if (m_read_locks > 0) {
+      --m_read_locks;
+    }
+    else {
+      ASSERT(false);
+    }
   }
+
+  // Wake up threads waiting in lock()/upgradeToWrite()
+  m_cond.notify_all();
 }
 
 bool RWLock::weakLock(std::atomic<WeakLock>* weak_lock_flag)
@@ -178,75 +176,69 @@ bool RWLock::weakLock(std::atomic<WeakLock>* weak_lock_flag)
 
 void RWLock::weakUnlock()
 {
-  const std::lock_guard lock(m_mutex);
+  {
+    const std::lock_guard lock(m_mutex);
 
-  ASSERT(m_weak_lock);
-  ASSERT(*m_weak_lock != WeakLock::WeakUnlocked);
-  ASSERT(!m_write_lock);
+    ASSERT(m_weak_lock);
+    ASSERT(*m_weak_lock != WeakLock::WeakUnlocked);
+    ASSERT(!m_write_lock);
 
-  if (m_weak_lock) {
-    *m_weak_lock = WeakLock::WeakUnlocked;
-    m_weak_lock = nullptr;
+    if (m_weak_lock) {
+      *m_weak_lock = WeakLock::WeakUnlocked;
+      m_weak_lock = nullptr;
+    }
   }
+
+  // Wake up writers waiting for this weak lock
+  m_cond.notify_all();
 }
 
 RWLock::LockResult RWLock::upgradeToWrite(int timeout)
 {
+  std::unique_lock lock(m_mutex);
+
   // Check for re-entrant upgrade to write (multiple write-lock in the
   // same thread are allowed).
-  {
-    const std::lock_guard lock(m_mutex);
-    if (m_write_lock &&
-        m_write_thread == std::this_thread::get_id()) {
-      return LockResult::Reentrant;
-    }
+  if (m_write_lock &&
+      m_write_thread == std::this_thread::get_id()) {
+    return LockResult::Reentrant;
   }
 
-  while (timeout >= 0) {
-    {
-      const std::lock_guard lock(m_mutex);
-
-      // Check that there is no weak lock
-      if (m_weak_lock) {
-        if (*m_weak_lock == WeakLocked)
-          *m_weak_lock = WeakUnlocking;
+  auto tryUpgrade = [this]() -> bool {
+    // Check that there is no weak lock
+    if (m_weak_lock) {
+      if (*m_weak_lock == WeakLocked)
+        *m_weak_lock = WeakUnlocking;
 
-        // Wait some time
-        if (*m_weak_lock == WeakUnlocking)
-          goto go_wait;
+      // Wait the weakUnlock()
+      if (*m_weak_lock == WeakUnlocking)
+        return false;
 
-        ASSERT(*m_weak_lock == WeakUnlocked);
-      }
-
-      // this only is possible if there are just one reader
-      if (m_read_locks == 1) {
-        ASSERT(!m_write_lock);
-        m_read_locks = 0;
-        m_write_lock = true;
-        m_write_thread = std::this_thread::get_id();
-
-#ifdef DEBUG_OBJECT_LOCKS
-        TRACE("LCK: upgradeToWrite: Locked <%p> to write\n", this);
-#endif
-
-        return LockResult::OK;
-      }
-
-    go_wait:;
+      ASSERT(*m_weak_lock == WeakUnlocked);
     }
 
-    if (timeout > 0) {
-      const int delay = std::min(100, timeout);
-      timeout -= delay;
+    // this only is possible if there are just one reader
+    if (m_read_locks == 1) {
+      ASSERT(!m_write_lock);
+      m_read_locks = 0;
+      m_write_lock = true;
+      m_write_thread = std::this_thread::get_id();
 
 #ifdef DEBUG_OBJECT_LOCKS
-      TRACE("LCK: upgradeToWrite: wait 100 msecs for <%p>\n", this);
+      TRACE("LCK: upgradeToWrite: Locked <%p> to write\n", this);
 #endif
 
-      base::this_thread::sleep_for(double(delay) / 1000.0);
+      return true;
     }
-    else
-      break;
+    return false;
+  };
+
+  // A negative timeout fails without trying to lock
+  if (timeout >= 0 &&
+      (tryUpgrade() ||
+       (timeout > 0 &&
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeout), tryUpgrade)))) {
+    return LockResult::OK;
   }
 
 #ifdef DEBUG_OBJECT_LOCKS
@@ -1,5 +1,5 @@
 // LAF Base Library
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include "base/disable_copying.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <thread>
 
@@ -78,6 +79,10 @@ namespace base {
     // Mutex to modify the 'locked' flag.
     mutable std::mutex m_mutex;
 
+    // Used to wake up threads waiting in lock()/upgradeToWrite() when
+    // the object is unlocked (or the weak lock is released).
+    std::condition_variable m_cond;
+
     // True if some thread is writing the object.
     bool m_write_lock = false;
     std::thread::id m_write_thread = {};
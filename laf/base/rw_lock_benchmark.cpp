@@ -0,0 +1,137 @@
+// LAF Base Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/rw_lock.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace base;
+using LockResult = RWLock::LockResult;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// Lock shared by all threads of the contention benchmark
+RWLock g_lock;
+
+double to_usecs(const Clock::duration& d)
+{
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+// Reports the median, 99th percentile, and max of the given
+// latencies (average of all threads).
+void report_latencies(benchmark::State& state,
+                      std::vector<double>& latencies)
+{
+  if (latencies.empty())
+    return;
+
+  std::sort(latencies.begin(), latencies.end());
+  const auto at = [&latencies](double q) {
+    return latencies[std::min(latencies.size()-1,
+                              size_t(q * latencies.size()))];
+  };
+  state.counters["p50_us"] = benchmark::Counter(at(0.5), benchmark::Counter::kAvgThreads);
+  state.counters["p99_us"] = benchmark::Counter(at(0.99), benchmark::Counter::kAvgThreads);
+  state.counters["max_us"] = benchmark::Counter(latencies.back(), benchmark::Counter::kAvgThreads);
+}
+
+} // anonymous namespace
+
+// Read lock/unlock without other threads using the lock
+void BM_RWLockReadUncontended(benchmark::State& state)
+{
+  RWLock lock;
+  for (auto _ : state) {
+    LockResult res = lock.lock(RWLock::ReadLock, 0);
+    benchmark::DoNotOptimize(res);
+    lock.unlock(res);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RWLockReadUncontended);
+
+// Several threads locking the same object: the first thread writes
+// (e.g. the UI thread modifying the document) and the other ones
+// read (e.g. rendering or backup threads). The counters show the
+// time each thread waited to get the lock.
+void BM_RWLockContention(benchmark::State& state)
+{
+  const RWLock::LockType lockType =
+    (state.thread_index() == 0 ? RWLock::WriteLock:
+                                 RWLock::ReadLock);
+  std::vector<double> latencies;
+  latencies.reserve(1024*64);
+
+  for (auto _ : state) {
+    const auto t0 = Clock::now();
+    LockResult res = g_lock.lock(lockType, 10000);
+    const auto t1 = Clock::now();
+    if (latencies.size() < latencies.capacity())
+      latencies.push_back(to_usecs(t1 - t0));
+    g_lock.unlock(res);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  report_latencies(state, latencies);
+}
+BENCHMARK(BM_RWLockContention)->ThreadRange(1, 8)->UseRealTime();
+
+// Time between unlocking a write lock and the moment that a thread
+// waiting to lock the object gets the lock.
+void BM_RWLockWakeUp(benchmark::State& state)
+{
+  const RWLock::LockType waiterLockType =
+    (state.range(0) == 0 ? RWLock::ReadLock:
+                           RWLock::WriteLock);
+  RWLock lock;
+  std::vector<double> latencies;
+
+  for (auto _ : state) {
+    LockResult res = lock.lock(RWLock::WriteLock, 0);
+
+    std::atomic<bool> waiting = false;
+    Clock::time_point locked;
+    std::thread waiter([&]{
+      waiting = true;
+      LockResult res = lock.lock(waiterLockType, 10000);
+      locked = Clock::now();
+      lock.unlock(res);
+    });
+
+    // Give some time to the waiter thread to start waiting
+    while (!waiting)
+      std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    const auto t0 = Clock::now();
+    lock.unlock(res);
+    waiter.join();
+
+    const double usecs = to_usecs(locked - t0);
+    latencies.push_back(usecs);
+    state.SetIterationTime(usecs / 1000000.0);
+  }
+
+  report_latencies(state, latencies);
+}
+BENCHMARK(BM_RWLockWakeUp)
+  ->Arg(0)  // Wake up a reader
+  ->Arg(1)  // Wake up a writer
+  ->UseManualTime();
+
+BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // LAF Base Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,7 +9,11 @@
 
 #include "base/rw_lock.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 
 using namespace base;
 using LockResult = RWLock::LockResult;
@@ -105,6 +109,131 @@ TEST(RWLock, WeakLock)
   a.unlock(res[0]);             // Unlock the write lock
 }
 
+TEST(RWLock, WaitTimeout)
+{
+  RWLock a;
+  LockResult res;
+
+  EXPECT_OK(res = a.lock(RWLock::WriteLock, 0));
+  BGTHREAD(EXPECT_FAIL(a.lock(RWLock::ReadLock, 50)));
+  a.unlock(res);
+}
+
+TEST(RWLock, NegativeTimeout)
+{
+  RWLock a;
+  LockResult res;
+
+  // A negative timeout fails even if the object is not locked
+  EXPECT_FAIL(a.lock(RWLock::ReadLock, -1));
+  EXPECT_FAIL(a.lock(RWLock::WriteLock, -1));
+
+  EXPECT_OK(res = a.lock(RWLock::ReadLock, 0));
+  EXPECT_FAIL(a.upgradeToWrite(-1));
+  a.unlock(res);
+}
+
+TEST(RWLock, WakeUpOnUnlock)
+{
+  RWLock a;
+
+  for (int i=0; i<40; ++i) {
+    const RWLock::LockType type = (i & 1 ? RWLock::WriteLock:
+                                           RWLock::ReadLock);
+    LockResult res;
+    EXPECT_OK(res = a.lock(RWLock::WriteLock, 0));
+
+    std::atomic<bool> unlocked(false);
+    std::thread thread([&a, type, &unlocked]{
+      LockResult res2;
+      EXPECT_OK(res2 = a.lock(type, 5000));
+      // The lock can be acquired only after the other thread unlocks it
+      EXPECT_TRUE(unlocked);
+      a.unlock(res2);
+    });
+
+    // Wait some time so the thread is waiting the lock
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    unlocked = true;
+    a.unlock(res);
+    thread.join();
+  }
+}
+
+TEST(RWLock, WakeUpOnWeakUnlock)
+{
+  RWLock a;
+  std::atomic<RWLock::WeakLock> flag(RWLock::WeakUnlocked);
+
+  for (int i=0; i<20; ++i) {
+    EXPECT_TRUE(a.weakLock(&flag));
+
+    // Background thread (e.g. the backup thread) which releases the
+    // weak lock as soon as possible.
+    std::atomic<bool> unlocked(false);
+    std::thread thread([&a, &flag, &unlocked]{
+      while (flag != RWLock::WeakUnlocking)
+        std::this_thread::yield();
+      unlocked = true;
+      a.weakUnlock();
+    });
+
+    LockResult res;
+    EXPECT_OK(res = a.lock(RWLock::WriteLock, 5000));
+    EXPECT_TRUE(unlocked);
+    EXPECT_EQ(RWLock::WeakUnlocked, flag);
+    a.unlock(res);
+    thread.join();
+  }
+}
+
+// Several threads reading and writing the same object at the same
+// time (e.g. UI thread + backup thread + background export).
+TEST(RWLock, Contention)
+{
+  RWLock a;
+  const int nthreads = std::max(4u, std::thread::hardware_concurrency());
+  const int iterations = 200;
+  int value = 0;
+  int writes = 0;
+  std::atomic<int> readers(0);
+  std::atomic<int> writers(0);
+  std::vector<std::thread> threads;
+
+  for (int t=0; t<nthreads; ++t) {
+    threads.emplace_back([&a, &value, &writes, &readers, &writers, t]{
+      for (int i=0; i<iterations; ++i) {
+        const bool write = ((i+t) % 4 == 0);
+        LockResult res = a.lock(write ? RWLock::WriteLock:
+                                        RWLock::ReadLock, 5000);
+        ASSERT_EQ(LockResult::OK, res);
+        if (write) {
+          // Only one writer and no readers
+          EXPECT_EQ(1, ++writers);
+          EXPECT_EQ(0, readers);
+          ++value;
+          ++writes;
+          --writers;
+        }
+        else {
+          ++readers;
+          EXPECT_EQ(0, writers);
+          volatile int v = value;
+          (void)v;
+          --readers;
+        }
+        std::this_thread::yield();
+        a.unlock(res);
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(writes, value);
+  EXPECT_EQ(nthreads*iterations/4, writes);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,5 @@
 // LAF Base Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -22,6 +22,8 @@ namespace base {
     thread_pool(const size_t n);
     ~thread_pool();
 
+    size_t size() const { return m_threads.size(); }
+
     void execute(std::function<void()>&& func);
 
     // Waits until the queue is empty.
@@ -69,6 +69,8 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_slice(m_po.add("slice").requiresValue("<name>").description("Crop the sprite to the given slice area"))
   , m_filenameFormat(m_po.add("filename-format").requiresValue("<fmt>").description("Special format to generate filenames"))
   , m_tagnameFormat(m_po.add("tagname-format").requiresValue("<fmt>").description("Special format to generate tagnames in JSON data"))
+  , m_compressionLevel(m_po.add("compression-level").requiresValue("<level>").description("Compression level of .aseprite files saved with --save-as\n(default, fast, or best)"))
+  , m_jobs(m_po.add("jobs").mnemonic('j').requiresValue("<n>").description("Save up to n files in parallel with --save-as\n(0 = one per CPU core)"))
 #ifdef ENABLE_SCRIPTING
   , m_script(m_po.add("script").requiresValue("<filename>").description("Execute a specific script"))
   , m_scriptParam(m_po.add("script-param").requiresValue("name=value").description("Parameter for a script executed from the\nCLI that you can access with app.params"))
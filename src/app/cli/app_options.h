@@ -85,6 +85,8 @@ public:
   const Option& slice() const { return m_slice; }
   const Option& filenameFormat() const { return m_filenameFormat; }
   const Option& tagnameFormat() const { return m_tagnameFormat; }
+  const Option& compressionLevel() const { return m_compressionLevel; }
+  const Option& jobs() const { return m_jobs; }
 #ifdef ENABLE_SCRIPTING
   const Option& script() const { return m_script; }
   const Option& scriptParam() const { return m_scriptParam; }
@@ -160,6 +162,8 @@ private:
   Option& m_slice;
   Option& m_filenameFormat;
   Option& m_tagnameFormat;
+  Option& m_compressionLevel;
+  Option& m_jobs;
 #ifdef ENABLE_SCRIPTING
   Option& m_script;
   Option& m_scriptParam;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -25,6 +25,7 @@ namespace app {
     std::string filename;
     std::string filenameFormat;
     std::string tagnameFormat;
+    std::string compressionLevel;
     std::string tag;
     std::string slice;
     std::vector<std::string> includeLayers;
@@ -20,6 +20,7 @@
 #include "app/doc_exporter.h"
 #include "app/doc_undo.h"
 #include "app/file/file.h"
+#include "app/file/file_op_queue.h"
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
 #include "app/ui_context.h"
@@ -38,6 +39,7 @@
 
 #include <algorithm>
 #include <queue>
+#include <thread>
 #include <vector>
 
 namespace app {
@@ -191,6 +193,8 @@ int CliProcessor::process(Context* ctx)
     Doc* lastDoc = nullptr;
     render::DitheringAlgorithm ditheringAlgorithm = render::DitheringAlgorithm::None;
     std::string ditheringMatrix;
+    // Files saved in parallel with --jobs
+    std::unique_ptr<FileOpQueue> saveQueue;
 
     for (const auto& value : m_options.values()) {
       const AppOptions::Option* opt = value.option();
@@ -390,6 +394,25 @@ int CliProcessor::process(Context* ctx)
           if (m_exporter)
             m_exporter->setTagnameFormat(cof.tagnameFormat);
         }
+        // --compression-level <level>
+        else if (opt == &m_options.compressionLevel()) {
+          const std::string& level = value.value();
+          if (level != "default" && level != "fast" && level != "best")
+            throw std::runtime_error("--compression-level must be default, fast, or best\n"
+                                     "E.g. --compression-level fast");
+
+          cof.compressionLevel = level;
+        }
+        // --jobs <n>
+        else if (opt == &m_options.jobs()) {
+          int jobs = strtol(value.value().c_str(), nullptr, 0);
+          if (jobs <= 0)
+            jobs = int(std::thread::hardware_concurrency());
+
+          saveQueue.reset();
+          if (jobs > 1)
+            saveQueue = std::make_unique<FileOpQueue>(jobs);
+        }
         // --save-as <filename>
         else if (opt == &m_options.saveAs()) {
           if (lastDoc) {
@@ -549,6 +572,11 @@ int CliProcessor::process(Context* ctx)
         else if (opt == &m_options.script()) {
           std::string filename = value.value();
           int code;
+
+          // The script could use the saved files
+          if (saveQueue)
+            saveQueue->waitAll();
+
           try {
             code = m_delegate->execScript(filename, scriptParams);
           }
@@ -622,6 +650,9 @@ int CliProcessor::process(Context* ctx)
       }
     }
 
+    // Wait all files to be saved
+    saveQueue.reset();
+
     if (m_exporter) {
       // Rows sprite sheet as the default type
       if (sheetType == SpriteSheetType::None)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -93,3 +93,23 @@ TEST(Cli, Version)
   p.process(nullptr);
   EXPECT_TRUE(d.versionWasShown());
 }
+
+TEST(Cli, Jobs)
+{
+  auto a = args({ "--batch", "-j", "4" });
+  ASSERT_EQ(2, a->values().size());
+  EXPECT_EQ(&a->jobs(), a->values()[1].option());
+  EXPECT_EQ("4", a->values()[1].value());
+
+  CliTestDelegate d;
+  CliProcessor p(&d, *a);
+  p.process(nullptr);
+}
+
+TEST(Cli, CompressionLevel)
+{
+  auto a = args({ "--batch", "--compression-level", "fast" });
+  ASSERT_EQ(2, a->values().size());
+  EXPECT_EQ(&a->compressionLevel(), a->values()[1].option());
+  EXPECT_EQ("fast", a->values()[1].value());
+}
@@ -108,6 +108,9 @@ void DefaultCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
   if (cof.ignoreEmpty)
     params.set("ignoreEmpty", "true");
 
+  if (!cof.compressionLevel.empty())
+    params.set("compressionLevel", cof.compressionLevel.c_str());
+
   ctx->executeCommand(saveAsCommand, params);
 }
 
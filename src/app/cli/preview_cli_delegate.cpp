@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -112,6 +112,10 @@ void PreviewCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
     std::cout << "  - Ignore empty frames\n";
   }
 
+  if (!cof.compressionLevel.empty()) {
+    std::cout << "  - Compression level: " << cof.compressionLevel << "\n";
+  }
+
   std::cout << "  - Size: "
             << cof.document->sprite()->width() << "x"
             << cof.document->sprite()->height() << "\n";
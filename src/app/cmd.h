@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,10 +13,12 @@
 #include "undo/undo_command.h"
 
 #include <string>
+#include <vector>
 
 namespace app {
 
   class Context;
+  class UndoBuffer;
 
   class Cmd : public undo::UndoCommand {
   public:
@@ -32,6 +35,11 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Adds to "buffers" the buffers where this command saves the data
+    // to undo/redo it, so they can be compressed (or saved in disk)
+    // when this command is an old undo state.
+    void getUndoBuffers(std::vector<UndoBuffer*>& buffers);
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -41,6 +49,7 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual void onGetUndoBuffers(std::vector<UndoBuffer*>& buffers);
 
   private:
     Context* m_ctx;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,8 @@
 #include "doc/layer.h"
 #include "doc/subobjects_io.h"
 
+#include <sstream>
+
 namespace app {
 namespace cmd {
 
@@ -31,7 +33,6 @@ using namespace doc;
 AddCel::AddCel(Layer* layer, Cel* cel)
   : WithLayer(layer)
   , WithCel(cel)
-  , m_size(0)
 {
 }
 
@@ -53,14 +54,15 @@ void AddCel::onUndo()
   ASSERT(cel);
 
   // Save the CelData only if the cel isn't linked
+  std::stringstream stream;
   bool has_data = (cel->links() == 0);
-  write8(m_stream, has_data ? 1: 0);
+  write8(stream, has_data ? 1: 0);
   if (has_data) {
-    write_image(m_stream, cel->image());
-    write_celdata(m_stream, cel->data());
+    write_image(stream, cel->image());
+    write_celdata(stream, cel->data());
   }
-  write_cel(m_stream, cel);
-  m_size = size_t(m_stream.tellp());
+  write_cel(stream, cel);
+  m_data.set(stream.str());
 
   removeCel(layer, cel);
 }
@@ -71,22 +73,21 @@ void AddCel::onRedo()
   ASSERT(layer);
 
   SubObjectsFromSprite io(layer->sprite());
-  bool has_data = (read8(m_stream) != 0);
+  std::stringstream stream(m_data.str());
+  bool has_data = (read8(stream) != 0);
   if (has_data) {
-    ImageRef image(read_image(m_stream));
+    ImageRef image(read_image(stream));
     io.addImageRef(image);
 
-    CelDataRef celdata(read_celdata(m_stream, &io));
+    CelDataRef celdata(read_celdata(stream, &io));
     io.addCelDataRef(celdata);
   }
-  Cel* cel = read_cel(m_stream, &io);
+  Cel* cel = read_cel(stream, &io);
   ASSERT(cel);
 
   addCel(layer, cel);
 
-  m_stream.str(std::string());
-  m_stream.clear();
-  m_size = 0;
+  m_data.clear();
 }
 
 void AddCel::addCel(Layer* layer, Cel* cel)
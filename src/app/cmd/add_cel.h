@@ -11,8 +11,8 @@
 #include "app/cmd.h"
 #include "app/cmd/with_cel.h"
 #include "app/cmd/with_layer.h"
+#include "app/undo_buffer.h"
 
-#include <sstream>
 
 namespace doc {
   class Cel;
@@ -34,15 +34,17 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_size;
+      return sizeof(*this) + m_data.memSize();
+    }
+    void onGetUndoBuffers(UndoBuffers& buffers) override {
+      buffers.push_back(&m_data);
     }
 
   private:
     void addCel(Layer* layer, Cel* cel);
     void removeCel(Layer* layer, Cel* cel);
 
-    size_t m_size;
-    std::stringstream m_stream;
+    UndoBuffer m_data;
   };
 
 } // namespace cmd
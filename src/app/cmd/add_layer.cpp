@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +17,8 @@
 #include "doc/layer_io.h"
 #include "doc/subobjects_io.h"
 
+#include <sstream>
+
 namespace app {
 namespace cmd {
 
@@ -25,7 +28,6 @@ AddLayer::AddLayer(Layer* group, Layer* newLayer, Layer* afterThis)
   : m_group(group)
   , m_newLayer(newLayer)
   , m_afterThis(afterThis)
-  , m_size(0)
 {
 }
 
@@ -43,8 +45,9 @@ void AddLayer::onUndo()
   Layer* group = m_group.layer();
   Layer* layer = m_newLayer.layer();
 
-  write_layer(m_stream, layer);
-  m_size = size_t(m_stream.tellp());
+  std::stringstream stream;
+  write_layer(stream, layer);
+  m_data.set(stream.str());
 
   removeLayer(group, layer);
 }
@@ -53,14 +56,13 @@ void AddLayer::onRedo()
 {
   Layer* group = m_group.layer();
   SubObjectsFromSprite io(group->sprite());
-  Layer* newLayer = read_layer(m_stream, &io);
+  std::stringstream stream(m_data.str());
+  Layer* newLayer = read_layer(stream, &io);
   Layer* afterThis = m_afterThis.layer();
 
   addLayer(group, newLayer, afterThis);
 
-  m_stream.str(std::string());
-  m_stream.clear();
-  m_size = 0;
+  m_data.clear();
 }
 
 void AddLayer::addLayer(Layer* group, Layer* newLayer, Layer* afterThis)
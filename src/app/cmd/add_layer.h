@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -10,8 +11,8 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_layer.h"
+#include "app/undo_buffer.h"
 
-#include <sstream>
 
 namespace doc {
   class Layer;
@@ -30,7 +31,10 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_size;
+      return sizeof(*this) + m_data.memSize();
+    }
+    void onGetUndoBuffers(UndoBuffers& buffers) override {
+      buffers.push_back(&m_data);
     }
 
   private:
@@ -40,8 +44,7 @@ namespace cmd {
     WithLayer m_group;
     WithLayer m_newLayer;
     WithLayer m_afterThis;
-    size_t m_size;
-    std::stringstream m_stream;
+    UndoBuffer m_data;
   };
 
 } // namespace cmd
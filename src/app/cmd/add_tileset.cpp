@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -16,6 +16,8 @@
 #include "doc/tileset_io.h"
 #include "doc/tilesets.h"
 
+#include <sstream>
+
 namespace app {
 namespace cmd {
 
@@ -24,7 +26,6 @@ using namespace doc;
 AddTileset::AddTileset(doc::Sprite* sprite, doc::Tileset* tileset)
   : WithSprite(sprite)
   , WithTileset(tileset)
-  , m_size(0)
   , m_tilesetIndex(-1)
 {
 }
@@ -32,7 +33,6 @@ AddTileset::AddTileset(doc::Sprite* sprite, doc::Tileset* tileset)
 AddTileset::AddTileset(doc::Sprite* sprite, const doc::tileset_index tsi)
   : WithSprite(sprite)
   , WithTileset(sprite->tilesets()->get(tsi))
-  , m_size(0)
   , m_tilesetIndex(tsi)
 {
 }
@@ -47,8 +47,9 @@ void AddTileset::onExecute()
 void AddTileset::onUndo()
 {
   doc::Tileset* tileset = this->tileset();
-  write_tileset(m_stream, tileset);
-  m_size = size_t(m_stream.tellp());
+  std::stringstream stream;
+  write_tileset(stream, tileset);
+  m_data.set(stream.str());
 
   doc::Sprite* sprite = this->sprite();
   sprite->tilesets()->erase(m_tilesetIndex);
@@ -62,13 +63,12 @@ void AddTileset::onUndo()
 void AddTileset::onRedo()
 {
   auto sprite = this->sprite();
-  doc::Tileset* tileset = read_tileset(m_stream, sprite);
+  std::stringstream stream(m_data.str());
+  doc::Tileset* tileset = read_tileset(stream, sprite);
 
   addTileset(tileset);
 
-  m_stream.str(std::string());
-  m_stream.clear();
-  m_size = 0;
+  m_data.clear();
 }
 
 void AddTileset::addTileset(doc::Tileset* tileset)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,9 +11,9 @@
 #include "app/cmd.h"
 #include "app/cmd/with_sprite.h"
 #include "app/cmd/with_tileset.h"
+#include "app/undo_buffer.h"
 #include "doc/tile.h"
 
-#include <sstream>
 
 namespace doc {
   class Tileset;
@@ -36,14 +36,16 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_size;
+      return sizeof(*this) + m_data.memSize();
+    }
+    void onGetUndoBuffers(UndoBuffers& buffers) override {
+      buffers.push_back(&m_data);
     }
 
   private:
     void addTileset(doc::Tileset* tileset);
 
-    size_t m_size;
-    std::stringstream m_stream;
+    UndoBuffer m_data;
     doc::tileset_index m_tilesetIndex;
   };
 
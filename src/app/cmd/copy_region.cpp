@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -42,7 +42,7 @@ CopyRegion::CopyRegion(Image* dst, const Image* src,
     m_region &= gfx::Region(clip.dstBounds());
   }
 
-  save_image_region_in_buffer(m_region, src, dstPos, m_buffer);
+  save_image_region_in_buffer(m_region, src, dstPos, m_buffer.data());
 }
 
 CopyTileRegion::CopyTileRegion(Image* dst, const Image* src,
@@ -78,7 +78,7 @@ void CopyRegion::swap()
   Image* image = this->image();
   ASSERT(image);
 
-  swap_image_region_with_buffer(m_region, image, m_buffer);
+  swap_image_region_with_buffer(m_region, image, m_buffer.data());
   image->incrementVersion();
 
   rehash();
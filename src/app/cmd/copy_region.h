@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -11,7 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
-#include "base/buffer.h"
+#include "app/undo_buffer.h"
 #include "doc/tile.h"
 #include "gfx/point.h"
 #include "gfx/region.h"
@@ -41,7 +41,10 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) + m_buffer.size();
+      return sizeof(*this) + m_buffer.memSize();
+    }
+    void onGetUndoBuffers(UndoBuffers& buffers) override {
+      buffers.push_back(&m_buffer);
     }
 
   private:
@@ -50,7 +53,7 @@ namespace cmd {
 
     bool m_alreadyCopied;
     gfx::Region m_region;
-    base::buffer m_buffer;
+    UndoBuffer m_buffer;
   };
 
   class CopyTileRegion : public CopyRegion {
@@ -18,6 +18,8 @@
 #include "app/cmd/set_transparent_color.h"
 #include "app/doc.h"
 #include "app/doc_event.h"
+#include "app/util/worker_pool.h"
+#include "base/parallel_for.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/document.h"
@@ -29,6 +31,13 @@
 #include "render/quantization.h"
 #include "render/task_delegate.h"
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
 namespace app {
 namespace cmd {
 
@@ -36,35 +45,69 @@ using namespace doc;
 
 namespace {
 
-class SuperDelegate : public render::TaskDelegate {
+// Minimum number of images that must use the same palette to
+// precompute a RgbMap shared by all threads.
+const int kMinImagesToShareRgbMap = 4;
+
+// Delegate to convert several images at the same time from different
+// threads. Only the calling thread reports the progress and asks the
+// original delegate if the task was canceled, the other threads just
+// check the canceled flag.
+class SuperDelegate {
 public:
   SuperDelegate(int nimages, render::TaskDelegate* delegate)
-    : m_nimages(nimages)
-    , m_curImage(0)
-    , m_delegate(delegate) {
+    : m_nimages(std::max(1, nimages))
+    , m_doneImages(0)
+    , m_canceled(false)
+    , m_delegate(delegate)
+    , m_callerThread(std::this_thread::get_id()) {
   }
 
-  void notifyTaskProgress(double progress) override {
-    if (m_delegate)
-      m_delegate->notifyTaskProgress(
-        (progress + m_curImage) / m_nimages);
+  bool isCanceled() const { return m_canceled; }
+
+  // Called when an image is converted (from any thread)
+  void imageDone() {
+    ++m_doneImages;
+    poll(0.0);
   }
 
-  bool continueTask() override {
-    if (m_delegate)
-      return m_delegate->continueTask();
-    else
-      return true;
+  // Reports the progress of the current image of this thread
+  void poll(const double imageProgress) {
+    if (!m_delegate ||
+        std::this_thread::get_id() != m_callerThread)
+      return;
+
+    m_delegate->notifyTaskProgress(
+      std::min(1.0, (imageProgress + m_doneImages) / m_nimages));
+
+    if (!m_delegate->continueTask())
+      m_canceled = true;
+  }
+
+private:
+  const int m_nimages;
+  std::atomic<int> m_doneImages;
+  std::atomic<bool> m_canceled;
+  render::TaskDelegate* m_delegate;
+  const std::thread::id m_callerThread;
+};
+
+// Delegate given to render::convert_pixel_format() to convert one
+// image.
+class ImageDelegate : public render::TaskDelegate {
+public:
+  ImageDelegate(SuperDelegate& superDel) : m_superDel(superDel) { }
+
+  void notifyTaskProgress(double progress) override {
+    m_superDel.poll(progress);
   }
 
-  void nextImage() {
-    ++m_curImage;
+  bool continueTask() override {
+    return !m_superDel.isCanceled();
   }
 
 private:
-  int m_nimages;
-  int m_curImage;
-  TaskDelegate* m_delegate;
+  SuperDelegate& m_superDel;
 };
 
 } // anonymous namespace
@@ -83,40 +126,16 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  // Calculate the number of images to convert just to show a proper
-  // progress bar.
-  tile_index nimages = 0;
-  for (Cel* cel : sprite->uniqueCels())
-    if (!cel->layer()->isTilemap())
-      ++nimages;
-  if (sprite->hasTilesets()) {
-    for (Tileset* tileset : *sprite->tilesets()) {
-      if (tileset)
-        nimages += tileset->size();
-    }
-  }
-
-  SuperDelegate superDel(nimages, delegate);
-
-  // Convert cel images
+  // List of unique images to convert (cel images and tileset images)
+  std::vector<ConvertItem> items;
   for (Cel* cel : sprite->uniqueCels()) {
     if (cel->layer()->isTilemap())
       continue;
 
-    ImageRef oldImage = cel->imageRef();
-    convertImage(sprite, dithering,
-                 oldImage,
-                 cel->frame(),
-                 cel->layer()->isBackground(),
-                 mapAlgorithm,
-                 toGray,
-                 &superDel,
-                 fitCriteria);
-
-    superDel.nextImage();
+    items.push_back(ConvertItem{ cel->imageRef(),
+                                 cel->frame(),
+                                 cel->layer()->isBackground() });
   }
-
-  // Convert tileset images
   if (sprite->hasTilesets()) {
     for (Tileset* tileset : *sprite->tilesets()) {
       if (!tileset)
@@ -125,20 +144,84 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
       for (tile_index i=0; i<tileset->size(); ++i) {
         ImageRef oldImage = tileset->get(i);
         if (oldImage) {
-          convertImage(sprite, dithering,
-                       oldImage,
-                       0,     // TODO select a frame or generate other tilesets?
-                       false, // TODO is background? it depends of the layer where this tileset is used
-                       mapAlgorithm,
-                       toGray,
-                       &superDel,
-                       fitCriteria);
+          items.push_back(ConvertItem{ oldImage,
+                                       0,      // TODO select a frame or generate other tilesets?
+                                       false }); // TODO is background? it depends of the layer where this tileset is used
         }
-        superDel.nextImage();
       }
     }
   }
 
+  // Making the RGBMaps for Image->INDEXED conversion.
+  std::map<const Palette*, std::unique_ptr<RgbMap>> rgbmaps;
+  if (newFormat == IMAGE_INDEXED) {
+    // Keep using the same algorithm/criteria in the sprite RgbMap
+    // after the conversion.
+    sprite->rgbMap(0, sprite->rgbMapForSprite(),
+                   mapAlgorithm, fitCriteria);
+
+    // Maps that can be precomputed are shared by all threads (one
+    // map for each palette used by several images). Other maps
+    // (e.g. octrees, or maps for palettes used by a few images, where
+    // generating all the entries doesn't pay off) are created for
+    // each image.
+    std::map<const Palette*, int> imagesPerPalette;
+    for (const ConvertItem& item : items)
+      ++imagesPerPalette[sprite->palette(item.frame)];
+
+    for (const ConvertItem& item : items) {
+      const Palette* palette = sprite->palette(item.frame);
+      if (rgbmaps.find(palette) != rgbmaps.end())
+        continue;
+
+      std::unique_ptr<RgbMap> rgbmap;
+      if (imagesPerPalette[palette] >= kMinImagesToShareRgbMap) {
+        rgbmap = sprite->createRgbMap(item.frame, sprite->rgbMapForSprite(),
+                                      mapAlgorithm, fitCriteria);
+        if (!rgbmap->precompute(&worker_pool()))
+          rgbmap.reset();
+      }
+      rgbmaps[palette] = std::move(rgbmap);
+    }
+  }
+
+  // Convert all images in parallel
+  SuperDelegate superDel(int(items.size()), delegate);
+  std::vector<ImageRef> newImages(items.size());
+  base::parallel_for(
+    worker_pool(), 0, int(items.size()),
+    [&](const int i) {
+      if (superDel.isCanceled())
+        return;
+
+      const ConvertItem& item = items[i];
+      const RgbMap* rgbmap = nullptr;
+      std::unique_ptr<RgbMap> ownRgbmap;
+      if (newFormat == IMAGE_INDEXED) {
+        rgbmap = rgbmaps.find(sprite->palette(item.frame))->second.get();
+        if (!rgbmap) {
+          ownRgbmap = sprite->createRgbMap(item.frame, sprite->rgbMapForSprite(),
+                                           mapAlgorithm, fitCriteria);
+          rgbmap = ownRgbmap.get();
+        }
+      }
+
+      ImageDelegate imageDel(superDel);
+      newImages[i] = convertImage(sprite, dithering, item, rgbmap,
+                                  toGray, &imageDel);
+      superDel.imageDone();
+    });
+
+  // If the conversion was canceled we don't generate any command, so
+  // the sprite is not modified at all.
+  if (superDel.isCanceled()) {
+    m_newFormat = m_oldFormat;
+    return;
+  }
+
+  for (size_t i=0; i<items.size(); ++i)
+    m_pre.add(new cmd::ReplaceImage(sprite, items[i].oldImage, newImages[i]));
+
   // By default, when converting to RGB or grayscale, the mask color
   // is always 0.
   int newMaskIndex = 0;
@@ -212,6 +295,8 @@ void SetPixelFormat::onRedo()
 void SetPixelFormat::setFormat(PixelFormat format)
 {
   Sprite* sprite = this->sprite();
+  if (sprite->pixelFormat() == format)
+    return;
 
   sprite->setPixelFormat(format);
   sprite->incrementVersion();
@@ -226,48 +311,37 @@ void SetPixelFormat::setFormat(PixelFormat format)
   doc->notify_observers<DocEvent&>(&DocObserver::onPixelFormatChanged, ev);
 }
 
-void SetPixelFormat::convertImage(doc::Sprite* sprite,
-                                  const render::Dithering& dithering,
-                                  const doc::ImageRef& oldImage,
-                                  const doc::frame_t frame,
-                                  const bool isBackground,
-                                  const doc::RgbMapAlgorithm mapAlgorithm,
-                                  doc::rgba_to_graya_func toGray,
-                                  render::TaskDelegate* delegate,
-                                  const doc::FitCriteria fitCriteria)
+ImageRef SetPixelFormat::convertImage(const doc::Sprite* sprite,
+                                      const render::Dithering& dithering,
+                                      const ConvertItem& item,
+                                      const doc::RgbMap* rgbmap,
+                                      doc::rgba_to_graya_func toGray,
+                                      render::TaskDelegate* delegate) const
 {
+  const ImageRef& oldImage = item.oldImage;
   ASSERT(oldImage);
   ASSERT(oldImage->pixelFormat() != IMAGE_TILEMAP);
 
-  // Making the RGBMap for Image->INDEXDED conversion.
-  // TODO: this is needed only when newImage
-  RgbMap* rgbmap;
-  int newMaskIndex = (isBackground ? -1 : 0);
+  int newMaskIndex = (item.isBackground ? -1 : 0);
   if (m_newFormat == IMAGE_INDEXED) {
-    rgbmap = sprite->rgbMap(frame,
-                            sprite->rgbMapForSprite(),
-                            mapAlgorithm,
-                            fitCriteria);
+    ASSERT(rgbmap);
     if (m_oldFormat == IMAGE_INDEXED)
       newMaskIndex = sprite->transparentColor();
     else
       newMaskIndex = rgbmap->maskIndex();
   }
-  else {
-    rgbmap = nullptr;
-  }
-  ImageRef newImage(
+
+  return ImageRef(
     render::convert_pixel_format
     (oldImage.get(), nullptr, m_newFormat,
      dithering,
      rgbmap,
-     sprite->palette(frame),
-     isBackground,
+     sprite->palette(item.frame),
+     item.isBackground,
      newMaskIndex,
      toGray,
-     delegate));
-
-  m_pre.add(new cmd::ReplaceImage(sprite, oldImage, newImage));
+     delegate,
+     &worker_pool()));
 }
 
 } // namespace cmd
@@ -19,6 +19,7 @@
 #include "doc/rgbmap_algorithm.h"
 
 namespace doc {
+  class RgbMap;
   class Sprite;
 }
 
@@ -50,16 +51,20 @@ namespace cmd {
     }
 
   private:
+    // Image to convert (a cel image or a tile)
+    struct ConvertItem {
+      doc::ImageRef oldImage;
+      doc::frame_t frame;
+      bool isBackground;
+    };
+
     void setFormat(doc::PixelFormat format);
-    void convertImage(doc::Sprite* sprite,
-                      const render::Dithering& dithering,
-                      const doc::ImageRef& oldImage,
-                      const doc::frame_t frame,
-                      const bool isBackground,
-                      const doc::RgbMapAlgorithm mapAlgorithm,
-                      doc::rgba_to_graya_func toGray,
-                      render::TaskDelegate* delegate,
-                      const doc::FitCriteria fitCriteria = doc::FitCriteria::DEFAULT);
+    doc::ImageRef convertImage(const doc::Sprite* sprite,
+                               const render::Dithering& dithering,
+                               const ConvertItem& item,
+                               const doc::RgbMap* rgbmap,
+                               doc::rgba_to_graya_func toGray,
+                               render::TaskDelegate* delegate) const;
 
     doc::PixelFormat m_oldFormat;
     doc::PixelFormat m_newFormat;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -80,6 +80,12 @@ size_t CmdSequence::onMemSize() const
   return size;
 }
 
+void CmdSequence::onGetUndoBuffers(std::vector<UndoBuffer*>& buffers)
+{
+  for (Cmd* cmd : m_cmds)
+    cmd->getUndoBuffers(buffers);
+}
+
 void CmdSequence::executeAndAdd(Cmd* cmd)
 {
   addAndExecute(context(), cmd);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +32,7 @@ namespace app {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override;
+    void onGetUndoBuffers(std::vector<UndoBuffer*>& buffers) override;
 
   private:
     std::vector<Cmd*> m_cmds;
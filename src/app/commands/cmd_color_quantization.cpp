@@ -22,6 +22,7 @@
 #include "app/ui/color_bar.h"
 #include "app/ui/rgbmap_algorithm_selector.h"
 #include "app/ui_context.h"
+#include "app/util/worker_pool.h"
 #include "doc/palette.h"
 #include "doc/sprite.h"
 #include "render/quantization.h"
@@ -183,7 +184,9 @@ void ColorQuantizationCommand::onExecute(Context* ctx)
           withAlpha, &tmpPalette,
           &job,                 // SpriteJob is a render::TaskDelegate
           newBlend,
-          algorithm);
+          algorithm,
+          true,
+          &worker_pool());
 
         std::unique_ptr<Palette> newPalette(
           new Palette(createPal ? tmpPalette:
@@ -20,6 +20,7 @@
 #include "app/doc.h"
 #include "app/doc_undo.h"
 #include "app/file/file.h"
+#include "app/file/file_op_queue.h"
 #include "app/file/gif_format.h"
 #include "app/file/png_format.h"
 #include "app/file_selector.h"
@@ -217,7 +218,19 @@ void SaveFileBaseCommand::saveDocumentInBackground(
     bounds = document->sprite()->bounds();
   }
 
-  FileOpROI roi(document, bounds,
+  // In batch mode with --jobs, a copy of the document is saved in a
+  // worker thread, so we can continue modifying the original one
+  // (e.g. to save the next layer/tag with --split-layers/tags).
+  FileOpQueue* queue = FileOpQueue::instance();
+  std::unique_ptr<Doc> docCopy;
+  if (queue &&
+      markAsSaved == MarkAsSaved::Off &&
+      !context->isUIAvailable() &&
+      FileOpQueue::canSaveCopy(document, filename)) {
+    docCopy.reset(document->duplicate(DuplicateExactCopy));
+  }
+
+  FileOpROI roi((docCopy ? docCopy.get(): document), bounds,
                 params().slice(), params().tag(),
                 m_framesSeq, m_adjustFramesByTag);
 
@@ -234,6 +247,21 @@ void SaveFileBaseCommand::saveDocumentInBackground(
   if (resizeOnTheFly == ResizeOnTheFly::On)
     fop->setOnTheFlyScale(scale);
 
+  // Use the given compression level instead of the preference
+  if (params().compressionLevel.isSet())
+    fop->setAseCompressionLevel(params().compressionLevel());
+
+  if (docCopy) {
+    queue->add(std::move(docCopy), std::move(fop));
+    return;
+  }
+
+  // Files that cannot be saved from a copy are saved in this thread,
+  // so we have to wait the queued ones first to report errors in the
+  // same order the files were saved.
+  if (queue)
+    queue->waitAll();
+
   SaveFileJob job(fop.get(), params().ui());
   job.showProgressWindow();
 
@@ -11,6 +11,7 @@
 
 #include "app/commands/command.h"
 #include "app/commands/new_params.h"
+#include "app/pref/preferences.h"
 #include "doc/anidir.h"
 #include "doc/frames_sequence.h"
 #include "gfx/point.h"
@@ -35,6 +36,7 @@ namespace app {
     Param<double> scale { this, 1.0, "scale" };
     Param<gfx::Rect> bounds { this, gfx::Rect(), "bounds" };
     Param<bool> playSubtags { this, false, "playSubtags" };
+    Param<gen::CompressionLevel> compressionLevel { this, gen::CompressionLevel::DEFAULT, "compressionLevel" };
   };
 
   class SaveFileBaseCommand : public CommandWithNewParams<SaveFileParams> {
@@ -22,6 +22,7 @@
 #include "app/modules/palettes.h"
 #include "app/sprite_job.h"
 #include "app/util/resize_image.h"
+#include "app/util/worker_pool.h"
 #include "base/convert_to.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/cel.h"
@@ -217,7 +218,8 @@ protected:
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
         sprite()->palette(0), // Ignored
         sprite()->rgbMap(0),  // Ignored
-        -1);                  // Ignored
+        -1,                   // Ignored
+        &worker_pool());
 
       // Reshrink
       new_mask->intersect(new_mask->bounds());
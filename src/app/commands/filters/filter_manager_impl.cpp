@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -29,27 +29,136 @@
 #include "app/ui_context.h"
 #include "app/util/cel_ops.h"
 #include "app/util/range_utils.h"
+#include "base/parallel_for.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "filters/filter.h"
 #include "ui/manager.h"
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <set>
+#include <thread>
 
 namespace app {
 
 using namespace std;
 using namespace ui;
 
+namespace {
+
+// Number of rows processed by each item of parallel_for() in
+// applyToCelsInParallel(). The progress is reported (and the
+// cancellation is checked) after each band of rows.
+const int kRowsPerBand = 16;
+
+// Maximum number of bytes of source/destination images that
+// applyToCelsInParallel() keeps in memory at the same time.
+const size_t kMaxBatchBytes = 64*1024*1024;
+
+} // anonymous namespace
+
+// FilterManager used to apply the filter to the rows of one cel from
+// worker threads. Each instance has its own row and mask iterator, so
+// several instances can be used at the same time (the filter, the
+// mask, the palette, and the source image are only read).
+class FilterManagerImpl::RowsManager : public FilterManager
+                                     , public FilterIndexedData {
+public:
+  RowsManager(FilterManagerImpl* mgr,
+              const Image* src, Image* dst,
+              const Target target,
+              const RgbMap* rgbmap)
+    : m_mgr(mgr)
+    , m_src(src)
+    , m_dst(dst)
+    , m_target(target)
+    , m_rgbmap(rgbmap)
+    , m_bounds(mgr->m_bounds)
+    , m_mask(mgr->m_mask)
+    , m_row(0) {
+  }
+
+  // Applies the filter to the given row (returns false if the row is
+  // outside the mask, in that case the next rows are outside too).
+  bool applyToRow(const int row) {
+    m_row = row;
+
+    if (m_mask && m_mask->bitmap()) {
+      int x = m_bounds.x - m_mask->bounds().x;
+      int y = m_bounds.y - m_mask->bounds().y + m_row;
+      if ((x >= m_bounds.w) ||
+          (y >= m_bounds.h))
+        return false;
+
+      m_maskBits = m_mask->bitmap()
+        ->lockBits<BitmapTraits>(Image::ReadLock,
+          gfx::Rect(x, y, m_bounds.w - x, m_bounds.h - y));
+
+      m_maskIterator = m_maskBits.begin();
+    }
+
+    Filter* filter = m_mgr->m_filter;
+    switch (pixelFormat()) {
+      case IMAGE_RGB:       filter->applyToRgba(this); break;
+      case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+      case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+    }
+    return true;
+  }
+
+  // FilterManager implementation
+  doc::PixelFormat pixelFormat() const override { return m_src->pixelFormat(); }
+  const void* getSourceAddress() override { return m_src->getPixelAddress(m_bounds.x, m_bounds.y+m_row); }
+  void* getDestinationAddress() override { return m_dst->getPixelAddress(m_bounds.x, m_bounds.y+m_row); }
+  int getWidth() override { return m_bounds.w; }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return this; }
+  bool skipPixel() override {
+    bool skip = false;
+    if (m_mask && m_mask->bitmap()) {
+      if (!*m_maskIterator)
+        skip = true;
+      ++m_maskIterator;
+    }
+    return skip;
+  }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return m_bounds.x; }
+  int y() const override { return m_bounds.y+m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return m_mgr->isMaskActive(); }
+  base::task_token& taskToken() const override { return m_mgr->taskToken(); }
+
+  // FilterIndexedData implementation
+  const doc::Palette* getPalette() const override { return m_mgr->getPalette(); }
+  const doc::RgbMap* getRgbMap() const override { return m_rgbmap; }
+  doc::Palette* getNewPalette() override { return m_mgr->getNewPalette(); }
+  doc::PalettePicks getPalettePicks() override { return m_mgr->getPalettePicks(); }
+
+private:
+  FilterManagerImpl* m_mgr;
+  const Image* m_src;
+  Image* m_dst;
+  Target m_target;
+  const RgbMap* m_rgbmap;
+  const gfx::Rect m_bounds;
+  const Mask* m_mask;
+  int m_row;
+  ImageBits<BitmapTraits> m_maskBits;
+  ImageBits<BitmapTraits>::iterator m_maskIterator;
+};
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_reader(context)
   , m_site(*const_cast<Site*>(m_reader.site()))
@@ -65,6 +174,7 @@ FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   , m_celsTarget(CelsTarget::Selected)
   , m_oldPalette(nullptr)
   , m_taskToken(&m_noToken)
+  , m_threadPool(nullptr)
   , m_progressDelegate(nullptr)
 {
   int x, y;
@@ -219,44 +329,7 @@ void FilterManagerImpl::apply()
   }
 
   if (!cancelled) {
-    gfx::Rect output;
-    if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
-                                  m_bounds, output)) {
-      if (m_cel->layer()->isTilemap()) {
-        modify_tilemap_cel_region(
-          *m_tx,
-          m_cel, nullptr,
-          gfx::Region(output),
-          m_site.tilesetMode(),
-          [this](const doc::ImageRef& origTile,
-                 const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
-            return ImageRef(
-              crop_image(m_dst.get(),
-                         tileBoundsInCanvas.x,
-                         tileBoundsInCanvas.y,
-                         tileBoundsInCanvas.w,
-                         tileBoundsInCanvas.h,
-                         m_dst->maskColor()));
-          });
-      }
-      else if (m_cel->layer()->isBackground()) {
-        (*m_tx)(
-          new cmd::CopyRegion(
-            m_cel->image(),
-            m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-      else {
-        // Patch "m_cel"
-        (*m_tx)(
-          new cmd::PatchCel(
-            m_cel, m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-    }
-
+    patchCel(m_cel, m_src.get(), m_dst.get());
     result = CommandResult(CommandResult::kOk);
   }
   else {
@@ -267,6 +340,50 @@ void FilterManagerImpl::apply()
   m_reader.context()->setCommandResult(result);
 }
 
+// Adds the commands to the transaction to patch the "cel" with the
+// pixels of "dst" that are different from "src" (the original
+// pixels of the cel).
+void FilterManagerImpl::patchCel(Cel* cel, Image* src, Image* dst)
+{
+  gfx::Rect output;
+  if (!algorithm::shrink_bounds2(src, dst, m_bounds, output))
+    return;
+
+  if (cel->layer()->isTilemap()) {
+    modify_tilemap_cel_region(
+      *m_tx,
+      cel, nullptr,
+      gfx::Region(output),
+      m_site.tilesetMode(),
+      [dst](const doc::ImageRef& origTile,
+            const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
+        return ImageRef(
+          crop_image(dst,
+                     tileBoundsInCanvas.x,
+                     tileBoundsInCanvas.y,
+                     tileBoundsInCanvas.w,
+                     tileBoundsInCanvas.h,
+                     dst->maskColor()));
+      });
+  }
+  else if (cel->layer()->isBackground()) {
+    (*m_tx)(
+      new cmd::CopyRegion(
+        cel->image(),
+        dst,
+        gfx::Region(output),
+        position()));
+  }
+  else {
+    // Patch "cel"
+    (*m_tx)(
+      new cmd::PatchCel(
+        cel, dst,
+        gfx::Region(output),
+        position()));
+  }
+}
+
 void FilterManagerImpl::applyToTarget()
 {
   applyToPaletteIfNeeded();
@@ -321,6 +438,11 @@ void FilterManagerImpl::applyToTarget()
                           m_site.frame(), &newPalette));
   }
 
+  if (m_threadPool && !cels.empty() && canApplyInParallel()) {
+    applyToCelsInParallel(cels);
+    cels.clear();
+  }
+
   // For each target image
   for (auto it = cels.begin();
        it != cels.end() && !cancelled;
@@ -345,6 +467,123 @@ void FilterManagerImpl::applyToTarget()
   m_oldPalette.reset(nullptr);
 }
 
+bool FilterManagerImpl::canApplyInParallel() const
+{
+  if (pixelFormat() != IMAGE_INDEXED)
+    return true;
+
+  // Filters for indexed images use the sprite RgbMap, which can be
+  // used from several threads only if all its entries are
+  // calculated in advance.
+  RgbMap* rgbmap = m_site.sprite()->rgbMap(m_site.frame());
+  return (rgbmap && rgbmap->precompute(m_threadPool));
+}
+
+// Applies the filter to all the given cels splitting the work in
+// bands of rows that are processed in parallel with m_threadPool.
+// Only the calling thread reports progress and checks if the user
+// canceled the process. Returns false if the process was canceled.
+bool FilterManagerImpl::applyToCelsInParallel(const CelList& cels)
+{
+  // Avoid applying the filter two times to the same image
+  std::set<ObjectId> visited;
+  CelList uniqueCels;
+  for (Cel* cel : cels) {
+    if (visited.insert(cel->image()->id()).second)
+      uniqueCels.push_back(cel);
+  }
+
+  // Filters can modify the palette only from the calling thread
+  applyToPaletteIfNeeded();
+
+  // The RgbMap (which is regenerated if the palette was modified) is
+  // precomputed and shared by all threads.
+  RgbMap* rgbmap = nullptr;
+  if (pixelFormat() == IMAGE_INDEXED) {
+    rgbmap = m_site.sprite()->rgbMap(m_site.frame());
+    rgbmap->precompute(m_threadPool);
+    ASSERT(rgbmap->isPrecomputed());
+  }
+
+  struct CelJob {
+    Cel* cel;
+    ImageRef src;
+    ImageRef dst;
+    Target target;
+  };
+  std::vector<CelJob> jobs;
+
+  begin();
+
+  const int bands = (m_bounds.h + kRowsPerBand - 1) / kRowsPerBand;
+  const int totalRows = int(uniqueCels.size()) * m_bounds.h;
+  const auto callerThread = std::this_thread::get_id();
+  std::atomic<bool> cancelled(false);
+  std::atomic<int> doneRows(0);
+
+  for (auto it = uniqueCels.begin();
+       it != uniqueCels.end() && !cancelled; ) {
+    // Prepare a batch of cels to process (at least one)
+    jobs.clear();
+    size_t batchBytes = 0;
+    do {
+      Cel* cel = *it;
+      CelJob job;
+      job.cel = cel;
+      job.src = crop_cel_image(cel, 0);
+      job.dst.reset(Image::createCopy(job.src.get()));
+      job.target = m_targetOrig;
+
+      // The alpha channel of the background layer can't be modified
+      if (cel->layer()->isBackground())
+        job.target &= ~TARGET_ALPHA_CHANNEL;
+
+      batchBytes += job.src->getMemSize() + job.dst->getMemSize();
+      jobs.push_back(std::move(job));
+      ++it;
+    } while (it != uniqueCels.end() && batchBytes < kMaxBatchBytes);
+
+    base::parallel_for(
+      *m_threadPool, 0, int(jobs.size()) * bands,
+      [&](const int i) {
+        if (cancelled)
+          return;
+
+        const CelJob& job = jobs[i / bands];
+        const int row1 = (i % bands) * kRowsPerBand;
+        const int row2 = std::min(row1 + kRowsPerBand, m_bounds.h);
+
+        RowsManager rows(this, job.src.get(), job.dst.get(),
+                         job.target, rgbmap);
+        for (int row=row1; row<row2 && !cancelled; ++row) {
+          if (!rows.applyToRow(row))
+            break;
+        }
+        doneRows += row2 - row1;
+
+        if (m_progressDelegate &&
+            std::this_thread::get_id() == callerThread) {
+          m_progressDelegate->reportProgress(float(doneRows) / totalRows);
+          if (m_progressDelegate->isCancelled())
+            cancelled = true;
+        }
+      });
+
+    if (!cancelled) {
+      for (CelJob& job : jobs)
+        patchCel(job.cel, job.src.get(), job.dst.get());
+    }
+  }
+
+  end();
+
+  ASSERT(m_reader.context());
+  m_reader.context()->setCommandResult(
+    CommandResult(cancelled ? CommandResult::kCanceled:
+                              CommandResult::kOk));
+  return !cancelled;
+}
+
 void FilterManagerImpl::initTransaction()
 {
   ASSERT(!m_tx);
@@ -15,6 +15,7 @@
 #include "app/tx.h"
 #include "base/exception.h"
 #include "base/task.h"
+#include "doc/cel_list.h"
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
@@ -26,6 +27,10 @@
 #include <memory>
 #include <vector>
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Cel;
   class Image;
@@ -79,6 +84,11 @@ namespace app {
 
     void setProgressDelegate(IProgressDelegate* progressDelegate);
 
+    // Thread pool used by applyToTarget() to apply the filter to
+    // several rows/cels at the same time (nullptr to apply it from
+    // the calling thread only).
+    void setThreadPool(base::thread_pool* pool) { m_threadPool = pool; }
+
     void setTarget(Target target);
     void setCelsTarget(CelsTarget celsTarget);
 
@@ -126,9 +136,14 @@ namespace app {
     doc::PalettePicks getPalettePicks() override;
 
   private:
+    class RowsManager;
+
     void init(doc::Cel* cel);
     void apply();
     void applyToCel(doc::Cel* cel);
+    void patchCel(doc::Cel* cel, doc::Image* src, doc::Image* dst);
+    bool canApplyInParallel() const;
+    bool applyToCelsInParallel(const doc::CelList& cels);
     bool updateBounds(doc::Mask* mask);
 
     // Returns true if the palette was changed (true when the filter
@@ -160,6 +175,7 @@ namespace app {
     std::unique_ptr<Tx> m_tx;
     base::task_token m_noToken;
     base::task_token* m_taskToken;
+    base::thread_pool* m_threadPool;
 
     // Hooks
     float m_progressBase;
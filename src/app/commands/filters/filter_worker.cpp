@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "app/modules/gui.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/status_bar.h"
+#include "app/util/worker_pool.h"
 #include "base/thread.h"
 #include "doc/sprite.h"
 #include "ui/ui.h"
@@ -102,6 +103,7 @@ FilterWorker::FilterWorker(FilterManagerImpl* filterMgr)
   : m_filterMgr(filterMgr)
 {
   m_filterMgr->setProgressDelegate(this);
+  m_filterMgr->setThreadPool(&worker_pool());
 
   m_pos = 0.0;
   m_done = false;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,6 +12,7 @@
 
 #include "app/color.h"
 #include "app/doc_exporter.h"
+#include "app/pref/preferences.h"
 #include "app/sprite_sheet_type.h"
 #include "app/tools/ink_type.h"
 #include "base/convert_to.h"
@@ -241,6 +242,17 @@ void Param<doc::RgbMapAlgorithm>::fromString(const std::string& value)
     setValue(doc::RgbMapAlgorithm::DEFAULT);
 }
 
+template<>
+void Param<gen::CompressionLevel>::fromString(const std::string& value)
+{
+  if (base::utf8_icmp(value, "fast") == 0)
+    setValue(gen::CompressionLevel::FAST);
+  else if (base::utf8_icmp(value, "best") == 0)
+    setValue(gen::CompressionLevel::BEST);
+  else
+    setValue(gen::CompressionLevel::DEFAULT);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Convert values from Lua
 //////////////////////////////////////////////////////////////////////
@@ -405,6 +417,15 @@ void Param<doc::RgbMapAlgorithm>::fromLua(lua_State* L, int index)
     setValue((doc::RgbMapAlgorithm)lua_tointeger(L, index));
 }
 
+template<>
+void Param<gen::CompressionLevel>::fromLua(lua_State* L, int index)
+{
+  if (lua_type(L, index) == LUA_TSTRING)
+    fromString(lua_tostring(L, index));
+  else
+    setValue((gen::CompressionLevel)lua_tointeger(L, index));
+}
+
 void CommandWithNewParamsBase::loadParamsFromLuaTable(lua_State* L, int index)
 {
   onResetValues();
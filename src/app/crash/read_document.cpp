@@ -14,6 +14,7 @@
 #include "app/console.h"
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
+#include "app/crash/tiled_image_io.h"
 #include "app/doc.h"
 #include "base/convert_to.h"
 #include "base/exception.h"
@@ -26,7 +27,6 @@
 #include "doc/cel_io.h"
 #include "doc/cels_range.h"
 #include "doc/frame.h"
-#include "doc/image_io.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "doc/palette.h"
@@ -48,6 +48,7 @@
 
 #include <fstream>
 #include <map>
+#include <set>
 
 namespace app {
 namespace crash {
@@ -520,7 +521,7 @@ private:
   }
 
   Image* readImage(std::ifstream& s) {
-    return read_image(s, false);
+    return read_backup_image(s, m_dir);
   }
 
   Palette* readPalette(std::ifstream& s) {
@@ -661,7 +662,7 @@ Doc* read_document_with_raw_images(const std::string& dir,
 
     ImageRef img;
     if (read32(s) == MAGIC_NUMBER)
-      img.reset(read_image(s, false));
+      img.reset(read_backup_image(s, dir));
 
     if (img) {
       lay->addCel(new Cel(frame, img));
@@ -0,0 +1,273 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/crash/tiled_image_io.h"
+
+#include "app/crash/internals.h"
+#include "app/crash/log.h"
+#include "base/fs.h"
+#include "base/sha1_rfc3174.h"
+#include "base/fstream_path.h"
+#include "base/serialization.h"
+#include "doc/cancel_io.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "doc/primitives.h"
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+namespace app {
+namespace crash {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+using namespace doc;
+
+namespace {
+
+std::string tile_filename(const std::string& dir, const TileKey& key)
+{
+  std::string fn = "tile-";
+  for (uint8_t byte : key)
+    fn += fmt::format("{:02x}", byte);
+  return base::join_path(dir, fn);
+}
+
+// Returns the key to identify the given tile of the image. Tiles
+// with the same bytes but different size/format must be different,
+// so the spec is included in the hash too. We use a cryptographic
+// hash as tiles are shared only by their key (a collision would
+// restore the wrong pixels).
+TileKey tile_key(const Image* image, const gfx::Rect& bounds)
+{
+  SHA1Context sha;
+  SHA1Reset(&sha);
+
+  const uint8_t spec[5] = {
+    uint8_t(image->pixelFormat()),
+    uint8_t(bounds.w), uint8_t(bounds.w >> 8),
+    uint8_t(bounds.h), uint8_t(bounds.h >> 8) };
+  SHA1Input(&sha, spec, sizeof(spec));
+
+  const unsigned int rowBytes = image->bytesPerPixel() * bounds.w;
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    SHA1Input(&sha, image->getPixelAddress(bounds.x, y), rowBytes);
+
+  TileKey key;
+  SHA1Result(&sha, key.data());
+  return key;
+}
+
+Image* read_tile(const std::string& dir,
+                 const TileKey& key,
+                 const PixelFormat pixelFormat,
+                 const int w, const int h)
+{
+  std::ifstream s(FSTREAM_PATH(tile_filename(dir, key)), std::ifstream::binary);
+  if (!s || read32(s) != MAGIC_NUMBER)
+    return nullptr;
+
+  std::unique_ptr<Image> tile(read_image(s, false));
+  if (!tile ||
+      tile->pixelFormat() != pixelFormat ||
+      tile->width() != w ||
+      tile->height() != h)
+    return nullptr;
+
+  return tile.release();
+}
+
+} // anonymous namespace
+
+bool TilesStore::writeImage(std::ostream& os,
+                            const std::string& dir,
+                            const std::string& fn,
+                            const Image* image,
+                            CancelIO* cancel)
+{
+  // Bitmaps cannot be split in tiles (we cannot hash a rectangle of
+  // bits), anyway they are not used in cels.
+  if (image->pixelFormat() == IMAGE_BITMAP)
+    return write_image(os, image, cancel);
+
+  write32(os, NullId);                 // Tiled image (old backups have the image ID here)
+  write32(os, image->id());
+  write8(os, image->pixelFormat());    // Pixel format
+  write16(os, image->width());         // Width
+  write16(os, image->height());        // Height
+  write32(os, image->maskColor());     // Mask color
+  write16(os, kImageTileSize);         // Tile size
+
+  std::vector<TileKey> keys;
+  std::vector<TileKey> newTiles;
+  for (int y=0; y<image->height(); y+=kImageTileSize) {
+    for (int x=0; x<image->width(); x+=kImageTileSize) {
+      if (cancel && cancel->isCanceled()) {
+        deleteUnusedTiles(dir, newTiles);
+        return false;
+      }
+
+      const int w = std::min(kImageTileSize, image->width()-x);
+      const int h = std::min(kImageTileSize, image->height()-y);
+      const TileKey key = tile_key(image, gfx::Rect(x, y, w, h));
+
+      // Save the tile only if it's not already in the directory
+      if (m_tiles.find(key) == m_tiles.end()) {
+        m_tiles[key] = 0;
+        newTiles.push_back(key);
+        if (!writeTile(dir, key, image, x, y, w, h)) {
+          deleteUnusedTiles(dir, newTiles);
+          return false;
+        }
+      }
+
+      os.write((const char*)key.data(), key.size());
+      keys.push_back(key);
+    }
+  }
+
+  if (os.fail()) {
+    deleteUnusedTiles(dir, newTiles);
+    return false;
+  }
+
+  // Add one reference to each tile used by this file
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  for (const TileKey& key : keys)
+    ++m_tiles[key];
+
+  // Release tiles of a previous file with the same name (which will
+  // be overwritten)
+  releaseImageFile(dir, fn);
+  m_files[fn] = std::move(keys);
+  return true;
+}
+
+void TilesStore::releaseImageFile(const std::string& dir,
+                                  const std::string& fn)
+{
+  auto it = m_files.find(fn);
+  if (it == m_files.end())
+    return;
+
+  std::vector<TileKey> unused;
+  for (const TileKey& key : it->second) {
+    auto tileIt = m_tiles.find(key);
+    ASSERT(tileIt != m_tiles.end());
+    if (tileIt != m_tiles.end() && --tileIt->second == 0)
+      unused.push_back(key);
+  }
+  m_files.erase(it);
+
+  deleteUnusedTiles(dir, unused);
+}
+
+void TilesStore::deleteUnusedTiles(const std::string& dir,
+                                   const std::vector<TileKey>& keys)
+{
+  for (const TileKey& key : keys) {
+    auto tileIt = m_tiles.find(key);
+    if (tileIt == m_tiles.end() || tileIt->second > 0)
+      continue;
+
+    m_tiles.erase(tileIt);
+
+    const std::string fn = tile_filename(dir, key);
+    try {
+      if (base::is_file(fn))
+        base::delete_file(fn);
+    }
+    catch (const std::exception&) {
+      RECO_TRACE(" - Cannot delete tile %s\n", fn.c_str());
+    }
+  }
+}
+
+bool TilesStore::writeTile(const std::string& dir,
+                           const TileKey& key,
+                           const Image* image,
+                           const int x, const int y, const int w, const int h)
+{
+  std::unique_ptr<Image> tile(crop_image(image, x, y, w, h,
+                                         image->maskColor()));
+
+  std::ofstream s(FSTREAM_PATH(tile_filename(dir, key)), std::ofstream::binary);
+  write32(s, 0);                // Leave a room for the magic number
+  if (!write_image(s, tile.get()))
+    return false;
+
+  // Write the magic number after all the tile data
+  s.flush();
+  s.seekp(0);
+  write32(s, MAGIC_NUMBER);
+  return !s.fail();
+}
+
+Image* read_backup_image(std::istream& is,
+                         const std::string& dir)
+{
+  // Old backups (and bitmaps) were saved directly with
+  // doc::write_image(), starting with the image ID.
+  const std::istream::pos_type pos = is.tellg();
+  if (read32(is) != NullId) {
+    is.seekg(pos);
+    return read_image(is, false);
+  }
+
+  read32(is);                           // Image ID (not used)
+  const int pixelFormat = read8(is);    // Pixel format
+  const int width = read16(is);         // Width
+  const int height = read16(is);        // Height
+  const uint32_t maskColor = read32(is);// Mask color
+  const int tileSize = read16(is);      // Tile size
+
+  if ((pixelFormat != IMAGE_RGB &&
+       pixelFormat != IMAGE_GRAYSCALE &&
+       pixelFormat != IMAGE_INDEXED &&
+       pixelFormat != IMAGE_TILEMAP) ||
+      (width < 1 || height < 1) ||
+      (width > 0xfffff || height > 0xfffff) ||
+      (tileSize < 1))
+    return nullptr;
+
+  std::unique_ptr<Image> image(
+    Image::create(static_cast<PixelFormat>(pixelFormat), width, height));
+  image->setMaskColor(maskColor);
+
+  for (int y=0; y<height; y+=tileSize) {
+    for (int x=0; x<width; x+=tileSize) {
+      TileKey key;
+      is.read((char*)key.data(), key.size());
+      if (is.fail())
+        return nullptr;
+
+      const int w = std::min(tileSize, width-x);
+      const int h = std::min(tileSize, height-y);
+      std::unique_ptr<Image> tile(
+        read_tile(dir, key, image->pixelFormat(), w, h));
+      if (!tile) {
+        RECO_TRACE("RECO: Tile %s not found\n",
+                   tile_filename(dir, key).c_str());
+        return nullptr;
+      }
+
+      copy_image(image.get(), tile.get(), x, y);
+    }
+  }
+
+  return image.release();
+}
+
+} // namespace crash
+} // namespace app
@@ -0,0 +1,87 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CRASH_TILED_IMAGE_IO_H_INCLUDED
+#define APP_CRASH_TILED_IMAGE_IO_H_INCLUDED
+#pragma once
+
+#include "base/sha1.h"
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace doc {
+  class CancelIO;
+  class Image;
+}
+
+namespace app {
+namespace crash {
+
+  // Images in the backup data are split in tiles of kImageTileSize x
+  // kImageTileSize pixels. Each tile is saved in its own file named
+  // "tile-<key>" where the key is the SHA1 of the tile content, so a
+  // tile is written only once and then shared between images and
+  // versions of the same image (e.g. after a brush stroke we only
+  // write the modified tiles of the cel image).
+  const int kImageTileSize = 64;
+
+  // SHA1 of the pixel format, size, and pixels of a tile.
+  using TileKey = std::array<uint8_t, base::Sha1::HashSize>;
+
+  // Tiles saved in the backup directory of one document.
+  class TilesStore {
+  public:
+    // Writes the image in "os" as a list of tiles, saving the tiles
+    // that aren't in the "dir" directory yet. "fn" is the full path
+    // of the file where the image is being saved, used to know which
+    // tiles can be deleted when this file is deleted (see
+    // releaseImageFile()).
+    bool writeImage(std::ostream& os,
+                    const std::string& dir,
+                    const std::string& fn,
+                    const doc::Image* image,
+                    doc::CancelIO* cancel);
+
+    // Must be called when the given image file (saved with
+    // writeImage()) is deleted, so the tiles that are not used
+    // anymore are deleted too.
+    void releaseImageFile(const std::string& dir,
+                          const std::string& fn);
+
+  private:
+    bool writeTile(const std::string& dir,
+                   const TileKey& key,
+                   const doc::Image* image,
+                   const int x, const int y, const int w, const int h);
+
+    // Deletes the given tiles if they are not used by any image file
+    // (e.g. tiles written by a canceled writeImage()).
+    void deleteUnusedTiles(const std::string& dir,
+                           const std::vector<TileKey>& keys);
+
+    // Number of image files using each tile (the tile file exists
+    // if it's in this map).
+    std::map<TileKey, int> m_tiles;
+
+    // Tiles used by each image file.
+    std::map<std::string, std::vector<TileKey>> m_files;
+  };
+
+  // Reads an image saved with TilesStore::writeImage() (or with
+  // doc::write_image() in old backups) from the backup directory
+  // "dir".
+  doc::Image* read_backup_image(std::istream& is,
+                                const std::string& dir);
+
+} // namespace crash
+} // namespace app
+
+#endif
@@ -0,0 +1,209 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/crash/tiled_image_io.h"
+#include "base/fs.h"
+#include "base/process.h"
+#include "doc/cancel_io.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "fmt/format.h"
+
+#include <memory>
+#include <sstream>
+
+using namespace app::crash;
+using namespace doc;
+
+namespace {
+
+// Temporary directory used as the backup directory of a document
+class TempDir {
+public:
+  TempDir() {
+    static int counter = 0;
+    m_path = base::join_path(
+      base::get_temp_path(),
+      fmt::format("tiled_image_io_tests-{}-{}",
+                  base::get_current_process_id(), ++counter));
+    base::make_directory(m_path);
+  }
+  ~TempDir() {
+    for (const auto& fn : base::list_files(m_path))
+      base::delete_file(base::join_path(m_path, fn));
+    base::remove_directory(m_path);
+  }
+  const std::string& path() const { return m_path; }
+  int tiles() const {
+    int n = 0;
+    for (const auto& fn : base::list_files(m_path))
+      if (fn.find("tile-") == 0)
+        ++n;
+    return n;
+  }
+private:
+  std::string m_path;
+};
+
+// Cancels the write operation after N calls to isCanceled()
+class CancelAfter : public CancelIO {
+public:
+  CancelAfter(int n) : m_n(n) { }
+  bool isCanceled() override { return (--m_n < 0); }
+private:
+  int m_n;
+};
+
+// Image of 3x2 tiles (the last column/row are smaller) where the
+// pixels of each tile depend on the given seed.
+ImageRef make_image(const PixelFormat format, const int seed)
+{
+  const int w = kImageTileSize*2 + 10;
+  const int h = kImageTileSize + 20;
+  ImageRef image(Image::create(format, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(image.get(), x, y,
+                (format == IMAGE_RGB ? rgba((x*seed) & 0xff, y, (x^y) & 0xff, 255):
+                                       color_t((x+y*seed) & 0xff)));
+  return image;
+}
+
+} // anonymous namespace
+
+TEST(TiledImageIO, RoundTrip)
+{
+  TempDir dir;
+  TilesStore store;
+
+  for (PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    const ImageRef image = make_image(format, 3);
+    image->setMaskColor(1);
+
+    std::stringstream tiled, old;
+    const std::string fn = fmt::format("img{}", int(format));
+    ASSERT_TRUE(store.writeImage(tiled, dir.path(), fn, image.get(), nullptr));
+    write_image(old, image.get());
+
+    std::unique_ptr<Image> a(read_backup_image(tiled, dir.path()));
+    std::unique_ptr<Image> b(read_backup_image(old, dir.path()));
+    ASSERT_TRUE(a != nullptr);
+    ASSERT_TRUE(b != nullptr);
+    EXPECT_EQ(format, a->pixelFormat());
+    EXPECT_EQ(image->bounds(), a->bounds());
+    EXPECT_EQ(1, a->maskColor());
+    EXPECT_TRUE(is_same_image(image.get(), a.get()));
+    EXPECT_TRUE(is_same_image(b.get(), a.get()));
+
+    // The image file only contains the tile keys
+    EXPECT_LT(tiled.str().size(), old.str().size());
+  }
+  EXPECT_EQ(3*6, dir.tiles());
+}
+
+TEST(TiledImageIO, ReadOldFormat)
+{
+  TempDir dir;
+  const ImageRef image = make_image(IMAGE_RGB, 5);
+
+  std::stringstream s;
+  write_image(s, image.get());
+
+  std::unique_ptr<Image> read(read_backup_image(s, dir.path()));
+  ASSERT_TRUE(read != nullptr);
+  EXPECT_TRUE(is_same_image(image.get(), read.get()));
+  EXPECT_EQ(0, dir.tiles());
+}
+
+TEST(TiledImageIO, MissingTile)
+{
+  TempDir dir;
+  TilesStore store;
+  const ImageRef image = make_image(IMAGE_RGB, 1);
+
+  std::stringstream s;
+  ASSERT_TRUE(store.writeImage(s, dir.path(), "img", image.get(), nullptr));
+
+  const auto files = base::list_files(dir.path());
+  ASSERT_FALSE(files.empty());
+  base::delete_file(base::join_path(dir.path(), files.front()));
+
+  std::unique_ptr<Image> read(read_backup_image(s, dir.path()));
+  EXPECT_TRUE(read == nullptr);
+}
+
+TEST(TiledImageIO, ReleaseImageFileDeletesTiles)
+{
+  TempDir dir;
+  TilesStore store;
+
+  // Two images that share all the tiles except the first one
+  const ImageRef image1 = make_image(IMAGE_RGB, 1);
+  const ImageRef image2(Image::createCopy(image1.get()));
+  put_pixel(image2.get(), 0, 0, rgba(255, 0, 0, 255));
+
+  std::stringstream s1, s2;
+  ASSERT_TRUE(store.writeImage(s1, dir.path(), "img1", image1.get(), nullptr));
+  EXPECT_EQ(6, dir.tiles());
+  ASSERT_TRUE(store.writeImage(s2, dir.path(), "img2", image2.get(), nullptr));
+  EXPECT_EQ(7, dir.tiles());
+
+  store.releaseImageFile(dir.path(), "img1");
+  EXPECT_EQ(6, dir.tiles());
+
+  // The second image can still be read
+  std::unique_ptr<Image> read(read_backup_image(s2, dir.path()));
+  ASSERT_TRUE(read != nullptr);
+  EXPECT_TRUE(is_same_image(image2.get(), read.get()));
+
+  // Overwriting a file releases the tiles of its previous version
+  std::stringstream s3;
+  ASSERT_TRUE(store.writeImage(s3, dir.path(), "img2", image1.get(), nullptr));
+  EXPECT_EQ(6, dir.tiles());
+
+  store.releaseImageFile(dir.path(), "img2");
+  EXPECT_EQ(0, dir.tiles());
+}
+
+TEST(TiledImageIO, CanceledWriteDeletesNewTiles)
+{
+  TempDir dir;
+  TilesStore store;
+
+  const ImageRef image1 = make_image(IMAGE_RGB, 1);
+  const ImageRef image2 = make_image(IMAGE_RGB, 2);
+
+  std::stringstream s1;
+  ASSERT_TRUE(store.writeImage(s1, dir.path(), "img1", image1.get(), nullptr));
+  EXPECT_EQ(6, dir.tiles());
+
+  // Cancel after writing some tiles of the second image
+  for (int n=0; n<6; ++n) {
+    CancelAfter cancel(n);
+    std::stringstream s2;
+    EXPECT_FALSE(store.writeImage(s2, dir.path(), "img2", image2.get(), &cancel));
+    EXPECT_EQ(6, dir.tiles());
+  }
+
+  // Cancel writing tiles shared with the first image
+  {
+    CancelAfter cancel(3);
+    std::stringstream s;
+    EXPECT_FALSE(store.writeImage(s, dir.path(), "img3", image1.get(), &cancel));
+    EXPECT_EQ(6, dir.tiles());
+  }
+
+  std::unique_ptr<Image> read(read_backup_image(s1, dir.path()));
+  ASSERT_TRUE(read != nullptr);
+  EXPECT_TRUE(is_same_image(image1.get(), read.get()));
+
+  store.releaseImageFile(dir.path(), "img1");
+  EXPECT_EQ(0, dir.tiles());
+}
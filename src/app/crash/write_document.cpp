@@ -13,6 +13,7 @@
 
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
+#include "app/crash/tiled_image_io.h"
 #include "app/doc.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
@@ -25,9 +26,9 @@
 #include "doc/cel_io.h"
 #include "doc/cels_range.h"
 #include "doc/frame.h"
-#include "doc/image_io.h"
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
+#include "doc/lazy_image.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
 #include "doc/serial_format.h"
@@ -57,6 +58,7 @@ namespace {
 
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
 static std::map<ObjectId, base::paths> g_deleteFiles;
+static std::map<ObjectId, TilesStore> g_docTiles;
 
 class Writer {
 public:
@@ -65,6 +67,7 @@ public:
     , m_doc(doc)
     , m_objVersions(g_docVersions[doc->id()])
     , m_deleteFiles(g_deleteFiles[doc->id()])
+    , m_tiles(g_docTiles[doc->id()])
     , m_cancel(cancel) {
   }
 
@@ -109,7 +112,14 @@ public:
         if (cel->link())        // Skip link
           continue;
 
-        if (!saveObject("img", cel->image(), &Writer::writeImage))
+        // Lazy images are saved with read-only access, so they can
+        // be discarded from memory after this.
+        if (const LazyImageRef& lazy = cel->data()->lazyImage()) {
+          const ImageConstRef image = lazy->getConst();
+          if (!saveObject("img", image.get(), &Writer::writeImage))
+            return false;
+        }
+        else if (!saveObject("img", cel->image(), &Writer::writeImage))
           return false;
 
         if (!saveObject("celdata", cel->data(), &Writer::writeCelData))
@@ -292,8 +302,10 @@ private:
     return true;
   }
 
-  bool writeImage(std::ofstream& s, Image* img) {
-    return write_image(s, img, m_cancel);
+  bool writeImage(std::ofstream& s, const Image* img) {
+    return m_tiles.writeImage(s, m_dir,
+                              objectFilename("img", img->id(), img->version()),
+                              img, m_cancel);
   }
 
   bool writePalette(std::ofstream& s, Palette* pal) {
@@ -316,25 +328,30 @@ private:
     return true;
   }
 
-  template<typename T>
-  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
+  // Objects without a version (zero) get their first version to be
+  // saved. Read-only objects must already have one (e.g. images
+  // decoded by a doc::LazyImage).
+  static void initVersion(doc::Object* obj) {
+    if (!obj->version())
+      obj->incrementVersion();
+  }
+  static void initVersion(const doc::Object* obj) {
+    ASSERT(obj->version());
+  }
+
+  template<typename T, typename U>
+  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, U*)) {
     if (isCanceled())
       return false;
 
-    if (!obj->version())
-      obj->incrementVersion();
+    initVersion(obj);
 
     ObjVersions& versions = m_objVersions[obj->id()];
     if (versions.newer() == obj->version())
       return true;
 
-    std::string fn = prefix;
-    fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
-
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+    std::string fullfn = objectFilename(prefix, obj->id(), obj->version());
+    std::string oldfn = objectFilename(prefix, obj->id(), versions.older());
 
     std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
     write32(s, 0);                // Leave a room for the magic number
@@ -368,6 +385,9 @@ private:
       try {
         RECO_TRACE(" - Deleting <%s>\n", file.c_str());
         base::delete_file(file);
+
+        // Delete tiles that were used only by this image file
+        m_tiles.releaseImageFile(m_dir, file);
       }
       catch (const std::exception&) {
         RECO_TRACE(" - Cannot delete <%s>\n", file.c_str());
@@ -375,10 +395,22 @@ private:
     }
   }
 
+  std::string objectFilename(const char* prefix,
+                             const ObjectId id,
+                             const ObjectVersion ver) const {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return base::join_path(m_dir, fn);
+  }
+
   std::string m_dir;
   Doc* m_doc;
   ObjVersionsMap& m_objVersions;
   base::paths& m_deleteFiles;
+  TilesStore& m_tiles;
   doc::CancelIO* m_cancel;
 };
 
@@ -411,6 +443,11 @@ void delete_document_internals(Doc* doc)
     if (it != g_deleteFiles.end())
       g_deleteFiles.erase(it);
   }
+  {
+    auto it = g_docTiles.find(doc->id());
+    if (it != g_docTiles.end())
+      g_docTiles.erase(it);
+  }
 }
 
 } // namespace crash
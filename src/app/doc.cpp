@@ -228,12 +228,14 @@ void Doc::notifyPaletteChanged()
   notify_observers<DocEvent&>(&DocObserver::onPaletteChanged, ev);
 }
 
-void Doc::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region, frame_t frame)
+void Doc::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region, frame_t frame,
+                                     Layer* layer)
 {
   DocEvent ev(this);
   ev.sprite(sprite);
   ev.region(region);
   ev.frame(frame);
+  ev.layer(layer);
   notify_observers<DocEvent&>(&DocObserver::onSpritePixelsModified, ev);
 }
 
@@ -121,7 +121,10 @@ namespace app {
     void notifyGeneralUpdate();
     void notifyColorSpaceChanged();
     void notifyPaletteChanged();
-    void notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region, frame_t frame);
+    // The "layer" (optional) is the layer whose cel was modified
+    // only inside the given region.
+    void notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region, frame_t frame,
+                                    Layer* layer = nullptr);
     void notifyExposeSpritePixels(Sprite* sprite, const gfx::Region& region);
     void notifyLayerMergedDown(Layer* srcLayer, Layer* targetLayer);
     void notifyBeforeLayerVisibilityChange(Layer* layer, bool newState);
@@ -21,16 +21,16 @@
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
+#include "app/util/worker_pool.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
+#include "base/parallel_for.h"
 #include "base/replace_string.h"
 #include "base/string.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
-#include "doc/images_map.h"
-#include "doc/images_map.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -54,6 +54,7 @@
 #include <iostream>
 #include <memory>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -235,7 +236,11 @@ public:
   void setLinked() { m_isLinked = true; }
   void setDuplicated() { m_isDuplicated = true; }
 
-  ImageRef createRender(ImageBufferPtr& imageBuf) {
+  // If "showLayers" is false, the caller must show the selected
+  // layers of this sample (e.g. to render several samples of the same
+  // layers from different threads).
+  ImageRef createRender(ImageBufferPtr& imageBuf,
+                        const bool showLayers = true) const {
     ASSERT(m_sprite);
 
     // We use the m_image as it is, it doesn't require a special
@@ -250,13 +255,14 @@ public:
                     imageBuf));
     render->setMaskColor(m_sprite->transparentColor());
     clear_image(render.get(), m_sprite->transparentColor());
-    renderSample(render.get(), 0, 0, false);
+    renderSample(render.get(), 0, 0, false, showLayers);
     return render;
   }
 
-  void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
+  void renderSample(doc::Image* dst, int x, int y, bool extrude,
+                    const bool showLayers = true) const {
     RestoreVisibleLayers layersVisibility;
-    if (m_selLayers)
+    if (m_selLayers && showLayers)
       layersVisibility.showSelectedLayers(m_sprite,
                                           *m_selLayers);
 
@@ -353,6 +359,94 @@ private:
   List m_samples;
 };
 
+// Finds samples with the same pixels using a hash table of the
+// rendered samples. Samples are rendered in parallel (in batches of
+// consecutive samples with the same sprite and layers, so the layers
+// visibility is changed only once for each batch), but duplicates are
+// resolved in the samples order, so the original sample of a set of
+// duplicates is always the first one (as in a sequential search).
+class DocExporter::DuplicatedSamples {
+public:
+  template<typename Predicate>
+  DuplicatedSamples(const Samples& samples,
+                    Predicate&& includeSample,
+                    base::task_token& token)
+    : m_originals(samples.size(), -1) {
+    // Max number of samples rendered at the same time (renders of
+    // duplicated samples are released after each batch)
+    constexpr int kBatchSize = 256;
+
+    const int n = samples.size();
+    std::vector<ImageRef> renders(n);
+    std::vector<uint64_t> hashes(kBatchSize);
+    std::vector<int> batch;
+    batch.reserve(kBatchSize);
+
+    // Original samples for each hash
+    std::unordered_map<uint64_t, std::vector<int>> originals;
+
+    for (int i=0; i<n; ) {
+      if (token.canceled())
+        return;
+
+      const Sample& first = samples[i];
+      batch.clear();
+      for (; i<n &&
+             int(batch.size()) < kBatchSize &&
+             samples[i].sprite() == first.sprite() &&
+             samples[i].selectedLayers() == first.selectedLayers(); ++i) {
+        if (includeSample(samples[i]))
+          batch.push_back(i);
+      }
+      if (batch.empty())
+        continue;
+
+      {
+        RestoreVisibleLayers layersVisibility;
+        if (first.selectedLayers())
+          layersVisibility.showSelectedLayers(first.sprite(),
+                                              *first.selectedLayers());
+
+        base::parallel_for(
+          worker_pool(), 0, int(batch.size()),
+          [&samples, &batch, &renders, &hashes](const int j) {
+            // We have to use one ImageBuffer for each image because
+            // we're going to keep the original images.
+            doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
+            ImageRef render = samples[batch[j]].createRender(sampleBuf, false);
+            hashes[j] = calculate_image_hash(render.get(), render->bounds());
+            renders[batch[j]] = render;
+          });
+      }
+
+      for (int j=0; j<int(batch.size()); ++j) {
+        const int k = batch[j];
+        std::vector<int>& candidates = originals[hashes[j]];
+        for (const int o : candidates) {
+          if (is_same_image(renders[o].get(), renders[k].get())) {
+            m_originals[k] = o;
+            break;
+          }
+        }
+        if (m_originals[k] < 0)
+          candidates.push_back(k);
+        else
+          renders[k].reset();
+      }
+    }
+  }
+
+  // Returns the index of the first sample with the same pixels as
+  // the i-th sample, or -1 if the i-th sample is the first one (or
+  // it wasn't included).
+  int original(const int i) const {
+    return m_originals[i];
+  }
+
+private:
+  std::vector<int> m_originals;
+};
+
 class DocExporter::LayoutSamples {
 public:
   virtual ~LayoutSamples() { }
@@ -392,7 +486,13 @@ public:
     const Layer* oldLayer = nullptr;
     const Tag* oldTag = nullptr;
 
-    doc::ImagesMap duplicates;
+    const DuplicatedSamples duplicates(
+      samples,
+      [this](const Sample& sample) {
+        return (!sample.isEmpty() &&
+                (m_mergeDups || sample.isLinked()));
+      },
+      token);
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
 
@@ -418,20 +518,13 @@ public:
       }
 
       if (m_mergeDups || sample.isLinked()) {
-        doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-        doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-        auto it = duplicates.find(sampleRender);
-        if (it != duplicates.end()) {
-          const uint32_t j = it->second;
-
+        const int j = duplicates.original(i);
+        if (j >= 0) {
           sample.setDuplicated();
           sample.setSharedBounds(samples[j].sharedBounds());
           ++i;
           continue;
         }
-        else {
-          duplicates[sampleRender] = i;
-        }
       }
 
       const Sprite* sprite = sample.sprite();
@@ -534,7 +627,10 @@ public:
                      int& width, int& height,
                      base::task_token& token) override {
     gfx::PackingRects pr(borderPadding, shapePadding);
-    doc::ImagesMap duplicates;
+    const DuplicatedSamples duplicates(
+      samples,
+      [](const Sample& sample) { return !sample.isEmpty(); },
+      token);
 
     uint32_t i = 0;
     for (auto& sample : samples) {
@@ -548,19 +644,12 @@ public:
         continue;
       }
 
-      // We have to use one ImageBuffer for each image because we're
-      // going to store all images in the "duplicates" map.
-      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-      doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-      auto it = duplicates.find(sampleRender);
-      if (it != duplicates.end()) {
-        const uint32_t j = it->second;
-
+      const int j = duplicates.original(i);
+      if (j >= 0) {
         sample.setDuplicated();
         sample.setSharedBounds(samples[j].sharedBounds());
       }
       else {
-        duplicates[sampleRender] = i;
         pr.add(sample.requiredSize());
       }
       ++i;
@@ -592,7 +681,6 @@ public:
 
 DocExporter::DocExporter()
   : m_docBuf(std::make_shared<doc::ImageBuffer>())
-  , m_sampleBuf(std::make_shared<doc::ImageBuffer>())
 {
   m_cache.spriteId = doc::NullId;
   reset();
@@ -885,6 +973,37 @@ void DocExporter::captureSamples(Samples& samples,
 {
   DX_TRACE("DX: Capture samples");
 
+  // Index of the first sample of each sprite/layer/frame, used to
+  // re-use linked samples.
+  struct SampleKey {
+    const Sprite* sprite;
+    const Layer* layer;
+    frame_t frame;
+    bool operator==(const SampleKey& o) const {
+      return (sprite == o.sprite && layer == o.layer && frame == o.frame);
+    }
+  };
+  struct SampleKeyHash {
+    size_t operator()(const SampleKey& k) const {
+      return (std::hash<const void*>()(k.sprite) ^
+              (std::hash<const void*>()(k.layer) << 1) ^
+              (std::hash<int>()(k.frame) << 2));
+    }
+  };
+  std::unordered_map<SampleKey, int, SampleKeyHash> samplesIndex;
+
+  // A sample of the current item (frame) before adding it to
+  // "samples", with the result of its trimming.
+  struct FrameSample {
+    Sample sample;
+    Cel* link;
+    bool trim;               // Must be rendered to trim it
+    bool trimmed;            // Already rendered and trimmed
+    bool empty;              // Completely transparent
+    gfx::Rect frameBounds;   // Shrunk bounds
+  };
+  std::vector<FrameSample> frameSamples;
+
   for (auto& item : m_documents) {
     if (token.canceled())
       return;
@@ -941,6 +1060,32 @@ void DocExporter::captureSamples(Samples& samples,
       }
     }
 
+    const bool trimSamples =
+      ((m_ignoreEmptyCels || m_trimCels) &&
+       !item.isOneImageOnly());
+
+    // Get the reference color to trim samples (before we change the
+    // layers visibility to render the samples of this item).
+    doc::color_t refColor = 0;
+    bool refColorFromRender = false;
+    if (m_trimCels) {
+      if ((layer &&
+           layer->isBackground()) ||
+          (!layer &&
+           sprite->backgroundLayer() &&
+           sprite->backgroundLayer()->isVisible())) {
+        refColorFromRender = true;
+      }
+      else {
+        refColor = sprite->transparentColor();
+      }
+    }
+    else if (m_ignoreEmptyCels)
+      refColor = sprite->transparentColor();
+
+    // 1) Create the samples of each frame
+    frameSamples.clear();
+    std::set<frame_t> itemFrames;
     frame_t outputFrame = 0;
     for (frame_t frame : item.getSelectedFrames()) {
       if (token.canceled())
@@ -972,74 +1117,98 @@ void DocExporter::captureSamples(Samples& samples,
         m_innerPadding, m_extrude);
       Cel* cel = nullptr;
       Cel* link = nullptr;
-      bool done = false;
 
       if (layer && layer->isImage()) {
         cel = layer->cel(frame);
         if (cel)
           link = cel->link();
       }
+      if (!m_mergeDuplicates || item.isOneImageOnly())
+        link = nullptr;
+
+      // Ignore empty cels
+      if (trimSamples && !link &&
+          layer && layer->isImage() && !cel && m_ignoreEmptyCels)
+        continue;
+
+      // We don't need to render linked samples that will re-use a
+      // previous sample.
+      const bool willBeLinked =
+        (link &&
+         (samplesIndex.find(SampleKey{ sprite, layer, link->frame() }) != samplesIndex.end() ||
+          itemFrames.find(link->frame()) != itemFrames.end()));
+
+      frameSamples.push_back(
+        FrameSample{ sample, link,
+                     trimSamples && !willBeLinked,
+                     false, false, gfx::Rect() });
+      itemFrames.insert(frame);
+    }
+
+    // 2) Render and trim the samples in parallel (changing the layers
+    //    visibility just one time for all samples of this item)
+    RestoreVisibleLayers layersVisibility;
+    if (item.selLayers && trimSamples)
+      layersVisibility.showSelectedLayers(sprite, *item.selLayers);
+
+    auto trimSample = [&spriteBounds, refColor, refColorFromRender](FrameSample& fs) {
+      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
+      ImageRef sampleRender(fs.sample.createRender(sampleBuf, false));
+
+      // If shrink_bounds() returns false, it's because the whole
+      // image is transparent (equal to the mask color).
+      fs.empty = !algorithm::shrink_bounds(
+        sampleRender.get(),
+        (refColorFromRender ? get_pixel(sampleRender.get(), 0, 0): refColor),
+        nullptr,                // layer
+        spriteBounds,           // startBounds
+        fs.frameBounds);        // output bounds
+      fs.trimmed = true;
+    };
+
+    base::parallel_for(
+      worker_pool(), 0, int(frameSamples.size()),
+      [&frameSamples, &token, &trimSample](const int i) {
+        FrameSample& fs = frameSamples[i];
+        if (fs.trim && !token.canceled())
+          trimSample(fs);
+      });
+    if (token.canceled())
+      return;
+
+    // 3) Add the samples in order
+    for (FrameSample& fs : frameSamples) {
+      Sample& sample = fs.sample;
+      bool done = false;
 
       // Re-use linked samples
       bool alreadyTrimmed = false;
-      if (link && m_mergeDuplicates &&
-          !item.isOneImageOnly()) {
-        for (const Sample& other : samples) {
-          if (token.canceled())
-            return;
-
-          if (other.sprite() == sprite &&
-              other.layer() == layer &&
-              other.frame() == link->frame()) {
-            ASSERT(!other.isLinked());
-
-            sample.setLinked();
-            sample.setTrimmedBounds(other.trimmedBounds());
-            sample.setSharedBounds(other.sharedBounds());
-            alreadyTrimmed = true;
-            done = true;
-            break;
-          }
+      if (fs.link) {
+        auto it = samplesIndex.find(
+          SampleKey{ sprite, layer, fs.link->frame() });
+        if (it != samplesIndex.end()) {
+          const Sample& other = samples[it->second];
+          ASSERT(!other.isLinked());
+
+          sample.setLinked();
+          sample.setTrimmedBounds(other.trimmedBounds());
+          sample.setSharedBounds(other.sharedBounds());
+          alreadyTrimmed = true;
+          done = true;
         }
         // "done" variable can be false here, e.g. when we export a
         // frame tag and the first linked cel is outside the tag range.
         ASSERT(done || (!done && tag));
       }
 
-      if (!done && (m_ignoreEmptyCels || m_trimCels) &&
-          !item.isOneImageOnly()) {
-        // Ignore empty cels
-        if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
-          continue;
-
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
-
-        gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
-
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
-          }
-          else {
-            refColor = sprite->transparentColor();
-          }
-        }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
-
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
-          // If shrink_bounds() returns false, it's because the whole
-          // image is transparent (equal to the mask color).
+      if (!done && trimSamples) {
+        // The linked sample wasn't added (e.g. it was empty), so we
+        // have to trim this sample now.
+        if (!fs.trimmed)
+          trimSample(fs);
 
+        gfx::Rect frameBounds = fs.frameBounds;
+        if (fs.empty) {
           // Should we ignore this empty frame? (i.e. don't include
           // the frame in the sprite sheet)
           if (m_ignoreEmptyCels)
@@ -1080,6 +1249,10 @@ void DocExporter::captureSamples(Samples& samples,
       if (!alreadyTrimmed && m_trimSprite)
         sample.setTrimmedBounds(spriteBounds);
 
+      samplesIndex.insert(
+        std::make_pair(SampleKey{ sprite, layer, sample.frame() },
+                       samples.size()));
+
       if (item.splitGrid) {
         const gfx::Rect& gridBounds = sprite->gridBounds();
         gfx::Point initPos(0, 0), pos;
@@ -1273,16 +1446,30 @@ void DocExporter::renderTexture(Context* ctx,
 {
   textureImage->clear(textureImage->maskColor());
 
-  int i = 0;
-  for (const auto& sample : samples) {
+  auto isRendered = [](const Sample& sample) {
+    return (!sample.isLinked() &&
+            !sample.isDuplicated() &&
+            !sample.isEmpty());
+  };
+
+  // Consecutive samples with the same sprite and layers are rendered
+  // in parallel (each one in its own area of the texture).
+  const int n = samples.size();
+  for (int i=0; i<n; ) {
     if (token.canceled())
       return;
-    token.set_progress(0.6f + 0.2f * i / int(samples.size()));
-
-    if (sample.isLinked() ||
-        sample.isDuplicated() ||
-        sample.isEmpty()) {
-      ++i;
+    token.set_progress(0.6f + 0.2f * i / n);
+
+    const Sample& sample = samples[i];
+    int end = i+1;
+    while (end < n &&
+           samples[end].sprite() == sample.sprite() &&
+           samples[end].selectedLayers() == sample.selectedLayers())
+      ++end;
+
+    const auto endIt = samples.begin()+end;
+    if (std::find_if(samples.begin()+i, endIt, isRendered) == endIt) {
+      i = end;
       continue;
     }
 
@@ -1304,12 +1491,25 @@ void DocExporter::renderTexture(Context* ctx,
         .execute(ctx);
     }
 
-    sample.renderSample(
-      textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding,
-      m_extrude);
-    ++i;
+    RestoreVisibleLayers layersVisibility;
+    if (sample.selectedLayers())
+      layersVisibility.showSelectedLayers(sample.sprite(),
+                                          *sample.selectedLayers());
+
+    base::parallel_for(
+      worker_pool(), i, end,
+      [this, &samples, &isRendered, textureImage, &token](const int j) {
+        const Sample& sample = samples[j];
+        if (!isRendered(sample) || token.canceled())
+          return;
+
+        sample.renderSample(
+          textureImage,
+          sample.inTextureBounds().x+m_innerPadding,
+          sample.inTextureBounds().y+m_innerPadding,
+          m_extrude, false);
+      });
+    i = end;
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -103,6 +103,7 @@ namespace app {
   private:
     class Sample;
     class Samples;
+    class DuplicatedSamples;
     class LayoutSamples;
     class SimpleLayoutSamples;
     class BestFitLayoutSamples;
@@ -187,7 +188,6 @@ namespace app {
 
     // Buffers used
     doc::ImageBufferPtr m_docBuf;
-    doc::ImageBufferPtr m_sampleBuf;
 
     // Trimmed bounds of a specific sprite (to avoid recalculating
     // this)
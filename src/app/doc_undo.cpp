@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,8 @@
 #include "app/context.h"
 #include "app/doc_undo_observer.h"
 #include "app/pref/preferences.h"
+#include "app/undo_buffer.h"
+#include "base/exception.h"
 #include "base/mem_utils.h"
 #include "base/scoped_value.h"
 #include "undo/undo_history.h"
@@ -31,11 +33,27 @@
 
 namespace app {
 
+namespace {
+
+// Number of the most recent undo states that are never compressed
+// (as it's likely that the user will undo/redo them)
+constexpr int kHotStates = 4;
+
+// Number of consecutive already compressed states needed to stop
+// looking for old states to compress
+constexpr int kMaxCompressedStates = 16;
+
+} // anonymous namespace
+
 DocUndo::DocUndo()
   : m_undoHistory(this)
 {
 }
 
+DocUndo::~DocUndo()
+{
+}
+
 void DocUndo::setContext(Context* ctx)
 {
   m_ctx = ctx;
@@ -68,10 +86,22 @@ void DocUndo::add(CmdTransaction* cmd)
   notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 
   if (App::instance()) {
+    auto& undoPref = App::instance()->preferences().undo;
     const size_t undoLimitSize =
-      int(App::instance()->preferences().undo.sizeLimit())
+      int(undoPref.sizeLimit())
       * 1024 * 1024;
 
+    if (undoPref.compress())
+      compressOldStates();
+
+    // Before discarding undo states, we can save the oldest ones in
+    // the disk.
+    if (undoLimitSize > 0 &&
+        m_totalUndoSize > undoLimitSize &&
+        undoPref.spillToDisk()) {
+      spillOldStates(undoLimitSize);
+    }
+
     // If undo limit is 0, it means "no limit", so we ignore the
     // complete logic to discard undo states.
     if (undoLimitSize > 0 &&
@@ -107,21 +137,27 @@ void DocUndo::undo()
   ASSERT(!m_undoing);
   base::ScopedValue undoing(m_undoing, true);
   const size_t oldSize = m_totalUndoSize;
+  bool loaded;
   {
     const undo::UndoState* state = nextUndo();
     ASSERT(state);
     const Cmd* cmd = STATE_CMD(state);
     m_totalUndoSize -= cmd->memSize();
-    m_undoHistory.undo();
+    loaded = loadUndoBuffers(state);
+    if (loaded)
+      m_undoHistory.undo();
     m_totalUndoSize += cmd->memSize();
   }
   // This notification could execute a script that modifies the sprite
   // again (e.g. a script that is listening the "change" event, check
   // the SpriteEvents class). If the sprite is modified, the "cmd" is
   // not valid anymore.
-  notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
+  if (loaded)
+    notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
   if (m_totalUndoSize != oldSize)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+  if (!loaded)
+    throw base::Exception("The data to undo the last action cannot be restored.");
 }
 
 void DocUndo::redo()
@@ -129,17 +165,23 @@ void DocUndo::redo()
   ASSERT(!m_undoing);
   base::ScopedValue undoing(m_undoing, true);
   const size_t oldSize = m_totalUndoSize;
+  bool loaded;
   {
     const undo::UndoState* state = nextRedo();
     ASSERT(state);
     const Cmd* cmd = STATE_CMD(state);
     m_totalUndoSize -= cmd->memSize();
-    m_undoHistory.redo();
+    loaded = loadUndoBuffers(state);
+    if (loaded)
+      m_undoHistory.redo();
     m_totalUndoSize += cmd->memSize();
   }
-  notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
+  if (loaded)
+    notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
   if (m_totalUndoSize != oldSize)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+  if (!loaded)
+    throw base::Exception("The data to redo the last action cannot be restored.");
 }
 
 void DocUndo::clearRedo()
@@ -314,6 +356,113 @@ const undo::UndoState* DocUndo::nextRedo() const
     return m_undoHistory.firstState();
 }
 
+// Loads in memory the undo data of the given state before
+// undoing/redoing it. Returns false if some data cannot be restored
+// (e.g. the spill file cannot be read), in that case the state must
+// not be undone/redone (instead of modifying the sprite with invalid
+// data).
+bool DocUndo::loadUndoBuffers(const undo::UndoState* state)
+{
+  UndoBuffers buffers;
+  STATE_CMD(state)->getUndoBuffers(buffers);
+  for (UndoBuffer* buffer : buffers) {
+    if (!buffer->load())
+      return false;
+  }
+  return true;
+}
+
+// Compresses (in background threads) the undo data of old undo
+// states, and replaces the uncompressed data with the compressed one
+// when the compression started in a previous call has finished.
+void DocUndo::compressOldStates()
+{
+  const size_t oldSize = m_totalUndoSize;
+  UndoBuffers buffers;
+  int hotStates = kHotStates;
+  int compressedStates = 0;
+
+  for (const undo::UndoState* state = currentState();
+       state && compressedStates < kMaxCompressedStates;
+       state = state->prev()) {
+    if (hotStates > 0) {
+      --hotStates;
+      continue;
+    }
+
+    buffers.clear();
+    STATE_CMD(state)->getUndoBuffers(buffers);
+
+    bool compressed = true;
+    for (UndoBuffer* buffer : buffers) {
+      const size_t before = buffer->memSize();
+      if (buffer->finishCompression())
+        m_totalUndoSize = m_totalUndoSize - before + buffer->memSize();
+      else if (buffer->startCompression())
+        compressed = false;     // Still compressing
+    }
+
+    if (compressed)
+      ++compressedStates;
+    else
+      compressedStates = 0;
+  }
+
+  if (m_totalUndoSize != oldSize)
+    notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+}
+
+// Saves the data of the oldest undo states in a temporary file until
+// the undo history uses less memory than the given limit.
+//
+// This is synchronous (the data that is not compressed yet is
+// compressed here) because the states that are still over the limit
+// after this call are deleted in add(). Anyway most of these old
+// states were already compressed in background by
+// compressOldStates() when the "compress" option is enabled.
+void DocUndo::spillOldStates(const size_t undoLimitSize)
+{
+  // Don't spill the most recent states
+  const undo::UndoState* hotState = currentState();
+  for (int i=1; hotState && hotState->prev() && i<kHotStates; ++i)
+    hotState = hotState->prev();
+
+  if (!m_spillFile)
+    m_spillFile = std::make_unique<UndoSpillFile>();
+
+  const size_t oldSize = m_totalUndoSize;
+  UndoBuffers buffers;
+  bool ok = true;
+
+  for (const undo::UndoState* state = firstState();
+       ok && state && state != hotState && m_totalUndoSize > undoLimitSize;
+       state = state->next()) {
+    buffers.clear();
+    STATE_CMD(state)->getUndoBuffers(buffers);
+
+    for (UndoBuffer* buffer : buffers) {
+      const size_t before = buffer->memSize();
+      if (before == 0)
+        continue;
+
+      // If we cannot write in the file, the old states will be
+      // deleted as usual.
+      if (!buffer->spill(m_spillFile.get())) {
+        ok = false;
+        break;
+      }
+
+      m_totalUndoSize = m_totalUndoSize - before + buffer->memSize();
+    }
+  }
+
+  UNDO_TRACE("UNDO: Undo data saved in disk %s\n",
+             base::get_pretty_memory_size(oldSize - m_totalUndoSize).c_str());
+
+  if (m_totalUndoSize != oldSize)
+    notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
+}
+
 void DocUndo::onDeleteUndoState(undo::UndoState* state)
 {
   ASSERT(state);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "undo/undo_history.h"
 
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 namespace app {
@@ -26,6 +27,7 @@ namespace app {
   class CmdTransaction;
   class Context;
   class DocUndoObserver;
+  class UndoSpillFile;
 
   // Exception thrown when we want to modify the sprite (add new
   // app::Cmd objects) when we are undoing/redoing/moving throw the
@@ -40,6 +42,7 @@ namespace app {
                   public undo::UndoHistoryDelegate {
   public:
     DocUndo();
+    ~DocUndo();
 
     size_t totalUndoSize() const { return m_totalUndoSize; }
 
@@ -103,10 +106,18 @@ namespace app {
   private:
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
+    bool loadUndoBuffers(const undo::UndoState* state);
+    void compressOldStates();
+    void spillOldStates(const size_t undoLimitSize);
 
     // undo::UndoHistoryDelegate impl
     void onDeleteUndoState(undo::UndoState* state) override;
 
+    // Temporary file where the oldest undo data is saved when the
+    // undo history is bigger than the undo limit. It's declared
+    // before m_undoHistory so it's destroyed after the undo states.
+    std::unique_ptr<UndoSpillFile> m_spillFile;
+
     undo::UndoHistory m_undoHistory;
     const undo::UndoState* m_savedState = nullptr;
     Context* m_ctx = nullptr;
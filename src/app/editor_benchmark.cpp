@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,9 +11,15 @@
 #include "app/app.h"
 #include "app/cli/app_options.h"
 #include "app/doc.h"
+#include "app/pref/preferences.h"
 #include "app/ui/editor/editor.h"
+#include "app/ui/editor/editor_render_cache.h"
 #include "app/ui/main_window.h"
 #include "app/ui_context.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "os/system.h"
 #include "ui/manager.h"
@@ -99,6 +105,98 @@ void BM_ZoomEditor(benchmark::State& state) {
   }
 }
 
+// Redraws the whole editor without changes in the sprite, with and
+// without the cache of rendered tiles (e.g. when a window over the
+// editor is moved).
+void BM_RedrawEditor(benchmark::State& state) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const bool useCache = state.range(2);
+  auto ctx = UIContext::instance();
+  auto& pref = Preferences::instance();
+  const bool oldRenderCache = pref.experimental.renderCache();
+  pref.experimental.renderCache(useCache);
+
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
+  std::unique_ptr<Doc> doc(new Doc(spr));
+  doc->setContext(ctx);
+
+  Editor* editor = ctx->activeEditor();
+  editor->setZoom(render::Zoom(1, 1));
+  editor->setScrollToCenter();
+
+  auto mgr = ui::Manager::getDefault();
+
+  ui::Timer timer(1);
+  timer.start();
+  while (state.KeepRunning()) {
+    editor->invalidate();
+    mgr->generateMessages();
+    mgr->dispatchMessages();
+  }
+
+  pref.experimental.renderCache(oldRenderCache);
+}
+
+// Modifies one pixel of the sprite in each iteration, so only the
+// cached tile that contains that pixel must be rendered again (or a
+// few tiles if the pixel is in the border of a tile).
+void BM_EditorCacheInvalidation(benchmark::State& state) {
+  const int w = state.range(0);
+  const int h = state.range(1);
+  auto ctx = UIContext::instance();
+  auto& pref = Preferences::instance();
+  const bool oldRenderCache = pref.experimental.renderCache();
+  pref.experimental.renderCache(true);
+
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
+  std::unique_ptr<Doc> doc(new Doc(spr));
+  doc->setContext(ctx);
+
+  Editor* editor = ctx->activeEditor();
+  editor->setZoom(render::Zoom(1, 1));
+  editor->setScrollToCenter();
+
+  Layer* layer = spr->root()->firstLayer();
+  Image* image = layer->cel(0)->image();
+  auto mgr = ui::Manager::getDefault();
+
+  // Fill the cache with the first render
+  editor->invalidate();
+  mgr->generateMessages();
+  mgr->dispatchMessages();
+
+  EditorRenderCache& cache = editor->renderCache();
+  cache.resetStats();
+
+  ui::Timer timer(1);
+  timer.start();
+  int i = 0;
+  while (state.KeepRunning()) {
+    const int x = (i % w);
+    const int y = (i / w) % h;
+    put_pixel(image, x, y, rgba(255, 0, 0, 255));
+    image->incrementVersion();
+    doc->notifySpritePixelsModified(
+      spr, gfx::Region(gfx::Rect(x, y, 1, 1)), 0, layer);
+    ++i;
+
+    editor->invalidate();
+    mgr->generateMessages();
+    mgr->dispatchMessages();
+  }
+
+  // At most 4 tiles can contain the modified pixel (plus the one
+  // pixel border used to invalidate tiles)
+  const int misses = cache.misses();
+  state.counters["rendered_tiles"] =
+    benchmark::Counter(misses, benchmark::Counter::kAvgIterations);
+  if (misses > 4*i)
+    state.SkipWithError("Too many tiles rendered again for one modified pixel");
+
+  pref.experimental.renderCache(oldRenderCache);
+}
+
 BENCHMARK(BM_ScrollEditor)
   // Normal zoom
   ->Args({ 32, 32, 1, 1 })
@@ -132,6 +230,21 @@ BENCHMARK(BM_ZoomEditor)
   ->Args({ 4096, 4096 })
   ->Unit(benchmark::kMicrosecond);
 
+BENCHMARK(BM_RedrawEditor)
+  ->Args({ 256, 256, 0 })
+  ->Args({ 256, 256, 1 })
+  ->Args({ 1024, 1024, 0 })
+  ->Args({ 1024, 1024, 1 })
+  ->Args({ 4096, 4096, 0 })
+  ->Args({ 4096, 4096, 1 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_EditorCacheInvalidation)
+  ->Args({ 256, 256 })
+  ->Args({ 1024, 1024 })
+  ->Args({ 4096, 4096 })
+  ->Unit(benchmark::kMicrosecond);
+
 int app_main(int argc, char* argv[])
 {
   os::SystemRef system(os::make_system());
@@ -18,21 +18,29 @@
 #include "base/exception.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/mapped_file.h"
 #include "base/mem_utils.h"
+#include "base/thread_pool.h"
 #include "dio/aseprite_common.h"
 #include "dio/aseprite_decoder.h"
 #include "dio/decode_delegate.h"
 #include "dio/file_interface.h"
 #include "doc/doc.h"
+#include "doc/lazy_image.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
 #include "ui/alert.h"
 #include "ver/info.h"
 #include "zlib.h"
 
+#include <atomic>
 #include <cstdio>
 #include <deque>
+#include <future>
+#include <memory>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
 #define ASEFILE_TRACE(...) // TRACE(__VA_ARGS__)
 
@@ -88,6 +96,26 @@ public:
     return m_fop->config().cacheCompressedTilesets;
   }
 
+  base::thread_pool* threadPool() override {
+    return &file_thread_pool();
+  }
+
+  std::shared_ptr<base::MappedFile> lazyLoadFile() override {
+    if (!m_fop->config().aseLazyLoadCels || m_fop->isOneFrame())
+      return nullptr;
+
+    // The canonical path is used to know if we are overwriting this
+    // file later (see LazyImage::DetachFile())
+    auto file = std::make_shared<base::MappedFile>();
+    const std::string filename = base::get_canonical_path(m_fop->filename());
+    if (filename.empty() || !file->open(filename))
+      return nullptr;
+
+    doc::LazyImage::SetMemoryLimit(
+      size_t(m_fop->config().aseLazyCelsMemoryLimit) * 1024 * 1024);
+    return file;
+  }
+
 private:
   FileOp* m_fop;
   doc::Sprite* m_sprite;
@@ -144,6 +172,8 @@ public:
 
 } // anonymous namespace
 
+class ImagesCompressor;
+
 static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const Sprite* sprite,
                                     const frame_t firstFrame, const frame_t totalFrames);
 static void ase_file_write_header(FILE* f, dio::AsepriteHeader* header);
@@ -159,6 +189,7 @@ static void ase_file_write_layers(FILE* f, FileOp* fop,
 static layer_t ase_file_write_cels(FILE* f,  FileOp* fop,
                                    dio::AsepriteFrameHeader* frame_header,
                                    const dio::AsepriteExternalFiles& ext_files,
+                                   ImagesCompressor& compressor,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
                                    const frame_t frame);
@@ -173,11 +204,15 @@ static void ase_file_write_color2_chunk(FILE* f, dio::AsepriteFrameHeader* frame
 static void ase_file_write_palette_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Palette* pal, int from, int to);
 static void ase_file_write_layer_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Layer* layer, int child_level);
 static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                     ImagesCompressor& compressor,
                                      const Cel* cel,
                                      const LayerImage* layer,
                                      const layer_t layer_index,
                                      const Sprite* sprite,
                                      const frame_t firstFrame);
+static const Cel* ase_file_get_cel_link(const Cel* cel,
+                                        const LayerImage* layer,
+                                        const frame_t firstFrame);
 static void ase_file_write_cel_extra_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
                                            const Cel* cel);
 static void ase_file_write_color_profile(FILE* f,
@@ -206,12 +241,26 @@ static void ase_file_write_external_files_chunk(FILE* f, FileOp* fop,
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
+                                          ImagesCompressor& compressor,
                                           const Tilesets* tilesets);
 static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const dio::AsepriteExternalFiles& ext_files,
+                                         ImagesCompressor& compressor,
                                          const Tileset* tileset,
                                          const tileset_index si);
+static bool ase_has_cached_compressed_data(const Tileset* tileset);
+static void ase_file_prefetch_tilesets(const Sprite* sprite,
+                                       ImagesCompressor& compressor);
+static void ase_file_prefetch_cels(FileOp* fop,
+                                   const Layer* layer,
+                                   const frame_t frame,
+                                   ImagesCompressor& compressor);
+static void write_compressed_image(FILE* f,
+                                   ScanlinesGen* gen,
+                                   PixelFormat pixelFormat,
+                                   const int level,
+                                   base::buffer* compressedOutput = nullptr);
 static void ase_file_write_properties_maps(FILE* f, FileOp* fop,
                                            const dio::AsepriteExternalFiles& ext_files,
                                             size_t nmaps,
@@ -234,6 +283,158 @@ private:
   dio::AsepriteChunk m_chunk;
 };
 
+// Compresses cel images and tilesets in the worker threads of the
+// given pool before the writer thread needs them. prefetch() must be
+// called in the same order the images are written in the file, then
+// write() waits for the compressed data of each image (or compresses
+// it if no worker has started it yet). The output is exactly the same
+// as compressing each image in the writer thread.
+//
+// Prefetched images are referenced until they are written, so the
+// caller should stop prefetching images when isFull() returns true
+// (e.g. to avoid decoding all lazy images at the same time).
+class ImagesCompressor {
+public:
+  ImagesCompressor(base::thread_pool& pool, const int level)
+    : m_pool(pool)
+    , m_level(level)
+    , m_maxScheduled(2*int(pool.size())) {
+  }
+
+  ~ImagesCompressor() {
+    // Wait the jobs that the workers are compressing right now (the
+    // other ones will be ignored as we mark them as "taken").
+    for (auto& it : m_jobs) {
+      Job* job = it.second.get();
+      if (job->scheduled && job->taken.exchange(true))
+        job->ready.wait();
+    }
+  }
+
+  void prefetch(const ImageConstRef& image) {
+    add(image.get(), std::make_unique<ImageScanlines>(image.get()),
+        image->pixelFormat(), image);
+  }
+
+  void prefetch(const Tileset* tileset) {
+    add(tileset, std::make_unique<TilesetScanlines>(tileset),
+        tileset->sprite()->pixelFormat());
+  }
+
+  // True if there are enough images waiting to be written.
+  bool isFull() const {
+    return int(m_jobs.size()) >= 2*m_maxScheduled;
+  }
+
+  // Writes the compressed pixels of "key" (the Image or Tileset used
+  // in prefetch()).
+  void write(FILE* f,
+             const void* key,
+             ScanlinesGen* gen,
+             const PixelFormat pixelFormat,
+             base::buffer* compressedOutput = nullptr) {
+    std::shared_ptr<Job> job;
+    auto it = m_jobs.find(key);
+    if (it != m_jobs.end()) {
+      job = it->second;
+      m_jobs.erase(it);
+      if (job->scheduled)
+        --m_scheduled;
+    }
+
+    // Compress the image right now if it wasn't prefetched or no
+    // worker thread has started with it.
+    if (!job || !job->taken.exchange(true)) {
+      write_compressed_image(f, gen, pixelFormat, m_level, compressedOutput);
+    }
+    else {
+      job->ready.get();         // Re-throws compression errors
+
+      const base::buffer& data = job->data;
+      if (!data.empty() &&
+          ((fwrite(&data[0], 1, data.size(), f) != data.size()) || ferror(f)))
+        throw base::Exception("Error writing compressed image pixels.\n");
+
+      if (compressedOutput)
+        *compressedOutput = std::move(job->data);
+    }
+
+    schedule();
+  }
+
+private:
+  struct Job {
+    std::unique_ptr<ScanlinesGen> gen;
+    ImageConstRef image;        // Keeps the prefetched image alive
+    PixelFormat pixelFormat;
+    // Set by the first thread (worker or writer) that compresses it
+    std::atomic<bool> taken { false };
+    bool scheduled = false;
+    base::buffer data;
+    std::promise<void> done;
+    std::future<void> ready = done.get_future();
+  };
+
+  void add(const void* key,
+           std::unique_ptr<ScanlinesGen>&& gen,
+           const PixelFormat pixelFormat,
+           const ImageConstRef& image = nullptr) {
+    if (m_jobs.find(key) != m_jobs.end())
+      return;
+
+    auto job = std::make_shared<Job>();
+    job->gen = std::move(gen);
+    job->image = image;
+    job->pixelFormat = pixelFormat;
+    m_jobs[key] = job;
+    m_queue.push_back(job);
+    schedule();
+  }
+
+  // Starts jobs in worker threads (keeping a limited number of
+  // compressed buffers in memory).
+  void schedule() {
+    while (m_scheduled < m_maxScheduled && !m_queue.empty()) {
+      std::shared_ptr<Job> job = m_queue.front();
+      m_queue.pop_front();
+      if (job->taken)
+        continue;
+
+      job->scheduled = true;
+      ++m_scheduled;
+      m_pool.execute([job, level = m_level]{
+        if (job->taken.exchange(true))
+          return;
+        try {
+          write_compressed_image(nullptr, job->gen.get(), job->pixelFormat,
+                                 level, &job->data);
+          job->done.set_value();
+        }
+        catch (...) {
+          job->done.set_exception(std::current_exception());
+        }
+      });
+    }
+  }
+
+  base::thread_pool& m_pool;
+  const int m_level;
+  const int m_maxScheduled;
+  int m_scheduled = 0;
+  std::unordered_map<const void*, std::shared_ptr<Job>> m_jobs;
+  std::deque<std::shared_ptr<Job>> m_queue;
+};
+
+// Converts the preferences value to the zlib compression level.
+static int ase_zlib_compression_level(const gen::CompressionLevel level)
+{
+  switch (level) {
+    case gen::CompressionLevel::FAST: return Z_BEST_SPEED;
+    case gen::CompressionLevel::BEST: return Z_BEST_COMPRESSION;
+    default:                          return Z_DEFAULT_COMPRESSION;
+  }
+}
+
 class AseFormat : public FileFormat {
 
   const char* onGetName() const override {
@@ -360,6 +561,19 @@ bool AseFormat::onSave(FileOp* fop)
                           fop->roi().frames());
   ase_file_write_header(f, &header);
 
+  // Start compressing cels and tilesets in worker threads
+  ImagesCompressor compressor(
+    file_thread_pool(),
+    ase_zlib_compression_level(fop->config().aseCompressionLevel));
+  ase_file_prefetch_tilesets(sprite, compressor);
+
+  // Cels are prefetched in a limited window of images from the frame
+  // that we're writing (see ImagesCompressor::isFull())
+  std::vector<frame_t> frames;
+  for (frame_t frame : fop->roi().framesSequence())
+    frames.push_back(frame);
+  int prefetchedFrames = 0;
+
   bool require_new_palette_chunk = false;
   for (Palette* pal : sprite->getPalettes()) {
     if (pal->size() > 256 || pal->hasAlpha()) {
@@ -372,6 +586,12 @@ bool AseFormat::onSave(FileOp* fop)
   int outputFrame = 0;
   dio::AsepriteExternalFiles ext_files;
   for (frame_t frame : fop->roi().framesSequence()) {
+    while (prefetchedFrames < int(frames.size()) &&
+           (prefetchedFrames <= outputFrame || !compressor.isFull())) {
+      ase_file_prefetch_cels(fop, sprite->root(),
+                             frames[prefetchedFrames++], compressor);
+    }
+
     // Prepare the frame header
     dio::AsepriteFrameHeader frame_header;
     ase_file_prepare_frame_header(f, &frame_header);
@@ -416,7 +636,7 @@ bool AseFormat::onSave(FileOp* fop)
 
       // Write tilesets
       ase_file_write_tileset_chunks(f, fop, &frame_header, ext_files,
-                                    sprite->tilesets());
+                                    compressor, sprite->tilesets());
 
       // Writer frame tags
       if (sprite->tags().size() > 0) {
@@ -446,7 +666,7 @@ bool AseFormat::onSave(FileOp* fop)
 
     // Write cel chunks
     ase_file_write_cels(f, fop, &frame_header, ext_files,
-                        sprite, sprite->root(),
+                        compressor, sprite, sprite->root(),
                         0, frame);
 
     // Write the frame header
@@ -593,6 +813,7 @@ static void ase_file_write_layers(FILE* f, FileOp* fop,
 static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
                                    dio::AsepriteFrameHeader* frame_header,
                                    const dio::AsepriteExternalFiles& ext_files,
+                                   ImagesCompressor& compressor,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
                                    const frame_t frame)
@@ -600,7 +821,7 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
   if (layer->isImage()) {
     const Cel* cel = layer->cel(frame);
     if (cel) {
-      ase_file_write_cel_chunk(f, frame_header, cel,
+      ase_file_write_cel_chunk(f, frame_header, compressor, cel,
                                static_cast<const LayerImage*>(layer),
                                layer_index, sprite, fop->roi().fromFrame());
 
@@ -621,14 +842,51 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
   if (layer->isGroup()) {
     for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers()) {
       layer_index =
-        ase_file_write_cels(f, fop, frame_header, ext_files, sprite, child,
-                            layer_index, frame);
+        ase_file_write_cels(f, fop, frame_header, ext_files, compressor,
+                            sprite, child, layer_index, frame);
     }
   }
 
   return layer_index;
 }
 
+// Enqueues the images to compress in the same order that
+// AseFormat::onSave() writes them: first the embedded tilesets (in
+// the first frame), and then the cels of each frame (with
+// ase_file_prefetch_cels()).
+static void ase_file_prefetch_tilesets(const Sprite* sprite,
+                                       ImagesCompressor& compressor)
+{
+  for (const Tileset* tileset : *sprite->tilesets()) {
+    if (tileset &&
+        tileset->externalFilename().empty() &&
+        !ase_has_cached_compressed_data(tileset)) {
+      compressor.prefetch(tileset);
+    }
+  }
+}
+
+static void ase_file_prefetch_cels(FileOp* fop,
+                                   const Layer* layer,
+                                   const frame_t frame,
+                                   ImagesCompressor& compressor)
+{
+  if (layer->isImage()) {
+    const Cel* cel = layer->cel(frame);
+    if (cel &&
+        !ase_file_get_cel_link(cel, static_cast<const LayerImage*>(layer),
+                               fop->roi().fromFrame())) {
+      if (ImageConstRef image = cel->imageConstRef())
+        compressor.prefetch(image);
+    }
+  }
+
+  if (layer->isGroup()) {
+    for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers())
+      ase_file_prefetch_cels(fop, child, frame, compressor);
+  }
+}
+
 static void ase_file_write_padding(FILE* f, int bytes)
 {
   for (int c=0; c<bytes; c++)
@@ -873,9 +1131,12 @@ static void write_raw_image(FILE* f, ScanlinesGen* gen, PixelFormat pixelFormat)
 // Compressed Image
 //////////////////////////////////////////////////////////////////////
 
+// If "f" is nullptr, the compressed data is only stored in
+// "compressedOutput".
 template<typename ImageTraits>
 static void write_compressed_image_templ(FILE* f,
                                          ScanlinesGen* gen,
+                                         const int level,
                                          base::buffer* compressedOutput)
 {
   PixelIO<ImageTraits> pixel_io;
@@ -885,7 +1146,7 @@ static void write_compressed_image_templ(FILE* f,
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, level);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
@@ -914,8 +1175,9 @@ static void write_compressed_image_templ(FILE* f,
 
       int output_bytes = compressed.size() - zstream.avail_out;
       if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
+        if (f &&
+            ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
+             || ferror(f)))
           throw base::Exception("Error writing compressed image pixels.\n");
 
         // Save the whole compressed buffer to re-use in following
@@ -940,23 +1202,24 @@ static void write_compressed_image_templ(FILE* f,
 static void write_compressed_image(FILE* f,
                                    ScanlinesGen* gen,
                                    PixelFormat pixelFormat,
-                                   base::buffer* compressedOutput = nullptr)
+                                   const int level,
+                                   base::buffer* compressedOutput)
 {
   switch (pixelFormat) {
     case IMAGE_RGB:
-      write_compressed_image_templ<RgbTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<RgbTraits>(f, gen, level, compressedOutput);
       break;
 
     case IMAGE_GRAYSCALE:
-      write_compressed_image_templ<GrayscaleTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<GrayscaleTraits>(f, gen, level, compressedOutput);
       break;
 
     case IMAGE_INDEXED:
-      write_compressed_image_templ<IndexedTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<IndexedTraits>(f, gen, level, compressedOutput);
       break;
 
     case IMAGE_TILEMAP:
-      write_compressed_image_templ<TilemapTraits>(f, gen, compressedOutput);
+      write_compressed_image_templ<TilemapTraits>(f, gen, level, compressedOutput);
       break;
   }
 }
@@ -965,15 +1228,12 @@ static void write_compressed_image(FILE* f,
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
-static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
-                                     const Cel* cel,
-                                     const LayerImage* layer,
-                                     const layer_t layer_index,
-                                     const Sprite* sprite,
-                                     const frame_t firstFrame)
+// Returns the cel that "cel" must be linked to in the file (or
+// nullptr if the cel must be saved with its own image).
+static const Cel* ase_file_get_cel_link(const Cel* cel,
+                                        const LayerImage* layer,
+                                        const frame_t firstFrame)
 {
-  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
-
   const Cel* link = cel->link();
 
   // In case the original link is outside the ROI, we've to find the
@@ -988,6 +1248,20 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
     if (link == cel)
       link = nullptr;
   }
+  return link;
+}
+
+static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                     ImagesCompressor& compressor,
+                                     const Cel* cel,
+                                     const LayerImage* layer,
+                                     const layer_t layer_index,
+                                     const Sprite* sprite,
+                                     const frame_t firstFrame)
+{
+  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
+
+  const Cel* link = ase_file_get_cel_link(cel, layer, firstFrame);
 
   int cel_type = (link ? ASE_FILE_LINK_CEL:
                   cel->layer()->isTilemap() ? ASE_FILE_COMPRESSED_TILEMAP:
@@ -1004,7 +1278,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
   switch (cel_type) {
 
     case ASE_FILE_RAW_CEL: {
-      const Image* image = cel->image();
+      const ImageConstRef image = cel->imageConstRef();
 
       if (image) {
         // Width and height
@@ -1012,7 +1286,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
         fputw(image->height(), f);
 
         // Pixel data
-        ImageScanlines scan(image);
+        ImageScanlines scan(image.get());
         write_raw_image(f, &scan, image->pixelFormat());
       }
       else {
@@ -1029,15 +1303,15 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
       break;
 
     case ASE_FILE_COMPRESSED_CEL: {
-      const Image* image = cel->image();
+      const ImageConstRef image = cel->imageConstRef();
       ASSERT(image);
       if (image) {
         // Width and height
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        ImageScanlines scan(image);
-        write_compressed_image(f, &scan, image->pixelFormat());
+        ImageScanlines scan(image.get());
+        compressor.write(f, image.get(), &scan, image->pixelFormat());
       }
       else {
         // Width and height
@@ -1048,7 +1322,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
     }
 
     case ASE_FILE_COMPRESSED_TILEMAP: {
-      const Image* image = cel->image();
+      const ImageConstRef image = cel->imageConstRef();
       ASSERT(image);
       ASSERT(image->pixelFormat() == IMAGE_TILEMAP);
 
@@ -1061,8 +1335,8 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
       fputl(tile_f_dflip, f);
       ase_file_write_padding(f, 10);
 
-      ImageScanlines scan(image);
-      write_compressed_image(f, &scan, IMAGE_TILEMAP);
+      ImageScanlines scan(image.get());
+      compressor.write(f, image.get(), &scan, IMAGE_TILEMAP);
     }
   }
 }
@@ -1413,13 +1687,14 @@ static void ase_file_write_external_files_chunk(
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
+                                          ImagesCompressor& compressor,
                                           const Tilesets* tilesets)
 {
   tileset_index si = 0;
   for (const Tileset* tileset : *tilesets) {
     if (tileset) {
       ase_file_write_tileset_chunk(f, fop, frame_header, ext_files,
-                                   tileset, si);
+                                   compressor, tileset, si);
 
       ase_file_write_user_data_chunk(f, fop, frame_header, ext_files, &tileset->userData());
 
@@ -1433,9 +1708,16 @@ static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
   }
 }
 
+static bool ase_has_cached_compressed_data(const Tileset* tileset)
+{
+  return (!tileset->compressedData().empty() &&
+          tileset->compressedDataVersion() == tileset->version());
+}
+
 static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const dio::AsepriteExternalFiles& ext_files,
+                                         ImagesCompressor& compressor,
                                          const Tileset* tileset,
                                          const tileset_index si)
 {
@@ -1486,8 +1768,7 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
     size_t beg = ftell(f);
 
     // Save the cached tileset compressed data
-    if (!tileset->compressedData().empty() &&
-        tileset->compressedDataVersion() == tileset->version()) {
+    if (ase_has_cached_compressed_data(tileset)) {
       const base::buffer& data = tileset->compressedData();
 
       ASEFILE_TRACE("[%d] saving compressed tileset (%s)\n",
@@ -1508,8 +1789,8 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
       if (fop->config().cacheCompressedTilesets)
         compressedDataPtr = &compressedData;
 
-      write_compressed_image(f, &gen, tileset->sprite()->pixelFormat(),
-                             compressedDataPtr);
+      compressor.write(f, tileset, &gen, tileset->sprite()->pixelFormat(),
+                       compressedDataPtr);
 
       // As we've just compressed the tileset, we can cache this same
       // data (so saving the file again will not need recompressing).
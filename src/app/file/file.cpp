@@ -33,9 +33,11 @@
 #include "app/ui/status_bar.h"
 #include "base/fs.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "dio/detect_format.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
+#include "doc/lazy_image.h"
 #include "fmt/format.h"
 #include "render/quantization.h"
 #include "render/render.h"
@@ -50,6 +52,7 @@
 #include <algorithm>
 #include <cstring>
 #include <cstdarg>
+#include <thread>
 
 namespace app {
 
@@ -165,6 +168,7 @@ public:
     render::Render render;
     render.setNewBlend(m_newBlend);
     render.setBgOptions(render::BgOptions::MakeNone());
+    render.setThreadPool(&file_thread_pool());
     render.renderSprite(
       (needResize ? m_tmpUnscaledRender.get(): dst),
       m_sprite, frame,
@@ -296,6 +300,22 @@ bool format_supports_palette(const std::string& filename)
   return (format && format->support(FILE_SUPPORT_PALETTES));
 }
 
+// Cels loaded on demand from the given file (if it exists) will not
+// depend on it anymore.
+static void detach_lazy_images_from_file(const std::string& filename)
+{
+  const std::string fn = base::get_canonical_path(filename);
+  if (!fn.empty())
+    doc::LazyImage::DetachFile(fn);
+}
+
+base::thread_pool& file_thread_pool()
+{
+  static base::thread_pool pool(
+    std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
 FileOpROI::FileOpROI()
   : m_document(nullptr)
   , m_slice(nullptr)
@@ -998,6 +1018,15 @@ void FileOp::operate(IFileOpProgress* progress)
     //      is already checked in SaveFileBaseCommand::saveDocumentInBackground
     //      and only in UI mode (so the CLI still works)
 
+    // Cels loaded on demand cannot depend on the memory-mapped file
+    // that we might be overwriting now.
+    if (isSequence()) {
+      for (const auto& fn : m_seq.filename_list)
+        detach_lazy_images_from_file(fn);
+    }
+    else
+      detach_lazy_images_from_file(m_filename);
+
     // Save a sequence
     if (isSequence()) {
       ASSERT(m_format->support(FILE_SUPPORT_SEQUENCES));
@@ -1015,6 +1044,7 @@ void FileOp::operate(IFileOpProgress* progress)
       // For each frame in the sprite.
       render::Render render;
       render.setNewBlend(m_config.newBlend);
+      render.setThreadPool(&file_thread_pool());
 
       frame_t outputFrame = 0;
       for (frame_t frame : m_roi.framesSequence()) {
@@ -1168,7 +1198,8 @@ void FileOp::postLoad()
         render::create_palette_from_sprite(
           sprite, frame_t(0), sprite->lastFrame(), true,
           nullptr, nullptr, m_config.newBlend,
-          m_config.rgbMapAlgorithm));
+          m_config.rgbMapAlgorithm, true,
+          &file_thread_pool()));
 
       sprite->resetPalettes();
       sprite->setPalette(palette.get(), false);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -35,6 +35,10 @@
 #define FILE_LOAD_DATA_FILE             0x00000020
 #define FILE_LOAD_CREATE_PALETTE        0x00000040
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Tag;
 }
@@ -284,6 +288,9 @@ namespace app {
 
     bool newBlend() const { return m_config.newBlend; }
     const FileOpConfig& config() const { return m_config; }
+    void setAseCompressionLevel(const gen::CompressionLevel level) {
+      m_config.aseCompressionLevel = level;
+    }
 
   private:
     FileOp();                   // Undefined
@@ -368,6 +375,10 @@ namespace app {
   // Returns true if the given file format supports palette/s
   bool format_supports_palette(const std::string& filename);
 
+  // Thread pool shared by all file operations to process heavy data
+  // in parallel (e.g. render big frames in tiles, compress cels, etc.).
+  base::thread_pool& file_thread_pool();
+
 } // namespace app
 
 #endif
@@ -27,6 +27,9 @@ void FileOpConfig::fillFromPreferences()
   rgbMapAlgorithm = pref.quantization.rgbmapAlgorithm();
   fitCriteria = pref.quantization.fitCriteria();
   cacheCompressedTilesets = pref.tileset.cacheCompressedTilesets();
+  aseCompressionLevel = pref.ase.compressionLevel();
+  aseLazyLoadCels = pref.ase.lazyLoadCels();
+  aseLazyCelsMemoryLimit = pref.ase.lazyCelsMemoryLimit();
 }
 
 } // namespace app
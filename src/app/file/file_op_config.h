@@ -47,6 +47,16 @@ namespace app {
     // compressed data that was loaded as-is).
     bool cacheCompressedTilesets = true;
 
+    // zlib compression level used for cels and tilesets in .aseprite
+    // files (fast saves bigger files).
+    app::gen::CompressionLevel aseCompressionLevel = app::gen::CompressionLevel::DEFAULT;
+
+    // Load cel images of .aseprite files on demand (from the
+    // memory-mapped file) keeping at most "aseLazyCelsMemoryLimit"
+    // MB of unmodified decoded images in memory.
+    bool aseLazyLoadCels = false;
+    int aseLazyCelsMemoryLimit = 512;
+
     void fillFromPreferences();
   };
 
@@ -0,0 +1,139 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/file/file_op_queue.h"
+
+#include "app/console.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "base/debug.h"
+#include "dio/detect_format.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+
+namespace app {
+
+static FileOpQueue* g_instance = nullptr;
+
+struct FileOpQueue::Item {
+  std::unique_ptr<Doc> doc;
+  std::unique_ptr<FileOp> fop;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+};
+
+FileOpQueue::FileOpQueue(const int jobs)
+  : m_jobs(std::max(1, jobs))
+  , m_pool(m_jobs)
+  , m_prevInstance(g_instance)
+{
+  g_instance = this;
+}
+
+FileOpQueue::~FileOpQueue()
+{
+  waitAll();
+
+  ASSERT(g_instance == this);
+  g_instance = m_prevInstance;
+}
+
+// static
+FileOpQueue* FileOpQueue::instance()
+{
+  return g_instance;
+}
+
+// static
+bool FileOpQueue::canSaveCopy(const Doc* doc,
+                              const std::string& filename)
+{
+  // Formats that save layers (i.e. .aseprite files) need data that
+  // is not copied by Doc::duplicate() (e.g. tilesets, user data)
+  FileFormat* format =
+    FileFormatsManager::instance()->getFileFormat(
+      dio::detect_format_by_file_extension(filename));
+  if (!format || format->support(FILE_SUPPORT_LAYERS))
+    return false;
+
+  // Doc::duplicate() doesn't support tilemaps
+  for (const doc::Layer* layer : doc->sprite()->allLayers()) {
+    if (layer->isTilemap())
+      return false;
+  }
+  return true;
+}
+
+void FileOpQueue::add(std::unique_ptr<Doc>&& doc,
+                      std::unique_ptr<FileOp>&& fop)
+{
+  ASSERT(doc);
+  ASSERT(fop);
+
+  while (int(m_items.size()) >= m_jobs)
+    finishFirstItem();
+
+  auto item = std::make_shared<Item>();
+  item->doc = std::move(doc);
+  item->fop = std::move(fop);
+  m_items.push_back(item);
+
+  m_pool.execute(
+    [item]{
+      FileOp* fop = item->fop.get();
+      try {
+        fop->operate(nullptr);
+      }
+      catch (const std::exception& e) {
+        fop->setError("Error saving file:\n%s", e.what());
+      }
+      fop->done();
+
+      std::unique_lock lock(item->mutex);
+      item->done = true;
+      item->cv.notify_one();
+    });
+}
+
+void FileOpQueue::waitAll()
+{
+  while (!m_items.empty())
+    finishFirstItem();
+}
+
+void FileOpQueue::finishFirstItem()
+{
+  ASSERT(!m_items.empty());
+  std::shared_ptr<Item> item = m_items.front();
+  m_items.pop_front();
+
+  {
+    std::unique_lock lock(item->mutex);
+    item->cv.wait(lock, [&item]{ return item->done; });
+  }
+
+  if (item->fop->hasError()) {
+    Console console;
+    console.printf(item->fop->error().c_str());
+  }
+
+  // The document copy is destroyed in the main thread
+  item->fop.reset();
+  item->doc.reset();
+}
+
+} // namespace app
@@ -0,0 +1,71 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_FILE_OP_QUEUE_H_INCLUDED
+#define APP_FILE_FILE_OP_QUEUE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/thread_pool.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace app {
+  class Doc;
+  class FileOp;
+
+  // Saves several files in parallel using worker threads (used by
+  // the --jobs option in batch mode). Each file is saved from its own
+  // copy of the document, so the original document can be modified
+  // (e.g. to show the next layer in --split-layers) while the file is
+  // being saved.
+  //
+  // At most "jobs" files are saved at the same time (which limits the
+  // memory used by document copies), and the result of each file
+  // operation (errors) is reported in the same order the files were
+  // added, so the output is the same as saving them one by one.
+  //
+  // While the queue exists, it's available through
+  // FileOpQueue::instance() to the save commands.
+  class FileOpQueue {
+  public:
+    FileOpQueue(const int jobs);
+    ~FileOpQueue();
+
+    static FileOpQueue* instance();
+
+    // Returns true if the given document can be saved in the given
+    // file from a copy of the document (see Doc::duplicate()).
+    static bool canSaveCopy(const Doc* doc,
+                            const std::string& filename);
+
+    // Saves the "doc" copy with the given "fop" in a worker thread.
+    // If there are already "jobs" files being saved, it waits the
+    // oldest one to finish.
+    void add(std::unique_ptr<Doc>&& doc,
+             std::unique_ptr<FileOp>&& fop);
+
+    // Waits all the files to be saved (e.g. before running a script
+    // that could use the saved files).
+    void waitAll();
+
+  private:
+    struct Item;
+    void finishFirstItem();
+
+    const int m_jobs;
+    base::thread_pool m_pool;
+    std::deque<std::shared_ptr<Item>> m_items;
+    FileOpQueue* m_prevInstance;
+
+    DISABLE_COPYING(FileOpQueue);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,103 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_op_queue.h"
+#include "base/fs.h"
+#include "doc/doc.h"
+#include "fmt/format.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+static std::unique_ptr<Doc> make_random_doc(const int w, const int h)
+{
+  std::unique_ptr<Doc> doc(
+    new Doc(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h))));
+
+  Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  std::srand(w*h);
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel_fast<RgbTraits>(image, x, y,
+                                rgba(std::rand()%256, std::rand()%256,
+                                     std::rand()%256, 255));
+  return doc;
+}
+
+// Saves big files that take some time and small files that fail
+// quickly in parallel. The errors must be reported in the same order
+// the files were added, not in the order the worker threads finish.
+TEST(FileOpQueue, ReportErrorsInOrder)
+{
+  app::Context ctx;
+
+  // A regular file used as a directory makes the save operation fail
+  const std::string blocker = "file_op_queue_blocker";
+  std::ofstream(blocker) << "x";
+
+  std::vector<std::string> okFiles;
+  std::vector<std::string> failFiles;
+
+  testing::internal::CaptureStdout();
+  {
+    FileOpQueue queue(4);
+    for (int i=0; i<8; ++i) {
+      std::unique_ptr<Doc> doc;
+      std::string fn;
+      if ((i & 1) == 0) {
+        doc = make_random_doc(1024, 1024);
+        fn = fmt::format("file_op_queue_ok{}.png", i);
+        okFiles.push_back(fn);
+      }
+      else {
+        doc = make_random_doc(4, 4);
+        fn = base::join_path(blocker, fmt::format("fail{}.png", i));
+        failFiles.push_back(fn);
+      }
+
+      FileOpROI roi(doc.get(), doc->sprite()->bounds(), "", "",
+                    FramesSequence(), false);
+      std::unique_ptr<FileOp> fop(
+        FileOp::createSaveDocumentOperation(&ctx, roi, fn, "", false));
+      ASSERT_TRUE(fop != nullptr);
+      ASSERT_FALSE(fop->hasError());
+
+      queue.add(std::move(doc), std::move(fop));
+    }
+    queue.waitAll();
+  }
+  const std::string output = testing::internal::GetCapturedStdout();
+
+  std::string::size_type prevPos = 0;
+  for (const std::string& fn : failFiles) {
+    const auto pos = output.find(fn);
+    ASSERT_NE(std::string::npos, pos) << fn << " not in:\n" << output;
+    EXPECT_LE(prevPos, pos) << fn << " reported out of order:\n" << output;
+    prevPos = pos;
+  }
+
+  for (const std::string& fn : okFiles) {
+    EXPECT_TRUE(base::is_file(fn)) << fn;
+    std::unique_ptr<Doc> doc(load_document(&ctx, fn));
+    ASSERT_TRUE(doc != nullptr) << fn;
+    EXPECT_EQ(1024, doc->sprite()->width());
+    EXPECT_EQ(1024, doc->sprite()->height());
+    doc->close();
+    base::delete_file(fn);
+  }
+  base::delete_file(blocker);
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,6 +23,7 @@
 #include "app/util/autocrop.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "doc/octree_map.h"
 #include "gfx/clip.h"
@@ -35,6 +36,9 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <deque>
+#include <future>
+#include <mutex>
 
 #include <gif_lib.h>
 
@@ -918,6 +922,17 @@ bool GifFormat::onLoad(FileOp* fop)
 
 #ifdef ENABLE_SAVE
 
+// Executes the given function in the thread pool and returns a
+// future to get its result.
+template<typename T, typename Func>
+static std::future<T> run_in_pool(base::thread_pool& pool, Func&& func)
+{
+  auto task = std::make_shared<std::packaged_task<T()>>(std::forward<Func>(func));
+  std::future<T> future = task->get_future();
+  pool.execute([task]{ (*task)(); });
+  return future;
+}
+
 // Our stragegy to encode GIF files depends of the sprite color mode:
 //
 // 1) If the sprite is indexed, we have two paths:
@@ -950,6 +965,32 @@ class GifEncoder {
 public:
   typedef int gifframe_t;
 
+private:
+  // Result of quantizeFrame(): the indexed image of a frame and how
+  // to convert its pixels to the GIF colormap.
+  struct QuantizedFrame {
+    ImageRef image;
+    Remap remap = Remap(256);
+    int transparentIndex = -1;
+    // Palette used to create a local colormap for this frame (when
+    // we don't use the global colormap)
+    Palette localPalette;
+    bool hasLocalPalette = false;
+  };
+
+  // Frame that is being quantized in a worker thread and waits to be
+  // written in the GIF file.
+  struct PendingFrame {
+    gifframe_t gifFrame;
+    frame_t frame;
+    gfx::Rect frameBounds;
+    DisposalMethod disposal;
+    bool fixDuration;
+    std::future<QuantizedFrame> quantized;
+  };
+
+public:
+
   GifEncoder(FileOp* fop, GifFileType* gifFile)
     : m_fop(fop)
     , m_gifFile(gifFile)
@@ -1071,7 +1112,8 @@ public:
           nullptr,
           m_fop->newBlend(),
           RgbMapAlgorithm::OCTREE, // TODO configurable?
-          false); // Do not add the transparent color yet
+          false, // Do not add the transparent color yet
+          &file_thread_pool());
 
         m_transparentIndex = 0;
         m_globalColormapPalette = newPalette;
@@ -1104,47 +1146,107 @@ public:
     m_currentImage = m_images[1].get();
     m_nextImage = m_images[2].get();
 
-    auto frame_beg = m_fop->roi().framesSequence().begin();
-#if _DEBUG
-    auto frame_end = m_fop->roi().framesSequence().end();
-#endif
-    auto frame_it = frame_beg;
-
     // In this code "gifFrame" will be the GIF frame, and "frame" will
     // be the doc::Sprite frame.
-    gifframe_t nframes = totalFrames();
-    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
-      ASSERT(frame_it != frame_end);
-      frame_t frame = *frame_it;
-      ++frame_it;
-
-      if (gifFrame == 0)
-        renderFrame(frame, m_nextImage);
-      else
-        std::swap(m_previousImage, m_currentImage);
-
-      // Render next frame
-      std::swap(m_currentImage, m_nextImage);
-      if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
+    const std::vector<frame_t> frames(m_fop->roi().framesSequence().begin(),
+                                      m_fop->roi().framesSequence().end());
+    const gifframe_t nframes = totalFrames();
+    ASSERT(gifframe_t(frames.size()) == nframes);
+
+    // The encoder works as a pipeline: upcoming frames are rendered
+    // in worker threads, the delta image/disposal method of each frame
+    // is calculated in order (as it depends on the previous frame),
+    // then the palette/pixels of each frame are quantized in worker
+    // threads, and finally frames are written in order in this
+    // thread. So the output is the same as encoding frames one by one.
+    base::thread_pool& pool = file_thread_pool();
+    const int maxFramesAhead = std::clamp(int(pool.size()), 2, 8);
+    // Frames are rendered one at a time (see renderFrame()), so we
+    // don't need to render too many frames ahead.
+    const int maxRenderedAhead = 2;
+    std::deque<std::future<ImageRef>> renderedFrames;
+    std::deque<PendingFrame> pendingFrames;
+    gifframe_t nextFrameToRender = 0;
+
+    auto renderNextFrame = [&](Image* dst) {
+      while (nextFrameToRender < nframes &&
+             int(renderedFrames.size()) < maxRenderedAhead) {
+        const frame_t frame = frames[nextFrameToRender++];
+        renderedFrames.push_back(
+          run_in_pool<ImageRef>(pool, [this, frame]{
+            return renderFrame(frame);
+          }));
+      }
 
-      gfx::Rect frameBounds = m_spriteBounds;
-      DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+      ASSERT(!renderedFrames.empty());
+      std::future<ImageRef> rendered = std::move(renderedFrames.front());
+      renderedFrames.pop_front();
+      ImageRef image = rendered.get();
+      copy_image(dst, image.get(), 0, 0);
+    };
 
-      // Creation of the deltaImage (difference image result respect
-      // to current VS previous frame image).  At the same time we
-      // must scan the next image, to check if some pixel turns to
-      // transparent (0), if the case, we need to force disposal
-      // method of the current image to RESTORE_BG.  Further, at the
-      // same time, we must check if we can go without color zero (0).
+    auto writeFirstPendingFrame = [&]() {
+      PendingFrame pending = std::move(pendingFrames.front());
+      pendingFrames.pop_front();
+      writeImage(pending, pending.quantized.get());
+      m_fop->setProgress(double(pending.gifFrame+1) / double(nframes));
+    };
 
-      calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
+    try {
+      for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
+        const frame_t frame = frames[gifFrame];
 
-      writeImage(gifFrame, frame, frameBounds, disposal,
-                 // Only the last frame in the animation needs the fix
-                 (fix_last_frame_duration && gifFrame == nframes-1));
+        if (gifFrame == 0)
+          renderNextFrame(m_nextImage);
+        else
+          std::swap(m_previousImage, m_currentImage);
+
+        // Render next frame
+        std::swap(m_currentImage, m_nextImage);
+        if (gifFrame+1 < nframes)
+          renderNextFrame(m_nextImage);
+
+        gfx::Rect frameBounds = m_spriteBounds;
+        DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+
+        // Creation of the deltaImage (difference image result respect
+        // to current VS previous frame image).  At the same time we
+        // must scan the next image, to check if some pixel turns to
+        // transparent (0), if the case, we need to force disposal
+        // method of the current image to RESTORE_BG.  Further, at the
+        // same time, we must check if we can go without color zero (0).
+
+        calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
+
+        PendingFrame pending;
+        pending.gifFrame = gifFrame;
+        pending.frame = frame;
+        pending.frameBounds = frameBounds;
+        pending.disposal = disposal;
+        // Only the last frame in the animation needs the fix
+        pending.fixDuration = (fix_last_frame_duration && gifFrame == nframes-1);
+
+        std::shared_ptr<Image> deltaImage(m_deltaImage.release());
+        pending.quantized =
+          run_in_pool<QuantizedFrame>(pool, [this, deltaImage, frameBounds]{
+            return quantizeFrame(deltaImage.get(), frameBounds);
+          });
+        pendingFrames.push_back(std::move(pending));
+
+        while (int(pendingFrames.size()) > maxFramesAhead)
+          writeFirstPendingFrame();
+      }
 
-      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      while (!pendingFrames.empty())
+        writeFirstPendingFrame();
+    }
+    catch (...) {
+      // Wait the jobs that are still running (they use this encoder)
+      for (auto& rendered : renderedFrames)
+        rendered.wait();
+      for (auto& pending : pendingFrames)
+        pending.quantized.wait();
+      throw;
     }
     return true;
   }
@@ -1366,35 +1468,44 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Converts the given delta image to an indexed image with its own
+  // palette (or the global one). This is called from worker threads,
+  // so it cannot modify the encoder state.
+  QuantizedFrame quantizeFrame(const Image* deltaImage,
+                               const gfx::Rect& frameBounds) const {
+    QuantizedFrame result;
+    int transparentIndex = m_transparentIndex;
+
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(deltaImage, transparentIndex);
+
+    if (m_preservePaletteOrder) {
+      result.image.reset(Image::createCopy(deltaImage));
+      result.transparentIndex = transparentIndex;
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
+        result.remap.map(i, i);
+      return result;
+    }
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
+    octree.regenerateMap(&framePalette, transparentIndex);
     ImageRef frameImage(Image::create(IMAGE_INDEXED,
                                       frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+                                      frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = result.remap;
 
-    if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
+    {
+      const LockImageBits<RgbTraits> srcBits(deltaImage);
       LockImageBits<IndexedTraits> dstBits(frameImage.get());
 
       auto srcIt = srcBits.begin();
@@ -1414,13 +1525,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1437,40 +1548,52 @@ private:
           *dstIt = i;
         }
       }
+    }
 
-      int usedNColors = usedColors.picks();
+    int usedNColors = usedColors.picks();
 
-      for (int i=0; i<remap.size(); ++i)
-        remap.map(i, i);
+    for (int i=0; i<remap.size(); ++i)
+      remap.map(i, i);
 
-      if (!colormap) {
-        Palette reducedPalette(0, usedNColors);
+    if (!m_globalColormap) {
+      // The colormap of this palette is created in writeImage()
+      result.localPalette = Palette(0, usedNColors);
 
-        for (int i=0, j=0; i<framePalette.size(); ++i) {
-          if (usedColors[i]) {
-            reducedPalette.setEntry(j, framePalette.getEntry(i));
-            remap.map(i, j);
-            ++j;
-          }
+      for (int i=0, j=0; i<framePalette.size(); ++i) {
+        if (usedColors[i]) {
+          result.localPalette.setEntry(j, framePalette.getEntry(i));
+          remap.map(i, j);
+          ++j;
         }
-
-        colormap = createColorMap(&reducedPalette);
-        if (localTransparent >= 0)
-          localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
-    }
-    else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
-        remap.map(i, i);
+      result.hasLocalPalette = true;
+      if (localTransparent >= 0)
+        localTransparent = remap[localTransparent];
     }
 
+    if (localTransparent >= 0 && transparentIndex != localTransparent)
+      remap.map(transparentIndex, localTransparent);
+
+    result.image = frameImage;
+    result.transparentIndex = localTransparent;
+    return result;
+  }
+
+  void writeImage(const PendingFrame& pending,
+                  const QuantizedFrame& quantized) {
+    const gifframe_t gifFrame = pending.gifFrame;
+    const gfx::Rect& frameBounds = pending.frameBounds;
+    const Image* frameImage = quantized.image.get();
+    const Remap& remap = quantized.remap;
+
+    ColorMapObject* colormap = m_globalColormap;
+    if (quantized.hasLocalPalette)
+      colormap = createColorMap(&quantized.localPalette);
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, pending.frame, quantized.transparentIndex,
+                   pending.disposal, pending.fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1488,8 +1611,8 @@ private:
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y=interlaced_offset[i]; y<frameBounds.h; y+=interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+          IndexedTraits::const_address_t addr =
+            (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
           for (int i=0; i<frameBounds.w; ++i, ++addr)
             scanline[i] = remap[*addr];
@@ -1501,8 +1624,8 @@ private:
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frameBounds.h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+        IndexedTraits::const_address_t addr =
+          (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
         for (int i=0; i<frameBounds.w; ++i, ++addr)
           scanline[i] = remap[*addr];
@@ -1516,9 +1639,10 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  static Palette calculatePalette(const Image* deltaImage,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(deltaImage);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1534,7 +1658,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1544,22 +1668,33 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
 
-  void renderFrame(frame_t frame, Image* dst) {
+  // Renders the given frame in a new image. This is called from
+  // worker threads.
+  ImageRef renderFrame(frame_t frame) {
+    ImageRef dst(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                               m_spriteBounds.w,
+                               m_spriteBounds.h));
     if (m_preservePaletteOrder)
-      clear_image(dst, m_bgIndex);
+      clear_image(dst.get(), m_bgIndex);
     else
-      clear_image(dst, 0);
-    m_img->renderFrame(frame, m_fop->roi().frameBounds(frame), dst);
+      clear_image(dst.get(), 0);
+
+    // FileAbstractImage::renderFrame() uses a temporary image to
+    // resize the output, so we cannot render two frames at the same
+    // time (anyway the rendering itself uses several threads).
+    const std::lock_guard lock(m_renderMutex);
+    m_img->renderFrame(frame, m_fop->roi().frameBounds(frame), dst.get());
+    return dst;
   }
 
 private:
 
-  ColorMapObject* createColorMap(const Palette* palette) {
+  ColorMapObject* createColorMap(const Palette* palette) const {
     int n = 1 << GifBitSizeLimited(palette->size());
     ColorMapObject* colormap = GifMakeMapObject(n, nullptr);
 
@@ -1602,7 +1737,7 @@ private:
   bool m_preservePaletteOrder;
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
+  std::mutex m_renderMutex;
   ImageRef m_images[3];
   Image* m_previousImage;
   Image* m_currentImage;
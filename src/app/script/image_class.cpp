@@ -39,8 +39,11 @@
 #include "render/render.h"
 
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace app {
 namespace script {
@@ -100,6 +103,185 @@ struct ImageObj {
   }
 };
 
+// Returns the rectangle of the image specified in the given argument
+// (clipped to the image bounds) or the whole image bounds if the
+// argument is not specified.
+gfx::Rect get_image_rect_from_arg(lua_State* L, int index, const Image* img)
+{
+  gfx::Rect rc = img->bounds();
+  if (!lua_isnoneornil(L, index))
+    rc &= convert_args_into_rect(L, index);
+  return rc;
+}
+
+// Must be called each time the pixels of the image are modified
+// directly (without a cmd), so the caches that depend on the image
+// version (e.g. doc::TilesetUsage) are updated.
+void image_modified(lua_State* L, ImageObj* obj, Image* img)
+{
+  img->incrementVersion();
+
+  // Rehash tileset
+  if (obj->tilesetId) {
+    if (doc::Tileset* ts = obj->tileset(L)) {
+      ts->incrementVersion();
+      ts->notifyTileContentChange(obj->ti);
+    }
+  }
+}
+
+// Modifies the "rc" area of the image with the given function. If the
+// image is from a cel, the function modifies a copy of the area and
+// then it's copied to the image with undo information.
+template<typename Func>
+void modify_image(lua_State* L, ImageObj* obj,
+                  const gfx::Rect& rc, Func&& func)
+{
+  if (rc.isEmpty())
+    return;
+
+  Image* img = obj->image(L);
+  if (auto cel = obj->cel(L)) {
+    ImageRef tmp(doc::crop_image(img, rc, 0));
+    func(tmp.get(), tmp->bounds());
+
+    Tx tx(cel->sprite());
+    tx(new cmd::CopyRegion(
+         img, tmp.get(), gfx::Region(tmp->bounds()), rc.origin()));
+    tx.commit();
+  }
+  else {
+    func(img, rc);
+    image_modified(L, obj, img);
+  }
+}
+
+using PixelMap = std::unordered_map<doc::color_t, doc::color_t>;
+
+template<typename ImageTraits>
+void map_pixels_templ(Image* img, const gfx::Rect& rc, const PixelMap& map)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  using address_t = typename ImageTraits::address_t;
+
+  // For 8-bit and 16-bit pixels we can use a table with all possible
+  // values, for 32-bit pixels we use the map directly (remembering
+  // the last mapped pixel, as consecutive pixels are usually equal).
+  if constexpr (sizeof(pixel_t) <= 2) {
+    std::vector<pixel_t> table(std::size_t(ImageTraits::max_value)+1);
+    for (std::size_t i=0; i<table.size(); ++i)
+      table[i] = pixel_t(i);
+    for (const auto& [from, to] : map) {
+      if (from < table.size())
+        table[from] = pixel_t(to);
+    }
+
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      auto it = (address_t)img->getPixelAddress(rc.x, y);
+      for (int x=0; x<rc.w; ++x, ++it)
+        *it = table[*it];
+    }
+  }
+  else {
+    bool hasLast = false;
+    pixel_t lastFrom = 0, lastTo = 0;
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      auto it = (address_t)img->getPixelAddress(rc.x, y);
+      for (int x=0; x<rc.w; ++x, ++it) {
+        if (!hasLast || *it != lastFrom) {
+          lastFrom = *it;
+          auto mapIt = map.find(lastFrom);
+          lastTo = (mapIt != map.end() ? pixel_t(mapIt->second): lastFrom);
+          hasLast = true;
+        }
+        *it = lastTo;
+      }
+    }
+  }
+}
+
+template<typename ImageTraits>
+void count_pixels_templ(const Image* img, const gfx::Rect& rc,
+                        std::vector<std::pair<doc::color_t, int>>& result)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  using const_address_t = typename ImageTraits::const_address_t;
+
+  if constexpr (sizeof(pixel_t) <= 2) {
+    std::vector<int> counts(std::size_t(ImageTraits::max_value)+1, 0);
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      auto it = (const_address_t)img->getPixelAddress(rc.x, y);
+      for (int x=0; x<rc.w; ++x, ++it)
+        ++counts[*it];
+    }
+    for (std::size_t i=0; i<counts.size(); ++i) {
+      if (counts[i])
+        result.push_back(std::make_pair(doc::color_t(i), counts[i]));
+    }
+  }
+  else {
+    std::unordered_map<doc::color_t, int> counts;
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      auto it = (const_address_t)img->getPixelAddress(rc.x, y);
+      for (int x=0; x<rc.w; ) {
+        // Count runs of equal pixels with just one map lookup
+        const pixel_t c = *it;
+        int n = 0;
+        for (; x<rc.w && *it == c; ++x, ++it)
+          ++n;
+        counts[c] += n;
+      }
+    }
+    result.assign(counts.begin(), counts.end());
+    std::sort(result.begin(), result.end());
+  }
+}
+
+template<typename ImageTraits>
+bool find_pixel_templ(const Image* img, const gfx::Rect& rc,
+                      const doc::color_t color, gfx::Point& pos)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  using const_address_t = typename ImageTraits::const_address_t;
+
+  const pixel_t c = pixel_t(color);
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    auto beg = (const_address_t)img->getPixelAddress(rc.x, y);
+    auto end = beg + rc.w;
+    auto it = std::find(beg, end, c);
+    if (it != end) {
+      pos = gfx::Point(rc.x + int(it - beg), y);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Look-up table for one channel (red, green, blue, gray, or alpha)
+using ChannelLut = std::array<uint8_t, 256>;
+
+// Gets a channel look-up table from the given field of the table in
+// the "index" argument. Returns false if the field doesn't exist.
+bool get_channel_lut_from_arg(lua_State* L, int index,
+                              const char* channel,
+                              ChannelLut& lut)
+{
+  for (int i=0; i<256; ++i)
+    lut[i] = i;
+
+  bool result = false;
+  if (lua_getfield(L, index, channel) == LUA_TTABLE) {
+    for (int i=0; i<256; ++i) {
+      if (lua_geti(L, -1, i+1) != LUA_TNIL)
+        lut[i] = std::clamp(int(lua_tointeger(L, -1)), 0, 255);
+      lua_pop(L, 1);
+    }
+    result = true;
+  }
+  lua_pop(L, 1);
+  return result;
+}
+
 void render_sprite(Image* dst,
                    const Sprite* sprite,
                    const frame_t frame,
@@ -255,6 +437,7 @@ int Image_clear(lua_State* L)
     color = convert_args_into_pixel_color(L, i, img->pixelFormat());
 
   doc::fill_rect(img, rc, color); // Clips the rectangle to the image bounds
+  image_modified(L, obj, img);
   return 0;
 }
 
@@ -270,14 +453,7 @@ int Image_drawPixel(lua_State* L)
   else
     color = convert_args_into_pixel_color(L, 4, img->pixelFormat());
   doc::put_pixel(img, x, y, color);
-
-  // Rehash tileset
-  if (obj->tilesetId) {
-    if (doc::Tileset* ts = obj->tileset(L)) {
-      ts->incrementVersion();
-      ts->notifyTileContentChange(obj->ti);
-    }
-  }
+  image_modified(L, obj, img);
   return 0;
 }
 
@@ -313,17 +489,22 @@ int Image_drawImage(lua_State* L)
   Image* dst = obj->image(L);
   const Image* src = sprite->image(L);
 
+  // Optional rectangle to draw only a part of the source image
+  const gfx::Rect srcBounds = get_image_rect_from_arg(L, 6 + argsFix, src);
+  if (srcBounds.isEmpty())
+    return 0;
+
   if (auto cel = obj->cel(L)) {
-    gfx::Rect bounds(src->size());
+    gfx::Rect bounds(srcBounds.size());
 
     // Create the ImageBuffer only when it doesn't exist so we can
     // cache the allocated buffer.
     if (!buf)
       buf = std::make_shared<doc::ImageBuffer>();
 
-    ImageRef tmp_src(doc::crop_image(dst, gfx::Rect(pos, src->size()), 0, buf));
+    ImageRef tmp_src(doc::crop_image(dst, gfx::Rect(pos, srcBounds.size()), 0, buf));
     doc::blend_image(tmp_src.get(), src,
-                     gfx::Clip(src->size()),
+                     gfx::Clip(0, 0, srcBounds),
                      cel->sprite()->palette(0),
                      opacity, blendMode);
     // TODO Use something similar to doc::algorithm::shrink_bounds2()
@@ -339,9 +520,10 @@ int Image_drawImage(lua_State* L)
   // the source image without undo information.
   else {
     doc::blend_image(dst, src,
-                     gfx::Clip(pos, src->bounds()),
+                     gfx::Clip(pos, srcBounds),
                      get_current_palette(),
                      opacity, blendMode);
+    image_modified(L, obj, dst);
   }
   return 0;
 }
@@ -376,6 +558,7 @@ int Image_drawSprite(lua_State* L)
   // the source image without undo information.
   else {
     render_sprite(dst, sprite, frame, pos.x, pos.y);
+    image_modified(L, obj, dst);
   }
   return 0;
 }
@@ -397,6 +580,165 @@ int Image_getPixel(lua_State* L)
   return 1;
 }
 
+// Replaces pixels using the given table of pixel values (keys) to
+// new pixel values (integers or Colors), e.g. to swap palettes:
+//   image:mapColors({ [oldPixel]=newPixel, ... } [, rectangle])
+int Image_mapColors(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  const Image* img = obj->image(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  PixelMap map;
+  lua_pushnil(L);
+  while (lua_next(L, 2) != 0) {
+    if (lua_isinteger(L, -2)) {
+      doc::color_t to;
+      if (lua_isinteger(L, -1))
+        to = lua_tointeger(L, -1);
+      else
+        to = convert_args_into_pixel_color(L, lua_absindex(L, -1),
+                                           img->pixelFormat());
+      map[doc::color_t(lua_tointeger(L, -2))] = to;
+    }
+    lua_pop(L, 1);
+  }
+
+  const gfx::Rect rc = get_image_rect_from_arg(L, 3, img);
+  if (map.empty())
+    return 0;
+
+  modify_image(
+    L, obj, rc,
+    [&map](Image* img, const gfx::Rect& rc){
+      switch (img->pixelFormat()) {
+        case IMAGE_RGB:       map_pixels_templ<RgbTraits>(img, rc, map); break;
+        case IMAGE_GRAYSCALE: map_pixels_templ<GrayscaleTraits>(img, rc, map); break;
+        case IMAGE_INDEXED:   map_pixels_templ<IndexedTraits>(img, rc, map); break;
+        case IMAGE_TILEMAP:   map_pixels_templ<TilemapTraits>(img, rc, map); break;
+        default: break;
+      }
+    });
+  return 0;
+}
+
+// Applies a look-up table (an array of 256 values) to each channel:
+//   image:mapChannels({ red={...}, green={...}, blue={...}, alpha={...} } [, rectangle])
+//   image:mapChannels({ gray={...}, alpha={...} } [, rectangle])
+int Image_mapChannels(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  const Image* img = obj->image(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+
+  ChannelLut r, g, b, v, a;
+  bool any = get_channel_lut_from_arg(L, 2, "alpha", a);
+  switch (img->pixelFormat()) {
+    case IMAGE_RGB:
+      any |= get_channel_lut_from_arg(L, 2, "red", r);
+      any |= get_channel_lut_from_arg(L, 2, "green", g);
+      any |= get_channel_lut_from_arg(L, 2, "blue", b);
+      break;
+    case IMAGE_GRAYSCALE:
+      any |= get_channel_lut_from_arg(L, 2, "gray", v);
+      break;
+    default:
+      return luaL_error(L, "mapChannels() is only available for RGB and grayscale images");
+  }
+
+  const gfx::Rect rc = get_image_rect_from_arg(L, 3, img);
+  if (!any)
+    return 0;
+
+  modify_image(
+    L, obj, rc,
+    [&](Image* img, const gfx::Rect& rc){
+      if (img->pixelFormat() == IMAGE_RGB) {
+        for (int y=rc.y; y<rc.y2(); ++y) {
+          auto it = (RgbTraits::address_t)img->getPixelAddress(rc.x, y);
+          for (int x=0; x<rc.w; ++x, ++it) {
+            const doc::color_t c = *it;
+            *it = doc::rgba(r[doc::rgba_getr(c)],
+                            g[doc::rgba_getg(c)],
+                            b[doc::rgba_getb(c)],
+                            a[doc::rgba_geta(c)]);
+          }
+        }
+      }
+      else {
+        for (int y=rc.y; y<rc.y2(); ++y) {
+          auto it = (GrayscaleTraits::address_t)img->getPixelAddress(rc.x, y);
+          for (int x=0; x<rc.w; ++x, ++it) {
+            const doc::color_t c = *it;
+            *it = doc::graya(v[doc::graya_getv(c)],
+                             a[doc::graya_geta(c)]);
+          }
+        }
+      }
+    });
+  return 0;
+}
+
+// Returns a table with the number of pixels of each pixel value:
+//   image:countColors([rectangle]) -> { [pixel]=count, ... }
+int Image_countColors(lua_State* L)
+{
+  const auto obj = get_obj<ImageObj>(L, 1);
+  const Image* img = obj->image(L);
+  const gfx::Rect rc = get_image_rect_from_arg(L, 2, img);
+
+  std::vector<std::pair<doc::color_t, int>> counts;
+  if (!rc.isEmpty()) {
+    switch (img->pixelFormat()) {
+      case IMAGE_RGB:       count_pixels_templ<RgbTraits>(img, rc, counts); break;
+      case IMAGE_GRAYSCALE: count_pixels_templ<GrayscaleTraits>(img, rc, counts); break;
+      case IMAGE_INDEXED:   count_pixels_templ<IndexedTraits>(img, rc, counts); break;
+      case IMAGE_TILEMAP:   count_pixels_templ<TilemapTraits>(img, rc, counts); break;
+      default: break;
+    }
+  }
+
+  lua_createtable(L, 0, int(counts.size()));
+  for (const auto& [color, count] : counts) {
+    lua_pushinteger(L, count);
+    lua_seti(L, -2, color);
+  }
+  return 1;
+}
+
+// Returns the position of the first pixel (from top to bottom, left
+// to right) with the given color, or nil if there is no such pixel:
+//   image:findColor(color [, rectangle]) -> Point or nil
+int Image_findColor(lua_State* L)
+{
+  const auto obj = get_obj<ImageObj>(L, 1);
+  const Image* img = obj->image(L);
+  doc::color_t color;
+  if (lua_isinteger(L, 2))
+    color = lua_tointeger(L, 2);
+  else
+    color = convert_args_into_pixel_color(L, 2, img->pixelFormat());
+  const gfx::Rect rc = get_image_rect_from_arg(L, 3, img);
+
+  gfx::Point pos;
+  bool found = false;
+  if (!rc.isEmpty()) {
+    switch (img->pixelFormat()) {
+      case IMAGE_RGB:       found = find_pixel_templ<RgbTraits>(img, rc, color, pos); break;
+      case IMAGE_GRAYSCALE: found = find_pixel_templ<GrayscaleTraits>(img, rc, color, pos); break;
+      case IMAGE_INDEXED:   found = find_pixel_templ<IndexedTraits>(img, rc, color, pos); break;
+      case IMAGE_TILEMAP:   found = find_pixel_templ<TilemapTraits>(img, rc, color, pos); break;
+      default: break;
+    }
+  }
+
+  if (found)
+    push_obj(L, pos);
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
 int Image_isEqual(lua_State* L)
 {
   auto objA = get_obj<ImageObj>(L, 1);
@@ -642,6 +984,7 @@ int Image_flip(lua_State* L)
   }
   else {
     doc::algorithm::flip_image(img, img->bounds(), flipType);
+    image_modified(L, obj, img);
   }
   return 0;
 }
@@ -684,12 +1027,14 @@ int Image_get_bytes(lua_State* L)
 
 int Image_set_bytes(lua_State* L)
 {
-  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  auto obj = get_obj<ImageObj>(L, 1);
+  const auto img = obj->image(L);
   size_t bytes_size, bytes_needed = img->rowBytes() * img->height();
   const char* bytes = lua_tolstring(L, 2, &bytes_size);
 
   if (bytes_size == bytes_needed) {
     std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    image_modified(L, obj, img);
   }
   else {
     lua_pushfstring(L, "Data size does not match: given %d, needed %d.", bytes_size, bytes_needed);
@@ -749,6 +1094,10 @@ const luaL_Reg Image_methods[] = {
   { "drawImage", Image_drawImage }, { "putImage", Image_drawImage }, // TODO putImage is deprecated
   { "drawSprite", Image_drawSprite }, { "putSprite", Image_drawSprite }, // TODO putSprite is deprecated
   { "pixels", Image_pixels },
+  { "mapColors", Image_mapColors },
+  { "mapChannels", Image_mapChannels },
+  { "countColors", Image_countColors },
+  { "findColor", Image_findColor },
   { "isEqual", Image_isEqual },
   { "isEmpty", Image_isEmpty },
   { "isPlain", Image_isPlain },
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,10 +27,12 @@ namespace {
 
 template<typename ImageTraits>
 struct ImageIteratorObj {
+  doc::Image* image;
   typename doc::LockImageBits<ImageTraits> bits;
   typename doc::LockImageBits<ImageTraits>::iterator begin, next, end;
-  ImageIteratorObj(const doc::Image* image, const gfx::Rect& bounds)
-    : bits(image, bounds),
+  ImageIteratorObj(doc::Image* image, const gfx::Rect& bounds)
+    : image(image),
+      bits(image, bounds),
       begin(bits.begin()),
       next(begin),
       end(bits.end()) {
@@ -63,6 +65,7 @@ int ImageIterator_call(lua_State* L)
   // Set value
   else {
     *obj->begin = lua_tointeger(L, 2);
+    obj->image->incrementVersion();
     return 1;
   }
 }
@@ -137,7 +140,7 @@ static int image_iterator_do_nothing(lua_State* L)
   return 1;
 }
 
-int push_image_iterator_function(lua_State* L, const doc::Image* image, int extraArgIndex)
+int push_image_iterator_function(lua_State* L, doc::Image* image, int extraArgIndex)
 {
   gfx::Rect bounds = image->bounds();
 
@@ -318,6 +318,7 @@ FOR_ENUM(app::gen::BgType)
 FOR_ENUM(app::gen::BrushPreview)
 FOR_ENUM(app::gen::BrushType)
 FOR_ENUM(app::gen::ColorProfileBehavior)
+FOR_ENUM(app::gen::CompressionLevel)
 FOR_ENUM(app::gen::Downsampling)
 FOR_ENUM(app::gen::EyedropperChannel)
 FOR_ENUM(app::gen::EyedropperSample)
@@ -0,0 +1,298 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/cli/app_options.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/site.h"
+#include "app/tilemap_mode.h"
+#include "app/tileset_mode.h"
+#include "app/tools/active_tool.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_box.h"
+#include "app/tools/tool_loop_manager.h"
+#include "app/ui/editor/tool_loop_impl.h"
+#include "base/pi.h"
+#include "doc/brush.h"
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "os/system.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+#ifdef ENABLE_SCRIPTING
+
+namespace {
+
+enum class LayerKind { Rgb, Indexed, Grayscale, Tilemap };
+
+const char* kLayerKindNames[] = { "rgb", "indexed", "grayscale", "tilemap" };
+
+// Tool/ink/brush combination to replay the strokes
+struct ToolCase {
+  const char* name;
+  const char* toolId;
+  tools::InkType inkType;
+  int brushSize;                // 0 means a custom image brush
+  bool pressureSize;            // Brush size depends on pressure
+};
+
+const ToolCase kToolCases[] = {
+  { "pencil",      "pencil",   tools::InkType::SIMPLE,            1,  false },
+  { "brush",       "pencil",   tools::InkType::ALPHA_COMPOSITING, 16, true  },
+  { "image_brush", "pencil",   tools::InkType::SIMPLE,            0,  false },
+  { "shading",     "pencil",   tools::InkType::SHADING,           8,  false },
+  { "blur",        "blur",     tools::InkType::DEFAULT,           16, false },
+  { "jumble",      "jumble",   tools::InkType::DEFAULT,           16, false },
+  { "gradient",    "gradient", tools::InkType::DEFAULT,           1,  false },
+};
+
+Sprite* create_sprite(const LayerKind kind, const int w, const int h)
+{
+  ColorMode colorMode = ColorMode::RGB;
+  switch (kind) {
+    case LayerKind::Indexed:   colorMode = ColorMode::INDEXED; break;
+    case LayerKind::Grayscale: colorMode = ColorMode::GRAYSCALE; break;
+    default: break;
+  }
+
+  if (kind != LayerKind::Tilemap)
+    return Sprite::MakeStdSprite(ImageSpec(colorMode, w, h));
+
+  // Sprite with one tilemap layer of 16x16 tiles (with an empty
+  // tileset, tiles are created automatically when we draw)
+  auto spr = new Sprite(ImageSpec(colorMode, w, h), 256);
+  const Grid grid(gfx::Size(16, 16));
+  spr->tilesets()->add(new Tileset(spr, grid, 1));
+
+  auto layer = new LayerTilemap(spr, 0);
+  spr->root()->addLayer(layer);
+
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP,
+                                 (w+15) / 16,
+                                 (h+15) / 16));
+  clear_image(tilemap.get(), notile);
+  layer->addCel(new Cel(0, tilemap));
+  return spr;
+}
+
+// Creates a brush with a 32x32 image with several colors (like a
+// custom brush picked from the canvas)
+BrushRef create_image_brush(const PixelFormat pixelFormat)
+{
+  const int size = 32;
+  ImageRef image(Image::create(pixelFormat, size, size));
+  for (int y=0; y<size; ++y) {
+    for (int x=0; x<size; ++x) {
+      const int dx = x - size/2;
+      const int dy = y - size/2;
+      const bool inside = (dx*dx + dy*dy < size*size/4);
+      const int v = (x*255/size) ^ (y*255/size);
+      color_t c = 0;
+      if (inside) {
+        switch (pixelFormat) {
+          case IMAGE_RGB:       c = rgba(v, 255-v, 128, 255); break;
+          case IMAGE_GRAYSCALE: c = graya(v, 255); break;
+          case IMAGE_INDEXED:   c = 1 + (v % 255); break;
+          default: break;
+        }
+      }
+      put_pixel(image.get(), x, y, c);
+    }
+  }
+
+  BrushRef brush = std::make_shared<Brush>(kImageBrushType, 1, 0);
+  brush->setImage(image.get(), nullptr);
+  return brush;
+}
+
+// Generates a deterministic pointer stream (like a recorded stroke
+// of a pen tablet) that goes through the whole canvas, with
+// variable pressure and the velocity between samples.
+std::vector<tools::Pointer> create_stroke(const int w, const int h)
+{
+  const int n = 256;
+  std::vector<tools::Pointer> stroke;
+  stroke.reserve(n);
+
+  uint32_t seed = 1;
+  auto jitter = [&seed]() {
+    seed = seed * 1664525 + 1013904223;
+    return int((seed >> 16) % 5) - 2;
+  };
+
+  gfx::Point prev;
+  for (int i=0; i<n; ++i) {
+    const float t = float(i) / float(n-1);
+    const gfx::Point pt(
+      int(w * (0.1f + 0.8f*t)) + jitter(),
+      int(h * (0.5f + 0.3f*std::sin(2.0f * float(PI) * 2.0f * t))) + jitter());
+    const tools::Vec2 velocity = (i == 0 ? tools::Vec2(0.0f, 0.0f):
+                                  tools::Vec2(pt.x - prev.x, pt.y - prev.y));
+    const float pressure = 0.2f + 0.8f*std::sin(float(PI) * t);
+
+    stroke.push_back(tools::Pointer(pt, velocity,
+                                    tools::Pointer::Button::Left,
+                                    tools::Pointer::Type::Pen,
+                                    pressure));
+    prev = pt;
+  }
+  return stroke;
+}
+
+double percentile(std::vector<double>& values, const double p)
+{
+  if (values.empty())
+    return 0.0;
+  const std::size_t i = std::min(values.size()-1,
+                                 std::size_t(p * double(values.size())));
+  std::nth_element(values.begin(), values.begin()+i, values.end());
+  return values[i];
+}
+
+} // anonymous namespace
+
+// Replays a stroke through the ToolLoopManager (intertwiners, point
+// shapes, and inks) with the given tool on the given kind of layer.
+// Each iteration is a whole stroke (which is rolled back at the end),
+// and the latency of each step (each mouse movement) is reported in
+// the p50/p90/p99/max counters (in microseconds).
+void BM_ToolLoop(benchmark::State& state) {
+  const ToolCase& toolCase = kToolCases[state.range(0)];
+  const LayerKind kind = LayerKind(state.range(1));
+  const int size = state.range(2);
+  Context* ctx = App::instance()->context();
+
+  std::unique_ptr<Doc> doc(new Doc(create_sprite(kind, size, size)));
+  doc->setContext(ctx);
+  ctx->setActiveDocument(doc.get());
+
+  Sprite* spr = doc->sprite();
+  Site site;
+  site.document(doc.get());
+  site.sprite(spr);
+  site.layer(spr->root()->firstLayer());
+  site.frame(0);
+  if (kind == LayerKind::Tilemap) {
+    site.tilemapMode(TilemapMode::Pixels);
+    site.tilesetMode(TilesetMode::Auto);
+  }
+
+  tools::ToolBox* toolbox = App::instance()->toolBox();
+  ToolLoopParams params;
+  params.tool = toolbox->getToolById(toolCase.toolId);
+  params.ink = params.tool->getInk(0);
+  params.controller = params.tool->getController(0);
+  params.inkType = toolCase.inkType;
+  params.opacity = 128;
+  if (kind == LayerKind::Indexed) {
+    params.fg = app::Color::fromIndex(2);
+    params.bg = app::Color::fromIndex(5);
+  }
+  else {
+    params.fg = app::Color::fromRgb(255, 64, 0);
+    params.bg = app::Color::fromRgb(0, 64, 255);
+  }
+  params.ink = App::instance()->activeToolManager()
+    ->adjustToolInkDependingOnSelectedInkType(
+      params.ink, params.inkType, params.fg);
+
+  if (toolCase.brushSize > 0)
+    params.brush = std::make_shared<Brush>(kCircleBrushType, toolCase.brushSize, 0);
+  else
+    params.brush = create_image_brush(spr->pixelFormat());
+
+  if (toolCase.pressureSize) {
+    params.dynamics.size = tools::DynamicSensor::Pressure;
+    params.dynamics.minSize = 1;
+  }
+
+  const std::vector<tools::Pointer> stroke = create_stroke(size, size);
+  std::vector<double> steps;
+
+  while (state.KeepRunning()) {
+    std::unique_ptr<tools::ToolLoop> loop(
+      create_tool_loop_for_script(ctx, site, params));
+    if (!loop) {
+      state.SkipWithError("Cannot create the tool loop");
+      break;
+    }
+
+    tools::ToolLoopManager manager(loop.get());
+    manager.prepareLoop(stroke.front());
+
+    for (std::size_t i=0; i<stroke.size(); ++i) {
+      const auto t0 = std::chrono::steady_clock::now();
+      if (i == 0)
+        manager.pressButton(stroke[i]);
+      else
+        manager.movement(stroke[i]);
+      const auto t1 = std::chrono::steady_clock::now();
+      steps.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    manager.releaseButton(stroke.back());
+
+    // Rollback the changes so each iteration draws on the same canvas
+    manager.cancel();
+    manager.end();
+  }
+
+  state.SetLabel(std::string(toolCase.name) + "/" + kLayerKindNames[int(kind)]);
+  state.counters["p50_us"] = percentile(steps, 0.50);
+  state.counters["p90_us"] = percentile(steps, 0.90);
+  state.counters["p99_us"] = percentile(steps, 0.99);
+  state.counters["max_us"] = (steps.empty() ? 0.0:
+                              *std::max_element(steps.begin(), steps.end()));
+
+  ctx->setActiveDocument(nullptr);
+}
+
+BENCHMARK(BM_ToolLoop)
+  ->ArgNames({ "tool", "layer", "size" })
+  ->ArgsProduct({
+      { 0, 1, 2, 3, 4, 5, 6 },  // kToolCases
+      { 0, 1, 2, 3 },           // LayerKind
+      { 256, 1024, 4096 } })
+  ->Unit(benchmark::kMillisecond);
+
+#endif // ENABLE_SCRIPTING
+
+int app_main(int argc, char* argv[])
+{
+  // Batch mode: tools are used without UI (as in app.useTool() from
+  // scripts executed from the command line)
+  os::SystemRef system(os::make_system());
+  App app;
+  const char* argv2[] = { argv[0], "-b" };
+  app.initialize(AppOptions(2, { argv2 }));
+
+  ::benchmark::Initialize(&argc, argv);
+  int status = ::benchmark::RunSpecifiedBenchmarks();
+
+  app.close();
+  return status;
+}
@@ -956,20 +956,15 @@ void ColorBar::onRemapTilesButtonClick()
       return;
 
     doc::Tileset* tileset = m_tilesView.tileset();
-    std::vector<ImageRef> tilemaps;
-    sprite->getTilemapsByTileset(tileset, tilemaps);
-
     const int n = std::max(m_oldTileset->size(),
                            tileset->size());
     PalettePicks usedTiles(n);
 
     if (n > 0) {
-      for (const ImageRef& tilemap : tilemaps) {
-        for (const doc::tile_t t : LockImageBits<TilemapTraits>(tilemap.get())) {
-          const doc::tile_index ti = doc::tile_geti(t);
-          if (ti > 0 && ti < n)
-            usedTiles[ti] = true;
-        }
+      const std::vector<std::size_t>& histogram = tileset->tilesHistogram();
+      for (int ti=1; ti<std::min<int>(n, histogram.size()); ++ti) {
+        if (histogram[ti] > 0)
+          usedTiles[ti] = true;
       }
     }
 
@@ -1009,6 +1004,8 @@ void ColorBar::onRemapTilesButtonClick()
       tx(new cmd::RemapTilemaps(tileset, remap));
     }
     else {
+      std::vector<ImageRef> tilemaps;
+      sprite->getTilemapsByTileset(tileset, tilemaps);
       for (const ImageRef& tilemap : tilemaps) {
         ImageRef newTilemap(Image::createCopy(tilemap.get()));
         doc::remap_image(newTilemap.get(), remap);
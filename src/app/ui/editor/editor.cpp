@@ -40,6 +40,7 @@
 #include "app/ui/editor/editor_customization_delegate.h"
 #include "app/ui/editor/editor_decorator.h"
 #include "app/ui/editor/editor_render.h"
+#include "app/ui/editor/editor_render_cache.h"
 #include "app/ui/editor/glue.h"
 #include "app/ui/editor/moving_pixels_state.h"
 #include "app/ui/editor/pixels_movement.h"
@@ -165,6 +166,7 @@ Editor::Editor(Doc* document, EditorFlags flags, EditorStatePtr state)
   , m_showGuidesThisCel(nullptr)
   , m_showAutoCelGuides(false)
   , m_tagFocusBand(-1)
+  , m_renderCache(std::make_unique<EditorRenderCache>())
 {
   if (!m_renderEngine)
     m_renderEngine = std::make_unique<EditorRender>();
@@ -677,6 +679,7 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     m_renderEngine->setupBackground(m_document, IMAGE_RGB);
     m_renderEngine->disableOnionskin();
 
+    bool onionskin = false;
     if ((m_flags & kShowOnionskin) == kShowOnionskin) {
       if (m_docPref.onionskin.active()) {
         OnionskinOptions opts(
@@ -699,12 +702,14 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         opts.loopTag(tag);
 
         m_renderEngine->setOnionskin(opts);
+        onionskin = true;
       }
     }
 
     ExtraCelRef extraCel = m_document->extraCel();
-    if (extraCel &&
-        extraCel->type() != render::ExtraType::NONE) {
+    const bool hasExtraCel = (extraCel &&
+                              extraCel->type() != render::ExtraType::NONE);
+    if (hasExtraCel) {
       m_renderEngine->setExtraImage(
         extraCel->type(),
         extraCel->cel(),
@@ -737,10 +742,48 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         maxw, maxh, m_document->osColorSpace());
     }
 
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+    const render::Projection renderProj =
+      (newEngine ? render::Projection(): m_proj);
+    m_renderEngine->setProjection(renderProj);
+
+    // The cache of rendered tiles is used only for the sprite as it
+    // is in the document, i.e. when there is no preview image (the
+    // user is drawing), or extra cel (e.g. moving pixels), or onion
+    // skin (depends on other frames).
+    if (pref.experimental.renderCache() &&
+        !m_renderEngine->hasPreviewImage() &&
+        !hasExtraCel &&
+        !onionskin &&
+        !renderProperties.renderBgOnScreen) {
+      const int nonactiveOpacity = otherLayersOpacity();
+
+      EditorRenderCache::Params params;
+      params.renderType = m_renderEngine->type();
+      params.newBlend = pref.experimental.newBlend();
+      if (nonactiveOpacity < 255)
+        params.selectedLayer = (m_layer ? m_layer->id(): NullId);
+      params.nonactiveLayersOpacity = nonactiveOpacity;
+      params.bgType = int(m_docPref.bg.type());
+      params.bgSize = m_docPref.bg.size();
+      params.bgZoom = m_docPref.bg.zoom();
+      params.bgColor1 = color_utils::color_for_image_without_alpha(
+        m_docPref.bg.color1(), IMAGE_RGB);
+      params.bgColor2 = color_utils::color_for_image_without_alpha(
+        m_docPref.bg.color2(), IMAGE_RGB);
+      params.colorSpace = m_document->osColorSpace();
+      params.proj = renderProj;
+
+      m_renderCache->draw(
+        rendered.get(), m_sprite, m_frame, params, rc2,
+        [this](os::Surface* dst, const gfx::Rect& area) {
+          m_renderEngine->renderSprite(
+            dst, m_sprite, m_frame, gfx::Clip(0, 0, area));
+        });
+    }
+    else {
+      m_renderEngine->renderSprite(
+        rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+    }
 
     m_renderEngine->removeExtraImage();
 
@@ -2384,6 +2427,14 @@ void Editor::onShowExtrasChange()
   invalidate();
 }
 
+void Editor::onGeneralUpdate(DocEvent& ev)
+{
+  // Something could be modified without incrementing the version of
+  // the modified objects (e.g. a script), so we render everything
+  // again.
+  m_renderCache->invalidate();
+}
+
 void Editor::onColorSpaceChanged(DocEvent& ev)
 {
   // As the document has a new color space, we've to redraw the
@@ -2391,6 +2442,12 @@ void Editor::onColorSpaceChanged(DocEvent& ev)
   invalidate();
 }
 
+void Editor::onSpritePixelsModified(DocEvent& ev)
+{
+  if (ev.sprite() == m_sprite)
+    m_renderCache->invalidateSpriteRegion(ev.frame(), ev.region(), ev.layer());
+}
+
 void Editor::onExposeSpritePixels(DocEvent& ev)
 {
   if (m_state && ev.sprite() == m_sprite)
@@ -60,6 +60,7 @@ namespace app {
   class DocView;
   class EditorCustomizationDelegate;
   class EditorRender;
+  class EditorRenderCache;
   class PixelsMovement;
   class Site;
   class Transformation;
@@ -296,6 +297,10 @@ namespace app {
 
     static EditorRender& renderEngine() { return *m_renderEngine; }
 
+    // Cache of rendered tiles (used when the experimental
+    // renderCache option is enabled).
+    EditorRenderCache& renderCache() { return *m_renderCache; }
+
     // IColorSource
     app::Color getColorByPosition(const gfx::Point& pos) override;
 
@@ -345,7 +350,9 @@ namespace app {
     void onShowExtrasChange();
 
     // DocObserver impl
+    void onGeneralUpdate(DocEvent& ev) override;
     void onColorSpaceChanged(DocEvent& ev) override;
+    void onSpritePixelsModified(DocEvent& ev) override;
     void onExposeSpritePixels(DocEvent& ev) override;
     void onSpritePixelRatioChanged(DocEvent& ev) override;
     void onBeforeRemoveLayer(DocEvent& ev) override;
@@ -493,6 +500,9 @@ namespace app {
     // For slices
     doc::SelectedObjects m_selectedSlices;
 
+    // Tiles of the sprite already rendered in this editor.
+    std::unique_ptr<EditorRenderCache> m_renderCache;
+
     // Active sprite editor with the keyboard focus.
     static Editor* m_activeEditor;
 
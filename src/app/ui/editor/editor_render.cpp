@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -142,11 +142,13 @@ void EditorRender::setPreviewImage(const doc::Layer* layer,
 {
   m_renderer->setPreviewImage(layer, frame, image, tileset,
                               pos, blendMode);
+  m_hasPreviewImage = true;
 }
 
 void EditorRender::removePreviewImage()
 {
   m_renderer->removePreviewImage();
+  m_hasPreviewImage = false;
 }
 
 void EditorRender::setExtraImage(
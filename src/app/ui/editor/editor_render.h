@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -72,6 +72,7 @@ namespace app {
                          const gfx::Point& pos,
                          const doc::BlendMode blendMode);
     void removePreviewImage();
+    bool hasPreviewImage() const { return m_hasPreviewImage; }
 
     void setExtraImage(
       render::ExtraType type,
@@ -107,6 +108,7 @@ namespace app {
 
   private:
     std::unique_ptr<Renderer> m_renderer;
+    bool m_hasPreviewImage = false;
   };
 
 } // namespace app
@@ -0,0 +1,349 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/editor_render_cache.h"
+
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "os/system.h"
+
+#include <algorithm>
+
+namespace app {
+
+using namespace doc;
+
+namespace {
+
+// By default we keep up to 64MB of rendered tiles (256 tiles of
+// 256x256 RGBA pixels)
+constexpr std::size_t kDefaultMaxBytes = 64*1024*1024;
+
+inline uint64_t tile_key(const int tx, const int ty)
+{
+  return (uint64_t(uint32_t(ty)) << 32) | uint64_t(uint32_t(tx));
+}
+
+inline std::size_t surface_bytes(const os::Surface* surface)
+{
+  return std::size_t(surface->width()) * surface->height() * 4;
+}
+
+uint64_t tileset_version(const Tileset* tileset)
+{
+  uint64_t version = tileset->version();
+  for (const auto& tile : *tileset) {
+    version = version*31 + (tile.image ? tile.image->version(): 0);
+  }
+  return version;
+}
+
+} // anonymous namespace
+
+bool EditorRenderCache::Params::operator==(const Params& other) const
+{
+  return (renderType == other.renderType &&
+          newBlend == other.newBlend &&
+          selectedLayer == other.selectedLayer &&
+          nonactiveLayersOpacity == other.nonactiveLayersOpacity &&
+          bgType == other.bgType &&
+          bgSize == other.bgSize &&
+          bgZoom == other.bgZoom &&
+          bgColor1 == other.bgColor1 &&
+          bgColor2 == other.bgColor2 &&
+          colorSpace == other.colorSpace &&
+          proj.zoom() == other.proj.zoom() &&
+          proj.pixelRatio().w == other.proj.pixelRatio().w &&
+          proj.pixelRatio().h == other.proj.pixelRatio().h);
+}
+
+bool EditorRenderCache::LayerState::sameRender(const LayerState& other) const
+{
+  return (flags == other.flags &&
+          opacity == other.opacity &&
+          blendMode == other.blendMode &&
+          celId == other.celId &&
+          imageId == other.imageId &&
+          imageVersion == other.imageVersion &&
+          celBounds == other.celBounds &&
+          celOpacity == other.celOpacity &&
+          zIndex == other.zIndex &&
+          tilesetVersion == other.tilesetVersion);
+}
+
+EditorRenderCache::EditorRenderCache()
+  : m_maxBytes(kDefaultMaxBytes)
+{
+}
+
+void EditorRenderCache::invalidate()
+{
+  m_frames.clear();
+  m_bytes = 0;
+}
+
+void EditorRenderCache::invalidateSpriteRegion(const frame_t frameNumber,
+                                               const gfx::Region& region,
+                                               const Layer* layer)
+{
+  auto it = m_frames.find(frameNumber);
+  if (it == m_frames.end())
+    return;
+
+  Frame& frame = it->second;
+  for (const gfx::Rect& rc : region)
+    invalidateSpriteRect(frame, rc);
+
+  if (!layer || !layer->isImage())
+    return;
+
+  // Update the image of the layer state, so validateFrame() doesn't
+  // invalidate the whole cel for pixels that were already
+  // invalidated. Other changes (cel bounds, opacity, etc.) are still
+  // detected by validateFrame().
+  const Cel* cel = layer->cel(frameNumber);
+  if (!cel)
+    return;
+
+  for (LayerState& state : frame.layers) {
+    if (state.layerId == layer->id()) {
+      if (state.celId == cel->id() &&
+          state.celBounds == cel->bounds()) {
+        const ImageConstRef image = cel->imageConstRef();
+        state.imageId = image->id();
+        state.imageVersion = image->version();
+      }
+      break;
+    }
+  }
+}
+
+void EditorRenderCache::draw(os::Surface* dst,
+                             const Sprite* sprite,
+                             const frame_t frameNumber,
+                             const Params& params,
+                             const gfx::Rect& area,
+                             const RenderFunc& renderFunc)
+{
+  // Check the properties that affect all frames
+  std::vector<uint64_t> palettes;
+  palettes.reserve(3*sprite->getPalettes().size());
+  for (const Palette* pal : sprite->getPalettes()) {
+    palettes.push_back(pal->frame());
+    palettes.push_back(pal->version());
+    palettes.push_back(pal->getModifications());
+  }
+
+  if (m_spriteId != sprite->id() ||
+      m_pixelFormat != int(sprite->pixelFormat()) ||
+      m_spriteSize != sprite->size() ||
+      m_transparentColor != sprite->transparentColor() ||
+      m_palettes != palettes ||
+      m_params != params) {
+    invalidate();
+
+    m_spriteId = sprite->id();
+    m_pixelFormat = int(sprite->pixelFormat());
+    m_spriteSize = sprite->size();
+    m_transparentColor = sprite->transparentColor();
+    m_palettes = std::move(palettes);
+    m_params = params;
+  }
+
+  Frame& frame = m_frames[frameNumber];
+  validateFrame(frame, sprite, frameNumber);
+
+  const gfx::Rect renderBounds = m_params.proj.apply(sprite->bounds());
+  const gfx::Rect rc = area & renderBounds;
+  if (rc.isEmpty())
+    return;
+
+  ++m_useCounter;
+
+  const int tx1 = rc.x / kSize;
+  const int ty1 = rc.y / kSize;
+  const int tx2 = (rc.x2()-1) / kSize;
+  const int ty2 = (rc.y2()-1) / kSize;
+  for (int ty=ty1; ty<=ty2; ++ty) {
+    for (int tx=tx1; tx<=tx2; ++tx) {
+      Tile& tile = frame.tiles[tile_key(tx, ty)];
+      tile.lastUse = m_useCounter;
+
+      if (!tile.valid) {
+        tile.bounds = gfx::Rect(tx*kSize, ty*kSize, kSize, kSize) & renderBounds;
+
+        if (!tile.surface ||
+            tile.surface->width() != tile.bounds.w ||
+            tile.surface->height() != tile.bounds.h) {
+          if (tile.surface)
+            m_bytes -= surface_bytes(tile.surface.get());
+
+          tile.surface = os::instance()->makeRgbaSurface(
+            tile.bounds.w, tile.bounds.h, m_params.colorSpace);
+          m_bytes += surface_bytes(tile.surface.get());
+        }
+
+        renderFunc(tile.surface.get(), tile.bounds);
+        tile.valid = true;
+        ++m_misses;
+      }
+      else
+        ++m_hits;
+
+      const gfx::Rect src = tile.bounds & rc;
+      tile.surface->blitTo(dst,
+                           src.x - tile.bounds.x,
+                           src.y - tile.bounds.y,
+                           src.x - area.x,
+                           src.y - area.y,
+                           src.w, src.h);
+    }
+  }
+
+  if (m_bytes > m_maxBytes)
+    releaseUnusedTiles();
+}
+
+void EditorRenderCache::validateFrame(Frame& frame,
+                                      const Sprite* sprite,
+                                      const frame_t frameNumber)
+{
+  std::vector<LayerState> layers;
+  layers.reserve(frame.layers.size());
+
+  for (const Layer* layer : sprite->allLayers()) {
+    LayerState state;
+    state.layerId = layer->id();
+    state.flags = int(layer->flags());
+    state.isGroup = layer->isGroup();
+
+    if (layer->isImage()) {
+      auto layerImage = static_cast<const LayerImage*>(layer);
+      state.opacity = layerImage->opacity();
+      state.blendMode = int(layerImage->blendMode());
+
+      if (const Cel* cel = layer->cel(frameNumber)) {
+        state.celId = cel->id();
+        // Read-only access (a lazy image can be discarded later)
+        if (const ImageConstRef image = cel->imageConstRef()) {
+          state.imageId = image->id();
+          state.imageVersion = image->version();
+        }
+        state.celBounds = cel->bounds();
+        state.celOpacity = cel->opacity();
+        state.zIndex = cel->zIndex();
+      }
+
+      if (layer->isTilemap()) {
+        if (const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset())
+          state.tilesetVersion = tileset_version(tileset);
+      }
+    }
+
+    layers.push_back(state);
+  }
+
+  // If the layers structure has changed (new layers, deleted layers,
+  // layers moved to other position, etc.) we have to render
+  // everything again.
+  bool sameStructure = (frame.layers.size() == layers.size());
+  for (std::size_t i=0; sameStructure && i<layers.size(); ++i) {
+    if (frame.layers[i].layerId != layers[i].layerId)
+      sameStructure = false;
+  }
+
+  if (!sameStructure) {
+    for (auto& it : frame.tiles)
+      it.second.valid = false;
+  }
+  // Invalidate only the areas of cels that were modified
+  else {
+    for (std::size_t i=0; i<layers.size(); ++i) {
+      const LayerState& oldState = frame.layers[i];
+      const LayerState& newState = layers[i];
+      if (oldState.sameRender(newState))
+        continue;
+
+      // A group changed (e.g. it was hidden/shown), all its children
+      // could be affected.
+      if (newState.isGroup) {
+        for (auto& it : frame.tiles)
+          it.second.valid = false;
+        break;
+      }
+
+      invalidateSpriteRect(frame, oldState.celBounds);
+      invalidateSpriteRect(frame, newState.celBounds);
+    }
+  }
+
+  frame.layers = std::move(layers);
+}
+
+void EditorRenderCache::invalidateRenderRect(Frame& frame, const gfx::Rect& rc)
+{
+  for (auto& it : frame.tiles) {
+    Tile& tile = it.second;
+    if (tile.valid && tile.bounds.intersects(rc))
+      tile.valid = false;
+  }
+}
+
+void EditorRenderCache::invalidateSpriteRect(Frame& frame, const gfx::Rect& rc)
+{
+  if (rc.isEmpty())
+    return;
+
+  // Enlarge the area one pixel to include the pixels that could be
+  // affected by the zoom/pixel ratio roundings.
+  gfx::Rect renderRc = m_params.proj.apply(rc);
+  renderRc.enlarge(1);
+  invalidateRenderRect(frame, renderRc);
+}
+
+void EditorRenderCache::releaseUnusedTiles()
+{
+  // Tiles sorted from the least recently used to the most recent one
+  struct Item {
+    uint64_t lastUse;
+    frame_t frame;
+    uint64_t key;
+  };
+  std::vector<Item> items;
+  for (const auto& f : m_frames) {
+    for (const auto& t : f.second.tiles) {
+      // We cannot release tiles used in the last draw() call
+      if (t.second.lastUse != m_useCounter)
+        items.push_back(Item{ t.second.lastUse, f.first, t.first });
+    }
+  }
+  std::sort(items.begin(), items.end(),
+            [](const Item& a, const Item& b){
+              return a.lastUse < b.lastUse;
+            });
+
+  for (const Item& item : items) {
+    if (m_bytes <= m_maxBytes)
+      break;
+
+    Frame& frame = m_frames[item.frame];
+    auto it = frame.tiles.find(item.key);
+    if (it->second.surface)
+      m_bytes -= surface_bytes(it->second.surface.get());
+    frame.tiles.erase(it);
+  }
+}
+
+} // namespace app
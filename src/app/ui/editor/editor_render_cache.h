@@ -0,0 +1,171 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_RENDER_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_RENDER_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/ui/editor/editor_render.h"
+#include "doc/color.h"
+#include "doc/frame.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "gfx/rect.h"
+#include "gfx/region.h"
+#include "os/color_space.h"
+#include "os/surface.h"
+#include "render/projection.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace doc {
+  class Layer;
+  class Sprite;
+}
+
+namespace app {
+
+  // Cache of rendered tiles of the sprite canvas (the output of
+  // EditorRender::renderSprite()) used by the Editor to avoid
+  // compositing all layers again each time a part of the canvas is
+  // exposed (e.g. scrolling, or moving a window over the editor).
+  //
+  // Tiles are kSize x kSize pixels in "render space", i.e. the same
+  // space of the rectangle given to EditorRender::renderSprite()
+  // (sprite pixels for the new render engine, zoomed pixels for the
+  // old one). Each frame of the sprite keeps its own tiles, and a
+  // snapshot of the layers/cels (ids, versions, bounds, etc.) used to
+  // know which tiles must be rendered again when the sprite changes.
+  class EditorRenderCache {
+  public:
+    static constexpr int kSize = 256;
+
+    // Parameters that affect the whole rendered canvas. If one of
+    // these changes, all the cached tiles are discarded.
+    struct Params {
+      EditorRender::Type renderType = EditorRender::kSimpleRenderer;
+      bool newBlend = true;
+      doc::ObjectId selectedLayer = doc::NullId;
+      int nonactiveLayersOpacity = 255;
+      int bgType = 0;
+      gfx::Size bgSize;
+      bool bgZoom = false;
+      doc::color_t bgColor1 = 0;
+      doc::color_t bgColor2 = 0;
+      os::ColorSpaceRef colorSpace;
+      // Projection used to render the sprite (an empty projection
+      // for the new render engine which renders without zoom).
+      render::Projection proj;
+
+      bool operator==(const Params& other) const;
+      bool operator!=(const Params& other) const {
+        return !operator==(other);
+      }
+    };
+
+    // Function used to render the given "area" (in render space) of
+    // the current sprite/frame in the (0, 0) of the "dst" surface.
+    using RenderFunc = std::function<void(os::Surface* dst,
+                                          const gfx::Rect& area)>;
+
+    EditorRenderCache();
+
+    // Memory used by tiles that aren't visible is released to keep
+    // the cache under this limit.
+    void setMaxBytes(const std::size_t bytes) { m_maxBytes = bytes; }
+    std::size_t bytes() const { return m_bytes; }
+
+    // Cache statistics (number of tiles reused/rendered), useful for
+    // tests and benchmarks.
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+    void resetStats() { m_hits = m_misses = 0; }
+
+    // Discards all cached tiles.
+    void invalidate();
+
+    // Marks as invalid the tiles that intersect the given region (in
+    // sprite coordinates) of the given frame. If "layer" is given, its
+    // cel was modified only inside this region, so the new version
+    // of its image will not invalidate the whole cel in the next
+    // draw() (only if the cel bounds are the same).
+    void invalidateSpriteRegion(const doc::frame_t frame,
+                                const gfx::Region& region,
+                                const doc::Layer* layer = nullptr);
+
+    // Draws the "area" (in render space) of the given sprite/frame in
+    // the (0, 0) position of "dst". Tiles that are not in the cache
+    // (or that were modified since the last time they were rendered)
+    // are rendered with "renderFunc".
+    void draw(os::Surface* dst,
+              const doc::Sprite* sprite,
+              const doc::frame_t frame,
+              const Params& params,
+              const gfx::Rect& area,
+              const RenderFunc& renderFunc);
+
+  private:
+    // Render state of one layer (and its cel) in a specific frame.
+    struct LayerState {
+      doc::ObjectId layerId = doc::NullId;
+      int flags = 0;
+      bool isGroup = false;
+      int opacity = 0;
+      int blendMode = 0;
+      doc::ObjectId celId = doc::NullId;
+      doc::ObjectId imageId = doc::NullId;
+      doc::ObjectVersion imageVersion = 0;
+      gfx::Rect celBounds;
+      int celOpacity = 0;
+      int zIndex = 0;
+      // Version of the tileset (and its tiles) for tilemap layers
+      uint64_t tilesetVersion = 0;
+
+      bool sameRender(const LayerState& other) const;
+    };
+
+    struct Tile {
+      os::SurfaceRef surface;
+      gfx::Rect bounds;         // In render space
+      bool valid = false;
+      uint64_t lastUse = 0;
+    };
+
+    struct Frame {
+      std::vector<LayerState> layers;
+      std::unordered_map<uint64_t, Tile> tiles;
+    };
+
+    void validateFrame(Frame& frame,
+                       const doc::Sprite* sprite,
+                       const doc::frame_t frameNumber);
+    void invalidateRenderRect(Frame& frame, const gfx::Rect& rc);
+    void invalidateSpriteRect(Frame& frame, const gfx::Rect& rc);
+    void releaseUnusedTiles();
+
+    // Properties of the sprite that affect all frames
+    doc::ObjectId m_spriteId = doc::NullId;
+    int m_pixelFormat = 0;
+    gfx::Size m_spriteSize;
+    doc::color_t m_transparentColor = 0;
+    std::vector<uint64_t> m_palettes;
+    Params m_params;
+
+    std::map<doc::frame_t, Frame> m_frames;
+    std::size_t m_bytes = 0;
+    std::size_t m_maxBytes;
+    uint64_t m_useCounter = 0;
+    int m_hits = 0;
+    int m_misses = 0;
+  };
+
+} // namespace app
+
+#endif
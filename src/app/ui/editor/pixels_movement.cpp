@@ -32,6 +32,7 @@
 #include "app/util/expand_cel_canvas.h"
 #include "app/util/new_image_from_mask.h"
 #include "app/util/range_utils.h"
+#include "app/util/worker_pool.h"
 #include "base/pi.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/rotate.h"
@@ -1323,7 +1324,8 @@ retry:;      // In case that we don't have enough memory for RotSprite
           int(corners.rightBottom().x-leftTop.x),
           int(corners.rightBottom().y-leftTop.y),
           int(corners.leftBottom().x-leftTop.x),
-          int(corners.leftBottom().y-leftTop.y));
+          int(corners.leftBottom().y-leftTop.y),
+          &worker_pool());
       }
       catch (const std::bad_alloc&) {
         StatusBar::instance()->showTip(
@@ -231,10 +231,11 @@ public:
     }
 
     if (m_controller->isFreehand() &&
-        !m_pointShape->isFloodFill() &&
-        // TODO add dynamics support when UI is not enabled
-        App::instance()->contextBar()) {
-      m_dynamics = App::instance()->contextBar()->getDynamics();
+        !m_pointShape->isFloodFill()) {
+      if (App::instance()->contextBar())
+        m_dynamics = App::instance()->contextBar()->getDynamics();
+      else
+        m_dynamics = params.dynamics;
     }
 
     if (m_tracePolicy == tools::TracePolicy::Accumulate) {
@@ -280,8 +281,10 @@ public:
       m_opacity = 255;
     }
 
-    if (params.inkType == tools::InkType::SHADING) {
-      // TODO add shading support when UI is not enabled
+    if (params.inkType == tools::InkType::SHADING &&
+        // TODO add shades support when UI is not enabled (without
+        //      shades the shading ink uses the whole palette)
+        App::instance()->contextBar()) {
       m_shade = App::instance()->contextBar()->getShade();
       m_shadingRemap.reset(
         App::instance()->contextBar()->createShadeRemap(
@@ -396,7 +399,7 @@ public:
     HideBrushPreview hide(m_editor->brushPreview());
 
     m_document->notifySpritePixelsModified(
-      m_sprite, dirtyArea, m_frame);
+      m_sprite, dirtyArea, m_frame, m_layer);
   }
 
   void updateStatusBar(const char* text) override {
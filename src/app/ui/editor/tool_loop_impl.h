@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/color.h"
+#include "app/tools/dynamics.h"
 #include "app/tools/freehand_algorithm.h"
 #include "app/tools/ink_type.h"
 #include "app/tools/pointer.h"
@@ -49,6 +50,10 @@ namespace app {
 
     // For selection tools executed from scripts
     tools::ToolLoopModifiers modifiers = tools::ToolLoopModifiers::kNone;
+
+    // Dynamics for freehand tools when the UI is not available (with
+    // UI the dynamics are taken from the context bar)
+    tools::DynamicsOptions dynamics;
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -0,0 +1,463 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undo_buffer.h"
+
+#include "app/util/worker_pool.h"
+#include "base/debug.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/process.h"
+#include "base/thread_pool.h"
+#include "fmt/format.h"
+#include "zlib.h"
+
+#include <atomic>
+#include <condition_variable>
+
+namespace app {
+
+namespace {
+
+// Buffers smaller than this are not compressed (it doesn't worth it)
+constexpr std::size_t kMinCompressSize = 256;
+
+base::buffer compress_buffer(const base::buffer& src)
+{
+  uLongf size = compressBound(uLong(src.size()));
+  base::buffer dst(size);
+  if (compress2(dst.data(), &size,
+                src.data(), uLong(src.size()),
+                Z_BEST_SPEED) != Z_OK) {
+    return base::buffer();
+  }
+  dst.resize(size);
+  dst.shrink_to_fit();
+  return dst;
+}
+
+bool uncompress_buffer(const base::buffer& src, base::buffer& dst)
+{
+  uLongf size = uLongf(dst.size());
+  return (uncompress(dst.data(), &size,
+                     src.data(), uLong(src.size())) == Z_OK &&
+          size == dst.size());
+}
+
+} // anonymous namespace
+
+struct UndoBuffer::Data {
+  enum class State {
+    Raw,               // Uncompressed data in "raw"
+    Compressing,       // Compressing "raw" in a background thread
+    Compressed,        // Compressed data in "compressed"
+    Spilled,           // Data saved in the spill file
+  };
+
+  std::mutex mutex;
+  std::condition_variable jobDone;
+  State state = State::Raw;
+  base::buffer raw;
+  base::buffer compressed;
+  std::size_t rawSize = 0;
+
+  // Background compression job: each job is identified by a
+  // generation number, so a job that was canceled (because the data
+  // was accessed with data()) doesn't touch the data.
+  int gen = 0;
+  bool jobRunning = false;
+  bool jobFinished = false;
+  bool incompressible = false;
+
+  // Position in the spill file (and if the data was compressed
+  // before saving it)
+  UndoSpillFile* spillFile = nullptr;
+  int64_t spillPos = -1;
+  std::size_t spillSize = 0;
+  bool spillCompressed = false;
+
+  // Cancels the background compression, waiting the job if it's
+  // already running (as it's reading the "raw" buffer).
+  void cancelCompression(std::unique_lock<std::mutex>& lock) {
+    ASSERT(state == State::Compressing);
+    ++gen;
+    jobDone.wait(lock, [this]{ return !jobRunning; });
+    compressed.clear();
+    compressed.shrink_to_fit();
+    state = State::Raw;
+  }
+
+  // Waits the background compression if the job is already running
+  // (to use its result), or cancels it if the job hasn't started yet.
+  void waitCompression(std::unique_lock<std::mutex>& lock) {
+    ASSERT(state == State::Compressing);
+    jobDone.wait(lock, [this]{ return !jobRunning; });
+    if (!finishCompression() && state == State::Compressing)
+      cancelCompression(lock);
+  }
+
+  // Restores the "raw" buffer from the compressed data or from the
+  // spill file. Returns false (keeping the current state) if the data
+  // cannot be read/uncompressed.
+  bool load() {
+    switch (state) {
+
+      case State::Raw:
+        break;
+
+      case State::Compressed:
+        raw.resize(rawSize);
+        if (!uncompress_buffer(compressed, raw)) {
+          releaseRaw();
+          return false;
+        }
+        compressed.clear();
+        compressed.shrink_to_fit();
+        break;
+
+      case State::Spilled:
+        ASSERT(spillFile);
+        if (spillCompressed) {
+          compressed.resize(spillSize);
+          raw.resize(rawSize);
+          const bool ok = (spillFile->read(spillPos, compressed) &&
+                           uncompress_buffer(compressed, raw));
+          compressed.clear();
+          compressed.shrink_to_fit();
+          if (!ok) {
+            releaseRaw();
+            return false;
+          }
+        }
+        else {
+          raw.resize(rawSize);
+          if (!spillFile->read(spillPos, raw)) {
+            releaseRaw();
+            return false;
+          }
+        }
+        spillFile = nullptr;
+        spillPos = -1;
+        break;
+
+      case State::Compressing:
+        ASSERT(false);
+        return false;
+    }
+    state = State::Raw;
+    return true;
+  }
+
+  void releaseRaw() {
+    raw.clear();
+    raw.shrink_to_fit();
+  }
+
+  // Replaces the "raw" buffer with the result of the background
+  // compression (if it's already finished).
+  bool finishCompression() {
+    if (state != State::Compressing || !jobFinished)
+      return false;
+
+    // Keep the uncompressed data if the compression doesn't help (or
+    // zlib failed)
+    if (compressed.empty() || compressed.size() >= raw.size()) {
+      compressed.clear();
+      compressed.shrink_to_fit();
+      incompressible = true;
+      state = State::Raw;
+      return false;
+    }
+
+    raw.clear();
+    raw.shrink_to_fit();
+    state = State::Compressed;
+    return true;
+  }
+};
+
+UndoBuffer::UndoBuffer()
+  : m_data(std::make_shared<Data>())
+{
+}
+
+UndoBuffer::~UndoBuffer()
+{
+  std::unique_lock lock(m_data->mutex);
+  // Cancel the background job (if there is one)
+  ++m_data->gen;
+}
+
+void UndoBuffer::set(base::buffer&& data)
+{
+  clear();
+  std::unique_lock lock(m_data->mutex);
+  m_data->raw = std::move(data);
+}
+
+void UndoBuffer::set(const std::string& data)
+{
+  set(base::buffer(data.begin(), data.end()));
+}
+
+void UndoBuffer::clear()
+{
+  std::unique_lock lock(m_data->mutex);
+  if (m_data->state == Data::State::Compressing)
+    m_data->cancelCompression(lock);
+
+  m_data->state = Data::State::Raw;
+  m_data->raw.clear();
+  m_data->raw.shrink_to_fit();
+  m_data->compressed.clear();
+  m_data->compressed.shrink_to_fit();
+  m_data->rawSize = 0;
+  m_data->incompressible = false;
+  m_data->spillFile = nullptr;
+  m_data->spillPos = -1;
+}
+
+bool UndoBuffer::load()
+{
+  std::unique_lock lock(m_data->mutex);
+  if (m_data->state == Data::State::Compressing) {
+    m_data->cancelCompression(lock);
+    return true;
+  }
+  return m_data->load();
+}
+
+base::buffer& UndoBuffer::data()
+{
+  std::unique_lock lock(m_data->mutex);
+  if (m_data->state == Data::State::Compressing)
+    m_data->cancelCompression(lock);
+  else if (!m_data->load())
+    throw base::Exception("The undo data cannot be restored.");
+
+  // The data can be modified from now on
+  m_data->incompressible = false;
+  return m_data->raw;
+}
+
+std::string UndoBuffer::str()
+{
+  const base::buffer& buf = data();
+  return std::string(buf.begin(), buf.end());
+}
+
+std::size_t UndoBuffer::size() const
+{
+  std::unique_lock lock(m_data->mutex);
+  if (m_data->state == Data::State::Raw ||
+      m_data->state == Data::State::Compressing)
+    return m_data->raw.size();
+  else
+    return m_data->rawSize;
+}
+
+std::size_t UndoBuffer::memSize() const
+{
+  std::unique_lock lock(m_data->mutex);
+  switch (m_data->state) {
+    // The memory used by the compressed data is not counted until
+    // finishCompression() is called (so memSize() only changes in
+    // the main thread).
+    case Data::State::Raw:
+    case Data::State::Compressing: return m_data->raw.size();
+    case Data::State::Compressed:  return m_data->compressed.size();
+    case Data::State::Spilled:     return 0;
+  }
+  return 0;
+}
+
+bool UndoBuffer::isCompressed() const
+{
+  std::unique_lock lock(m_data->mutex);
+  return (m_data->state == Data::State::Compressed);
+}
+
+bool UndoBuffer::isSpilled() const
+{
+  std::unique_lock lock(m_data->mutex);
+  return (m_data->state == Data::State::Spilled);
+}
+
+bool UndoBuffer::startCompression()
+{
+  std::unique_lock lock(m_data->mutex);
+  if (m_data->state == Data::State::Compressing)
+    return true;
+
+  if (m_data->state != Data::State::Raw ||
+      m_data->raw.size() < kMinCompressSize ||
+      m_data->incompressible)
+    return false;
+
+  m_data->state = Data::State::Compressing;
+  m_data->rawSize = m_data->raw.size();
+  m_data->jobFinished = false;
+
+  const int gen = ++m_data->gen;
+  std::shared_ptr<Data> data = m_data;
+  worker_pool().execute(
+    [data, gen]{
+      {
+        std::unique_lock lock(data->mutex);
+        if (data->gen != gen)
+          return;
+        data->jobRunning = true;
+      }
+
+      // The "raw" buffer cannot be modified while the job is running
+      // (data() waits the job), so we can compress it without
+      // locking the mutex.
+      base::buffer compressed = compress_buffer(data->raw);
+
+      std::unique_lock lock(data->mutex);
+      data->jobRunning = false;
+      if (data->gen == gen) {
+        data->compressed = std::move(compressed);
+        data->jobFinished = true;
+      }
+      data->jobDone.notify_all();
+    });
+  return true;
+}
+
+bool UndoBuffer::finishCompression()
+{
+  std::unique_lock lock(m_data->mutex);
+  return m_data->finishCompression();
+}
+
+bool UndoBuffer::spill(UndoSpillFile* file)
+{
+  ASSERT(file);
+  std::unique_lock lock(m_data->mutex);
+
+  switch (m_data->state) {
+    case Data::State::Spilled:
+      return true;
+    case Data::State::Compressing:
+      m_data->waitCompression(lock);
+      break;
+    default:
+      break;
+  }
+
+  if (m_data->state == Data::State::Raw) {
+    if (m_data->raw.empty())
+      return false;
+
+    m_data->rawSize = m_data->raw.size();
+    if (!m_data->incompressible) {
+      m_data->compressed = compress_buffer(m_data->raw);
+      if (!m_data->compressed.empty() &&
+          m_data->compressed.size() < m_data->raw.size()) {
+        m_data->raw.clear();
+        m_data->raw.shrink_to_fit();
+        m_data->state = Data::State::Compressed;
+      }
+      else {
+        m_data->compressed.clear();
+        m_data->incompressible = true;
+      }
+    }
+  }
+
+  const bool compressed = (m_data->state == Data::State::Compressed);
+  const int64_t pos = file->write(compressed ? m_data->compressed:
+                                               m_data->raw);
+  if (pos < 0)
+    return false;
+
+  m_data->spillFile = file;
+  m_data->spillPos = pos;
+  m_data->spillSize = (compressed ? m_data->compressed.size():
+                                    m_data->raw.size());
+  m_data->spillCompressed = compressed;
+  m_data->state = Data::State::Spilled;
+  m_data->compressed.clear();
+  m_data->compressed.shrink_to_fit();
+  m_data->raw.clear();
+  m_data->raw.shrink_to_fit();
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// UndoSpillFile
+
+UndoSpillFile::UndoSpillFile()
+{
+}
+
+UndoSpillFile::~UndoSpillFile()
+{
+  if (m_file.is_open()) {
+    m_file.close();
+    try {
+      base::delete_file(m_filename);
+    }
+    catch (const std::exception&) {
+      // Ignore errors deleting the file
+    }
+  }
+}
+
+int64_t UndoSpillFile::write(const base::buffer& data)
+{
+  if (!m_file.is_open() && !open())
+    return -1;
+
+  const int64_t pos = m_size;
+  m_file.seekp(pos);
+  m_file.write((const char*)data.data(), data.size());
+  if (m_file.fail()) {
+    m_file.clear();
+    return -1;
+  }
+  m_size += data.size();
+  return pos;
+}
+
+bool UndoSpillFile::read(const int64_t pos, base::buffer& data)
+{
+  if (!m_file.is_open())
+    return false;
+
+  m_file.seekg(pos);
+  m_file.read((char*)data.data(), data.size());
+  if (m_file.fail()) {
+    m_file.clear();
+    return false;
+  }
+  return true;
+}
+
+bool UndoSpillFile::open()
+{
+  static std::atomic<int> counter(0);
+  m_filename = base::join_path(
+    base::get_temp_path(),
+    fmt::format("aseprite-undo-{}-{}.tmp",
+                base::get_current_process_id(),
+                ++counter));
+
+  m_file.open(FSTREAM_PATH(m_filename),
+              std::fstream::in |
+              std::fstream::out |
+              std::fstream::trunc |
+              std::fstream::binary);
+  return m_file.is_open();
+}
+
+} // namespace app
@@ -0,0 +1,123 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UNDO_BUFFER_H_INCLUDED
+#define APP_UNDO_BUFFER_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/disable_copying.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class UndoSpillFile;
+
+  // Data saved by an undo command (e.g. pixels of the modified
+  // region, or a serialized layer/cel) that can be compressed in a
+  // background thread when the command is not used (i.e. when it's an
+  // old undo state), and even saved in a temporary file (see
+  // UndoSpillFile). The data is loaded again in memory transparently
+  // when it's accessed with data()/str().
+  //
+  // All member functions must be called from the main thread.
+  class UndoBuffer {
+  public:
+    UndoBuffer();
+    ~UndoBuffer();
+
+    void set(base::buffer&& data);
+    void set(const std::string& data);
+    void clear();
+
+    // Restores the uncompressed data in memory. Returns false if the
+    // data cannot be decompressed or read from the spill file, in
+    // that case data()/str() cannot be used (the command that owns
+    // this buffer must not be undone/redone).
+    bool load();
+
+    // Returns the uncompressed data to read or modify it. If the
+    // buffer was compressed it's decompressed again. Throws a
+    // base::Exception if the data cannot be restored (see load()).
+    base::buffer& data();
+    std::string str();
+
+    // Size of the uncompressed data.
+    std::size_t size() const;
+
+    // Bytes used in memory by this buffer (uncompressed or compressed
+    // size, or 0 if the data is in the spill file).
+    std::size_t memSize() const;
+
+    bool isCompressed() const;
+    bool isSpilled() const;
+
+    // Starts the compression of the data in a background thread.
+    // Returns true if the data is being compressed, or false if
+    // there is nothing to compress (e.g. the data is too small,
+    // incompressible, or it's already compressed).
+    bool startCompression();
+
+    // Replaces the uncompressed data with the compressed data if the
+    // compression started with startCompression() has finished.
+    // Returns false if the compression hasn't finished yet.
+    bool finishCompression();
+
+    // Compresses the data (if it's not compressed yet) and saves it
+    // in the given file, releasing the memory used by the buffer.
+    //
+    // The data is compressed in the calling thread (only if there is
+    // no background compression already running for this buffer, in
+    // that case its result is used). It cannot be delayed to a
+    // background thread: the caller needs the memory released when
+    // this function returns, otherwise the undo state would be
+    // discarded because the undo history is still over the limit.
+    bool spill(UndoSpillFile* file);
+
+  private:
+    struct Data;
+    std::shared_ptr<Data> m_data;
+
+    DISABLE_COPYING(UndoBuffer);
+  };
+
+  using UndoBuffers = std::vector<UndoBuffer*>;
+
+  // Temporary file where the oldest undo data is saved when the undo
+  // history uses more memory than the limit specified in the
+  // preferences. The file is deleted when this object is destroyed.
+  class UndoSpillFile {
+  public:
+    UndoSpillFile();
+    ~UndoSpillFile();
+
+    // Returns the position of the written data in the file, or -1 if
+    // the data cannot be written.
+    int64_t write(const base::buffer& data);
+    bool read(const int64_t pos, base::buffer& data);
+
+    // Empty if nothing was written yet
+    const std::string& filename() const { return m_filename; }
+
+  private:
+    bool open();
+
+    std::string m_filename;
+    std::fstream m_file;
+    int64_t m_size = 0;
+
+    DISABLE_COPYING(UndoSpillFile);
+  };
+
+} // namespace app
+
+#endif
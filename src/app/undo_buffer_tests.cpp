@@ -0,0 +1,185 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/undo_buffer.h"
+#include "base/buffer.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+using namespace app;
+
+// Data that can be compressed (a gradient with some noise)
+static base::buffer make_data(const std::size_t size)
+{
+  base::buffer data(size);
+  std::srand(int(size));
+  for (std::size_t i=0; i<size; ++i)
+    data[i] = uint8_t((i / 64) + (std::rand() % 4));
+  return data;
+}
+
+static bool wait_compression(UndoBuffer& buffer)
+{
+  for (int i=0; i<1000; ++i) {
+    if (buffer.finishCompression())
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+TEST(UndoBuffer, CompressAndFinish)
+{
+  const base::buffer orig = make_data(256*1024);
+  UndoBuffer buffer;
+  buffer.set(base::buffer(orig));
+  EXPECT_EQ(orig.size(), buffer.memSize());
+
+  ASSERT_TRUE(buffer.startCompression());
+  // The memory is the same until finishCompression() is called
+  EXPECT_EQ(orig.size(), buffer.memSize());
+
+  ASSERT_TRUE(wait_compression(buffer));
+  EXPECT_TRUE(buffer.isCompressed());
+  EXPECT_LT(buffer.memSize(), orig.size());
+  EXPECT_EQ(orig.size(), buffer.size());
+
+  // Nothing else to compress
+  EXPECT_FALSE(buffer.startCompression());
+
+  EXPECT_TRUE(buffer.data() == orig);
+  EXPECT_FALSE(buffer.isCompressed());
+  EXPECT_EQ(orig.size(), buffer.memSize());
+}
+
+TEST(UndoBuffer, SmallBuffersAreNotCompressed)
+{
+  UndoBuffer buffer;
+  buffer.set(make_data(16));
+  EXPECT_FALSE(buffer.startCompression());
+  EXPECT_FALSE(buffer.finishCompression());
+  EXPECT_FALSE(buffer.isCompressed());
+}
+
+TEST(UndoBuffer, CancelCompression)
+{
+  const base::buffer orig = make_data(1024*1024);
+  for (int i=0; i<8; ++i) {
+    UndoBuffer buffer;
+    buffer.set(base::buffer(orig));
+    ASSERT_TRUE(buffer.startCompression());
+
+    // Accessing the data cancels the compression (waiting the job
+    // if it's already running)
+    base::buffer& data = buffer.data();
+    EXPECT_TRUE(data == orig);
+    EXPECT_FALSE(buffer.isCompressed());
+    EXPECT_FALSE(buffer.finishCompression());
+
+    // The data can be modified and compressed again
+    data[0] = 255;
+    ASSERT_TRUE(buffer.startCompression());
+    ASSERT_TRUE(wait_compression(buffer));
+    EXPECT_EQ(255, buffer.data()[0]);
+  }
+
+  // Destroying the buffer during the compression
+  for (int i=0; i<8; ++i) {
+    UndoBuffer buffer;
+    buffer.set(base::buffer(orig));
+    ASSERT_TRUE(buffer.startCompression());
+  }
+}
+
+TEST(UndoBuffer, SpillAndReload)
+{
+  const base::buffer orig1 = make_data(64*1024);
+  base::buffer orig2(1024);   // Incompressible data
+  std::srand(1);
+  for (auto& v : orig2)
+    v = uint8_t(std::rand());
+
+  std::string filename;
+  {
+    UndoSpillFile file;
+    UndoBuffer buffer1, buffer2, buffer3;
+    buffer1.set(base::buffer(orig1));
+    buffer2.set(base::buffer(orig2));
+
+    // Spill a buffer that is being compressed in background
+    buffer3.set(base::buffer(orig1));
+    buffer3.startCompression();
+
+    ASSERT_TRUE(buffer1.spill(&file));
+    ASSERT_TRUE(buffer2.spill(&file));
+    ASSERT_TRUE(buffer3.spill(&file));
+    for (UndoBuffer* buffer : { &buffer1, &buffer2, &buffer3 }) {
+      EXPECT_TRUE(buffer->isSpilled());
+      EXPECT_EQ(0u, buffer->memSize());
+    }
+    EXPECT_EQ(orig1.size(), buffer1.size());
+    EXPECT_EQ(orig2.size(), buffer2.size());
+
+    filename = file.filename();
+    EXPECT_TRUE(base::is_file(filename));
+
+    // Load them in a different order
+    EXPECT_TRUE(buffer2.load());
+    EXPECT_FALSE(buffer2.isSpilled());
+    EXPECT_TRUE(buffer2.data() == orig2);
+    EXPECT_TRUE(buffer3.data() == orig1);
+    EXPECT_TRUE(buffer1.data() == orig1);
+    EXPECT_EQ(orig1.size(), buffer1.memSize());
+  }
+  // The file is deleted with the UndoSpillFile
+  EXPECT_FALSE(base::is_file(filename));
+}
+
+TEST(UndoBuffer, CorruptSpillFile)
+{
+  const base::buffer orig = make_data(64*1024);
+  UndoSpillFile file;
+  UndoBuffer buffer;
+  buffer.set(base::buffer(orig));
+  ASSERT_TRUE(buffer.spill(&file));
+
+  // Overwrite the compressed data with zeros
+  {
+    std::fstream f(FSTREAM_PATH(file.filename()),
+                   std::fstream::in | std::fstream::out | std::fstream::binary);
+    ASSERT_TRUE(f.is_open());
+    const std::string zeros(1024, 0);
+    f.write(zeros.data(), zeros.size());
+  }
+
+  EXPECT_FALSE(buffer.load());
+  EXPECT_TRUE(buffer.isSpilled());
+  EXPECT_THROW(buffer.data(), base::Exception);
+}
+
+TEST(UndoBuffer, MissingSpillData)
+{
+  const base::buffer orig = make_data(64*1024);
+  UndoSpillFile file;
+  UndoBuffer buffer;
+  buffer.set(base::buffer(orig));
+  ASSERT_TRUE(buffer.spill(&file));
+
+  // Truncate the file
+  std::ofstream(FSTREAM_PATH(file.filename()),
+                std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+
+  EXPECT_FALSE(buffer.load());
+  EXPECT_THROW(buffer.str(), base::Exception);
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -99,6 +99,7 @@ void create_region_with_differences_templ(const Image* a,
   }
 }
 
+#ifdef _DEBUG
 // TODO merge this with Sprite::getTilemapsByTileset()
 template<typename UnaryFunction>
 void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
@@ -112,6 +113,7 @@ void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
     for_each_pixel<TilemapTraits>(tilemapImage, f);
   }
 }
+#endif
 
 struct Mod {
   tile_index tileIndex;
@@ -120,38 +122,6 @@ struct Mod {
   gfx::Region tileRgn;
 };
 
-class DoFlip {
-public:
-  DoFlip(const doc::ImageRef& image,
-         const doc::algorithm::FlipType flipType)
-    : m_image(image.get())
-    , m_flipType(flipType) {
-  }
-  ~DoFlip() {
-    reset();
-  }
-  void flip() {
-    m_flipped = !m_flipped;
-    doc::algorithm::flip_image(m_image,
-                               m_image->bounds(),
-                               m_flipType);
-  }
-  void reset() {
-    if (m_flipped)
-      flip();
-  }
-  bool operator!() const {
-    return !m_flipped;
-  }
-private:
-  doc::Image* m_image;
-  bool m_flipped = false;
-  doc::algorithm::FlipType m_flipType;
-};
-
-// This is a terrible way to find tiles, i.e. flipping several times
-// the image, instead of searching for flipped hashes. In the future
-// we could try to improve it.
 bool find_tile(doc::Tileset* tileset,
                doc::ImageRef& tileImage,
                doc::tile_index& tileIndex,
@@ -166,88 +136,12 @@ bool find_tile(doc::Tileset* tileset,
   if (tileset->matchFlags() == 0) // In case we don't allow flipped tiles
     return false;
 
-  DoFlip x(tileImage, doc::algorithm::FlipHorizontal);
-
-  // Find with X flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    x.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip;
-      return true;
-    }
-    x.reset();
-  }
-
-  // Find with Y flip
-  DoFlip y(tileImage, doc::algorithm::FlipVertical);
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    y.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_yflip;
-      return true;
-    }
-
-    if (tileset->matchFlags() & doc::tile_f_xflip) {
-      // Find with X+Y flip
-      x.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip;
-        return true;
-      }
-      x.reset();
-    }
-    y.reset();
-  }
-
-  // Check if we can match diagonal flips
-  if ((tileset->matchFlags() & doc::tile_f_dflip) == 0)
-    return false;
-
-  // Find with D flip
-  DoFlip d(tileImage, doc::algorithm::FlipDiagonal);
-  d.flip();
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
-    tileFlags = doc::tile_f_dflip;
-    return true;
-  }
-
-  // Find with X+D flip
-  if (tileset->matchFlags() & doc::tile_f_xflip) {
-    d.reset();
-    x.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags = doc::tile_f_xflip | doc::tile_f_dflip;
-      return true;
-    }
-
-    // Find with X+Y+D flip
-    if (tileset->matchFlags() & doc::tile_f_yflip) {
-      d.reset();
-      y.flip();
-      d.flip();
-      if (tileset->findTileIndex(tileImage, tileIndex)) {
-        tileFlags = doc::tile_f_xflip | doc::tile_f_yflip | doc::tile_f_dflip;
-        return true;
-      }
-    }
-  }
-
-  // Find with Y+D flip only
-  if (tileset->matchFlags() & doc::tile_f_yflip) {
-    d.reset();
-    x.reset();
-    if (!y)
-      y.flip();
-    d.flip();
-    if (tileset->findTileIndex(tileImage, tileIndex)) {
-      tileFlags =  doc::tile_f_yflip | doc::tile_f_dflip;
-      return true;
-    }
-  }
-
-  // DoFlip destructors will reset the image.
-  return false;
+  // Find all the flipped versions of the tile with just one lookup
+  // (without flipping the image several times)
+  return tileset->findTileIndexWithFlags(tileImage,
+                                         tileset->matchFlags(),
+                                         tileIndex,
+                                         tileFlags);
 }
 
 } // anonymous namespace
@@ -647,17 +541,12 @@ void modify_tilemap_cel_region(
     regionToPatch |= region;
 
     std::vector<bool> modifiedTileIndexes(tileset->size(), false);
-    std::vector<size_t> tilesHistogram(tileset->size(), 0);
+    std::vector<size_t> tilesHistogram;
     if (tilesetMode == TilesetMode::Auto) {
-      for_each_tile_using_tileset(
-        tileset, [tileset, &tilesHistogram](const doc::tile_t t){
-                   if (t != doc::notile) {
-                     doc::tile_index ti = doc::tile_geti(t);
-                     if (ti >= 0 && ti < tileset->size())
-                       ++tilesHistogram[ti];
-                   }
-                 });
+      // Only tilemaps modified since the last time are scanned
+      tilesHistogram = tileset->tilesHistogram();
     }
+    tilesHistogram.resize(tileset->size(), 0);
 
     for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(regionToPatch)) {
       const int u = tilePt.x-newTilemapBounds.x;
@@ -956,33 +845,27 @@ static void remove_unused_tiles_from_tileset(
 {
   OPS_TRACE("remove_unused_tiles_from_tileset\n");
 
-  int n = tileset->size();
-#ifdef _DEBUG
-  // Histogram just to check that we've a correct tilesHistogram
-  std::vector<size_t> tilesHistogram2(n, 0);
-#endif
+  // The tileset histogram includes tiles outside the valid range
+  // referenced by tilemaps (e.g. when we resize the tileset deleting
+  // tiles that will not be present anymore)
+  const std::vector<size_t>& tilesHistogram2 = tileset->tilesHistogram();
+  const int n = std::max<int>(tileset->size(), tilesHistogram2.size());
 
+#ifdef _DEBUG
+  // Check that we've a correct tilesHistogram (and the incremental
+  // tileset histogram is equal to the one from scratch)
+  std::vector<size_t> tilesHistogram3(tilesHistogram2.size(), 0);
   for_each_tile_using_tileset(
     tileset,
-    [&n
-#ifdef _DEBUG
-     , &tilesHistogram2
-#endif
-     ](const doc::tile_t t){
+    [&tilesHistogram3](const doc::tile_t t){
       if (t != doc::notile) {
         const doc::tile_index ti = doc::tile_geti(t);
-        n = std::max<int>(n, ti+1);
-#ifdef _DEBUG
-        // This check is necessary in case the tilemap has a reference
-        // to a tile outside the valid range (e.g. when we resize the
-        // tileset deleting tiles that will not be present anymore)
-        if (ti >= 0 && ti < tilesHistogram2.size())
-          ++tilesHistogram2[ti];
-#endif
+        if (ti >= 0 && ti < tilesHistogram3.size())
+          ++tilesHistogram3[ti];
       }
     });
+  ASSERT(tilesHistogram2 == tilesHistogram3);
 
-#ifdef _DEBUG
   for (int k=0; k<tilesHistogram.size(); ++k) {
     OPS_TRACE("comparing [%d] -> %d vs %d\n", k, tilesHistogram[k], tilesHistogram2[k]);
     ASSERT(tilesHistogram[k] == tilesHistogram2[k]);
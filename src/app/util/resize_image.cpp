@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -14,6 +14,7 @@
 #include "app/cmd/set_cel_bounds.h"
 #include "app/cmd/set_cel_position.h"
 #include "app/tx.h"
+#include "app/util/worker_pool.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
@@ -46,7 +47,8 @@ doc::Image* resize_image(
     method,
     pal,
     rgbmap,
-    newImage->maskColor());
+    newImage->maskColor(),
+    &worker_pool());
 
   return newImage.release();
 }
@@ -91,7 +93,8 @@ void resize_cel_image(
         method,
         sprite->palette(cel->frame()),
         sprite->rgbMap(cel->frame()),
-        (cel->layer()->isBackground() ? -1: sprite->transparentColor()));
+        (cel->layer()->isBackground() ? -1: sprite->transparentColor()),
+        &worker_pool());
 
       tx(new cmd::ReplaceImage(sprite, cel->imageRef(), newImage));
     }
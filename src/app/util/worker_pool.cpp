@@ -0,0 +1,27 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/worker_pool.h"
+
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace app {
+
+base::thread_pool& worker_pool()
+{
+  static base::thread_pool pool(
+    std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+} // namespace app
@@ -0,0 +1,25 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_WORKER_POOL_H_INCLUDED
+#define APP_UTIL_WORKER_POOL_H_INCLUDED
+#pragma once
+
+namespace base {
+  class thread_pool;
+}
+
+namespace app {
+
+// Pool of threads shared by CPU-bound operations over the sprite
+// (e.g. applying filters) which split their work with
+// base::parallel_for(). It's created the first time it's used, with
+// one thread per hardware thread.
+base::thread_pool& worker_pool();
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,23 +15,31 @@
 #include "base/exception.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/mapped_file.h"
 #include "base/mask_shift.h"
+#include "base/parallel_for.h"
 #include "dio/aseprite_common.h"
 #include "dio/decode_delegate.h"
 #include "dio/file_interface.h"
 #include "dio/pixel_io.h"
 #include "doc/doc.h"
+#include "doc/lazy_image.h"
 #include "doc/util.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
 #include "gfx/color_space.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <vector>
 
 namespace dio {
 
+// Maximum number of bytes of compressed cels to read in each
+// prefetchCompressedCels() call.
+const size_t kMaxPrefetchBytes = 64*1024*1024;
+
 bool AsepriteDecoder::decode()
 {
   bool ignore_old_color_chunks = false;
@@ -89,6 +97,11 @@ bool AsepriteDecoder::decode()
   auto tag_end = sprite->tags().end();
 
   m_allLayers.clear();
+  m_prefetched.clear();
+  m_prefetchedFrames = 0;
+
+  // Decode cel images on demand
+  m_lazyFile = delegate()->lazyLoadFile();
 
   int current_level = -1;
   AsepriteExternalFiles extFiles;
@@ -98,8 +111,15 @@ bool AsepriteDecoder::decode()
   if (nframes > 1 && delegate()->decodeOneFrame())
     nframes = 1;
 
+  // Thread pool to decompress the cels of the next frames in parallel
+  base::thread_pool* pool = delegate()->threadPool();
+
   // Read frame by frame to end-of-file
   for (doc::frame_t frame=0; frame<nframes; ++frame) {
+    if (pool && frame >= m_prefetchedFrames)
+      prefetchCompressedCels(*pool, &header, frame, nframes,
+                             sprite->pixelFormat());
+
     // Start frame position
     size_t frame_pos = f()->tell();
     delegate()->progress((float)frame_pos / (float)header.size);
@@ -310,6 +330,9 @@ bool AsepriteDecoder::decode()
       break;
   }
 
+  m_prefetched.clear();
+  m_lazyFile.reset();
+
   delegate()->onSprite(sprite.release());
   return true;
 }
@@ -839,8 +862,249 @@ void read_compressed_image(FileInterface* f,
   }
 }
 
+// Compressed data of a cel read from the file (so it can be
+// decompressed from a worker thread or on demand). The positions are
+// the same as in the original file.
+class BufferFileInterface : public FileInterface {
+public:
+  BufferFileInterface(const uint8_t* data,
+                      const size_t size,
+                      const size_t dataPos)
+    : m_data(data)
+    , m_size(size)
+    , m_begin(dataPos)
+    , m_pos(dataPos)
+    , m_ok(true) {
+  }
+
+  bool ok() const override { return m_ok; }
+  size_t tell() override { return m_pos; }
+  void seek(size_t absPos) override { m_pos = absPos; }
+
+  uint8_t read8() override {
+    uint8_t value = 0;
+    readBytes(&value, 1);
+    return value;
+  }
+
+  size_t readBytes(uint8_t* buf, size_t n) override {
+    size_t n2 = 0;
+    if (m_pos >= m_begin && m_pos < m_begin+m_size) {
+      n2 = std::min(n, m_begin+m_size-m_pos);
+      std::copy(m_data+(m_pos-m_begin),
+                m_data+(m_pos-m_begin+n2), buf);
+      m_pos += n2;
+    }
+    if (n2 != n)
+      m_ok = false;
+    return n2;
+  }
+
+  void write8(uint8_t value) override {
+    m_ok = false;
+  }
+
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_begin;
+  size_t m_pos;
+  bool m_ok;
+};
+
+// Collects the errors found decoding a cel in a worker thread, so
+// they can be reported later to the real delegate.
+class PrefetchDelegate : public DecodeDelegate {
+public:
+  void error(const std::string& msg) override {
+    errors.push_back(msg);
+  }
+  std::vector<std::string> errors;
+};
+
+// Compressed cel image in a memory-mapped file, decoded when the
+// image is needed.
+class CompressedCelSource : public doc::LazyImageSource {
+public:
+  CompressedCelSource(const std::shared_ptr<base::MappedFile>& file,
+                      const AsepriteHeader& header,
+                      const size_t pos,
+                      const size_t chunk_end)
+    : m_file(file)
+    , m_header(header)
+    , m_pos(pos)
+    , m_end(chunk_end) {
+  }
+
+  doc::Image* decode(const doc::ImageSpec& spec) override {
+    std::unique_ptr<doc::Image> image(doc::Image::create(spec));
+    BufferFileInterface bf(
+      (m_file ? m_file->data()+m_pos: m_data.data()),
+      m_end-m_pos, m_pos);
+
+    // Errors cannot be reported at this point, the image is
+    // partially decoded (the same as when we load the whole file)
+    DecodeDelegate delegate;
+    read_compressed_image(&bf, &delegate, image.get(), &m_header, m_end);
+    return image.release();
+  }
+
+  bool isFromFile(const std::string& filename) const override {
+    return (m_file && m_file->filename() == filename);
+  }
+
+  void detach() override {
+    if (m_file) {
+      m_data.assign(m_file->data()+m_pos, m_file->data()+m_end);
+      m_file.reset();
+    }
+  }
+
+private:
+  std::shared_ptr<base::MappedFile> m_file;
+  std::vector<uint8_t> m_data;  // Compressed data when it's detached
+  AsepriteHeader m_header;
+  size_t m_pos;
+  size_t m_end;
+};
+
 } // anonymous namespace
 
+//////////////////////////////////////////////////////////////////////
+// Parallel decoding of compressed cels
+//////////////////////////////////////////////////////////////////////
+
+// Scans the chunks of the next frames (starting from the current
+// file position) reading the compressed data of all cels, and
+// decompresses them in the worker threads of the given pool. Then
+// readCelChunk() uses these images instead of decoding them. The
+// file position is restored at the end.
+void AsepriteDecoder::prefetchCompressedCels(base::thread_pool& pool,
+                                             const AsepriteHeader* header,
+                                             doc::frame_t frame,
+                                             const doc::frame_t nframes,
+                                             const doc::PixelFormat pixelFormat)
+{
+  struct Job {
+    size_t pos;                 // Position of the compressed data
+    size_t end;                 // End of the chunk
+    doc::PixelFormat pixelFormat;
+    int w, h;
+    std::vector<uint8_t> data;
+    PrefetchedImage result;
+  };
+  std::vector<Job> jobs;
+  size_t totalBytes = 0;
+
+  const doc::frame_t fromFrame = frame;
+  const size_t startPos = f()->tell();
+  for (; frame<nframes && totalBytes < kMaxPrefetchBytes; ++frame) {
+    const size_t frame_pos = f()->tell();
+    AsepriteFrameHeader frame_header;
+    readFrameHeader(&frame_header);
+
+    // Broken file, the sequential reading will report the problem
+    if (!f()->ok() || frame_pos+frame_header.size > header->size)
+      break;
+
+    if (frame_header.magic == ASE_FILE_FRAME_MAGIC) {
+      for (uint32_t c=0; c<frame_header.chunks; c++) {
+        const size_t chunk_pos = f()->tell();
+        const size_t chunk_size = read32();
+        const int chunk_type = read16();
+        const size_t chunk_end = chunk_pos+chunk_size;
+        if (chunk_end > frame_pos+frame_header.size)
+          break;
+
+        if (chunk_type == ASE_FILE_CHUNK_CEL) {
+          readPadding(7);       // Layer index, x, y, opacity
+          const int cel_type = read16();
+          readPadding(7);       // z-index + reserved
+
+          doc::PixelFormat celPixelFormat = pixelFormat;
+          int w = 0, h = 0;
+
+          // Lazy images are not decoded now
+          if (cel_type == ASE_FILE_COMPRESSED_CEL && !m_lazyFile) {
+            w = read16();
+            h = read16();
+          }
+          else if (cel_type == ASE_FILE_COMPRESSED_TILEMAP) {
+            w = read16();
+            h = read16();
+            const int bitsPerTile = read16();
+            readPadding(4*4 + 10); // Masks + reserved
+            if (bitsPerTile != 32)
+              w = h = 0;
+            celPixelFormat = doc::IMAGE_TILEMAP;
+          }
+
+          const size_t pos = f()->tell();
+          if (w > 0 && h > 0 && pos < chunk_end) {
+            Job job;
+            job.pos = pos;
+            job.end = chunk_end;
+            job.pixelFormat = celPixelFormat;
+            job.w = w;
+            job.h = h;
+            job.data.resize(chunk_end - pos);
+            job.data.resize(readBytes(&job.data[0], job.data.size()));
+            totalBytes += job.data.size();
+            jobs.push_back(std::move(job));
+          }
+        }
+
+        f()->seek(chunk_end);
+      }
+    }
+
+    f()->seek(frame_pos+frame_header.size);
+  }
+
+  // Next frames will be prefetched in another call
+  m_prefetchedFrames = std::max(frame, fromFrame+1);
+  f()->seek(startPos);
+
+  base::parallel_for(
+    pool, 0, int(jobs.size()),
+    [&jobs, header](const int i){
+      Job& job = jobs[i];
+      doc::ImageRef image(doc::Image::create(job.pixelFormat, job.w, job.h));
+      if (job.pixelFormat == doc::IMAGE_TILEMAP) {
+        image->setMaskColor(doc::notile);
+        image->clear(doc::notile);
+      }
+
+      BufferFileInterface bf(job.data.data(), job.data.size(), job.pos);
+      PrefetchDelegate delegate;
+      read_compressed_image(&bf, &delegate, image.get(), header, job.end);
+
+      job.result.image = image;
+      job.result.errors = std::move(delegate.errors);
+      job.data = std::vector<uint8_t>();
+    });
+
+  for (Job& job : jobs)
+    m_prefetched[job.pos] = std::move(job.result);
+}
+
+// Returns the image decoded by prefetchCompressedCels() for the
+// compressed data at the given position (or nullptr if it wasn't
+// prefetched).
+doc::ImageRef AsepriteDecoder::takePrefetchedImage(const size_t pos)
+{
+  auto it = m_prefetched.find(pos);
+  if (it == m_prefetched.end())
+    return nullptr;
+
+  PrefetchedImage prefetched = std::move(it->second);
+  m_prefetched.erase(it);
+
+  for (const std::string& msg : prefetched.errors)
+    delegate()->error(msg);
+  return prefetched.image;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
@@ -931,9 +1195,26 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int w = read16();
       int h = read16();
 
-      if (w > 0 && h > 0) {
-        doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+      const size_t pos = f()->tell();
+      if (w > 0 && h > 0 &&
+          m_lazyFile && pos < chunk_end && chunk_end <= m_lazyFile->size()) {
+        auto lazyImage = std::make_shared<doc::LazyImage>(
+          doc::ImageSpec(doc::ColorMode(pixelFormat), w, h),
+          std::make_unique<CompressedCelSource>(m_lazyFile, *header,
+                                                pos, chunk_end));
+
+        cel = std::make_unique<doc::Cel>(
+          frame, std::make_shared<doc::CelData>(lazyImage));
+        cel->setPosition(x, y);
+        cel->setOpacity(opacity);
+        cel->setZIndex(zIndex);
+      }
+      else if (w > 0 && h > 0) {
+        doc::ImageRef image = takePrefetchedImage(pos);
+        if (!image) {
+          image.reset(doc::Image::create(pixelFormat, w, h));
+          read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        }
 
         cel = std::make_unique<doc::Cel>(frame, image);
         cel->setPosition(x, y);
@@ -965,10 +1246,13 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       }
 
       if (w > 0 && h > 0) {
-        doc::ImageRef image(doc::Image::create(doc::IMAGE_TILEMAP, w, h));
-        image->setMaskColor(doc::notile);
-        image->clear(doc::notile);
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        doc::ImageRef image = takePrefetchedImage(f()->tell());
+        if (!image) {
+          image.reset(doc::Image::create(doc::IMAGE_TILEMAP, w, h));
+          image->setMaskColor(doc::notile);
+          image->clear(doc::notile);
+          read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        }
 
         // Check if the tileset of this tilemap has the
         // "ASE_TILESET_FLAG_ZERO_IS_NOTILE" we have to adjust all
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "dio/decoder.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/layer_list.h"
 #include "doc/pixel_format.h"
 #include "doc/slices.h"
@@ -18,9 +19,16 @@
 #include "doc/tileset.h"
 #include "doc/user_data.h"
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+namespace base {
+  class MappedFile;
+  class thread_pool;
+}
+
 namespace doc {
   class Cel;
   class Layer;
@@ -73,9 +81,29 @@ private:
                           const AsepriteExternalFiles& extFiles);
   const doc::UserData::Variant readPropertyValue(uint16_t type);
   void readTilesData(doc::Tileset* tileset, const AsepriteExternalFiles& extFiles);
+  void prefetchCompressedCels(base::thread_pool& pool,
+                              const AsepriteHeader* header,
+                              doc::frame_t frame,
+                              const doc::frame_t nframes,
+                              const doc::PixelFormat pixelFormat);
+  doc::ImageRef takePrefetchedImage(const size_t pos);
+
+  // Cel image decoded by prefetchCompressedCels() in a worker thread.
+  struct PrefetchedImage {
+    doc::ImageRef image;
+    std::vector<std::string> errors;
+  };
 
   doc::LayerList m_allLayers;
   std::vector<uint32_t> m_tilesetFlags;
+
+  // Images already decoded, the key is the position of the
+  // compressed data in the file.
+  std::map<size_t, PrefetchedImage> m_prefetched;
+  doc::frame_t m_prefetchedFrames = 0;
+
+  // File used to decode cel images on demand
+  std::shared_ptr<base::MappedFile> m_lazyFile;
 };
 
 } // namespace dio
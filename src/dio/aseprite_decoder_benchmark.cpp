@@ -0,0 +1,95 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/thread_pool.h"
+#include "dio/decode_delegate.h"
+#include "dio/decode_file.h"
+#include "dio/file_interface.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+class BenchmarkDelegate : public dio::DecodeDelegate {
+public:
+  BenchmarkDelegate(base::thread_pool* pool) : m_pool(pool) { }
+  base::thread_pool* threadPool() override { return m_pool; }
+private:
+  base::thread_pool* m_pool;
+};
+
+// Sprites to decode, by default the ones in tests/sprites, but
+// another directory (e.g. with bigger sprites) can be specified
+// with the ASEPRITE_BENCHMARK_SPRITES environment variable.
+std::vector<std::string> sprite_files()
+{
+  std::string dir;
+  if (const char* env = std::getenv("ASEPRITE_BENCHMARK_SPRITES"))
+    dir = env;
+  else
+    dir = base::join_path(base::get_file_path(__FILE__), "../../tests/sprites");
+
+  std::vector<std::string> files;
+  for (const auto& fn : base::list_files(dir, base::ItemType::Files, "*.aseprite"))
+    files.push_back(base::join_path(dir, fn));
+  return files;
+}
+
+} // anonymous namespace
+
+static void Bm_DecodeSprites(benchmark::State& state)
+{
+  const int threads = state.range(0);
+
+  // threads=0 means the serial path (without thread pool)
+  std::unique_ptr<base::thread_pool> pool;
+  if (threads > 0)
+    pool = std::make_unique<base::thread_pool>(threads);
+
+  const std::vector<std::string> files = sprite_files();
+  if (files.empty()) {
+    state.SkipWithError("No .aseprite files found");
+    return;
+  }
+
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    for (const auto& fn : files) {
+      base::FileHandle handle(base::open_file_with_exception(fn, "rb"));
+      dio::StdioFileInterface f(handle.get());
+      BenchmarkDelegate delegate(pool.get());
+      if (!dio::decode_file(&delegate, &f)) {
+        state.SkipWithError(("Error decoding " + fn).c_str());
+        return;
+      }
+      bytes += f.tell();
+    }
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(state.iterations() * files.size());
+}
+
+BENCHMARK(Bm_DecodeSprites)
+  ->Arg(0)
+  ->Arg(1)
+  ->Arg(2)
+  ->Arg(4)
+  ->Arg(8)
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
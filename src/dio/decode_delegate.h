@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,8 +13,14 @@
 #include "doc/frame.h"
 #include "doc/sprite.h"
 
+#include <memory>
 #include <string>
 
+namespace base {
+  class MappedFile;
+  class thread_pool;
+}
+
 namespace dio {
 
 class DecodeDelegate {
@@ -56,6 +62,19 @@ public:
   virtual bool cacheCompressedTilesets() const {
     return false;
   }
+
+  // Returns a thread pool to decompress cel images in parallel, or
+  // nullptr to decode everything in the calling thread.
+  virtual base::thread_pool* threadPool() {
+    return nullptr;
+  }
+
+  // Returns the same file that is being decoded mapped in memory to
+  // create cels which images are decoded on demand (see
+  // doc::LazyImage), or nullptr to decode all images.
+  virtual std::shared_ptr<base::MappedFile> lazyLoadFile() {
+    return nullptr;
+  }
 };
 
 } // namespace dio
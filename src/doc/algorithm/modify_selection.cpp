@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2021 Igara Studio S.A.
+// Copyright (c) 2021-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,18 +15,315 @@
 #include "doc/mask.h"
 #include "doc/primitives.h"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
-// TODO create morphological operators/functions in "doc" namespace
-// TODO the impl is not optimal, but is good enough as a first version
+namespace {
+
+// Creates the brush used to modify the selection (without the center
+// pixel, which is the pixel being modified)
+Image* create_kernel(const int radius, const BrushType brush)
+{
+  const int size = 2*radius+1;
+  Image* kernel = Image::create(IMAGE_BITMAP, size, size);
+  clear_image(kernel, 0);
+  if (brush == kCircleBrushType)
+    fill_ellipse(kernel, 0, 0, size-1, size-1, 0, 0, 1);
+  else
+    fill_rect(kernel, 0, 0, size-1, size-1, 1);
+  put_pixel(kernel, radius, radius, 0);
+  return kernel;
+}
+
+// The kernel (including the center pixel) as the horizontal extents
+// of each row, which is how we can dilate an image without checking
+// each pixel of the kernel.
+//
+// If a source row j has a pixel at a distance "g" to the left of the
+// pixel x (or at the right), the dilation includes the pixel x of
+// each row j-dy where the kernel row dy extends "g" pixels to the
+// left (or to the right). For convex kernels (both the circle and the
+// square), these "dy" rows are an interval [dyMin, dyMax], so each
+// source pixel adds just one or two intervals to each column.
+class Kernel {
+public:
+  using Interval = std::pair<int, int>; // dyMin, dyMax
+
+  Kernel(const int radius, const BrushType brush)
+    : m_radius(radius) {
+    std::unique_ptr<Image> kernel(create_kernel(radius, brush));
+    put_pixel(kernel.get(), radius, radius, 1);
+
+    const int size = 2*radius+1;
+    std::vector<int> left(size, -1);
+    std::vector<int> right(size, -1);
+    for (int v=0; v<size; ++v) {
+      int runs = 0;
+      for (int u=0; u<size; ++u) {
+        if (!get_pixel(kernel.get(), u, v))
+          continue;
+        if (u == 0 || !get_pixel(kernel.get(), u-1, v))
+          ++runs;
+        if (left[v] < 0)
+          left[v] = radius - u;
+        right[v] = u - radius;
+      }
+
+      // Each row must be just one run of pixels that includes the
+      // center column
+      if (runs > 1 ||
+          (runs == 1 && (left[v] < 0 || right[v] < 0))) {
+        m_valid = false;
+      }
+    }
+
+    // "m_leftRows[g]" are the rows of the kernel that extend at least
+    // "g" pixels to the left of the center.
+    calcIntervals(left, m_leftRows);
+    calcIntervals(right, m_rightRows);
+  }
+
+  int radius() const { return m_radius; }
+  bool isValid() const { return m_valid; }
+  const Interval& leftRows(const int g) const { return m_leftRows[g]; }
+  const Interval& rightRows(const int g) const { return m_rightRows[g]; }
+
+private:
+  void calcIntervals(const std::vector<int>& extents,
+                     std::vector<Interval>& intervals) {
+    const int size = int(extents.size());
+    intervals.resize(m_radius+1);
+    for (int g=0; g<=m_radius; ++g) {
+      int v0 = size, v1 = -1;
+      for (int v=0; v<size; ++v) {
+        if (extents[v] >= g) {
+          v0 = std::min(v0, v);
+          v1 = v;
+        }
+      }
+      // All rows in [v0, v1] must extend "g" pixels (convex kernel)
+      for (int v=v0; v<=v1; ++v) {
+        if (extents[v] < g)
+          m_valid = false;
+      }
+      intervals[g] = Interval(v0 - m_radius, v1 - m_radius);
+    }
+  }
+
+  int m_radius;
+  bool m_valid = true;
+  std::vector<Interval> m_leftRows;
+  std::vector<Interval> m_rightRows;
+};
+
+// Reads a row of a bitmap image as one byte per pixel. Returns false
+// if the whole row is empty.
+bool read_bitmap_row(const Image* image, const int y, uint8_t* row)
+{
+  const int w = image->width();
+  const uint8_t* p = image->getPixelAddress(0, y);
+  bool any = false;
+  for (int x=0; x<w; x+=8, ++p) {
+    const int n = std::min(8, w-x);
+    if (*p == 0) {
+      std::memset(row+x, 0, n);
+      continue;
+    }
+    any = true;
+    for (int k=0; k<n; ++k)
+      row[x+k] = ((*p >> k) & 1);
+  }
+  return any;
+}
+
+// Sets to 1 the pixels of a bitmap row (the row is clipped to the
+// image bounds).
+void write_bitmap_row(Image* image, const int x, const int y,
+                      const uint8_t* row, const int w)
+{
+  if (y < 0 || y >= image->height())
+    return;
+
+  const int x0 = std::max(0, -x);
+  const int x1 = std::min(w, image->width() - x);
+  uint8_t* p = image->getPixelAddress(0, y);
+  for (int u=x0; u<x1; ++u) {
+    if (row[u]) {
+      const int v = x+u;
+      p[v >> 3] |= (1 << (v & 7));
+    }
+  }
+}
+
+// Dilates a binary image of "w" columns using the given kernel. The
+// output rows [y0, y1) are generated with "putRow(y, row)", and
+// source rows are requested with "getRow(j, row)" (it must return
+// false if the row is empty). "outsideOn" indicates if the columns
+// outside [0, w) are on (1) or off (0) in the source rows.
+//
+// Each output row is O(w) independently of the kernel size: each
+// source pixel adds its intervals of covered rows to a ring buffer
+// of differences per column.
+template<typename GetRow, typename PutRow>
+void dilate(const Kernel& kernel,
+            const int w,
+            const int y0,
+            const int y1,
+            const bool outsideOn,
+            GetRow getRow,
+            PutRow putRow)
+{
+  const int r = kernel.radius();
+  const int ringSize = 2*r+2;
+  const int far = r+1;          // Distances > r don't cover any row
+
+  std::vector<uint8_t> row(w);
+  std::vector<int> left(w), right(w), count(w, 0);
+  std::vector<int> diff(ringSize*w, 0);
+  std::vector<uint8_t> covered(w);
+
+  auto addInterval = [&](const int j, const int x, const Kernel::Interval& rows) {
+    const int a = std::max(y0, j - rows.second);
+    const int b = j - rows.first;
+    if (a > b || a >= y1)
+      return;
+    ++diff[((a - y0) % ringSize)*w + x];
+    if (b+1 < y1)
+      --diff[((b+1 - y0) % ringSize)*w + x];
+  };
+
+  for (int j=y0-r; j<y1+r; ++j) {
+    if (getRow(j, row.data())) {
+      // Distance to the nearest pixel at the left and at the right
+      int d = (outsideOn ? 0: far);
+      for (int x=0; x<w; ++x) {
+        d = (row[x] ? 0: std::min(d+1, far));
+        left[x] = d;
+      }
+      d = (outsideOn ? 0: far);
+      for (int x=w-1; x>=0; --x) {
+        d = (row[x] ? 0: std::min(d+1, far));
+        right[x] = d;
+      }
+
+      for (int x=0; x<w; ++x) {
+        // A pixel at the left of "x" is reached by the kernel rows
+        // that extend to the left, and vice versa (when the pixel
+        // "x" itself is on, left == right == 0).
+        if (left[x] < far)
+          addInterval(j, x, kernel.leftRows(left[x]));
+        if (right[x] < far && right[x] > 0)
+          addInterval(j, x, kernel.rightRows(right[x]));
+      }
+    }
+
+    // All source rows that can cover the row "y" were processed
+    const int y = j - r;
+    if (y >= y0) {
+      int* rowDiff = &diff[((y - y0) % ringSize)*w];
+      for (int x=0; x<w; ++x) {
+        count[x] += rowDiff[x];
+        rowDiff[x] = 0;
+        covered[x] = (count[x] > 0 ? 1: 0);
+      }
+      putRow(y, covered.data());
+    }
+  }
+}
+
+} // anonymous namespace
+
 void modify_selection(const SelectionModifier modifier,
                       const Mask* srcMask,
                       Mask* dstMask,
                       const int radius,
-                      const doc::BrushType brush)
+                      const BrushType brush)
+{
+  const Kernel kernel(radius, brush);
+  if (!kernel.isValid()) {
+    modify_selection_slow(modifier, srcMask, dstMask, radius, brush);
+    return;
+  }
+
+  const Image* srcImage = srcMask->bitmap();
+  Image* dstImage = dstMask->bitmap();
+  const gfx::Point offset =
+    srcMask->bounds().origin() -
+    dstMask->bounds().origin();
+  const int w = srcImage->width();
+  const int h = srcImage->height();
+
+  switch (modifier) {
+
+    // Dilation of the selection (with "radius" pixels around the
+    // source image)
+    case SelectionModifier::Expand: {
+      const int r = radius;
+      dilate(
+        kernel, w+2*r, -r, h+r, false,
+        [srcImage, r, w, h](const int j, uint8_t* row) -> bool {
+          if (j < 0 || j >= h)
+            return false;
+          std::memset(row, 0, r);
+          std::memset(row+r+w, 0, r);
+          return read_bitmap_row(srcImage, j, row+r);
+        },
+        [dstImage, offset, r, w](const int y, const uint8_t* covered) {
+          write_bitmap_row(dstImage, offset.x-r, offset.y+y,
+                           covered, w+2*r);
+        });
+      break;
+    }
+
+    // Erosion of the selection: a selected pixel is kept if the
+    // kernel doesn't touch unselected pixels, i.e. it's not in the
+    // dilation of the unselected pixels (the outside of the source
+    // image is unselected too).
+    case SelectionModifier::Border:
+    case SelectionModifier::Contract: {
+      const bool border = (modifier == SelectionModifier::Border);
+      std::vector<uint8_t> srcRow(w), result(w);
+      dilate(
+        kernel, w, 0, h, true,
+        [srcImage, w, h](const int j, uint8_t* row) -> bool {
+          if (j < 0 || j >= h) {
+            std::memset(row, 1, w);
+          }
+          else {
+            read_bitmap_row(srcImage, j, row);
+            for (int x=0; x<w; ++x)
+              row[x] ^= 1;
+          }
+          return true;
+        },
+        [dstImage, srcImage, offset, border, w, &srcRow, &result]
+        (const int y, const uint8_t* covered) {
+          if (!read_bitmap_row(srcImage, y, srcRow.data()))
+            return;
+          for (int x=0; x<w; ++x) {
+            result[x] = (srcRow[x] &&
+                         (border ? covered[x]: !covered[x]) ? 1: 0);
+          }
+          write_bitmap_row(dstImage, offset.x, offset.y+y,
+                           result.data(), w);
+        });
+      break;
+    }
+  }
+}
+
+// TODO create morphological operators/functions in "doc" namespace
+void modify_selection_slow(const SelectionModifier modifier,
+                           const Mask* srcMask,
+                           Mask* dstMask,
+                           const int radius,
+                           const BrushType brush)
 {
   const doc::Image* srcImage = srcMask->bitmap();
   doc::Image* dstImage = dstMask->bitmap();
@@ -39,13 +336,7 @@ void modify_selection(const SelectionModifier modifier,
 
   // Create a kernel
   const int size = 2*radius+1;
-  std::unique_ptr<doc::Image> kernel(doc::Image::create(IMAGE_BITMAP, size, size));
-  doc::clear_image(kernel.get(), 0);
-  if (brush == doc::kCircleBrushType)
-    doc::fill_ellipse(kernel.get(), 0, 0, size-1, size-1, 0, 0, 1);
-  else
-    doc::fill_rect(kernel.get(), 0, 0, size-1, size-1, 1);
-  doc::put_pixel(kernel.get(), radius, radius, 0);
+  std::unique_ptr<doc::Image> kernel(create_kernel(radius, brush));
 
   int total = 0;                // Number of 1s in the kernel image
   for (int v=0; v<size; ++v)
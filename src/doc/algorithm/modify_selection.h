@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -22,11 +23,22 @@ namespace doc {
       Contract,
     };
 
+    // Modifies the selection with a square or circular brush of the
+    // given radius. The "dstMask" must be cleared and big enough to
+    // contain the result (it's not resized).
+    //
+    // modify_selection: O(1) per pixel (independent of the radius)
+    // modify_selection_slow: checks the whole brush for each pixel
     void modify_selection(const SelectionModifier modifier,
                           const Mask* srcMask,
                           Mask* dstMask,
                           const int radius,
                           const BrushType brush);
+    void modify_selection_slow(const SelectionModifier modifier,
+                               const Mask* srcMask,
+                               Mask* dstMask,
+                               const int radius,
+                               const BrushType brush);
 
   } // namespace algorithm
 } // namespace doc
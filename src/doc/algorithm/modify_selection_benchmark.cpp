@@ -0,0 +1,94 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/modify_selection.h"
+
+#include "doc/image.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+// Selection with an ellipse and a hole inside (like a common lasso
+// or magic wand selection)
+static void make_mask(Mask& mask, const int size)
+{
+  mask.replace(gfx::Rect(0, 0, size, size));
+  Image* bitmap = mask.bitmap();
+  clear_image(bitmap, 0);
+  fill_ellipse(bitmap, size/8, size/8, size*7/8, size*7/8, 0, 0, 1);
+  fill_rect(bitmap, size*3/8, size*3/8, size*5/8, size*5/8, 0);
+}
+
+template<typename Func>
+static void run_modify_selection(benchmark::State& state, Func func)
+{
+  const auto modifier = (SelectionModifier)state.range(0);
+  const auto brush = (BrushType)state.range(1);
+  const int radius = state.range(2);
+  const int size = state.range(3);
+
+  Mask src;
+  make_mask(src, size);
+
+  gfx::Rect dstBounds = src.bounds();
+  dstBounds.enlarge(radius);
+
+  for (auto _ : state) {
+    Mask dst;
+    dst.reserve(dstBounds);
+    func(modifier, &src, &dst, radius, brush);
+  }
+  state.SetItemsProcessed(state.iterations() * size * size);
+}
+
+void BM_ModifySelectionSlow(benchmark::State& state) {
+  run_modify_selection(state, modify_selection_slow);
+}
+
+void BM_ModifySelection(benchmark::State& state) {
+  run_modify_selection(state, modify_selection);
+}
+
+#define ARGS(MODIFIER, BRUSH, RADIUS, SIZE)                     \
+  ->Args({ int(SelectionModifier::MODIFIER), BRUSH, RADIUS, SIZE })
+
+#define DEFARGS(RADIUS, SIZE)                                   \
+  ARGS(Border, kCircleBrushType, RADIUS, SIZE)                  \
+  ARGS(Border, kSquareBrushType, RADIUS, SIZE)                  \
+  ARGS(Expand, kCircleBrushType, RADIUS, SIZE)                  \
+  ARGS(Expand, kSquareBrushType, RADIUS, SIZE)                  \
+  ARGS(Contract, kCircleBrushType, RADIUS, SIZE)                \
+  ARGS(Contract, kSquareBrushType, RADIUS, SIZE)
+
+BENCHMARK(BM_ModifySelectionSlow)
+  DEFARGS(1, 256)
+  DEFARGS(10, 256)
+  DEFARGS(1, 1024)
+  DEFARGS(10, 1024)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_ModifySelection)
+  DEFARGS(1, 256)
+  DEFARGS(10, 256)
+  DEFARGS(1, 1024)
+  DEFARGS(10, 1024)
+  DEFARGS(50, 1024)
+  DEFARGS(1, 4096)
+  DEFARGS(50, 4096)
+  DEFARGS(100, 4096)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
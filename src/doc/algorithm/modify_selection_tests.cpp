@@ -0,0 +1,101 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/modify_selection.h"
+
+#include "doc/image.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <memory>
+#include <random>
+
+using namespace doc;
+using namespace doc::algorithm;
+using namespace gfx;
+
+namespace {
+
+// Creates a mask with some random rectangles and ellipses, and some
+// isolated pixels
+std::unique_ptr<Mask> make_random_mask(const gfx::Rect& bounds,
+                                       const int seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> x(0, bounds.w-1);
+  std::uniform_int_distribution<int> y(0, bounds.h-1);
+
+  auto mask = std::make_unique<Mask>();
+  mask->replace(bounds);
+  Image* bitmap = mask->bitmap();
+  clear_image(bitmap, 0);
+
+  for (int i=0; i<4; ++i) {
+    const int x0 = x(gen), y0 = y(gen), x1 = x(gen), y1 = y(gen);
+    if (i & 1)
+      fill_ellipse(bitmap, std::min(x0, x1), std::min(y0, y1),
+                   std::max(x0, x1), std::max(y0, y1), 0, 0, 1);
+    else
+      fill_rect(bitmap, x0, y0, x1, y1, 1);
+  }
+  for (int i=0; i<bounds.w*bounds.h/50; ++i)
+    put_pixel(bitmap, x(gen), y(gen), (i & 1));
+  return mask;
+}
+
+} // anonymous namespace
+
+TEST(ModifySelection, SameResultAsSlowVersion)
+{
+  for (const BrushType brush : { kCircleBrushType, kSquareBrushType }) {
+    for (const auto modifier : { SelectionModifier::Border,
+                                 SelectionModifier::Expand,
+                                 SelectionModifier::Contract }) {
+      for (const int radius : { 0, 1, 2, 3, 5, 8, 13, 20 }) {
+        for (const gfx::Size& size : { gfx::Size(1, 1),
+                                      gfx::Size(9, 3),
+                                      gfx::Size(31, 47),
+                                      gfx::Size(64, 64) }) {
+          const gfx::Rect bounds(5, 7, size.w, size.h);
+          auto src = make_random_mask(bounds, size.w*radius);
+
+          // The destination is bigger to contain the expanded mask
+          gfx::Rect dstBounds = bounds;
+          dstBounds.enlarge(radius+3);
+          Mask a, b;
+          a.reserve(dstBounds);
+          b.reserve(dstBounds);
+
+          modify_selection(modifier, src.get(), &a, radius, brush);
+          modify_selection_slow(modifier, src.get(), &b, radius, brush);
+
+          ASSERT_TRUE(is_same_image(a.bitmap(), b.bitmap()))
+            << "Brush=" << int(brush)
+            << " Modifier=" << int(modifier)
+            << " Radius=" << radius
+            << " Size=" << size.w << "x" << size.h;
+
+          // Clipped destination (like Border/Contract in
+          // stroke_selection())
+          Mask c, d;
+          c.reserve(bounds);
+          d.reserve(bounds);
+          modify_selection(modifier, src.get(), &c, radius, brush);
+          modify_selection_slow(modifier, src.get(), &d, radius, brush);
+          ASSERT_TRUE(is_same_image(c.bitmap(), d.bitmap()));
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
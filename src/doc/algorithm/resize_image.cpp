@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "doc/algorithm/resize_image.h"
 
+#include "base/parallel_for.h"
 #include "doc/algorithm/rotsprite.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
@@ -18,13 +19,350 @@
 #include "doc/rgbmap.h"
 #include "gfx/point.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_WIN64)
+  #include <emmintrin.h>
+#endif
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Number of destination rows processed by each parallel_for() item
+constexpr int kRowsPerItem = 16;
+
+// Bilinear weights are fixed-point values in [0, 256]
+constexpr int kWeightBits = 8;
+constexpr int kWeightOne = (1 << kWeightBits);
+
+// Calls func(y0, y1) for bands of rows in [0, h), using the threads
+// of the given pool (if it's not nullptr). Each band writes only its
+// own rows of the destination image.
+template<typename Func>
+void for_each_row_band(base::thread_pool* pool, const int h, Func&& func)
+{
+  const int n = (h + kRowsPerItem - 1) / kRowsPerItem;
+  auto band = [h, &func](const int i) {
+    const int y0 = i*kRowsPerItem;
+    func(y0, std::min(h, y0+kRowsPerItem));
+  };
+  if (pool && n > 1)
+    base::parallel_for(*pool, 0, n, band);
+  else {
+    for (int i=0; i<n; ++i)
+      band(i);
+  }
+}
+
 template<typename ImageTraits>
-void resize_image_nearest(const Image* src, Image* dst)
+void resize_image_nearest(const Image* src, Image* dst, base::thread_pool* pool)
+{
+  using address_t = typename ImageTraits::address_t;
+  using const_address_t = typename ImageTraits::const_address_t;
+
+  const double x_ratio = double(src->width()) / double(dst->width());
+  const double y_ratio = double(src->height()) / double(dst->height());
+  const int w = dst->width();
+
+  // Source column of each destination column (the same values that
+  // resize_image_slow() calculates for each pixel)
+  std::vector<int> srcX(w);
+  for (int x=0; x<w; ++x)
+    srcX[x] = int(std::floor(x * x_ratio));
+
+  for_each_row_band(
+    pool, dst->height(),
+    [src, dst, y_ratio, w, &srcX](const int y0, const int y1) {
+      int prevY = -1;
+      for (int y=y0; y<y1; ++y) {
+        const int py = int(std::floor(y * y_ratio));
+        auto d = (address_t)dst->getPixelAddress(0, y);
+
+        // When we scale up, consecutive rows are equal
+        if (py == prevY) {
+          auto prev = (const_address_t)dst->getPixelAddress(0, y-1);
+          std::copy(prev, prev+w, d);
+          continue;
+        }
+        prevY = py;
+
+        auto s = (const_address_t)src->getPixelAddress(0, py);
+        for (int x=0; x<w; ++x)
+          d[x] = s[srcX[x]];
+      }
+    });
+}
+
+template<>
+void resize_image_nearest<BitmapTraits>(const Image* src, Image* dst, base::thread_pool* pool)
+{
+  const double x_ratio = double(src->width()) / double(dst->width());
+  const double y_ratio = double(src->height()) / double(dst->height());
+  const int w = dst->width();
+
+  std::vector<int> srcX(w);
+  for (int x=0; x<w; ++x)
+    srcX[x] = int(std::floor(x * x_ratio));
+
+  // Each row of a bitmap uses its own bytes, so bands of rows can be
+  // written in parallel too.
+  for_each_row_band(
+    pool, dst->height(),
+    [src, dst, y_ratio, w, &srcX](const int y0, const int y1) {
+      for (int y=y0; y<y1; ++y) {
+        const int py = int(std::floor(y * y_ratio));
+        for (int x=0; x<w; ++x)
+          put_pixel_fast<BitmapTraits>(
+            dst, x, y, get_pixel_fast<BitmapTraits>(src, srcX[x], py));
+      }
+    });
+}
+
+// Source positions (and fixed-point weights) of each destination
+// column/row for the bilinear interpolation. The positions are
+// clamped to the source size as in resize_image_slow().
+struct BilinearAxis {
+  std::vector<int> i1, i2, w;
+
+  BilinearAxis(const int srcSize, const int dstSize)
+    : i1(dstSize), i2(dstSize), w(dstSize) {
+    const double d = (dstSize > 1 ? (srcSize-1) * 1.0 / (dstSize-1): 0.0);
+    for (int i=0; i<dstSize; ++i) {
+      const double u = i * d;
+      int f = int(std::floor(u));
+      int f2;
+      if (f > srcSize-1)
+        f = f2 = srcSize-1;
+      else if (f == srcSize-1)
+        f2 = f;
+      else
+        f2 = f+1;
+      i1[i] = f;
+      i2[i] = f2;
+      w[i] = std::clamp(int((u - f)*kWeightOne + 0.5), 0, kWeightOne);
+    }
+  }
+};
+
+// Interpolates two rows of "n" 8-bit channels, the result has
+// kWeightBits of extra precision. This is the vertical pass of the
+// bilinear filter, and it's where most of the time is spent (the
+// whole source row is processed for each destination row).
+void lerp_rows(const uint8_t* a, const uint8_t* b, const int wb,
+               uint16_t* out, const int n)
+{
+  const int wa = kWeightOne - wb;
+  int i = 0;
+
+#if defined(__x86_64__) || defined(_WIN64)
+  // All x86-64 CPUs support SSE2. Products fit in 16 bits
+  // (255*256) so we can use _mm_mullo_epi16() on unsigned values.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i va = _mm_set1_epi16(short(wa));
+  const __m128i vb = _mm_set1_epi16(short(wb));
+  for (; i+16<=n; i+=16) {
+    const __m128i pa = _mm_loadu_si128((const __m128i*)(a+i));
+    const __m128i pb = _mm_loadu_si128((const __m128i*)(b+i));
+    const __m128i lo = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_unpacklo_epi8(pa, zero), va),
+      _mm_mullo_epi16(_mm_unpacklo_epi8(pb, zero), vb));
+    const __m128i hi = _mm_add_epi16(
+      _mm_mullo_epi16(_mm_unpackhi_epi8(pa, zero), va),
+      _mm_mullo_epi16(_mm_unpackhi_epi8(pb, zero), vb));
+    _mm_storeu_si128((__m128i*)(out+i), lo);
+    _mm_storeu_si128((__m128i*)(out+i+8), hi);
+  }
+#endif
+
+  for (; i<n; ++i)
+    out[i] = uint16_t(a[i]*wa + b[i]*wb);
+}
+
+// Horizontal pass of the bilinear filter for one destination pixel
+// of "C" channels (each channel of "row" comes from lerp_rows()).
+template<int C>
+inline void lerp_pixel(const uint16_t* row, const BilinearAxis& ax,
+                       const int x, uint8_t* out)
+{
+  const uint16_t* p1 = row + ax.i1[x]*C;
+  const uint16_t* p2 = row + ax.i2[x]*C;
+  const uint32_t wb = ax.w[x];
+  const uint32_t wa = kWeightOne - wb;
+  for (int c=0; c<C; ++c)
+    out[c] = uint8_t((p1[c]*wa + p2[c]*wb) >> (2*kWeightBits));
+}
+
+// Bilinear interpolation of RGB and grayscale images, where we can
+// interpolate each byte of the pixels (RgbTraits::pixel_t is RGBA
+// and GrayscaleTraits::pixel_t is VA) directly.
+template<typename ImageTraits>
+void resize_image_bilinear(const Image* src, Image* dst, base::thread_pool* pool)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  constexpr int C = sizeof(pixel_t);
+
+  const BilinearAxis ax(src->width(), dst->width());
+  const BilinearAxis ay(src->height(), dst->height());
+  const int w = dst->width();
+  const int n = src->width()*C;
+
+  for_each_row_band(
+    pool, dst->height(),
+    [src, dst, w, n, &ax, &ay](const int y0, const int y1) {
+      std::vector<uint16_t> row(n);
+      for (int y=y0; y<y1; ++y) {
+        lerp_rows(src->getPixelAddress(0, ay.i1[y]),
+                  src->getPixelAddress(0, ay.i2[y]),
+                  ay.w[y], row.data(), n);
+
+        uint8_t* d = dst->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x, d+=C)
+          lerp_pixel<C>(row.data(), ax, x, d);
+      }
+    });
+}
+
+// Bilinear interpolation of indexed images: source rows are
+// converted to RGBA with the palette (the mask color is converted to
+// a transparent color) and each interpolated RGBA color is mapped
+// to the palette again with the RgbMap.
+void resize_image_bilinear_indexed(const Image* src, Image* dst,
+                                   const Palette* pal,
+                                   const RgbMap* rgbmap,
+                                   const color_t maskColor,
+                                   base::thread_pool* pool)
+{
+  const BilinearAxis ax(src->width(), dst->width());
+  const BilinearAxis ay(src->height(), dst->height());
+  const int w = dst->width();
+  const int sw = src->width();
+
+  uint32_t colors[256];
+  for (int i=0; i<256; ++i) {
+    if (color_t(i) == maskColor)
+      colors[i] = pal->getEntry(i) & rgba_rgb_mask; // Set alpha = 0
+    else
+      colors[i] = pal->getEntry(i);
+  }
+
+  // A RgbMap that isn't precomputed calculates its entries lazily,
+  // so it cannot be used from several threads.
+  if (!rgbmap->isPrecomputed())
+    pool = nullptr;
+
+  for_each_row_band(
+    pool, dst->height(),
+    [src, dst, w, sw, &ax, &ay, &colors, rgbmap](const int y0, const int y1) {
+      // Source rows converted to RGBA (cached because consecutive
+      // destination rows use the same source rows when we scale up)
+      std::vector<uint32_t> rgbaRows[2] = { std::vector<uint32_t>(sw),
+                                            std::vector<uint32_t>(sw) };
+      int rgbaRowY[2] = { -1, -1 };
+      std::vector<uint16_t> row(sw*4);
+
+      auto getRgbaRow = [src, sw, &colors, &rgbaRows, &rgbaRowY]
+        (const int sy, const int other) -> const uint8_t* {
+        for (int j=0; j<2; ++j)
+          if (rgbaRowY[j] == sy)
+            return (const uint8_t*)rgbaRows[j].data();
+
+        // Replace the row that is not used by the other source row
+        const int j = (rgbaRowY[0] == other ? 1: 0);
+        auto s = (const IndexedTraits::const_address_t)src->getPixelAddress(0, sy);
+        uint32_t* d = rgbaRows[j].data();
+        for (int x=0; x<sw; ++x)
+          d[x] = colors[s[x]];
+        rgbaRowY[j] = sy;
+        return (const uint8_t*)d;
+      };
+
+      for (int y=y0; y<y1; ++y) {
+        const uint8_t* a = getRgbaRow(ay.i1[y], ay.i2[y]);
+        const uint8_t* b = getRgbaRow(ay.i2[y], ay.i1[y]);
+        lerp_rows(a, b, ay.w[y], row.data(), sw*4);
+
+        auto d = (IndexedTraits::address_t)dst->getPixelAddress(0, y);
+        for (int x=0; x<w; ++x) {
+          uint8_t c[4];
+          lerp_pixel<4>(row.data(), ax, x, c);
+          d[x] = rgbmap->mapColor(c[rgba_r_shift/8],
+                                  c[rgba_g_shift/8],
+                                  c[rgba_b_shift/8],
+                                  c[rgba_a_shift/8]);
+        }
+      }
+    });
+}
+
+} // anonymous namespace
+
+void resize_image(const Image* src,
+                  Image* dst,
+                  const ResizeMethod method,
+                  const Palette* pal,
+                  const RgbMap* rgbmap,
+                  const color_t maskColor,
+                  base::thread_pool* pool)
+{
+  switch (method) {
+
+    case RESIZE_METHOD_NEAREST_NEIGHBOR: {
+      ASSERT(src->pixelFormat() == dst->pixelFormat());
+
+      switch (src->pixelFormat()) {
+        case IMAGE_RGB: resize_image_nearest<RgbTraits>(src, dst, pool); break;
+        case IMAGE_GRAYSCALE: resize_image_nearest<GrayscaleTraits>(src, dst, pool); break;
+        case IMAGE_INDEXED: resize_image_nearest<IndexedTraits>(src, dst, pool); break;
+        case IMAGE_BITMAP: resize_image_nearest<BitmapTraits>(src, dst, pool); break;
+      }
+      break;
+    }
+
+    case RESIZE_METHOD_BILINEAR: {
+      ASSERT(src->pixelFormat() == dst->pixelFormat());
+
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:
+          resize_image_bilinear<RgbTraits>(src, dst, pool);
+          break;
+        case IMAGE_GRAYSCALE:
+          resize_image_bilinear<GrayscaleTraits>(src, dst, pool);
+          break;
+        case IMAGE_INDEXED:
+          // We cannot do interpolations between RGB values on indexed
+          // images without a palette/rgbmap.
+          if (!pal || !rgbmap)
+            resize_image_nearest<IndexedTraits>(src, dst, pool);
+          else
+            resize_image_bilinear_indexed(src, dst, pal, rgbmap, maskColor, pool);
+          break;
+        default:
+          resize_image_slow(src, dst, method, pal, rgbmap, maskColor);
+          break;
+      }
+      break;
+    }
+
+    case RESIZE_METHOD_ROTSPRITE: {
+      rotsprite_image(
+        dst, src, nullptr,
+        0, 0,
+        dst->width(), 0,
+        dst->width(), dst->height(),
+        0, dst->height(),
+        pool);
+      break;
+    }
+
+  }
+}
+
+template<typename ImageTraits>
+static void resize_image_nearest_slow(const Image* src, Image* dst)
 {
   double x_ratio = double(src->width()) / double(dst->width());
   double y_ratio = double(src->height()) / double(dst->height());
@@ -42,29 +380,27 @@ void resize_image_nearest(const Image* src, Image* dst)
   }
 }
 
-void resize_image(const Image* src,
-                  Image* dst,
-                  const ResizeMethod method,
-                  const Palette* pal,
-                  const RgbMap* rgbmap,
-                  const color_t maskColor)
+void resize_image_slow(const Image* src,
+                       Image* dst,
+                       const ResizeMethod method,
+                       const Palette* pal,
+                       const RgbMap* rgbmap,
+                       const color_t maskColor)
 {
   switch (method) {
 
-    // TODO optimize this
     case RESIZE_METHOD_NEAREST_NEIGHBOR: {
       ASSERT(src->pixelFormat() == dst->pixelFormat());
 
       switch (src->pixelFormat()) {
-        case IMAGE_RGB: resize_image_nearest<RgbTraits>(src, dst); break;
-        case IMAGE_GRAYSCALE: resize_image_nearest<GrayscaleTraits>(src, dst); break;
-        case IMAGE_INDEXED: resize_image_nearest<IndexedTraits>(src, dst); break;
-        case IMAGE_BITMAP: resize_image_nearest<BitmapTraits>(src, dst); break;
+        case IMAGE_RGB: resize_image_nearest_slow<RgbTraits>(src, dst); break;
+        case IMAGE_GRAYSCALE: resize_image_nearest_slow<GrayscaleTraits>(src, dst); break;
+        case IMAGE_INDEXED: resize_image_nearest_slow<IndexedTraits>(src, dst); break;
+        case IMAGE_BITMAP: resize_image_nearest_slow<BitmapTraits>(src, dst); break;
       }
       break;
     }
 
-    // TODO optimize this
     case RESIZE_METHOD_BILINEAR: {
       uint32_t color[4], dst_color = 0;
       double u, v, du, dv;
@@ -76,7 +412,7 @@ void resize_image(const Image* src,
       // images without a palette/rgbmap.
       if (dst->pixelFormat() == IMAGE_INDEXED &&
           (!pal || !rgbmap)) {
-        resize_image(
+        resize_image_slow(
           src, dst,
           RESIZE_METHOD_NEAREST_NEIGHBOR,
           pal, rgbmap, maskColor);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,10 @@
 #include "doc/color.h"
 #include "gfx/fwd.h"
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Image;
   class Palette;
@@ -30,12 +34,24 @@ namespace doc {
     // Warning: If you are using the RESIZE_METHOD_BILINEAR, it is
     // recommended to use 'fixup_image_transparent_colors' function
     // over the source image 'src' BEFORE using this routine.
+    //
+    // resize_image: processes bands of rows in parallel (if a thread
+    //   pool is given), the bilinear method uses fixed-point weights
+    //   (the result can differ in 1 from the slow version)
+    // resize_image_slow: calculates each pixel with doubles
     void resize_image(const Image* src,
                       Image* dst,
                       const ResizeMethod method,
                       const Palette* palette,
                       const RgbMap* rgbmap,
-                      const color_t maskColor);
+                      const color_t maskColor,
+                      base::thread_pool* pool = nullptr);
+    void resize_image_slow(const Image* src,
+                           Image* dst,
+                           const ResizeMethod method,
+                           const Palette* palette,
+                           const RgbMap* rgbmap,
+                           const color_t maskColor);
 
     // It does not modify the image to the human eye, but internally
     // tries to fixup all colors that are completely transparent
@@ -0,0 +1,148 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/resize_image.h"
+
+#include "base/thread_pool.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+using namespace doc;
+using namespace doc::algorithm;
+
+// Image with a gradient and some stripes (so nearest-neighbor and
+// bilinear interpolation have something to do)
+static ImageRef make_image(const PixelFormat format, const int size)
+{
+  ImageRef image(Image::create(format, size, size));
+  for (int y=0; y<size; ++y) {
+    for (int x=0; x<size; ++x) {
+      const int v = (x*255/size);
+      const int a = ((y/4) & 1 ? 255: y*255/size);
+      color_t c = 0;
+      switch (format) {
+        case IMAGE_RGB:       c = rgba(v, 255-v, (x^y) & 255, a); break;
+        case IMAGE_GRAYSCALE: c = graya(v, a); break;
+        case IMAGE_INDEXED:   c = (v ^ y) & 255; break;
+        case IMAGE_BITMAP:    c = ((x/3 + y/5) & 1); break;
+      }
+      put_pixel(image.get(), x, y, c);
+    }
+  }
+  return image;
+}
+
+static Palette make_palette()
+{
+  Palette pal(0, 256);
+  for (int i=0; i<256; ++i)
+    pal.setEntry(i, rgba((i & 7)*36, ((i>>3) & 7)*36, ((i>>6) & 3)*85, 255));
+  return pal;
+}
+
+// Arguments: method, pixel format, source size, scale factor (in
+// percentage), and number of threads (0 = without a thread pool)
+template<typename Func>
+static void run_resize_image(benchmark::State& state, Func func)
+{
+  const auto method = (ResizeMethod)state.range(0);
+  const auto format = (PixelFormat)state.range(1);
+  const int size = state.range(2);
+  const int scale = state.range(3);
+  const int threads = state.range(4);
+  const int dstSize = std::max(1, size*scale/100);
+
+  Palette::initBestfit();
+  const Palette pal = make_palette();
+  RgbMapRGB5A3 rgbmap;
+  rgbmap.regenerateMap(&pal, 0);
+
+  std::unique_ptr<base::thread_pool> pool;
+  if (threads > 0)
+    pool = std::make_unique<base::thread_pool>(threads);
+
+  // Like the app does for indexed images before using the RgbMap
+  // from several threads
+  rgbmap.precompute(pool.get());
+
+  ImageRef src = make_image(format, size);
+  ImageRef dst(Image::create(format, dstSize, dstSize));
+
+  for (auto _ : state)
+    func(src.get(), dst.get(), method, &pal, &rgbmap, pool.get());
+
+  state.SetItemsProcessed(state.iterations() * dstSize * dstSize);
+}
+
+void BM_ResizeImageSlow(benchmark::State& state) {
+  run_resize_image(
+    state,
+    [](const Image* src, Image* dst, ResizeMethod method,
+       const Palette* pal, const RgbMap* rgbmap, base::thread_pool*) {
+      resize_image_slow(src, dst, method, pal, rgbmap, 0);
+    });
+}
+
+void BM_ResizeImage(benchmark::State& state) {
+  run_resize_image(
+    state,
+    [](const Image* src, Image* dst, ResizeMethod method,
+       const Palette* pal, const RgbMap* rgbmap, base::thread_pool* pool) {
+      resize_image(src, dst, method, pal, rgbmap, 0, pool);
+    });
+}
+
+static const int kThreads = std::max(1, int(std::thread::hardware_concurrency()));
+
+#define ARGS(METHOD, FORMAT, SIZE, SCALE, THREADS)              \
+  ->Args({ METHOD, FORMAT, SIZE, SCALE, THREADS })
+
+#define DEFARGS(METHOD, FORMAT, SIZE, THREADS)                  \
+  ARGS(METHOD, FORMAT, SIZE, 25, THREADS)                       \
+  ARGS(METHOD, FORMAT, SIZE, 50, THREADS)                       \
+  ARGS(METHOD, FORMAT, SIZE, 150, THREADS)                      \
+  ARGS(METHOD, FORMAT, SIZE, 200, THREADS)                      \
+  ARGS(METHOD, FORMAT, SIZE, 400, THREADS)
+
+#define ALLFORMATS(METHOD, SIZE, THREADS)                       \
+  DEFARGS(METHOD, IMAGE_RGB, SIZE, THREADS)                     \
+  DEFARGS(METHOD, IMAGE_GRAYSCALE, SIZE, THREADS)               \
+  DEFARGS(METHOD, IMAGE_INDEXED, SIZE, THREADS)
+
+BENCHMARK(BM_ResizeImageSlow)
+  ALLFORMATS(RESIZE_METHOD_NEAREST_NEIGHBOR, 512, 0)
+  DEFARGS(RESIZE_METHOD_NEAREST_NEIGHBOR, IMAGE_BITMAP, 512, 0)
+  ALLFORMATS(RESIZE_METHOD_BILINEAR, 512, 0)
+  ALLFORMATS(RESIZE_METHOD_ROTSPRITE, 128, 0)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK(BM_ResizeImage)
+  ALLFORMATS(RESIZE_METHOD_NEAREST_NEIGHBOR, 512, 0)
+  ALLFORMATS(RESIZE_METHOD_NEAREST_NEIGHBOR, 512, kThreads)
+  DEFARGS(RESIZE_METHOD_NEAREST_NEIGHBOR, IMAGE_BITMAP, 512, 0)
+  DEFARGS(RESIZE_METHOD_NEAREST_NEIGHBOR, IMAGE_BITMAP, 512, kThreads)
+  ALLFORMATS(RESIZE_METHOD_BILINEAR, 512, 0)
+  ALLFORMATS(RESIZE_METHOD_BILINEAR, 512, kThreads)
+  ALLFORMATS(RESIZE_METHOD_ROTSPRITE, 128, 0)
+  ALLFORMATS(RESIZE_METHOD_ROTSPRITE, 128, kThreads)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2023  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,6 +9,7 @@
 #include "config.h"
 #endif
 
+#include "base/parallel_for.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image_impl.h"
 #include "doc/primitives.h"
@@ -19,154 +20,103 @@
 namespace doc {
 namespace algorithm {
 
+// Number of source rows processed by each parallel_for() item
+constexpr int kRowsPerItem = 16;
+
 // More information about EPX/Scale2x:
 // http://en.wikipedia.org/wiki/Pixel_art_scaling_algorithms#EPX.2FScale2.C3.97.2FAdvMAME2.C3.97
 // http://scale2x.sourceforge.net/algorithm.html
 // http://scale2x.sourceforge.net/scale2xandepx.html
+//
+// Scales the source rows [y0, y1) to the destination rows
+// [2*y0, 2*y1), so different bands of rows can be processed in
+// parallel.
 template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+static void image_scale2x_rows(Image* dst, const Image* src,
+                               int src_w, int src_h, int y0, int y1)
 {
-#if 0      // TODO complete this implementation that should be faster
-           // than using a lot of get/put_pixel_fast calls.
-  int dst_w = src_w*2;
-  int dst_h = src_h*2;
-
-  LockImageBits<ImageTraits> dstBits(dst, Image::WriteLock, gfx::Rect(0, 0, dst_w, dst_h));
-  const LockImageBits<ImageTraits> srcBits(src);
-
-  LockImageBits<ImageTraits>::iterator dstRow0_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow1_it = dstBits.begin();
-  LockImageBits<ImageTraits>::iterator dstRow0_end = dstBits.end();
-  LockImageBits<ImageTraits>::iterator dstRow1_end = dstBits.end();
-
-  // Iterators:
-  //   A
-  // C P B
-  //   D
-  //
-  // These iterators are displaced through src image and are modified in this way:
-  //
-  // P: is the simplest one, we just start from (0, 0) to srcEnd.
-  // A: starts from row 0 (so A = P in the first row), then we start
-  //    again from the row 0.
-  // B: It starts from (1, row) and in the last pixel we don't moved it.
-  // C: It starts from (0, 0) and then it is moved with a delay.
-  // D: It starts from row 1 and continues until we reach the last
-  //    row, in that case we start D iterator again.
-  //
-  LockImageBits<ImageTraits>::const_iterator itP, itA, itB, itC, itD, savedD;
-  LockImageBits<ImageTraits>::const_iterator srcEnd = srcBits.end();
-  color_t P, A, B, C, D;
-
-  // Adjust iterators
-  itP = itA = itB = itC = itD = savedD = srcBits.begin();
-  dstRow1_it += dst_w;
-  itD += src->width();
-
-  for (int y=0; y<src_h; ++y) {
-    if (y == 1) itA = srcBits.begin();
-    if (y == src_h-2) savedD = itD;
-    if (y == src_h-1) itD = savedD;
-    ++itB;
-
-    for (int x=0; x<src_w; ++x) {
-      ASSERT(itP != srcEnd);
-      ASSERT(itA != srcEnd);
-      ASSERT(itB != srcEnd);
-      ASSERT(itC != srcEnd);
-      ASSERT(itD != srcEnd);
-      ASSERT(dstRow0_it != dstRow0_end);
-      ASSERT(dstRow1_it != dstRow1_end);
-
-      P = *itP;
-      A = *itA;                 // y-1
-      B = *itB;                 // x+1
-      C = *itC;                 // x-1
-      D = *itD;                 // y+1
-
-      *dstRow0_it = (C == A && C != D && A != B ? A: P);
-      ++dstRow0_it;
-      *dstRow0_it = (A == B && A != C && B != D ? B: P);
-      ++dstRow0_it;
-
-      *dstRow1_it = (D == C && D != B && C != A ? C: P);
-      ++dstRow1_it;
-      *dstRow1_it = (B == D && B != A && D != C ? D: P);
-      ++dstRow1_it;
-
-      ++itP;
-      ++itA;
-      if (x < src_w-2) ++itB;
-      if (x > 0) ++itC;
-      ++itD;
+  using address_t = typename ImageTraits::address_t;
+  using const_address_t = typename ImageTraits::const_address_t;
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  for (int y=y0; y<y1; ++y) {
+    // Rows above/below (the same row on the edges)
+    auto rowP = (const_address_t)src->getPixelAddress(0, y);
+    auto rowA = (y > 0 ? (const_address_t)src->getPixelAddress(0, y-1): rowP);
+    auto rowD = (y < src_h-1 ? (const_address_t)src->getPixelAddress(0, y+1): rowP);
+    auto dst0 = (address_t)dst->getPixelAddress(0, 2*y);
+    auto dst1 = (address_t)dst->getPixelAddress(0, 2*y+1);
+
+    for (int x=0; x<src_w; ++x, dst0+=2, dst1+=2) {
+      const pixel_t P = rowP[x];
+      const pixel_t A = rowA[x];
+      const pixel_t B = (x < src_w-1 ? rowP[x+1]: P);
+      const pixel_t C = (x > 0 ? rowP[x-1]: P);
+      const pixel_t D = rowD[x];
+
+      dst0[0] = (C == A && C != D && A != B ? A: P);
+      dst0[1] = (A == B && A != C && B != D ? B: P);
+      dst1[0] = (D == C && D != B && C != A ? C: P);
+      dst1[1] = (B == D && B != A && D != C ? D: P);
     }
-
-    // Adjust iterators for the next two rows.
-    ++itB;
-    ++itC;
-    dstRow0_it += dst_w;
-    if (y < src_h-1)
-      dstRow1_it += dst_w;
   }
+}
 
-  // ASSERT(itP == srcEnd);
-  // ASSERT(itA == srcEnd);
-  // ASSERT(itB == srcEnd);
-  // ASSERT(itC == srcEnd);
-  // ASSERT(itD == srcEnd);
-  ASSERT(dstRow0_it == dstRow0_end);
-  ASSERT(dstRow1_it == dstRow1_end);
-#else
-
-#define A c[0]
-#define B c[1]
-#define C c[2]
-#define D c[3]
-#define P c[4]
-
-  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, 0, src_w*2, src_h*2));
-  auto dstIt = dstBits.begin();
-  auto dstIt2 = dstIt;
-
-  color_t c[5];
-  for (int y=0; y<src_h; ++y) {
-    dstIt2 += src_w*2;
+// Bitmaps don't have one pixel per address
+template<>
+void image_scale2x_rows<BitmapTraits>(Image* dst, const Image* src,
+                                      int src_w, int src_h, int y0, int y1)
+{
+  color_t A, B, C, D, P;
+  for (int y=y0; y<y1; ++y) {
     for (int x=0; x<src_w; ++x) {
-      P = get_pixel_fast<ImageTraits>(src, x, y);
-      A = (y > 0 ? get_pixel_fast<ImageTraits>(src, x, y-1): P);
-      B = (x < src_w-1 ? get_pixel_fast<ImageTraits>(src, x+1, y): P);
-      C = (x > 0 ? get_pixel_fast<ImageTraits>(src, x-1, y): P);
-      D = (y < src_h-1 ? get_pixel_fast<ImageTraits>(src, x, y+1): P);
-
-      *dstIt = (C == A && C != D && A != B ? A: P);
-      ++dstIt;
-      *dstIt = (A == B && A != C && B != D ? B: P);
-      ++dstIt;
-
-      *dstIt2 = (D == C && D != B && C != A ? C: P);
-      ++dstIt2;
-      *dstIt2 = (B == D && B != A && D != C ? D: P);
-      ++dstIt2;
+      P = get_pixel_fast<BitmapTraits>(src, x, y);
+      A = (y > 0 ? get_pixel_fast<BitmapTraits>(src, x, y-1): P);
+      B = (x < src_w-1 ? get_pixel_fast<BitmapTraits>(src, x+1, y): P);
+      C = (x > 0 ? get_pixel_fast<BitmapTraits>(src, x-1, y): P);
+      D = (y < src_h-1 ? get_pixel_fast<BitmapTraits>(src, x, y+1): P);
+
+      put_pixel_fast<BitmapTraits>(dst, 2*x,   2*y,   (C == A && C != D && A != B ? A: P));
+      put_pixel_fast<BitmapTraits>(dst, 2*x+1, 2*y,   (A == B && A != C && B != D ? B: P));
+      put_pixel_fast<BitmapTraits>(dst, 2*x,   2*y+1, (D == C && D != B && C != A ? C: P));
+      put_pixel_fast<BitmapTraits>(dst, 2*x+1, 2*y+1, (B == D && B != A && D != C ? D: P));
     }
-    dstIt += src_w*2;
   }
+}
 
-#endif
+template<typename ImageTraits>
+static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h,
+                              base::thread_pool* pool)
+{
+  const int n = (src_h + kRowsPerItem - 1) / kRowsPerItem;
+  auto band = [dst, src, src_w, src_h](const int i) {
+    const int y0 = i*kRowsPerItem;
+    image_scale2x_rows<ImageTraits>(dst, src, src_w, src_h,
+                                    y0, std::min(src_h, y0+kRowsPerItem));
+  };
+  if (pool && n > 1)
+    base::parallel_for(*pool, 0, n, band);
+  else {
+    for (int i=0; i<n; ++i)
+      band(i);
+  }
 }
 
-static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
+static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h,
+                          base::thread_pool* pool)
 {
   switch (src->pixelFormat()) {
-    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h, pool); break;
+    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h, pool); break;
+    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h, pool); break;
+    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h, pool); break;
   }
 }
 
 void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
+  int x3, int y3, int x4, int y4,
+  base::thread_pool* pool)
 {
   static ImageBufferPtr buf[3]; // TODO non-thread safe
 
@@ -199,15 +149,17 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   spr_copy->clear(maskColor);
   spr_copy->copy(spr, gfx::Clip(spr->bounds()));
 
+  // Scale the sprite 3 times (8x) swapping the source and
+  // destination images (instead of copying each intermediate result),
+  // so the final result is in spr_copy.
   for (int i=0; i<3; ++i) {
-    // clear_image(tmp_copy, maskColor);
-    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy.get(), gfx::Clip(tmp_copy->bounds()));
+    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i), pool);
+    std::swap(tmp_copy, spr_copy);
   }
 
   if (mask) {
-    // Same ImageBuffer than tmp_copy
-    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[1]));
+    // Same ImageBuffer than tmp_copy (after 3 swaps it's buf[2])
+    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[2]));
     clear_image(msk_copy.get(), 0);
     scale_image(msk_copy.get(), mask,
                 0, 0, msk_copy->width(), msk_copy->height(),
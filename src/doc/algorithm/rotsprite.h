@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -8,14 +9,21 @@
 #define DOC_ALGORITHM_ROTSPRITE_H_INCLUDED
 #pragma once
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Image;
 
   namespace algorithm {
 
+    // The scale2x steps are processed by bands of rows in parallel
+    // if a thread pool is given.
     void rotsprite_image(Image* dst, const Image* src, const Image* mask,
       int x1, int y1, int x2, int y2,
-      int x3, int y3, int x4, int y4);
+      int x3, int y3, int x4, int y4,
+      base::thread_pool* pool = nullptr);
 
   } // namespace algorithm
 } // namespace doc
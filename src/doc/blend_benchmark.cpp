@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,9 +10,13 @@
 #endif
 
 #include "doc/blend_funcs.h"
+#include "doc/blend_span.h"
 
 #include <benchmark/benchmark.h>
 
+#include <random>
+#include <vector>
+
 using namespace doc;
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
@@ -53,4 +58,51 @@ BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_saturation)->Apply(CustomArguments)
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_color)->Apply(CustomArguments);
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_luminosity)->Apply(CustomArguments);
 
+// Span blenders, arguments: blend mode, newBlend, instruction set
+static void SpanArguments(benchmark::internal::Benchmark* b) {
+  b->ArgNames({ "mode", "new", "isa" });
+  for (int mode=int(BlendMode::NORMAL); mode<=int(BlendMode::DIVIDE); ++mode)
+    for (int newBlend : { 0, 1 })
+      for (BlendIsa isa : { BlendIsa::Scalar, BlendIsa::SSE2, BlendIsa::AVX2 })
+        b->Args({ mode, newBlend, int(isa) });
+}
+
+template<typename Pixel>
+static auto get_span(BlendMode mode, bool newBlend, BlendIsa isa) {
+  if constexpr (sizeof(Pixel) == 4)
+    return get_rgba_span_blender(mode, newBlend, isa);
+  else
+    return get_graya_span_blender(mode, newBlend, isa);
+}
+
+template<typename Pixel>
+static void BM_Span(benchmark::State& state) {
+  const BlendMode mode = BlendMode(state.range(0));
+  const bool newBlend = (state.range(1) != 0);
+  const BlendIsa isa = BlendIsa(state.range(2));
+  if (!is_blend_isa_supported(isa)) {
+    state.SkipWithError("Instruction set not supported");
+    return;
+  }
+
+  const int n = 4096;
+  std::mt19937 gen(1);
+  std::vector<Pixel> dst(n), src(n);
+  for (int i=0; i<n; ++i) {
+    dst[i] = Pixel(gen());
+    src[i] = Pixel(gen());
+  }
+
+  auto span = get_span<Pixel>(mode, newBlend, isa);
+  while (state.KeepRunning()) {
+    span(&dst[0], &src[0], n, 200, 0);
+    benchmark::DoNotOptimize(dst[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetLabel(blend_mode_to_string(mode));
+}
+
+BENCHMARK_TEMPLATE(BM_Span, uint32_t)->Apply(SpanArguments);
+BENCHMARK_TEMPLATE(BM_Span, uint16_t)->Apply(SpanArguments);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,205 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/blend_span.h"
+
+#include "base/debug.h"
+#include "doc/blend_funcs.h"
+
+#if defined(_MSC_VER) && defined(_WIN64)
+  #include <intrin.h>
+#endif
+
+namespace doc {
+
+// Defined in blend_span_sse2.cpp and blend_span_avx2.cpp, they
+// return nullptr if the mode (or the instruction set) isn't
+// available.
+RgbaSpanBlendFunc get_rgba_span_blender_sse2(BlendMode blendmode, const bool newBlend);
+GrayaSpanBlendFunc get_graya_span_blender_sse2(BlendMode blendmode, const bool newBlend);
+RgbaSpanBlendFunc get_rgba_span_blender_avx2(BlendMode blendmode, const bool newBlend);
+GrayaSpanBlendFunc get_graya_span_blender_avx2(BlendMode blendmode, const bool newBlend);
+
+namespace {
+
+//////////////////////////////////////////////////////////////////////
+// Scalar reference implementation
+
+template<typename Pixel, BlendFunc F>
+void scalar_span(Pixel* dst, const Pixel* src,
+                 const int n, const int opacity, const color_t maskColor)
+{
+  for (int i=0; i<n; ++i, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = (*F)(*dst, *src, opacity);
+  }
+}
+
+#define RGBA_SPAN(name) { rgba_blender_##name, scalar_span<uint32_t, rgba_blender_##name> }
+#define GRAYA_SPAN(name) { graya_blender_##name, scalar_span<uint16_t, graya_blender_##name> }
+
+struct {
+  BlendFunc func;
+  RgbaSpanBlendFunc span;
+} const rgba_scalar_spans[] = {
+  RGBA_SPAN(src), RGBA_SPAN(merge), RGBA_SPAN(neg_bw),
+  RGBA_SPAN(red_tint), RGBA_SPAN(blue_tint),
+  RGBA_SPAN(normal), RGBA_SPAN(normal_dst_over),
+  RGBA_SPAN(multiply), RGBA_SPAN(multiply_n),
+  RGBA_SPAN(screen), RGBA_SPAN(screen_n),
+  RGBA_SPAN(overlay), RGBA_SPAN(overlay_n),
+  RGBA_SPAN(darken), RGBA_SPAN(darken_n),
+  RGBA_SPAN(lighten), RGBA_SPAN(lighten_n),
+  RGBA_SPAN(color_dodge), RGBA_SPAN(color_dodge_n),
+  RGBA_SPAN(color_burn), RGBA_SPAN(color_burn_n),
+  RGBA_SPAN(hard_light), RGBA_SPAN(hard_light_n),
+  RGBA_SPAN(soft_light), RGBA_SPAN(soft_light_n),
+  RGBA_SPAN(difference), RGBA_SPAN(difference_n),
+  RGBA_SPAN(exclusion), RGBA_SPAN(exclusion_n),
+  RGBA_SPAN(hsl_hue), RGBA_SPAN(hsl_hue_n),
+  RGBA_SPAN(hsl_saturation), RGBA_SPAN(hsl_saturation_n),
+  RGBA_SPAN(hsl_color), RGBA_SPAN(hsl_color_n),
+  RGBA_SPAN(hsl_luminosity), RGBA_SPAN(hsl_luminosity_n),
+  RGBA_SPAN(addition), RGBA_SPAN(addition_n),
+  RGBA_SPAN(subtract), RGBA_SPAN(subtract_n),
+  RGBA_SPAN(divide), RGBA_SPAN(divide_n),
+};
+
+struct {
+  BlendFunc func;
+  GrayaSpanBlendFunc span;
+} const graya_scalar_spans[] = {
+  GRAYA_SPAN(src), GRAYA_SPAN(merge), GRAYA_SPAN(neg_bw),
+  GRAYA_SPAN(normal), GRAYA_SPAN(normal_dst_over),
+  GRAYA_SPAN(multiply), GRAYA_SPAN(multiply_n),
+  GRAYA_SPAN(screen), GRAYA_SPAN(screen_n),
+  GRAYA_SPAN(overlay), GRAYA_SPAN(overlay_n),
+  GRAYA_SPAN(darken), GRAYA_SPAN(darken_n),
+  GRAYA_SPAN(lighten), GRAYA_SPAN(lighten_n),
+  GRAYA_SPAN(color_dodge), GRAYA_SPAN(color_dodge_n),
+  GRAYA_SPAN(color_burn), GRAYA_SPAN(color_burn_n),
+  GRAYA_SPAN(hard_light), GRAYA_SPAN(hard_light_n),
+  GRAYA_SPAN(soft_light), GRAYA_SPAN(soft_light_n),
+  GRAYA_SPAN(difference), GRAYA_SPAN(difference_n),
+  GRAYA_SPAN(exclusion), GRAYA_SPAN(exclusion_n),
+  GRAYA_SPAN(addition), GRAYA_SPAN(addition_n),
+  GRAYA_SPAN(subtract), GRAYA_SPAN(subtract_n),
+  GRAYA_SPAN(divide), GRAYA_SPAN(divide_n),
+};
+
+// The scalar span is found from the BlendFunc returned by
+// get_rgba/graya_blender() so we use exactly the same per-pixel
+// function.
+template<typename SpanFunc, typename Table>
+SpanFunc get_scalar_span(const BlendFunc func, const Table& table)
+{
+  for (const auto& item : table) {
+    if (item.func == func)
+      return item.span;
+  }
+  ASSERT(false);
+  return nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////
+// CPU features
+
+bool cpu_has_avx2()
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // The OS must save the AVX registers (OSXSAVE + AVX bits)
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 ||
+      (info[2] & (1 << 28)) == 0 ||
+      (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+} // anonymous namespace
+
+bool is_blend_isa_supported(BlendIsa isa)
+{
+  switch (isa) {
+    case BlendIsa::Scalar:
+      return true;
+    case BlendIsa::SSE2:
+      // All x86-64 CPUs support SSE2
+      return (get_rgba_span_blender_sse2(BlendMode::NORMAL, false) != nullptr);
+    case BlendIsa::AVX2: {
+      static const bool avx2 =
+        (cpu_has_avx2() &&
+         get_rgba_span_blender_avx2(BlendMode::NORMAL, false) != nullptr);
+      return avx2;
+    }
+  }
+  return false;
+}
+
+BlendIsa best_blend_isa()
+{
+  static const BlendIsa best =
+    (is_blend_isa_supported(BlendIsa::AVX2) ? BlendIsa::AVX2:
+     is_blend_isa_supported(BlendIsa::SSE2) ? BlendIsa::SSE2:
+                                              BlendIsa::Scalar);
+  return best;
+}
+
+RgbaSpanBlendFunc get_rgba_span_blender(BlendMode blendmode,
+                                        const bool newBlend,
+                                        const BlendIsa isa)
+{
+  RgbaSpanBlendFunc span = nullptr;
+  if (is_blend_isa_supported(isa)) {
+    switch (isa) {
+      case BlendIsa::Scalar: break;
+      case BlendIsa::SSE2: span = get_rgba_span_blender_sse2(blendmode, newBlend); break;
+      case BlendIsa::AVX2: span = get_rgba_span_blender_avx2(blendmode, newBlend); break;
+    }
+  }
+  if (!span) {
+    span = get_scalar_span<RgbaSpanBlendFunc>(
+      get_rgba_blender(blendmode, newBlend), rgba_scalar_spans);
+  }
+  return span;
+}
+
+GrayaSpanBlendFunc get_graya_span_blender(BlendMode blendmode,
+                                          const bool newBlend,
+                                          const BlendIsa isa)
+{
+  GrayaSpanBlendFunc span = nullptr;
+  if (is_blend_isa_supported(isa)) {
+    switch (isa) {
+      case BlendIsa::Scalar: break;
+      case BlendIsa::SSE2: span = get_graya_span_blender_sse2(blendmode, newBlend); break;
+      case BlendIsa::AVX2: span = get_graya_span_blender_avx2(blendmode, newBlend); break;
+    }
+  }
+  if (!span) {
+    span = get_scalar_span<GrayaSpanBlendFunc>(
+      get_graya_blender(blendmode, newBlend), graya_scalar_spans);
+  }
+  return span;
+}
+
+} // namespace doc
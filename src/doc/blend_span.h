@@ -0,0 +1,55 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_BLEND_SPAN_H_INCLUDED
+#define DOC_BLEND_SPAN_H_INCLUDED
+#pragma once
+
+#include "doc/blend_mode.h"
+#include "doc/color.h"
+
+#include <cstdint>
+
+namespace doc {
+
+  // Blends "n" consecutive "src" pixels over the "dst" pixels (the
+  // backdrop) and stores the result in "dst". Source pixels equal to
+  // "maskColor" are skipped (as BlenderHelper does). The result must
+  // be exactly the same as calling the BlendFunc of the same mode for
+  // each pixel.
+  typedef void (*RgbaSpanBlendFunc)(uint32_t* dst, const uint32_t* src,
+                                    int n, int opacity, color_t maskColor);
+  typedef void (*GrayaSpanBlendFunc)(uint16_t* dst, const uint16_t* src,
+                                     int n, int opacity, color_t maskColor);
+
+  // Instruction set used to blend spans. Scalar is the reference
+  // implementation (it just calls the BlendFunc of each pixel).
+  enum class BlendIsa {
+    Scalar,
+    SSE2,
+    AVX2,
+  };
+
+  // Returns true if the given instruction set was compiled in and is
+  // supported by the CPU we are running on.
+  bool is_blend_isa_supported(BlendIsa isa);
+
+  // Best instruction set available for this CPU (detected only once).
+  BlendIsa best_blend_isa();
+
+  // Returns a span blender for the given mode. If the mode doesn't
+  // have a SIMD implementation for "isa" (or "isa" isn't supported)
+  // the scalar version is returned.
+  RgbaSpanBlendFunc get_rgba_span_blender(BlendMode blendmode,
+                                          const bool newBlend,
+                                          const BlendIsa isa = best_blend_isa());
+  GrayaSpanBlendFunc get_graya_span_blender(BlendMode blendmode,
+                                            const bool newBlend,
+                                            const BlendIsa isa = best_blend_isa());
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,94 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/blend_span.h"
+
+// This file is compiled with AVX2 enabled (see doc/CMakeLists.txt),
+// its functions are used only if the CPU supports AVX2.
+#if defined(__AVX2__)
+
+#include "doc/blend_span_kernels.h"
+
+#include <immintrin.h>
+
+namespace doc {
+
+namespace {
+
+struct Avx2Ops {
+  using V = __m256i;
+  static constexpr int N = 8;
+
+  static V set1(const int v) { return _mm256_set1_epi32(v); }
+  static V add(const V a, const V b) { return _mm256_add_epi32(a, b); }
+  static V sub(const V a, const V b) { return _mm256_sub_epi32(a, b); }
+  static V and_(const V a, const V b) { return _mm256_and_si256(a, b); }
+  static V or_(const V a, const V b) { return _mm256_or_si256(a, b); }
+  static V andnot(const V a, const V b) { return _mm256_andnot_si256(a, b); }
+  static V cmpeq(const V a, const V b) { return _mm256_cmpeq_epi32(a, b); }
+  static V cmpgt(const V a, const V b) { return _mm256_cmpgt_epi32(a, b); }
+  static V sll(const V a, const int n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+  static V srl(const V a, const int n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+  static V sra(const V a, const int n) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+
+  // Same as in blend_span_sse2.cpp, _mm256_madd_epi16() is faster
+  // than _mm256_mullo_epi32() and it's enough for our ranges.
+  static V mul(const V a, const V b) { return _mm256_madd_epi16(a, b); }
+
+  static V div(const V a, const V b) {
+    return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a),
+                                             _mm256_cvtepi32_ps(b)));
+  }
+
+  static V select(const V m, const V a, const V b) {
+    return _mm256_blendv_epi8(b, a, m);
+  }
+
+  static V load32(const uint32_t* p) {
+    return _mm256_loadu_si256((const __m256i*)p);
+  }
+  static void store32(uint32_t* p, const V v) {
+    _mm256_storeu_si256((__m256i*)p, v);
+  }
+
+  static V load16(const uint16_t* p) {
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+  }
+  static void store16(uint16_t* p, const V v) {
+    _mm_storeu_si128((__m128i*)p,
+                     _mm_packus_epi32(_mm256_castsi256_si128(v),
+                                      _mm256_extracti128_si256(v, 1)));
+  }
+};
+
+} // anonymous namespace
+
+RgbaSpanBlendFunc get_rgba_span_blender_avx2(BlendMode blendmode, const bool newBlend)
+{
+  return blend_span::get_rgba_span_blender<Avx2Ops>(blendmode, newBlend);
+}
+
+GrayaSpanBlendFunc get_graya_span_blender_avx2(BlendMode blendmode, const bool newBlend)
+{
+  return blend_span::get_graya_span_blender<Avx2Ops>(blendmode, newBlend);
+}
+
+} // namespace doc
+
+#else
+
+namespace doc {
+
+RgbaSpanBlendFunc get_rgba_span_blender_avx2(BlendMode, const bool) { return nullptr; }
+GrayaSpanBlendFunc get_graya_span_blender_avx2(BlendMode, const bool) { return nullptr; }
+
+} // namespace doc
+
+#endif
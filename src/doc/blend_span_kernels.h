@@ -0,0 +1,468 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_BLEND_SPAN_KERNELS_H_INCLUDED
+#define DOC_BLEND_SPAN_KERNELS_H_INCLUDED
+#pragma once
+
+// Generic SIMD implementation of the span blenders. This file is
+// included only from blend_span_*.cpp files, each one defining an
+// "Ops" struct for a specific instruction set with these members:
+//
+//   V                     Vector type with N int32 lanes
+//   N                     Number of lanes
+//   set1(int)             All lanes with the same value
+//   add/sub/and_/or_      Lane-wise operations
+//   andnot(a, b)          ~a & b
+//   cmpeq/cmpgt           Lane-wise comparisons (signed)
+//   sll/srl/sra(a, n)     Shifts
+//   mul(a, b)             a*b for a in int16 range and b in [0,32767]
+//   div(a, b)             a/b (truncated towards zero) where the result
+//                         is known to be in [-255,255] and b in [1,255]
+//   select(m, a, b)       (m & a) | (~m & b)
+//   load32/store32        N uint32_t pixels
+//   load16/store16        N uint16_t pixels zero-extended to int32
+//
+// Each pixel channel uses one int32 lane, so we can replicate the
+// integer arithmetic of blend_funcs.cpp exactly (e.g. MUL_UN8() with
+// negative values, or the truncated divisions).
+
+#include "doc/blend_mode.h"
+#include "doc/blend_span.h"
+#include "doc/color.h"
+
+#include <cstring>
+
+namespace doc {
+namespace blend_span {
+
+template<class Ops>
+using V = typename Ops::V;
+
+// MUL_UN8(a, b) (from pixman-combine32.h), "a" can be negative
+template<class Ops>
+inline V<Ops> mul_un8(const V<Ops> a, const V<Ops> b)
+{
+  const V<Ops> t = Ops::add(Ops::mul(a, b), Ops::set1(0x80));
+  return Ops::sra(Ops::add(Ops::sra(t, 8), t), 8);
+}
+
+// DIV_UN8(a, b) for a < b
+template<class Ops>
+inline V<Ops> div_un8(const V<Ops> a, const V<Ops> b)
+{
+  const V<Ops> a255 = Ops::sub(Ops::sll(a, 8), a);
+  return Ops::div(Ops::add(a255, Ops::srl(b, 1)), b);
+}
+
+template<class Ops>
+inline V<Ops> min(const V<Ops> a, const V<Ops> b)
+{
+  return Ops::select(Ops::cmpgt(a, b), b, a);
+}
+
+template<class Ops>
+inline V<Ops> max(const V<Ops> a, const V<Ops> b)
+{
+  return Ops::select(Ops::cmpgt(a, b), a, b);
+}
+
+// Channels of N pixels (C=3 for RGBA, C=1 for gray), one lane per
+// pixel.
+template<class Ops, int C>
+struct Pixels {
+  static constexpr int kChannels = C;
+  V<Ops> c[C];
+  V<Ops> a;
+
+  Pixels select(const V<Ops> m, const Pixels& other) const {
+    Pixels r;
+    for (int i=0; i<C; ++i)
+      r.c[i] = Ops::select(m, c[i], other.c[i]);
+    r.a = Ops::select(m, a, other.a);
+    return r;
+  }
+};
+
+//////////////////////////////////////////////////////////////////////
+// Pixel formats
+
+template<class Ops>
+struct RgbaFormat {
+  using pixel_t = uint32_t;
+  using Px = Pixels<Ops, 3>;
+
+  static V<Ops> load(const pixel_t* p) { return Ops::load32(p); }
+  static void store(pixel_t* p, const V<Ops> v) { Ops::store32(p, v); }
+
+  static Px unpack(const V<Ops> v) {
+    const V<Ops> ff = Ops::set1(0xff);
+    Px px;
+    px.c[0] = Ops::and_(Ops::srl(v, rgba_r_shift), ff);
+    px.c[1] = Ops::and_(Ops::srl(v, rgba_g_shift), ff);
+    px.c[2] = Ops::and_(Ops::srl(v, rgba_b_shift), ff);
+    px.a = Ops::srl(v, rgba_a_shift);
+    return px;
+  }
+
+  // Like rgba(), each channel is truncated to 8 bits
+  static V<Ops> pack(const Px& px) {
+    const V<Ops> ff = Ops::set1(0xff);
+    return Ops::or_(
+      Ops::or_(Ops::sll(Ops::and_(px.c[0], ff), rgba_r_shift),
+               Ops::sll(Ops::and_(px.c[1], ff), rgba_g_shift)),
+      Ops::or_(Ops::sll(Ops::and_(px.c[2], ff), rgba_b_shift),
+               Ops::sll(Ops::and_(px.a, ff), rgba_a_shift)));
+  }
+};
+
+template<class Ops>
+struct GrayaFormat {
+  using pixel_t = uint16_t;
+  using Px = Pixels<Ops, 1>;
+
+  static V<Ops> load(const pixel_t* p) { return Ops::load16(p); }
+  static void store(pixel_t* p, const V<Ops> v) { Ops::store16(p, v); }
+
+  static Px unpack(const V<Ops> v) {
+    const V<Ops> ff = Ops::set1(0xff);
+    Px px;
+    px.c[0] = Ops::and_(Ops::srl(v, graya_v_shift), ff);
+    px.a = Ops::and_(Ops::srl(v, graya_a_shift), ff);
+    return px;
+  }
+
+  static V<Ops> pack(const Px& px) {
+    const V<Ops> ff = Ops::set1(0xff);
+    return Ops::or_(Ops::sll(Ops::and_(px.c[0], ff), graya_v_shift),
+                    Ops::sll(Ops::and_(px.a, ff), graya_a_shift));
+  }
+};
+
+//////////////////////////////////////////////////////////////////////
+// Alpha compositing (same as rgba/graya_blender_normal/merge)
+
+template<class Ops, class Px>
+inline Px normal(const Px& B, const Px& S, const V<Ops> opacity)
+{
+  const V<Ops> zero = Ops::set1(0);
+  const V<Ops> Sa = mul_un8<Ops>(S.a, opacity);
+
+  Px R;
+  R.a = Ops::sub(Ops::add(Sa, B.a), mul_un8<Ops>(B.a, Sa));
+  for (int i=0; i<Px::kChannels; ++i)
+    R.c[i] = Ops::add(B.c[i],
+                      Ops::div(Ops::mul(Ops::sub(S.c[i], B.c[i]), Sa), R.a));
+
+  // Transparent source: keep backdrop
+  R = B.select(Ops::cmpeq(S.a, zero), R);
+
+  // Transparent backdrop: source with the opacity applied
+  Px S2 = S;
+  S2.a = Sa;
+  return S2.select(Ops::cmpeq(B.a, zero), R);
+}
+
+template<class Ops, class Px>
+inline Px merge(const Px& B, const Px& S, const V<Ops> opacity)
+{
+  const V<Ops> zero = Ops::set1(0);
+  const V<Ops> B0 = Ops::cmpeq(B.a, zero);
+  const V<Ops> S0 = Ops::andnot(B0, Ops::cmpeq(S.a, zero));
+
+  Px R;
+  R.a = Ops::add(B.a, mul_un8<Ops>(Ops::sub(S.a, B.a), opacity));
+  const V<Ops> R0 = Ops::cmpeq(R.a, zero);
+  for (int i=0; i<Px::kChannels; ++i) {
+    V<Ops> c = Ops::add(B.c[i], mul_un8<Ops>(Ops::sub(S.c[i], B.c[i]), opacity));
+    c = Ops::select(B0, S.c[i], c);
+    c = Ops::select(S0, B.c[i], c);
+    R.c[i] = Ops::andnot(R0, c);
+  }
+  return R;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Blend modes (one channel, "b" is the backdrop, "s" the source)
+
+struct Multiply {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return mul_un8<Ops>(b, s);
+  }
+};
+
+struct Screen {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return Ops::sub(Ops::add(b, s), mul_un8<Ops>(b, s));
+  }
+};
+
+struct HardLight {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    const V<Ops> s2 = Ops::sll(s, 1);
+    return Ops::select(Ops::cmpgt(Ops::set1(128), s),
+                       Multiply::blend<Ops>(b, s2),
+                       Screen::blend<Ops>(b, Ops::sub(s2, Ops::set1(255))));
+  }
+};
+
+struct Overlay {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return HardLight::blend<Ops>(s, b);
+  }
+};
+
+struct Darken {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return min<Ops>(b, s);
+  }
+};
+
+struct Lighten {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return max<Ops>(b, s);
+  }
+};
+
+struct ColorDodge {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    const V<Ops> s2 = Ops::sub(Ops::set1(255), s);
+    V<Ops> r = Ops::select(Ops::cmpgt(s2, b),
+                           div_un8<Ops>(b, s2),
+                           Ops::set1(255));
+    return Ops::andnot(Ops::cmpeq(b, Ops::set1(0)), r);
+  }
+};
+
+struct ColorBurn {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    const V<Ops> ff = Ops::set1(255);
+    const V<Ops> b2 = Ops::sub(ff, b);
+    V<Ops> r = Ops::and_(Ops::cmpgt(s, b2),
+                         Ops::sub(ff, div_un8<Ops>(b2, s)));
+    return Ops::select(Ops::cmpeq(b, ff), ff, r);
+  }
+};
+
+struct Difference {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return Ops::sub(max<Ops>(b, s), min<Ops>(b, s));
+  }
+};
+
+struct Exclusion {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    const V<Ops> t = mul_un8<Ops>(b, s);
+    return Ops::sub(Ops::add(b, s), Ops::add(t, t));
+  }
+};
+
+struct Addition {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return min<Ops>(Ops::add(b, s), Ops::set1(255));
+  }
+};
+
+struct Subtract {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    return max<Ops>(Ops::sub(b, s), Ops::set1(0));
+  }
+};
+
+struct Divide {
+  template<class Ops>
+  static V<Ops> blend(const V<Ops> b, const V<Ops> s) {
+    V<Ops> r = Ops::select(Ops::cmpgt(s, b),
+                           div_un8<Ops>(b, s),
+                           Ops::set1(255));
+    return Ops::andnot(Ops::cmpeq(b, Ops::set1(0)), r);
+  }
+};
+
+//////////////////////////////////////////////////////////////////////
+// Kernels (the whole operation for N pixels)
+
+struct NormalKernel {
+  template<class Ops, class Px>
+  static Px run(const Px& B, const Px& S, const V<Ops> opacity) {
+    return normal<Ops>(B, S, opacity);
+  }
+};
+
+struct MergeKernel {
+  template<class Ops, class Px>
+  static Px run(const Px& B, const Px& S, const V<Ops> opacity) {
+    return merge<Ops>(B, S, opacity);
+  }
+};
+
+struct DstOverKernel {
+  template<class Ops, class Px>
+  static Px run(const Px& B, const Px& S, const V<Ops> opacity) {
+    Px S2 = S;
+    S2.a = mul_un8<Ops>(S.a, opacity);
+    return normal<Ops>(S2, B, Ops::set1(255));
+  }
+};
+
+// Old blend method: rgba_blender_multiply(), etc.
+template<class Mode>
+struct BlendKernel {
+  template<class Ops, class Px>
+  static Px run(const Px& B, const Px& S, const V<Ops> opacity) {
+    Px X = S;
+    for (int i=0; i<Px::kChannels; ++i)
+      X.c[i] = Mode::template blend<Ops>(B.c[i], S.c[i]);
+    return normal<Ops>(B, X, opacity);
+  }
+};
+
+// New blend method: RGBA_BLENDER_N()/GRAYA_BLENDER_N() macros
+template<class Mode>
+struct BlendNKernel {
+  template<class Ops, class Px>
+  static Px run(const Px& B, const Px& S, const V<Ops> opacity) {
+    const Px normalPx = normal<Ops>(B, S, opacity);
+    const Px blendPx = BlendKernel<Mode>::template run<Ops>(B, S, opacity);
+    const Px normalToBlendMerge = merge<Ops>(normalPx, blendPx, B.a);
+    const V<Ops> srcTotalAlpha = mul_un8<Ops>(S.a, opacity);
+    const V<Ops> compositeAlpha = mul_un8<Ops>(B.a, srcTotalAlpha);
+    const Px R = merge<Ops>(normalToBlendMerge, blendPx, compositeAlpha);
+    return normalPx.select(Ops::cmpeq(B.a, Ops::set1(0)), R);
+  }
+};
+
+//////////////////////////////////////////////////////////////////////
+// Span functions
+
+template<class Ops, class Format, class Kernel>
+inline void blend_block(typename Format::pixel_t* dst,
+                        const typename Format::pixel_t* src,
+                        const V<Ops> opacity,
+                        const V<Ops> maskColor)
+{
+  const V<Ops> d = Format::load(dst);
+  const V<Ops> s = Format::load(src);
+  const V<Ops> r =
+    Format::pack(Kernel::template run<Ops>(Format::unpack(d),
+                                           Format::unpack(s),
+                                           opacity));
+  Format::store(dst, Ops::select(Ops::cmpeq(s, maskColor), d, r));
+}
+
+template<class Ops, class Format, class Kernel>
+void blend_span(typename Format::pixel_t* dst,
+                const typename Format::pixel_t* src,
+                const int n,
+                const int opacity,
+                const color_t maskColor)
+{
+  using pixel_t = typename Format::pixel_t;
+
+  const V<Ops> opacityV = Ops::set1(opacity);
+  const V<Ops> maskColorV = Ops::set1(int(maskColor));
+
+  int i = 0;
+  for (; i+Ops::N <= n; i += Ops::N)
+    blend_block<Ops, Format, Kernel>(dst+i, src+i, opacityV, maskColorV);
+
+  // Remaining pixels are processed in a temporary block
+  const int rest = n - i;
+  if (rest > 0) {
+    pixel_t d[Ops::N] = { 0 };
+    pixel_t s[Ops::N] = { 0 };
+    std::memcpy(d, dst+i, sizeof(pixel_t)*rest);
+    std::memcpy(s, src+i, sizeof(pixel_t)*rest);
+    blend_block<Ops, Format, Kernel>(d, s, opacityV, maskColorV);
+    std::memcpy(dst+i, d, sizeof(pixel_t)*rest);
+  }
+}
+
+// Returns nullptr for modes without a SIMD implementation. These
+// switches must match get_rgba_blender() and get_graya_blender().
+
+template<class Ops, template<class> class Format, class Mode>
+inline auto get_blend_span(const bool newBlend)
+{
+  return (newBlend ? blend_span<Ops, Format<Ops>, BlendNKernel<Mode>>:
+                     blend_span<Ops, Format<Ops>, BlendKernel<Mode>>);
+}
+
+template<class Ops>
+RgbaSpanBlendFunc get_rgba_span_blender(BlendMode blendmode, const bool newBlend)
+{
+  switch (blendmode) {
+    case BlendMode::MERGE:       return blend_span<Ops, RgbaFormat<Ops>, MergeKernel>;
+    case BlendMode::DST_OVER:    return blend_span<Ops, RgbaFormat<Ops>, DstOverKernel>;
+    case BlendMode::NORMAL:      return blend_span<Ops, RgbaFormat<Ops>, NormalKernel>;
+    case BlendMode::MULTIPLY:    return get_blend_span<Ops, RgbaFormat, Multiply>(newBlend);
+    case BlendMode::SCREEN:      return get_blend_span<Ops, RgbaFormat, Screen>(newBlend);
+    case BlendMode::OVERLAY:     return get_blend_span<Ops, RgbaFormat, Overlay>(newBlend);
+    case BlendMode::DARKEN:      return get_blend_span<Ops, RgbaFormat, Darken>(newBlend);
+    case BlendMode::LIGHTEN:     return get_blend_span<Ops, RgbaFormat, Lighten>(newBlend);
+    case BlendMode::COLOR_DODGE: return get_blend_span<Ops, RgbaFormat, ColorDodge>(newBlend);
+    case BlendMode::COLOR_BURN:  return get_blend_span<Ops, RgbaFormat, ColorBurn>(newBlend);
+    case BlendMode::HARD_LIGHT:  return get_blend_span<Ops, RgbaFormat, HardLight>(newBlend);
+    case BlendMode::DIFFERENCE:  return get_blend_span<Ops, RgbaFormat, Difference>(newBlend);
+    case BlendMode::EXCLUSION:   return get_blend_span<Ops, RgbaFormat, Exclusion>(newBlend);
+    case BlendMode::ADDITION:    return get_blend_span<Ops, RgbaFormat, Addition>(newBlend);
+    case BlendMode::SUBTRACT:    return get_blend_span<Ops, RgbaFormat, Subtract>(newBlend);
+    case BlendMode::DIVIDE:      return get_blend_span<Ops, RgbaFormat, Divide>(newBlend);
+    default:
+      // Soft light and HSL modes use floating point math
+      return nullptr;
+  }
+}
+
+template<class Ops>
+GrayaSpanBlendFunc get_graya_span_blender(BlendMode blendmode, const bool newBlend)
+{
+  switch (blendmode) {
+    case BlendMode::MERGE:          return blend_span<Ops, GrayaFormat<Ops>, MergeKernel>;
+    case BlendMode::DST_OVER:       return blend_span<Ops, GrayaFormat<Ops>, DstOverKernel>;
+    case BlendMode::RED_TINT:
+    case BlendMode::BLUE_TINT:
+    case BlendMode::NORMAL:
+    case BlendMode::HSL_HUE:
+    case BlendMode::HSL_SATURATION:
+    case BlendMode::HSL_COLOR:
+    case BlendMode::HSL_LUMINOSITY: return blend_span<Ops, GrayaFormat<Ops>, NormalKernel>;
+    case BlendMode::MULTIPLY:       return get_blend_span<Ops, GrayaFormat, Multiply>(newBlend);
+    case BlendMode::SCREEN:         return get_blend_span<Ops, GrayaFormat, Screen>(newBlend);
+    case BlendMode::OVERLAY:        return get_blend_span<Ops, GrayaFormat, Overlay>(newBlend);
+    case BlendMode::DARKEN:         return get_blend_span<Ops, GrayaFormat, Darken>(newBlend);
+    case BlendMode::LIGHTEN:        return get_blend_span<Ops, GrayaFormat, Lighten>(newBlend);
+    case BlendMode::COLOR_DODGE:    return get_blend_span<Ops, GrayaFormat, ColorDodge>(newBlend);
+    case BlendMode::COLOR_BURN:     return get_blend_span<Ops, GrayaFormat, ColorBurn>(newBlend);
+    case BlendMode::HARD_LIGHT:     return get_blend_span<Ops, GrayaFormat, HardLight>(newBlend);
+    case BlendMode::DIFFERENCE:     return get_blend_span<Ops, GrayaFormat, Difference>(newBlend);
+    case BlendMode::EXCLUSION:      return get_blend_span<Ops, GrayaFormat, Exclusion>(newBlend);
+    // get_graya_blender() uses exclusion for the new addition method
+    case BlendMode::ADDITION:       return (newBlend ? get_blend_span<Ops, GrayaFormat, Exclusion>(true):
+                                                       get_blend_span<Ops, GrayaFormat, Addition>(false));
+    case BlendMode::SUBTRACT:       return get_blend_span<Ops, GrayaFormat, Subtract>(newBlend);
+    case BlendMode::DIVIDE:         return get_blend_span<Ops, GrayaFormat, Divide>(newBlend);
+    default:
+      return nullptr;
+  }
+}
+
+} // namespace blend_span
+} // namespace doc
+
+#endif
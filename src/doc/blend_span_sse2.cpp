@@ -0,0 +1,99 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/blend_span.h"
+
+#if defined(__x86_64__) || defined(_WIN64)
+
+#include "doc/blend_span_kernels.h"
+
+#include <emmintrin.h>
+
+namespace doc {
+
+namespace {
+
+struct Sse2Ops {
+  using V = __m128i;
+  static constexpr int N = 4;
+
+  static V set1(const int v) { return _mm_set1_epi32(v); }
+  static V add(const V a, const V b) { return _mm_add_epi32(a, b); }
+  static V sub(const V a, const V b) { return _mm_sub_epi32(a, b); }
+  static V and_(const V a, const V b) { return _mm_and_si128(a, b); }
+  static V or_(const V a, const V b) { return _mm_or_si128(a, b); }
+  static V andnot(const V a, const V b) { return _mm_andnot_si128(a, b); }
+  static V cmpeq(const V a, const V b) { return _mm_cmpeq_epi32(a, b); }
+  static V cmpgt(const V a, const V b) { return _mm_cmpgt_epi32(a, b); }
+  static V sll(const V a, const int n) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+  static V srl(const V a, const int n) { return _mm_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+  static V sra(const V a, const int n) { return _mm_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+
+  // SSE2 doesn't have _mm_mullo_epi32(), but as "b" is positive and
+  // both values fit in 16 bits, the high 16 bits of each lane are
+  // zero (or 0xffff for a negative "a", which is multiplied by zero).
+  static V mul(const V a, const V b) { return _mm_madd_epi16(a, b); }
+
+  // The quotient is small enough (|q| <= 255, b <= 255) to get the
+  // exact truncated integer division from the rounded float one.
+  static V div(const V a, const V b) {
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a),
+                                       _mm_cvtepi32_ps(b)));
+  }
+
+  static V select(const V m, const V a, const V b) {
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+  }
+
+  static V load32(const uint32_t* p) {
+    return _mm_loadu_si128((const __m128i*)p);
+  }
+  static void store32(uint32_t* p, const V v) {
+    _mm_storeu_si128((__m128i*)p, v);
+  }
+
+  static V load16(const uint16_t* p) {
+    return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p),
+                              _mm_setzero_si128());
+  }
+  static void store16(uint16_t* p, const V v) {
+    // There is no _mm_packus_epi32() in SSE2, so we move the range
+    // to signed values to use _mm_packs_epi32()
+    V w = _mm_sub_epi32(v, _mm_set1_epi32(0x8000));
+    w = _mm_packs_epi32(w, w);
+    w = _mm_add_epi16(w, _mm_set1_epi16(-0x8000));
+    _mm_storel_epi64((__m128i*)p, w);
+  }
+};
+
+} // anonymous namespace
+
+RgbaSpanBlendFunc get_rgba_span_blender_sse2(BlendMode blendmode, const bool newBlend)
+{
+  return blend_span::get_rgba_span_blender<Sse2Ops>(blendmode, newBlend);
+}
+
+GrayaSpanBlendFunc get_graya_span_blender_sse2(BlendMode blendmode, const bool newBlend)
+{
+  return blend_span::get_graya_span_blender<Sse2Ops>(blendmode, newBlend);
+}
+
+} // namespace doc
+
+#else
+
+namespace doc {
+
+RgbaSpanBlendFunc get_rgba_span_blender_sse2(BlendMode, const bool) { return nullptr; }
+GrayaSpanBlendFunc get_graya_span_blender_sse2(BlendMode, const bool) { return nullptr; }
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,186 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/blend_span.h"
+
+#include "doc/blend_funcs.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+const BlendMode kModes[] = {
+  BlendMode::SRC, BlendMode::MERGE, BlendMode::NEG_BW,
+  BlendMode::RED_TINT, BlendMode::BLUE_TINT, BlendMode::DST_OVER,
+  BlendMode::NORMAL, BlendMode::MULTIPLY, BlendMode::SCREEN,
+  BlendMode::OVERLAY, BlendMode::DARKEN, BlendMode::LIGHTEN,
+  BlendMode::COLOR_DODGE, BlendMode::COLOR_BURN, BlendMode::HARD_LIGHT,
+  BlendMode::SOFT_LIGHT, BlendMode::DIFFERENCE, BlendMode::EXCLUSION,
+  BlendMode::HSL_HUE, BlendMode::HSL_SATURATION, BlendMode::HSL_COLOR,
+  BlendMode::HSL_LUMINOSITY, BlendMode::ADDITION, BlendMode::SUBTRACT,
+  BlendMode::DIVIDE,
+};
+
+const BlendIsa kIsas[] = {
+  BlendIsa::Scalar, BlendIsa::SSE2, BlendIsa::AVX2
+};
+
+const int kOpacities[] = { 0, 1, 64, 127, 128, 200, 254, 255 };
+
+// Channel values with a lot of edge cases (transparent/opaque,
+// values around the 128 threshold of hard light/overlay, etc.)
+class RandomChannel {
+public:
+  RandomChannel() : m_gen(1234), m_any(0, 255), m_which(0, 7) { }
+  int operator()() {
+    switch (m_which(m_gen)) {
+      case 0: return 0;
+      case 1: return 255;
+      case 2: return 127 + m_which(m_gen) % 3;
+      default: return m_any(m_gen);
+    }
+  }
+  int index(int n) { return m_any(m_gen) % n; }
+private:
+  std::mt19937 m_gen;
+  std::uniform_int_distribution<int> m_any;
+  std::uniform_int_distribution<int> m_which;
+};
+
+} // anonymous namespace
+
+TEST(BlendSpan, RgbaSameAsScalar)
+{
+  RandomChannel rnd;
+  const int n = 1031;           // Not a multiple of the vector size
+  std::vector<uint32_t> backdrop(n), src(n), dst(n);
+  for (int i=0; i<n; ++i) {
+    backdrop[i] = rgba(rnd(), rnd(), rnd(), rnd());
+    src[i] = rgba(rnd(), rnd(), rnd(), rnd());
+  }
+  const color_t maskColor = src[rnd.index(n)];
+
+  for (const BlendIsa isa : kIsas) {
+    if (!is_blend_isa_supported(isa))
+      continue;
+
+    for (const BlendMode mode : kModes) {
+      for (const bool newBlend : { false, true }) {
+        const BlendFunc func = get_rgba_blender(mode, newBlend);
+        const RgbaSpanBlendFunc span = get_rgba_span_blender(mode, newBlend, isa);
+        ASSERT_TRUE(span != nullptr);
+
+        for (const int opacity : kOpacities) {
+          dst = backdrop;
+          span(&dst[0], &src[0], n, opacity, maskColor);
+
+          for (int i=0; i<n; ++i) {
+            const color_t expected =
+              (src[i] != maskColor ? func(backdrop[i], src[i], opacity):
+                                     backdrop[i]);
+            ASSERT_EQ(expected, dst[i])
+              << "isa=" << int(isa)
+              << " mode=" << blend_mode_to_string(mode)
+              << " newBlend=" << newBlend
+              << " opacity=" << opacity
+              << " backdrop=" << std::hex << backdrop[i]
+              << " src=" << src[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(BlendSpan, GrayaSameAsScalar)
+{
+  RandomChannel rnd;
+  const int n = 1031;
+  std::vector<uint16_t> backdrop(n), src(n), dst(n);
+  for (int i=0; i<n; ++i) {
+    backdrop[i] = graya(rnd(), rnd());
+    src[i] = graya(rnd(), rnd());
+  }
+  const color_t maskColor = src[rnd.index(n)];
+
+  for (const BlendIsa isa : kIsas) {
+    if (!is_blend_isa_supported(isa))
+      continue;
+
+    for (const BlendMode mode : kModes) {
+      for (const bool newBlend : { false, true }) {
+        const BlendFunc func = get_graya_blender(mode, newBlend);
+        const GrayaSpanBlendFunc span = get_graya_span_blender(mode, newBlend, isa);
+        ASSERT_TRUE(span != nullptr);
+
+        for (const int opacity : kOpacities) {
+          dst = backdrop;
+          span(&dst[0], &src[0], n, opacity, maskColor);
+
+          for (int i=0; i<n; ++i) {
+            const uint16_t expected =
+              (src[i] != maskColor ? func(backdrop[i], src[i], opacity):
+                                     backdrop[i]);
+            ASSERT_EQ(expected, dst[i])
+              << "isa=" << int(isa)
+              << " mode=" << blend_mode_to_string(mode)
+              << " newBlend=" << newBlend
+              << " opacity=" << opacity
+              << " backdrop=" << std::hex << backdrop[i]
+              << " src=" << src[i];
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(BlendSpan, SimdIsUsed)
+{
+  for (const BlendIsa isa : { BlendIsa::SSE2, BlendIsa::AVX2 }) {
+    if (!is_blend_isa_supported(isa))
+      continue;
+
+    EXPECT_NE(get_rgba_span_blender(BlendMode::NORMAL, true, BlendIsa::Scalar),
+              get_rgba_span_blender(BlendMode::NORMAL, true, isa));
+    EXPECT_NE(get_graya_span_blender(BlendMode::NORMAL, true, BlendIsa::Scalar),
+              get_graya_span_blender(BlendMode::NORMAL, true, isa));
+  }
+}
+
+TEST(BlendSpan, ShortSpans)
+{
+  // Spans shorter than the vector size must not touch other pixels
+  for (const BlendIsa isa : kIsas) {
+    if (!is_blend_isa_supported(isa))
+      continue;
+
+    const RgbaSpanBlendFunc span =
+      get_rgba_span_blender(BlendMode::NORMAL, true, isa);
+    for (int n=0; n<9; ++n) {
+      std::vector<uint32_t> dst(16, rgba(1, 2, 3, 4));
+      std::vector<uint32_t> src(16, rgba(255, 255, 255, 255));
+      span(&dst[0], &src[0], n, 255, 0);
+      for (int i=0; i<16; ++i)
+        EXPECT_EQ(i < n ? rgba(255, 255, 255, 255): rgba(1, 2, 3, 4), dst[i]);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -68,6 +68,14 @@ void Cel::setFrame(frame_t frame)
 void Cel::setDataRef(const CelDataRef& celData)
 {
   ASSERT(celData);
+
+  // Update the CelData index of the sprite
+  if (m_layer && m_layer->isInSpriteTree()) {
+    Sprite* sprite = m_layer->sprite();
+    sprite->addCelDataRef(celData);
+    sprite->removeCelDataRef(m_data.get());
+  }
+
   m_data = celData;
 }
 
@@ -172,8 +180,15 @@ Grid Cel::grid() const
 
 void Cel::fixupImage()
 {
-  // Change the mask color to the sprite mask color
-  if (m_layer && image()) {
+  // Change the mask color to the sprite mask color (without decoding
+  // lazy images)
+  if (m_layer && m_data->lazyImage()) {
+    LazyImage* lazyImage = m_data->lazyImage().get();
+    lazyImage->setMaskColor((lazyImage->spec().colorMode() == ColorMode::TILEMAP) ?
+                              notile : m_layer->sprite()->transparentColor());
+    m_data->adjustBounds(m_layer);
+  }
+  else if (m_layer && image()) {
     image()->setMaskColor((image()->pixelFormat() == IMAGE_TILEMAP) ?
                             notile : m_layer->sprite()->transparentColor());
     ASSERT(m_data);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -31,9 +31,19 @@ CelData::CelData(const ImageRef& image)
 {
 }
 
+CelData::CelData(const LazyImageRef& lazyImage)
+  : WithUserData(ObjectType::CelData)
+  , m_lazyImage(lazyImage)
+  , m_opacity(255)
+  , m_bounds(lazyImage->spec().bounds())
+  , m_boundsF(nullptr)
+{
+}
+
 CelData::CelData(const CelData& celData)
   : WithUserData(ObjectType::CelData)
   , m_image(celData.m_image)
+  , m_lazyImage(celData.m_lazyImage)
   , m_opacity(celData.m_opacity)
   , m_bounds(celData.m_bounds)
   , m_boundsF(celData.m_boundsF ? std::make_unique<gfx::RectF>(*celData.m_boundsF):
@@ -50,6 +60,7 @@ void CelData::setImage(const ImageRef& image, Layer* layer)
   ASSERT(image.get());
 
   m_image = image;
+  m_lazyImage.reset();
   adjustBounds(layer);
 }
 
@@ -62,23 +73,24 @@ void CelData::setPosition(const gfx::Point& pos)
 
 void CelData::adjustBounds(Layer* layer)
 {
-  ASSERT(m_image);
-  if (m_image->pixelFormat() == IMAGE_TILEMAP) {
+  ASSERT(m_image || m_lazyImage);
+  const ImageSpec& spec = imageSpec();
+  if (spec.colorMode() == ColorMode::TILEMAP) {
     Tileset* tileset = nullptr;
     if (layer && layer->isTilemap())
       tileset = static_cast<LayerTilemap*>(layer)->tileset();
     if (tileset) {
       gfx::Size canvasSize =
         tileset->grid().tilemapSizeToCanvas(
-          gfx::Size(m_image->width(),
-                    m_image->height()));
+          gfx::Size(spec.width(),
+                    spec.height()));
       m_bounds.w = canvasSize.w;
       m_bounds.h = canvasSize.h;
       return;
     }
   }
-  m_bounds.w = m_image->width();
-  m_bounds.h = m_image->height();
+  m_bounds.w = spec.width();
+  m_bounds.h = spec.height();
 }
 
 } // namespace doc
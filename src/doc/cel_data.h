@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "doc/image_ref.h"
+#include "doc/lazy_image.h"
 #include "doc/object.h"
 #include "doc/with_user_data.h"
 #include "gfx/rect.h"
@@ -24,14 +25,34 @@ namespace doc {
   class CelData : public WithUserData {
   public:
     CelData(const ImageRef& image);
+    CelData(const LazyImageRef& lazyImage);
     CelData(const CelData& celData);
     ~CelData();
 
     gfx::Point position() const { return m_bounds.origin(); }
     const gfx::Rect& bounds() const { return m_bounds; }
     int opacity() const { return m_opacity; }
-    Image* image() const { return const_cast<Image*>(m_image.get()); };
-    ImageRef imageRef() const { return m_image; }
+    // These functions give write access to the image, so a lazy image
+    // is decoded and pinned in memory (it's still referenced by
+    // m_lazyImage, so the returned raw pointer is valid while this
+    // CelData is alive).
+    Image* image() const {
+      return (m_lazyImage ? m_lazyImage->get().get():
+                            const_cast<Image*>(m_image.get()));
+    }
+    ImageRef imageRef() const {
+      return (m_lazyImage ? m_lazyImage->get(): m_image);
+    }
+
+    // Read-only access to the image, a lazy image can be discarded
+    // from memory when the returned reference is released.
+    ImageConstRef imageConstRef() const {
+      return (m_lazyImage ? m_lazyImage->getConst(): m_image);
+    }
+
+    // Image decoded on demand (or nullptr if the image is always in
+    // memory).
+    const LazyImageRef& lazyImage() const { return m_lazyImage; }
 
     // Returns a rectangle with the bounds of the image (width/height
     // of the image) in the position of the cel (useful to compare
@@ -40,8 +61,8 @@ namespace doc {
     gfx::Rect imageBounds() const {
       return gfx::Rect(m_bounds.x,
                        m_bounds.y,
-                       m_image->width(),
-                       m_image->height());
+                       imageSpec().width(),
+                       imageSpec().height());
     }
 
     void setImage(const ImageRef& image, Layer* layer);
@@ -81,6 +102,8 @@ namespace doc {
     }
 
     virtual int getMemSize() const override {
+      if (m_lazyImage)
+        return sizeof(CelData) + m_lazyImage->getMemSize();
       ASSERT(m_image);
       return sizeof(CelData) + m_image->getMemSize();
     }
@@ -88,7 +111,13 @@ namespace doc {
     void adjustBounds(Layer* layer);
 
   private:
+    // Returns the spec of the image without decoding lazy images
+    const ImageSpec& imageSpec() const {
+      return (m_lazyImage ? m_lazyImage->spec(): m_image->spec());
+    }
+
     ImageRef m_image;
+    LazyImageRef m_lazyImage;
     int m_opacity;
     gfx::Rect m_bounds;
 
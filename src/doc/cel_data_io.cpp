@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -36,7 +36,7 @@ void write_celdata(std::ostream& os,
   write32(os, celdata->bounds().w);
   write32(os, celdata->bounds().h);
   write8(os, celdata->opacity());
-  write32(os, celdata->image()->id());
+  write32(os, celdata->imageConstRef()->id());
   write_user_data(os, celdata->userData());
 
   if (celdata->hasBoundsF()) {  // Reference layer
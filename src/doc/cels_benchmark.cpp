@@ -0,0 +1,162 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/cel.h"
+#include "doc/cels_range.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Creates a long animation with "nlayers" x "nframes" cels. Each
+// layer has some empty frames, and some cels linked with the
+// previous one (to test the UNIQUE CelsRange).
+std::unique_ptr<Sprite> make_sprite(const int nlayers,
+                                    const frame_t nframes)
+{
+  auto spr = std::make_unique<Sprite>(
+    ImageSpec(ColorMode::INDEXED, 32, 32), 256);
+  spr->setTotalFrames(nframes);
+
+  for (int i=0; i<nlayers; ++i) {
+    auto lay = new LayerImage(spr.get());
+    spr->root()->addLayer(lay);
+
+    Cel* prev = nullptr;
+    for (frame_t fr=0; fr<nframes; ++fr) {
+      if (((fr+i) % 7) == 0) {    // Empty frame
+        prev = nullptr;
+        continue;
+      }
+
+      Cel* cel;
+      if (prev && (fr % 3) == 0)  // Linked cel
+        cel = Cel::MakeLink(fr, prev);
+      else
+        cel = new Cel(fr, ImageRef(Image::create(IMAGE_INDEXED, 1, 1)));
+      lay->addCel(cel);
+      prev = cel;
+    }
+  }
+  return spr;
+}
+
+} // anonymous namespace
+
+// Access to random cels (e.g. timeline painting or rendering)
+void BM_LayerCel(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+  const frame_t nframes = state.range(1);
+  auto spr = make_sprite(nlayers, nframes);
+  const LayerList layers = spr->allLayers();
+
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> layer(0, nlayers-1);
+  std::uniform_int_distribution<frame_t> frame(0, nframes-1);
+  std::vector<std::pair<Layer*, frame_t>> queries(1024);
+  for (auto& q : queries)
+    q = std::make_pair(layers[layer(gen)], frame(gen));
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    const auto& q = queries[i++ & 1023];
+    benchmark::DoNotOptimize(q.first->cel(q.second));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Access to the cels of one frame (e.g. rendering one frame)
+void BM_FrameCels(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+  const frame_t nframes = state.range(1);
+  auto spr = make_sprite(nlayers, nframes);
+  const LayerList layers = spr->allLayers();
+
+  frame_t frame = 0;
+  for (auto _ : state) {
+    for (Layer* layer : layers)
+      benchmark::DoNotOptimize(layer->cel(frame));
+    frame = (frame+1) % nframes;
+  }
+  state.SetItemsProcessed(state.iterations() * nlayers);
+}
+
+// Search of CelData by ID (e.g. undo/redo of linked cels, or loading
+// a backup session)
+void BM_GetCelDataRef(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+  const frame_t nframes = state.range(1);
+  auto spr = make_sprite(nlayers, nframes);
+
+  std::vector<ObjectId> ids;
+  for (Cel* cel : spr->cels())
+    ids.push_back(cel->data()->id());
+
+  std::mt19937 gen(42);
+  std::shuffle(ids.begin(), ids.end(), gen);
+
+  std::size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(spr->getCelDataRef(ids[i++ % ids.size()]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Iteration of all unique cels (e.g. saving/exporting the sprite)
+void BM_UniqueCels(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+  const frame_t nframes = state.range(1);
+  auto spr = make_sprite(nlayers, nframes);
+
+  int n = 0;
+  for (auto _ : state) {
+    n = 0;
+    for (Cel* cel : spr->uniqueCels()) {
+      benchmark::DoNotOptimize(cel);
+      ++n;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_LayerCel)
+  ->Args({ 10, 100 })
+  ->Args({ 100, 2000 });
+
+BENCHMARK(BM_FrameCels)
+  ->Args({ 10, 100 })
+  ->Args({ 100, 2000 });
+
+BENCHMARK(BM_GetCelDataRef)
+  ->Args({ 10, 100 })
+  ->Args({ 100, 2000 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_UniqueCels)
+  ->Args({ 10, 100 })
+  ->Args({ 100, 2000 })
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
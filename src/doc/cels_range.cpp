@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,39 @@
 
 namespace doc {
 
+// Maximum number of IDs in the bitmap of visited IDs (128KB)
+static constexpr ObjectId kMaxVisitedBits = 1024*1024;
+
+bool CelsRange::VisitedIds::insert(const ObjectId id)
+{
+  if (m_bits.empty())
+    m_base = (id & ~ObjectId(63));
+
+  // Grow the bitmap to the left (IDs before the first visited one)
+  if (id < m_base) {
+    const ObjectId newBase = (id & ~ObjectId(63));
+    const std::size_t words = (m_base - newBase) / 64;
+    if (m_bits.size() + words > kMaxVisitedBits / 64)
+      return m_others.insert(id).second;
+
+    m_bits.insert(m_bits.begin(), words, 0);
+    m_base = newBase;
+  }
+
+  const std::size_t i = (id - m_base);
+  if (i >= kMaxVisitedBits)
+    return m_others.insert(id).second;
+  if (i/64 >= m_bits.size())
+    m_bits.resize(i/64 + 1, 0);
+
+  uint64_t& word = m_bits[i/64];
+  const uint64_t bit = (uint64_t(1) << (i % 64));
+  if (word & bit)
+    return false;
+  word |= bit;
+  return true;
+}
+
 CelsRange::CelsRange(const Sprite* sprite,
                      const SelectedFrames& selFrames,
                      const Flags flags)
@@ -79,10 +112,8 @@ CelsRange::iterator& CelsRange::iterator::operator++()
         m_cel = layer->cel(*m_frameIterator);
         if (m_cel) {
           if (m_flags == CelsRange::UNIQUE) {
-            if (m_visited.find(m_cel->data()->id()) == m_visited.end()) {
-              m_visited.insert(m_cel->data()->id());
+            if (m_visited.insert(m_cel->data()->id()))
               break;
-            }
             else
               m_cel = nullptr;
           }
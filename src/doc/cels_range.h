@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,7 +13,9 @@
 #include "doc/object_id.h"
 #include "doc/selected_frames.h"
 
-#include <set>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
 
 namespace doc {
 
@@ -22,6 +25,20 @@ namespace doc {
   class Sprite;
 
   class CelsRange {
+    // Set of visited CelData IDs (for the UNIQUE flag). As CelData of
+    // the same sprite are usually created together, their IDs are
+    // near each other, so we can use a flat bitmap starting from the
+    // first visited ID (IDs that are too far away use a hash set).
+    class VisitedIds {
+    public:
+      // Returns true if the ID wasn't visited before.
+      bool insert(const ObjectId id);
+    private:
+      ObjectId m_base = 0;
+      std::vector<uint64_t> m_bits;
+      std::unordered_set<ObjectId> m_others;
+    };
+
   public:
     enum Flags {
       ALL,
@@ -64,7 +81,7 @@ namespace doc {
       const SelectedFrames& m_selFrames;
       frames::const_iterator m_frameIterator;
       Flags m_flags;
-      std::set<ObjectId> m_visited;
+      VisitedIds m_visited;
     };
 
     iterator begin() { return m_begin; }
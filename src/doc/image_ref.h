@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,6 +16,7 @@
 namespace doc {
 
   typedef std::shared_ptr<Image> ImageRef;
+  typedef std::shared_ptr<const Image> ImageConstRef;
 
 } // namespace doc
 
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -22,6 +22,28 @@
 
 namespace doc {
 
+namespace {
+
+// Adds/removes the CelData of all cels of the given layer (and its
+// children) to/from the CelData index of the sprite.
+void add_cels_to_sprite_index(Sprite* sprite, const Layer* layer)
+{
+  CelList cels;
+  layer->getCels(cels);
+  for (const Cel* cel : cels)
+    sprite->addCelDataRef(cel->dataRef());
+}
+
+void remove_cels_from_sprite_index(Sprite* sprite, const Layer* layer)
+{
+  CelList cels;
+  layer->getCels(cels);
+  for (const Cel* cel : cels)
+    sprite->removeCelDataRef(cel->data());
+}
+
+} // anonymous namespace
+
 Layer::Layer(ObjectType type, Sprite* sprite)
   : WithUserData(type)
   , m_sprite(sprite)
@@ -209,6 +231,14 @@ bool Layer::hasAncestor(const Layer* ancestor) const
   return false;
 }
 
+bool Layer::isInSpriteTree() const
+{
+  const Layer* layer = this;
+  while (layer->parent())
+    layer = layer->parent();
+  return (m_sprite && m_sprite->root() == layer);
+}
+
 Grid Layer::grid() const
 {
   gfx::Rect rc = (m_sprite ? m_sprite->gridBounds():
@@ -253,8 +283,11 @@ int LayerImage::getMemSize() const
     const Cel* cel = *it;
     size += cel->getMemSize();
 
-    const Image* image = cel->image();
-    size += image->getMemSize();
+    // Don't decode/pin lazy images (they use memory only when loaded)
+    if (const LazyImageRef& lazy = cel->data()->lazyImage())
+      size += lazy->getMemSize();
+    else
+      size += cel->image()->getMemSize();
   }
 
   return size;
@@ -262,21 +295,24 @@ int LayerImage::getMemSize() const
 
 void LayerImage::destroyAllCels()
 {
+  Sprite* sprite = (isInSpriteTree() ? this->sprite(): nullptr);
   CelIterator it = getCelBegin();
   CelIterator end = getCelEnd();
 
   for (; it != end; ++it) {
     Cel* cel = *it;
+    if (sprite)
+      sprite->removeCelDataRef(cel->data());
     delete cel;
   }
   m_cels.clear();
+  m_celsByFrame.clear();
 }
 
 Cel* LayerImage::cel(frame_t frame) const
 {
-  CelConstIterator it = findCelIterator(frame);
-  if (it != getCelEnd())
-    return *it;
+  if (frame >= 0 && frame < frame_t(m_celsByFrame.size()))
+    return m_celsByFrame[frame];
   else
     return nullptr;
 }
@@ -342,15 +378,25 @@ void LayerImage::addCel(Cel* cel)
 {
   ASSERT(cel);
   ASSERT(cel->data() && "The cel doesn't contain CelData");
-  ASSERT(cel->image());
+  ASSERT(cel->imageConstRef());
   ASSERT(sprite());
-  ASSERT(cel->image()->pixelFormat() == sprite()->pixelFormat() ||
-         cel->image()->pixelFormat() == IMAGE_TILEMAP);
+  ASSERT(cel->imageConstRef()->pixelFormat() == sprite()->pixelFormat() ||
+         cel->imageConstRef()->pixelFormat() == IMAGE_TILEMAP);
+
+  ASSERT(cel->frame() >= 0);
+  ASSERT(!this->cel(cel->frame()));
 
   CelIterator it = findFirstCelIteratorAfter(cel->frame());
   m_cels.insert(it, cel);
 
+  if (cel->frame() >= frame_t(m_celsByFrame.size()))
+    m_celsByFrame.resize(cel->frame()+1, nullptr);
+  m_celsByFrame[cel->frame()] = cel;
+
   cel->setParentLayer(this);
+
+  if (isInSpriteTree())
+    sprite()->addCelDataRef(cel->dataRef());
 }
 
 /**
@@ -367,6 +413,14 @@ void LayerImage::removeCel(Cel* cel)
 
   m_cels.erase(it);
 
+  ASSERT(m_celsByFrame[cel->frame()] == cel);
+  m_celsByFrame[cel->frame()] = nullptr;
+  while (!m_celsByFrame.empty() && !m_celsByFrame.back())
+    m_celsByFrame.pop_back();
+
+  if (isInSpriteTree())
+    sprite()->removeCelDataRef(cel->data());
+
   cel->setParentLayer(NULL);
 }
 
@@ -564,6 +618,9 @@ void LayerGroup::addLayer(Layer* layer)
 {
   m_layers.push_back(layer);
   layer->setParent(this);
+
+  if (isInSpriteTree())
+    add_cels_to_sprite_index(sprite(), layer);
 }
 
 void LayerGroup::removeLayer(Layer* layer)
@@ -572,6 +629,9 @@ void LayerGroup::removeLayer(Layer* layer)
   ASSERT(it != m_layers.end());
   m_layers.erase(it);
 
+  if (isInSpriteTree())
+    remove_cels_from_sprite_index(sprite(), layer);
+
   layer->setParent(nullptr);
 }
 
@@ -586,6 +646,9 @@ void LayerGroup::insertLayer(Layer* layer, Layer* after)
   m_layers.insert(after_it, layer);
 
   layer->setParent(this);
+
+  if (isInSpriteTree())
+    add_cels_to_sprite_index(sprite(), layer);
 }
 
 void LayerGroup::stackLayer(Layer* layer, Layer* after)
@@ -17,6 +17,7 @@
 #include "doc/with_user_data.h"
 
 #include <string>
+#include <vector>
 
 namespace doc {
 
@@ -98,6 +99,10 @@ namespace doc {
     bool canEditPixels() const;
     bool hasAncestor(const Layer* ancestor) const;
 
+    // Returns true if this layer is inside the layers tree of its
+    // sprite (i.e. it can be reached from sprite()->root()).
+    bool isInSpriteTree() const;
+
     void setBackground(bool state) { switchFlags(LayerFlags::Background, state); }
     void setVisible   (bool state) { switchFlags(LayerFlags::Visible, state); }
     void setEditable  (bool state) { switchFlags(LayerFlags::Editable, state); }
@@ -184,6 +189,10 @@ namespace doc {
     BlendMode m_blendmode;
     int m_opacity;
     CelList m_cels;   // List of all cels inside this layer used by frames.
+
+    // Table of cels indexed by frame (nullptr for empty frames) to
+    // get the cel of a specific frame in O(1) (see cel()).
+    std::vector<Cel*> m_celsByFrame;
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -0,0 +1,229 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/lazy_image.h"
+
+#include "base/debug.h"
+#include "doc/image.h"
+
+#include <set>
+
+namespace doc {
+
+// All lazy images and the loaded ones (the most recently used first)
+static std::mutex g_mutex;
+static std::set<LazyImage*> g_all;
+static std::list<LazyImage*> g_loaded;
+static size_t g_loadedBytes = 0;
+static size_t g_limit = 0;
+
+LazyImage::LazyImage(const ImageSpec& spec,
+                     std::unique_ptr<LazyImageSource>&& source)
+  : m_spec(spec)
+  , m_source(std::move(source))
+  , m_bytes(0)
+  , m_id(0)
+  , m_version(0)
+  , m_loadedVersion(0)
+  , m_pinned(false)
+  , m_inList(false)
+{
+  ASSERT(m_source);
+
+  const std::lock_guard lock(g_mutex);
+  g_all.insert(this);
+}
+
+LazyImage::~LazyImage()
+{
+  const std::lock_guard lock(g_mutex);
+  g_all.erase(this);
+  if (m_inList) {
+    g_loaded.erase(m_listIt);
+    g_loadedBytes -= m_bytes;
+  }
+}
+
+void LazyImage::setMaskColor(const color_t color)
+{
+  const std::lock_guard lock(m_mutex);
+  m_spec.setMaskColor(color);
+  if (m_image)
+    m_image->setMaskColor(color);
+}
+
+// Called with m_mutex locked
+void LazyImage::decode()
+{
+  if (m_image)
+    return;
+
+  m_image.reset(m_source->decode(m_spec));
+  if (m_id) {
+    m_image->setId(m_id);
+    m_image->setVersion(m_version);
+  }
+  // Objects without version are versioned by the data recovery
+  // before saving them, so we start with the first version to avoid
+  // modifying the image (it couldn't be discarded anymore).
+  else if (!m_image->version()) {
+    m_image->incrementVersion();
+  }
+  m_loadedVersion = m_image->version();
+  m_bytes = m_image->getMemSize();
+}
+
+ImageRef LazyImage::get()
+{
+  ImageRef image;
+  {
+    const std::lock_guard lock(m_mutex);
+    decode();
+    image = m_image;
+  }
+  // The caller can modify the image (without changing its version)
+  // or keep a raw pointer/ID of it, so we cannot discard it anymore.
+  if (!m_pinned) {
+    m_pinned = true;
+    unlist();
+  }
+  return image;
+}
+
+ImageConstRef LazyImage::getConst()
+{
+  ImageConstRef image;
+  {
+    const std::lock_guard lock(m_mutex);
+    decode();
+    image = m_image;
+  }
+  // As we hold a reference to the image, it cannot be unloaded
+  // after we release the mutex.
+  touch();
+  return image;
+}
+
+bool LazyImage::isLoaded() const
+{
+  const std::lock_guard lock(m_mutex);
+  return (m_image != nullptr);
+}
+
+int LazyImage::getMemSize() const
+{
+  const std::lock_guard lock(m_mutex);
+  return (m_image ? m_image->getMemSize(): 0);
+}
+
+void LazyImage::detach()
+{
+  const std::lock_guard lock(m_mutex);
+  m_source->detach();
+}
+
+// static
+void LazyImage::DetachFile(const std::string& filename)
+{
+  const std::lock_guard lock(g_mutex);
+  for (LazyImage* lazy : g_all) {
+    const std::lock_guard lazyLock(lazy->m_mutex);
+    if (lazy->m_source->isFromFile(filename))
+      lazy->m_source->detach();
+  }
+}
+
+// static
+void LazyImage::SetMemoryLimit(const size_t bytes)
+{
+  const std::lock_guard lock(g_mutex);
+  g_limit = bytes;
+  trim(nullptr);
+}
+
+// static
+size_t LazyImage::MemoryLimit()
+{
+  const std::lock_guard lock(g_mutex);
+  return g_limit;
+}
+
+void LazyImage::touch()
+{
+  const std::lock_guard lock(g_mutex);
+  // Pinned images are not in the list (m_pinned is set before
+  // unlist() locks g_mutex, so we cannot add it again to the list)
+  if (m_pinned)
+    return;
+
+  if (m_inList) {
+    if (m_listIt != g_loaded.begin())
+      g_loaded.splice(g_loaded.begin(), g_loaded, m_listIt);
+  }
+  else {
+    g_loaded.push_front(this);
+    g_loadedBytes += m_bytes;
+    m_listIt = g_loaded.begin();
+    m_inList = true;
+    trim(this);
+  }
+}
+
+// Removes the image from the list of loaded images that can be
+// discarded.
+void LazyImage::unlist()
+{
+  const std::lock_guard lock(g_mutex);
+  if (m_inList) {
+    g_loaded.erase(m_listIt);
+    g_loadedBytes -= m_bytes;
+    m_inList = false;
+  }
+}
+
+// Called with g_mutex locked. Returns false if the image is being
+// used/decoded in other thread, or it was pinned/modified.
+bool LazyImage::tryUnload()
+{
+  std::unique_lock lock(m_mutex, std::try_to_lock);
+  if (!lock.owns_lock() ||
+      m_pinned ||
+      !m_image ||
+      m_image.use_count() > 1 ||
+      m_image->version() != m_loadedVersion) {
+    return false;
+  }
+
+  m_id = m_image->id();
+  m_version = m_image->version();
+  m_image.reset();
+  return true;
+}
+
+// static
+void LazyImage::trim(LazyImage* except)
+{
+  if (g_limit == 0)
+    return;
+
+  // Unload the least recently used images
+  auto it = g_loaded.end();
+  while (g_loadedBytes > g_limit && it != g_loaded.begin()) {
+    --it;
+    LazyImage* lazy = *it;
+    if (lazy != except && lazy->tryUnload()) {
+      g_loadedBytes -= lazy->m_bytes;
+      lazy->m_inList = false;
+      it = g_loaded.erase(it);
+    }
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,125 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_LAZY_IMAGE_H_INCLUDED
+#define DOC_LAZY_IMAGE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+#include "doc/image_spec.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace doc {
+
+  // Source of the pixels of a LazyImage (e.g. compressed data in a
+  // memory-mapped file).
+  class LazyImageSource {
+  public:
+    virtual ~LazyImageSource() { }
+
+    // Creates a new image with the given spec decoding the pixels.
+    // It can be called from any thread.
+    virtual Image* decode(const ImageSpec& spec) = 0;
+
+    // Returns true if the data to decode the image is read from the
+    // given file (a canonical path, see base::get_canonical_path()).
+    virtual bool isFromFile(const std::string& filename) const = 0;
+
+    // Copies to memory all the data needed to decode the image, so
+    // the source doesn't depend on external resources anymore
+    // (e.g. before overwriting the file that was memory-mapped).
+    virtual void detach() = 0;
+  };
+
+  // An image that is decoded the first time it's needed. Images that
+  // were only accessed with getConst() can be discarded from memory
+  // when the total of loaded lazy images exceeds
+  // LazyImage::SetMemoryLimit(), and then they are decoded again on
+  // demand (keeping the same ID and version).
+  //
+  // As soon as the image is accessed with get() (which gives write
+  // access, and its ID/raw pointer can be kept by someone else
+  // e.g. in undo commands or scripts), the image is pinned in memory
+  // until the LazyImage is destroyed.
+  class LazyImage {
+  public:
+    LazyImage(const ImageSpec& spec,
+              std::unique_ptr<LazyImageSource>&& source);
+    ~LazyImage();
+
+    LazyImage(const LazyImage&) = delete;
+    LazyImage& operator=(const LazyImage&) = delete;
+
+    const ImageSpec& spec() const { return m_spec; }
+    void setMaskColor(const color_t color);
+
+    // Returns the image decoding it if it's not in memory, and pins
+    // it (it will not be discarded anymore). Thread-safe.
+    ImageRef get();
+
+    // Returns the image decoding it if it's not in memory for
+    // read-only access. It can be discarded later when the returned
+    // reference is released (if the image wasn't pinned). Thread-safe.
+    ImageConstRef getConst();
+
+    bool isLoaded() const;
+    bool isPinned() const { return m_pinned; }
+    int getMemSize() const;
+
+    void detach();
+
+    // Detaches all lazy images that are decoded from the given file
+    // (e.g. before overwriting it).
+    static void DetachFile(const std::string& filename);
+
+    // Soft limit (in bytes) for all loaded lazy images, zero means
+    // no limit (the default).
+    static void SetMemoryLimit(const size_t bytes);
+    static size_t MemoryLimit();
+
+  private:
+    void decode();
+    void touch();
+    void unlist();
+    bool tryUnload();
+    static void trim(LazyImage* except);
+
+    ImageSpec m_spec;
+    std::unique_ptr<LazyImageSource> m_source;
+    mutable std::mutex m_mutex;
+    ImageRef m_image;
+    size_t m_bytes;
+
+    // ID/version to restore when the image is decoded again
+    ObjectId m_id;
+    ObjectVersion m_version;
+
+    // Version of the image when it was decoded (to know if it was
+    // modified)
+    ObjectVersion m_loadedVersion;
+
+    // True if the image was accessed with get()
+    std::atomic<bool> m_pinned;
+
+    // Position in the list of loaded images (protected by a global
+    // mutex)
+    bool m_inList;
+    std::list<LazyImage*>::iterator m_listIt;
+  };
+
+  typedef std::shared_ptr<LazyImage> LazyImageRef;
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,258 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/cel_data_io.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer_tilemap.h"
+#include "doc/lazy_image.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tile.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Fills the image with the given color
+class TestSource : public LazyImageSource {
+public:
+  TestSource(color_t color, int* decoded,
+             const std::string& filename, int* detached)
+    : m_color(color), m_decoded(decoded)
+    , m_filename(filename), m_detached(detached) { }
+  Image* decode(const ImageSpec& spec) override {
+    Image* image = Image::create(spec);
+    clear_image(image, m_color);
+    ++(*m_decoded);
+    return image;
+  }
+  bool isFromFile(const std::string& filename) const override {
+    return (!m_filename.empty() && m_filename == filename);
+  }
+  void detach() override {
+    m_filename.clear();
+    if (m_detached)
+      ++(*m_detached);
+  }
+private:
+  color_t m_color;
+  int* m_decoded;
+  std::string m_filename;
+  int* m_detached;
+};
+
+LazyImageRef make_lazy(color_t color, int* decoded,
+                       const std::string& filename = "a.aseprite",
+                       int* detached = nullptr)
+{
+  return std::make_shared<LazyImage>(
+    ImageSpec(ColorMode::RGB, 32, 32),
+    std::make_unique<TestSource>(color, decoded, filename, detached));
+}
+
+} // anonymous namespace
+
+TEST(LazyImage, DecodeOnDemand)
+{
+  int decoded = 0;
+  LazyImageRef lazy = make_lazy(rgba(255, 0, 0, 255), &decoded);
+  CelData celData(lazy);
+  EXPECT_EQ(0, decoded);
+  EXPECT_FALSE(lazy->isLoaded());
+  EXPECT_EQ(gfx::Rect(0, 0, 32, 32), celData.bounds());
+  EXPECT_EQ(gfx::Rect(0, 0, 32, 32), celData.imageBounds());
+
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(celData.image(), 0, 0));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(celData.image(), 31, 31));
+  EXPECT_EQ(1, decoded);
+  EXPECT_TRUE(lazy->isLoaded());
+}
+
+TEST(LazyImage, UnloadLeastRecentlyUsed)
+{
+  const int imageSize = ImageRef(Image::create(IMAGE_RGB, 32, 32))->getMemSize();
+  LazyImage::SetMemoryLimit(2*imageSize);
+
+  int decoded = 0;
+  std::vector<LazyImageRef> lazies;
+  for (int i=0; i<4; ++i)
+    lazies.push_back(make_lazy(rgba(i, 0, 0, 255), &decoded));
+
+  const ObjectId id0 = lazies[0]->getConst()->id();
+  const ObjectVersion ver0 = lazies[0]->getConst()->version();
+  lazies[1]->getConst();
+  lazies[2]->getConst();
+  EXPECT_EQ(3, decoded);
+  EXPECT_FALSE(lazies[0]->isLoaded());
+  EXPECT_TRUE(lazies[1]->isLoaded());
+  EXPECT_TRUE(lazies[2]->isLoaded());
+
+  // Decoded again with the same ID/version
+  ImageConstRef image0 = lazies[0]->getConst();
+  EXPECT_EQ(4, decoded);
+  EXPECT_EQ(id0, image0->id());
+  EXPECT_EQ(ver0, image0->version());
+  EXPECT_EQ(rgba(0, 0, 0, 255), get_pixel(image0.get(), 0, 0));
+
+  // Images in use are not unloaded
+  ImageConstRef image1 = lazies[1]->getConst();
+  lazies[2]->getConst();
+  lazies[3]->getConst();
+  EXPECT_TRUE(lazies[0]->isLoaded());
+  EXPECT_TRUE(lazies[1]->isLoaded());
+  EXPECT_FALSE(lazies[2]->isLoaded());
+
+  LazyImage::SetMemoryLimit(0);
+}
+
+TEST(LazyImage, WriteAccessPinsImage)
+{
+  const int imageSize = ImageRef(Image::create(IMAGE_RGB, 32, 32))->getMemSize();
+  LazyImage::SetMemoryLimit(imageSize);
+
+  int decoded = 0;
+  std::vector<LazyImageRef> lazies;
+  for (int i=0; i<5; ++i)
+    lazies.push_back(make_lazy(rgba(i, 0, 0, 255), &decoded));
+
+  // Raw pointers from CelData::image() and images modified without
+  // changing their version are never discarded
+  CelData celData(lazies[0]);
+  Image* image0 = celData.image();
+  put_pixel(image0, 0, 0, rgba(255, 255, 255, 255));
+  EXPECT_TRUE(lazies[0]->isPinned());
+  lazies[1]->get();
+  lazies[2]->getConst();
+  lazies[3]->getConst();
+  EXPECT_TRUE(lazies[0]->isLoaded());
+  EXPECT_TRUE(lazies[1]->isLoaded());
+  EXPECT_FALSE(lazies[2]->isLoaded());
+  EXPECT_TRUE(lazies[3]->isLoaded());
+  EXPECT_EQ(4, decoded);
+
+  EXPECT_EQ(image0, celData.image());
+  EXPECT_EQ(image0, celData.imageConstRef().get());
+  EXPECT_EQ(rgba(255, 255, 255, 255), get_pixel(image0, 0, 0));
+
+  // The image is still registered with its ID
+  EXPECT_EQ(image0, get<Image>(image0->id()));
+
+  // A modified image (new version) is not discarded
+  ImageConstRef image3 = lazies[3]->getConst();
+  const_cast<Image*>(image3.get())->incrementVersion();
+  image3.reset();
+  lazies[4]->getConst();
+  EXPECT_TRUE(lazies[3]->isLoaded());
+  EXPECT_TRUE(lazies[4]->isLoaded());
+
+  LazyImage::SetMemoryLimit(0);
+}
+
+// The data recovery (backup of cels), the editor render cache, and
+// the tileset usage histogram only read images, so they must not pin
+// lazy images.
+TEST(LazyImage, ReadOnlyAccessDoesntPin)
+{
+  const int imageSize = ImageRef(Image::create(IMAGE_RGB, 32, 32))->getMemSize();
+  LazyImage::SetMemoryLimit(imageSize);
+
+  auto spr = std::make_unique<Sprite>(ImageSpec(ColorMode::RGB, 32, 32), 256);
+  Tileset* tileset = new Tileset(spr.get(), Grid(gfx::Size(4, 4)), 2);
+  spr->tilesets()->add(tileset);
+  auto layer = new LayerTilemap(spr.get(), 0);
+  spr->root()->addLayer(layer);
+
+  int decoded = 0;
+  LazyImageRef lazy = std::make_shared<LazyImage>(
+    ImageSpec(ColorMode::TILEMAP, 32, 32),
+    std::make_unique<TestSource>(tile(1, 0), &decoded, "", nullptr));
+  Cel* cel = new Cel(0, std::make_shared<CelData>(lazy));
+  layer->addCel(cel);
+
+  // Tileset usage
+  EXPECT_EQ(std::size_t(32*32), tileset->tilesHistogram()[1]);
+
+  // Backup of the cel data and its image
+  {
+    const ImageConstRef image = cel->imageConstRef();
+    EXPECT_NE(0, image->version());
+    EXPECT_EQ(tile(1, 0), get_pixel(image.get(), 0, 0));
+    std::stringstream os;
+    write_celdata(os, cel->data());
+  }
+
+  // Snapshot of the image ID/version (render cache)
+  const ObjectId id = cel->imageConstRef()->id();
+  const ObjectVersion ver = cel->imageConstRef()->version();
+
+  EXPECT_FALSE(lazy->isPinned());
+  EXPECT_TRUE(lazy->isLoaded());
+
+  // The image can be discarded, and it's decoded again with the same
+  // ID/version
+  make_lazy(rgba(0, 0, 0, 255), &decoded)->getConst();
+  EXPECT_FALSE(lazy->isLoaded());
+  EXPECT_EQ(id, cel->imageConstRef()->id());
+  EXPECT_EQ(ver, cel->imageConstRef()->version());
+  EXPECT_EQ(3, decoded);
+
+  LazyImage::SetMemoryLimit(0);
+}
+
+TEST(LazyImage, DetachFile)
+{
+  int decoded = 0, detachedA = 0, detachedB = 0;
+  LazyImageRef a = make_lazy(rgba(255, 0, 0, 255), &decoded, "a.aseprite", &detachedA);
+  LazyImageRef b = make_lazy(rgba(255, 0, 0, 255), &decoded, "b.aseprite", &detachedB);
+
+  // Only sources from "b.aseprite" are detached (without decoding them)
+  LazyImage::DetachFile("b.aseprite");
+  EXPECT_EQ(0, detachedA);
+  EXPECT_EQ(1, detachedB);
+  EXPECT_FALSE(b->isLoaded());
+  EXPECT_EQ(0, decoded);
+
+  // Already detached
+  LazyImage::DetachFile("b.aseprite");
+  EXPECT_EQ(1, detachedB);
+
+  LazyImage::DetachFile("c.aseprite");
+  EXPECT_EQ(0, detachedA);
+}
+
+TEST(LazyImage, SetImageReplacesLazyImage)
+{
+  int decoded = 0;
+  CelData celData(make_lazy(rgba(255, 0, 0, 255), &decoded));
+  ImageRef image(Image::create(IMAGE_RGB, 8, 8));
+  celData.setImage(image, nullptr);
+  EXPECT_EQ(nullptr, celData.lazyImage());
+  EXPECT_EQ(image.get(), celData.image());
+  EXPECT_EQ(gfx::Rect(0, 0, 8, 8), celData.bounds());
+  EXPECT_EQ(0, decoded);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
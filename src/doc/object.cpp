@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,15 +13,69 @@
 
 #include "base/debug.h"
 
-#include <map>
+#include <atomic>
 #include <mutex>
+#include <unordered_map>
 
 namespace doc {
 
-static std::mutex g_mutex;
-static ObjectId newId = 0;
-// TODO Profile this and see if an unordered_map is better
-static std::map<ObjectId, Object*> objects;
+namespace {
+
+// Registry of all objects with an ID. It's split in several shards
+// (each one with its own mutex and hash table) so threads that
+// register/look up different objects (e.g. the UI thread, the
+// backup thread, and background tasks) don't block each other.
+// As IDs are consecutive numbers, objects are distributed uniformly
+// between shards.
+class ObjectsRegistry {
+public:
+  void insert(const ObjectId id, Object* obj) {
+    Shard& s = shard(id);
+    const std::lock_guard lock(s.mutex);
+    s.objects.insert(std::make_pair(id, obj));
+  }
+
+  void erase(const ObjectId id, const Object* obj) {
+    Shard& s = shard(id);
+    const std::lock_guard lock(s.mutex);
+    auto it = s.objects.find(id);
+    ASSERT(it != s.objects.end());
+    ASSERT(it->second == obj);
+    if (it != s.objects.end())
+      s.objects.erase(it);
+  }
+
+  Object* find(const ObjectId id) {
+    Shard& s = shard(id);
+    const std::lock_guard lock(s.mutex);
+    auto it = s.objects.find(id);
+    if (it != s.objects.end())
+      return it->second;
+    else
+      return nullptr;
+  }
+
+private:
+  static constexpr int kShards = 64;
+
+  // Aligned to avoid false sharing between mutexes of different
+  // shards.
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::unordered_map<ObjectId, Object*> objects;
+  };
+
+  Shard& shard(const ObjectId id) {
+    return m_shards[id % kShards];
+  }
+
+  Shard m_shards[kShards];
+};
+
+std::atomic<ObjectId> newId(0);
+ObjectsRegistry objects;
+
+} // anonymous namespace
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -53,44 +107,30 @@ const ObjectId Object::id() const
   // The first time the ID is request, we store the object in the
   // "objects" hash table.
   if (!m_id) {
-    const std::lock_guard lock(g_mutex);
-    m_id = ++newId;
-    objects.insert(std::make_pair(m_id, const_cast<Object*>(this)));
+    const ObjectId id = ++newId;
+    objects.insert(id, const_cast<Object*>(this));
+    m_id = id;
   }
   return m_id;
 }
 
 void Object::setId(ObjectId id)
 {
-  const std::lock_guard lock(g_mutex);
-
-  if (m_id) {
-    auto it = objects.find(m_id);
-    ASSERT(it != objects.end());
-    ASSERT(it->second == this);
-    if (it != objects.end())
-      objects.erase(it);
-  }
+  if (m_id)
+    objects.erase(m_id, this);
 
   m_id = id;
 
   if (m_id) {
 #ifdef _DEBUG
-    if (objects.find(m_id) != objects.end()) {
-      Object* obj = objects.find(m_id)->second;
-      if (obj) {
-        TRACEARGS("ASSERT FAILED: Object with id", m_id,
-                  "of kind", int(obj->type()),
-                  "version", obj->version(), "should not exist");
-      }
-      else {
-        TRACEARGS("ASSERT FAILED: Object with id", m_id,
-                  "registered as nullptr should not exist");
-      }
+    if (Object* obj = objects.find(m_id)) {
+      TRACEARGS("ASSERT FAILED: Object with id", m_id,
+                "of kind", int(obj->type()),
+                "version", obj->version(), "should not exist");
     }
-    ASSERT(objects.find(m_id) == objects.end());
+    ASSERT(objects.find(m_id) == nullptr);
 #endif
-    objects.insert(std::make_pair(m_id, this));
+    objects.insert(m_id, this);
   }
 }
 
@@ -101,12 +141,7 @@ void Object::setVersion(ObjectVersion version)
 
 Object* get_object(ObjectId id)
 {
-  const std::lock_guard lock(g_mutex);
-  auto it = objects.find(id);
-  if (it != objects.end())
-    return it->second;
-  else
-    return nullptr;
+  return objects.find(id);
 }
 
 } // namespace doc
@@ -0,0 +1,110 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/object.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Objects registered in all benchmarks (e.g. a big document with a
+// lot of cels/images)
+std::vector<std::unique_ptr<Object>> g_objects;
+std::vector<ObjectId> g_ids;
+
+void create_objects(const benchmark::State& state)
+{
+  const int n = state.range(0);
+  if (int(g_objects.size()) == n)
+    return;
+
+  g_objects.clear();
+  g_ids.clear();
+  for (int i=0; i<n; ++i) {
+    g_objects.push_back(std::make_unique<Object>(ObjectType::Image));
+    g_ids.push_back(g_objects.back()->id());
+  }
+}
+
+} // anonymous namespace
+
+// Lookups of existing objects from several threads (e.g. undo
+// commands, scripts, and the backup thread)
+void BM_GetObject(benchmark::State& state)
+{
+  std::mt19937 gen(state.thread_index());
+  std::uniform_int_distribution<size_t> dist(0, state.range(0)-1);
+  std::vector<ObjectId> ids(1024);
+  for (auto& id : ids)
+    id = g_ids[dist(gen)];
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(get_object(ids[i++ & 1023]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Creation (id assignment) and destruction of objects while other
+// objects are registered
+void BM_CreateDeleteObject(benchmark::State& state)
+{
+  for (auto _ : state) {
+    Object obj(ObjectType::Image);
+    benchmark::DoNotOptimize(obj.id());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Mixed workload: 90% lookups, 10% creation/destruction
+void BM_MixedObjects(benchmark::State& state)
+{
+  std::mt19937 gen(state.thread_index());
+  std::uniform_int_distribution<size_t> dist(0, state.range(0)-1);
+
+  int i = 0;
+  for (auto _ : state) {
+    if ((++i % 10) == 0) {
+      Object obj(ObjectType::Image);
+      benchmark::DoNotOptimize(obj.id());
+    }
+    else {
+      benchmark::DoNotOptimize(get_object(g_ids[dist(gen)]));
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_GetObject)
+  ->Arg(1000)
+  ->Arg(300000)
+  ->ThreadRange(1, 8)
+  ->Setup(create_objects)
+  ->UseRealTime();
+
+BENCHMARK(BM_CreateDeleteObject)
+  ->Arg(300000)
+  ->ThreadRange(1, 8)
+  ->Setup(create_objects)
+  ->UseRealTime();
+
+BENCHMARK(BM_MixedObjects)
+  ->Arg(300000)
+  ->ThreadRange(1, 8)
+  ->Setup(create_objects)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
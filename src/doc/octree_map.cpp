@@ -90,6 +90,52 @@ int OctreeNode::removeLeaves(OctreeNodes& auxParentVector,
   return result - 1;
 }
 
+void OctreeNode::merge(const OctreeNode& other, OctreeNode* parent)
+{
+  m_parent = parent;
+  if (other.m_leafColor.pixelCount() > 0)
+    m_leafColor.add(other.m_leafColor);
+
+  if (other.m_children) {
+    if (!m_children)
+      m_children.reset(new std::array<OctreeNode, 16>());
+    for (int i=0; i<16; ++i)
+      (*m_children)[i].merge((*other.m_children)[i], this);
+  }
+}
+
+int OctreeNode::countColorNodes(int level) const
+{
+  if (level == 0)
+    return (m_leafColor.pixelCount() > 0 || m_children ? 1: 0);
+
+  int count = 0;
+  if (m_children) {
+    for (const OctreeNode& child : *m_children)
+      count += child.countColorNodes(level-1);
+  }
+  return count;
+}
+
+void OctreeNode::collapse(int level)
+{
+  if (!m_children)
+    return;
+
+  if (level > 0) {
+    for (OctreeNode& child : *m_children)
+      child.collapse(level-1);
+    return;
+  }
+
+  for (OctreeNode& child : *m_children) {
+    child.collapse(0);
+    if (child.m_leafColor.pixelCount() > 0)
+      m_leafColor.add(child.m_leafColor);
+  }
+  m_children.reset();
+}
+
 // static
 int OctreeNode::getHextet(color_t c, int level)
 {
@@ -263,6 +309,29 @@ void OctreeMap::feedWithImage(const Image* image,
   m_maskColor = maskColor;
 }
 
+void OctreeMap::merge(const OctreeMap& other)
+{
+  m_root.merge(other.m_root, &m_root);
+  m_maskColor = other.m_maskColor;
+}
+
+void OctreeMap::makePaletteFromDeepMap(Palette* palette,
+                                       int colorCount)
+{
+  // Same condition used in makePalette() to return false with
+  // levelDeep=7 (number of leaves < number of colors)
+  const int leaves = m_root.countColorNodes(7);
+  const int opaqueColors =
+    (m_maskColor != DOC_OCTREE_IS_OPAQUE ? colorCount-1: colorCount);
+
+  if (leaves < opaqueColors)
+    makePalette(palette, colorCount, 8);
+  else {
+    m_root.collapse(7);
+    makePalette(palette, colorCount, 7);
+  }
+}
+
 int OctreeMap::mapColor(color_t rgba) const
 {
   return m_root.mapColor(rgba_getr(rgba),
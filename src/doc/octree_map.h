@@ -107,6 +107,19 @@ public:
   int removeLeaves(OctreeNodes& auxParentVector,
                    OctreeNodes& rootLeavesVector);
 
+  // Adds the colors of "other" (and its children) to this node.
+  void merge(const OctreeNode& other, OctreeNode* parent);
+
+  // Number of nodes with colors in the given level (relative to this
+  // node), i.e. the number of leaves if the colors were added with
+  // levelDeep=level.
+  int countColorNodes(int level) const;
+
+  // Joins the colors of the children of the nodes in the given level
+  // (relative to this node) in those nodes, so they become leaves
+  // (as if the colors were added with levelDeep=level).
+  void collapse(int level);
+
 private:
   bool isLeaf() { return m_leafColor.pixelCount() > 0; }
   void paletteIndex(int index) { m_paletteIndex = index; }
@@ -138,6 +151,17 @@ public:
                      const color_t maskColor,
                      const int levelDeep = 7);
 
+  // Adds all the colors (and the mask color) of a map fed with the
+  // same levelDeep. Used to feed several maps in parallel.
+  void merge(const OctreeMap& other);
+
+  // Creates the palette from a map fed with levelDeep=8. The result
+  // is the same as feeding a map with levelDeep=7, and feeding a new
+  // map with levelDeep=8 if makePalette() returns false, but the
+  // colors are fed only once.
+  void makePaletteFromDeepMap(Palette* palette,
+                              int colorCount);
+
   // RgbMap impl
   void regenerateMap(const Palette* palette,
                      const int maskIndex,
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -23,7 +23,9 @@
 
 #include <city.h>
 
+#include <cstring>
 #include <stdexcept>
+#include <vector>
 
 #if defined(__x86_64__) || defined(_WIN64)
   #include <emmintrin.h>
@@ -368,6 +370,14 @@ bool is_same_image_simd_templ(const Image* i1, const Image* i2)
   for (int y=0; y<h; ++y) {
     auto p = (const address_t)i1->getPixelAddress(0, y);
     auto q = (const address_t)i2->getPixelAddress(0, y);
+
+    // Rows with exactly the same bytes are equal, memcmp() is a lot
+    // faster than comparing pixel by pixel. We compare each pixel
+    // only to know if different bytes are the same color
+    // (e.g. transparent pixels with different RGB values).
+    if (std::memcmp(p, q, ImageTraits::bytes_per_pixel * w) == 0)
+      continue;
+
     int x = 0;
 
 #if DOC_USE_ALIGNED_PIXELS
@@ -539,44 +549,42 @@ void remap_image(Image* image, const Remap& remap)
   }
 }
 
-// TODO test this hash routine and find a better alternative
-
-template <typename ImageTraits, uint32_t Mask>
-static uint32_t calculate_image_hash_templ(const Image* image,
+template <typename ImageTraits>
+static uint64_t calculate_image_hash_templ(const Image* image,
                                            const gfx::Rect& bounds)
 {
-#if defined(__LP64__) || defined(__x86_64__) || defined(_WIN64)
-  #define CITYHASH(buf, len) (CityHash64(buf, len) & 0xffffffff)
-  static_assert(sizeof(void*) == 8, "This CPU is not 64-bit");
-#else
-  #define CITYHASH(buf, len) CityHash32(buf, len)
-  static_assert(sizeof(void*) == 4, "This CPU is not 32-bit");
-#endif
-
   const uint32_t widthBytes = ImageTraits::bytes_per_pixel * bounds.w;
   const uint32_t len = widthBytes * bounds.h;
+
+  // Fast path: all rows are contiguous in memory so we can hash the
+  // whole pixel buffer at once.
   if (bounds == image->bounds() &&
       widthBytes == image->rowBytes()) {
-    return CITYHASH((const char*)image->getPixelAddress(0, 0), len);
+    return CityHash64((const char*)image->getPixelAddress(0, 0), len);
   }
-  else {
-    std::vector<uint8_t> buf(len);
-    uint8_t* dst = &buf[0];
-    for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
-      auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
-      std::copy(src, src+widthBytes, dst);
-    }
-    return CITYHASH((const char*)&buf[0], buf.size());
+
+  // In other case (e.g. rows with padding bytes for aligned pixels,
+  // or a sub-rectangle of the image) we copy the rows to a reusable
+  // buffer to hash exactly the same bytes as in the fast path.
+  static thread_local std::vector<uint8_t> buf;
+  if (buf.size() < len)
+    buf.resize(len);
+
+  uint8_t* dst = buf.data();
+  for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
+    auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
+    std::copy(src, src+widthBytes, dst);
   }
+  return CityHash64((const char*)buf.data(), len);
 }
 
-uint32_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
+uint64_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
 {
   switch (img->pixelFormat()) {
-    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits, rgba_rgb_mask>(img, bounds);
-    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits, graya_v_mask>(img, bounds);
-    case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits, 0xff>(img, bounds);
-    case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits, 1>(img, bounds);
+    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits>(img, bounds);
+    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits>(img, bounds);
+    case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits>(img, bounds);
+    case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits>(img, bounds);
   }
   ASSERT(false);
   return 0;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -80,6 +80,29 @@ TYPED_TEST(Primitives, IsSameImage)
   }
 }
 
+TEST(Primitives, ImageHash)
+{
+  for (const PixelFormat pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    for (const int size : { 1, 3, 8, 16, 33 }) {
+      ImageRef a(Image::create(pf, size, size));
+      doc::algorithm::random_image(a.get());
+      const uint64_t hash = calculate_image_hash(a.get(), a->bounds());
+
+      // Same pixels inside a bigger image (rows aren't contiguous)
+      ImageRef b(Image::create(pf, size+5, size+7));
+      doc::algorithm::random_image(b.get());
+      copy_image(b.get(), a.get(), 2, 3);
+      EXPECT_EQ(hash, calculate_image_hash(b.get(), gfx::Rect(2, 3, size, size)));
+
+      // Modify one pixel
+      ImageRef c(Image::createCopy(a.get()));
+      const color_t old = get_pixel(c.get(), size/2, size/2);
+      put_pixel(c.get(), size/2, size/2, old ^ 1);
+      EXPECT_NE(hash, calculate_image_hash(c.get(), c->bounds()));
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
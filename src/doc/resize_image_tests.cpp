@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,11 +11,17 @@
 
 #include <gtest/gtest.h>
 
+#include "base/thread_pool.h"
 #include "doc/algorithm/resize_image.h"
 #include "doc/color.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
+#include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+#include <cstdlib>
+#include <random>
 
 using namespace std;
 using namespace doc;
@@ -101,8 +107,164 @@ TEST(ResizeImage, BilinearInterpRGBType)
 }
 #endif
 
+static ImageRef create_random_image(PixelFormat format, int width, int height)
+{
+  std::mt19937 gen(width*1000 + height);
+  std::uniform_int_distribution<int> dist(0, 255);
+  ImageRef image(Image::create(format, width, height));
+  for (int y=0; y<height; ++y) {
+    for (int x=0; x<width; ++x) {
+      color_t c = 0;
+      switch (format) {
+        case IMAGE_RGB: c = rgba(dist(gen), dist(gen), dist(gen), dist(gen)); break;
+        case IMAGE_GRAYSCALE: c = graya(dist(gen), dist(gen)); break;
+        case IMAGE_INDEXED: c = dist(gen) % 64; break;
+        case IMAGE_BITMAP: c = dist(gen) & 1; break;
+        default: break;
+      }
+      put_pixel(image.get(), x, y, c);
+    }
+  }
+  return image;
+}
+
+// Maximum difference between the channels of two RGB/grayscale images
+static int max_channel_diff(const Image* a, const Image* b)
+{
+  int diff = 0;
+  for (int y=0; y<a->height(); ++y) {
+    for (int x=0; x<a->width(); ++x) {
+      const color_t c = a->getPixel(x, y);
+      const color_t d = b->getPixel(x, y);
+      for (int shift=0; shift<32; shift+=8)
+        diff = std::max(diff, std::abs(int((c >> shift) & 0xff) -
+                                       int((d >> shift) & 0xff)));
+    }
+  }
+  return diff;
+}
+
+static const gfx::Size test_src_sizes[] = {
+  gfx::Size(1, 1), gfx::Size(3, 3), gfx::Size(17, 5), gfx::Size(64, 61)
+};
+static const gfx::Size test_dst_sizes[] = {
+  gfx::Size(1, 1), gfx::Size(2, 7), gfx::Size(9, 9), gfx::Size(33, 40),
+  gfx::Size(128, 130)
+};
+
+TEST(ResizeImage, NearestNeighborSameAsSlowVersion)
+{
+  base::thread_pool pool(3);
+  for (const PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE,
+                                    IMAGE_INDEXED, IMAGE_BITMAP }) {
+    for (const gfx::Size& srcSize : test_src_sizes) {
+      ImageRef src = create_random_image(format, srcSize.w, srcSize.h);
+      for (const gfx::Size& dstSize : test_dst_sizes) {
+        ImageRef expected(Image::create(format, dstSize.w, dstSize.h));
+        ImageRef dst(Image::create(format, dstSize.w, dstSize.h));
+        ImageRef dstMt(Image::create(format, dstSize.w, dstSize.h));
+
+        algorithm::resize_image_slow(src.get(), expected.get(),
+                                     algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+                                     nullptr, nullptr, -1);
+        algorithm::resize_image(src.get(), dst.get(),
+                                algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+                                nullptr, nullptr, -1);
+        algorithm::resize_image(src.get(), dstMt.get(),
+                                algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
+                                nullptr, nullptr, -1, &pool);
+
+        ASSERT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+        ASSERT_EQ(0, count_diff_between_images(expected.get(), dstMt.get()));
+      }
+    }
+  }
+}
+
+TEST(ResizeImage, BilinearSimilarToSlowVersion)
+{
+  base::thread_pool pool(3);
+  for (const PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE }) {
+    for (const gfx::Size& srcSize : test_src_sizes) {
+      ImageRef src = create_random_image(format, srcSize.w, srcSize.h);
+      for (const gfx::Size& dstSize : test_dst_sizes) {
+        ImageRef expected(Image::create(format, dstSize.w, dstSize.h));
+        ImageRef dst(Image::create(format, dstSize.w, dstSize.h));
+        ImageRef dstMt(Image::create(format, dstSize.w, dstSize.h));
+
+        algorithm::resize_image_slow(src.get(), expected.get(),
+                                     algorithm::RESIZE_METHOD_BILINEAR,
+                                     nullptr, nullptr, -1);
+        algorithm::resize_image(src.get(), dst.get(),
+                                algorithm::RESIZE_METHOD_BILINEAR,
+                                nullptr, nullptr, -1);
+        algorithm::resize_image(src.get(), dstMt.get(),
+                                algorithm::RESIZE_METHOD_BILINEAR,
+                                nullptr, nullptr, -1, &pool);
+
+        // Fixed-point weights can give a difference of 1
+        EXPECT_GE(1, max_channel_diff(expected.get(), dst.get()));
+        ASSERT_EQ(0, count_diff_between_images(dst.get(), dstMt.get()));
+      }
+    }
+  }
+}
+
+TEST(ResizeImage, BilinearIndexed)
+{
+  Palette pal(0, 64);
+  for (int i=0; i<64; ++i)
+    pal.setEntry(i, rgba((i & 3)*85, ((i>>2) & 3)*85, ((i>>4) & 3)*85, 255));
+
+  RgbMapRGB5A3 rgbmap;
+  rgbmap.regenerateMap(&pal, 0);
+
+  base::thread_pool pool(3);
+  ImageRef src = create_random_image(IMAGE_INDEXED, 17, 5);
+  ImageRef dst(Image::create(IMAGE_INDEXED, 40, 33));
+  ImageRef dstMt(Image::create(IMAGE_INDEXED, 40, 33));
+
+  // Lazy RgbMap (it's used from one thread only)
+  algorithm::resize_image(src.get(), dst.get(),
+                          algorithm::RESIZE_METHOD_BILINEAR,
+                          &pal, &rgbmap, 0, &pool);
+
+  rgbmap.precompute(&pool);
+  algorithm::resize_image(src.get(), dstMt.get(),
+                          algorithm::RESIZE_METHOD_BILINEAR,
+                          &pal, &rgbmap, 0, &pool);
+  ASSERT_EQ(0, count_diff_between_images(dst.get(), dstMt.get()));
+
+  // Corners are not interpolated (and all palette entries can be
+  // mapped exactly)
+  EXPECT_EQ(get_pixel(src.get(), 0, 0), get_pixel(dst.get(), 0, 0));
+  EXPECT_EQ(get_pixel(src.get(), 16, 4), get_pixel(dst.get(), 39, 32));
+}
+
+TEST(ResizeImage, RotSpriteWithThreads)
+{
+  base::thread_pool pool(3);
+  for (const PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE,
+                                    IMAGE_INDEXED }) {
+    ImageRef src = create_random_image(format, 17, 13);
+    ImageRef dst(Image::create(format, 40, 21));
+    ImageRef dstMt(Image::create(format, 40, 21));
+    clear_image(dst.get(), 0);
+    clear_image(dstMt.get(), 0);
+
+    algorithm::resize_image(src.get(), dst.get(),
+                            algorithm::RESIZE_METHOD_ROTSPRITE,
+                            nullptr, nullptr, 0);
+    algorithm::resize_image(src.get(), dstMt.get(),
+                            algorithm::RESIZE_METHOD_ROTSPRITE,
+                            nullptr, nullptr, 0, &pool);
+    ASSERT_EQ(0, count_diff_between_images(dst.get(), dstMt.get()));
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
   return RUN_ALL_TESTS();
 }
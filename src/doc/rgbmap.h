@@ -13,6 +13,10 @@
 #include "doc/fit_criteria.h"
 #include "doc/rgbmap_algorithm.h"
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
 
   class Palette;
@@ -38,6 +42,18 @@ namespace doc {
 
     virtual int modifications() const = 0;
 
+    // Calculates all the entries of the map in advance (using the
+    // threads of the given pool if it's not nullptr). After this,
+    // mapColor() doesn't modify the map, so the same RgbMap can be
+    // used from several threads at the same time until the next
+    // regenerateMap() that changes the palette/mask/criteria.
+    // Returns false if the map doesn't support this mode (in that
+    // case it must be used from one thread only).
+    virtual bool precompute(base::thread_pool*) { return false; }
+
+    // Returns true if all entries were calculated with precompute().
+    virtual bool isPrecomputed() const { return false; }
+
     // Color Best Fit Criteria used to generate the rgbmap
     virtual FitCriteria fitCriteria() const = 0;
     virtual void fitCriteria(const FitCriteria fitCriteria) = 0;
@@ -0,0 +1,117 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/thread_pool.h"
+#include "doc/algorithm/random_image.h"
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+
+using namespace doc;
+
+static Palette make_palette(const int ncolors)
+{
+  std::mt19937 gen(ncolors);
+  std::uniform_int_distribution<int> dist(0, 255);
+  Palette pal(0, ncolors);
+  for (int i=0; i<ncolors; ++i)
+    pal.setEntry(i, rgba(dist(gen), dist(gen), dist(gen), 255));
+  return pal;
+}
+
+static ImageRef make_image()
+{
+  ImageRef image(Image::create(IMAGE_RGB, 512, 512));
+  doc::algorithm::random_image(image.get());
+  return image;
+}
+
+static int map_image(const RgbMap& map, const Image* image)
+{
+  int sum = 0;
+  for (const color_t c : LockImageBits<RgbTraits>(image))
+    sum += map.mapColor(c);
+  return sum;
+}
+
+// Maps all the pixels of an image with a new map (entries are
+// generated lazily when they are needed).
+static void BM_RgbMapLazy(benchmark::State& state)
+{
+  Palette::initBestfit();
+  const Palette pal = make_palette(state.range(0));
+  const ImageRef image = make_image();
+
+  while (state.KeepRunning()) {
+    RgbMapRGB5A3 map;
+    map.regenerateMap(&pal, 0);
+    benchmark::DoNotOptimize(map_image(map, image.get()));
+  }
+}
+
+// Precomputes all the entries of the map (with "threads" threads, or
+// without a thread pool if it's 0) and then maps the image.
+static void BM_RgbMapEager(benchmark::State& state)
+{
+  Palette::initBestfit();
+  const Palette pal = make_palette(state.range(0));
+  const int threads = state.range(1);
+  const ImageRef image = make_image();
+
+  std::unique_ptr<base::thread_pool> pool;
+  if (threads > 0)
+    pool = std::make_unique<base::thread_pool>(threads);
+
+  while (state.KeepRunning()) {
+    RgbMapRGB5A3 map;
+    map.regenerateMap(&pal, 0);
+    map.precompute(pool.get());
+    benchmark::DoNotOptimize(map_image(map, image.get()));
+  }
+}
+
+// Reference: the octree map (which cannot be precomputed)
+static void BM_RgbMapOctree(benchmark::State& state)
+{
+  Palette::initBestfit();
+  const Palette pal = make_palette(state.range(0));
+  const ImageRef image = make_image();
+
+  while (state.KeepRunning()) {
+    OctreeMap map;
+    map.regenerateMap(&pal, 0);
+    benchmark::DoNotOptimize(map_image(map, image.get()));
+  }
+}
+
+BENCHMARK(BM_RgbMapLazy)
+  ->Arg(16)->Arg(64)->Arg(256)
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_RgbMapEager)
+  ->Args({ 16, 0 })->Args({ 64, 0 })->Args({ 256, 0 })
+  ->Args({ 16, 4 })->Args({ 64, 4 })->Args({ 256, 4 })
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_RgbMapOctree)
+  ->Arg(16)->Arg(64)->Arg(256)
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -11,6 +11,7 @@
 
 #include "doc/rgbmap_rgb5a3.h"
 
+#include "base/parallel_for.h"
 #include "doc/color_scales.h"
 #include "doc/palette.h"
 
@@ -39,12 +40,46 @@ void RgbMapRGB5A3::regenerateMap(const Palette* palette,
   m_fitCriteria = fitCriteria;
   m_modifications = palette->getModifications();
   m_maskIndex = maskIndex;
+  m_precomputed = false;
 
   // Mark all entries as invalid (need to be regenerated)
   for (uint16_t& entry : m_map)
     entry |= INVALID;
 }
 
+bool RgbMapRGB5A3::precompute(base::thread_pool* pool)
+{
+  ASSERT(m_palette);
+  if (m_precomputed || !m_palette)
+    return m_precomputed;
+
+  // Each item generates all the entries with the same 5 bits of red
+  // (the most significant bits of the index), so threads write
+  // different parts of the map.
+  auto generateRed = [this](const int r5) {
+    const int i0 = (r5 << 13);
+    for (int i=i0; i<i0+(GSIZE*BSIZE*ASIZE); ++i) {
+      if (m_map[i] & INVALID) {
+        generateEntry(i,
+                      (r5 << 3),
+                      ((i >> 8) & 0x1f) << 3,
+                      ((i >> 3) & 0x1f) << 3,
+                      (i & 0x07) << 5);
+      }
+    }
+  };
+
+  if (pool)
+    base::parallel_for(*pool, 0, RSIZE, generateRed);
+  else {
+    for (int r5=0; r5<RSIZE; ++r5)
+      generateRed(r5);
+  }
+
+  m_precomputed = true;
+  return true;
+}
+
 int RgbMapRGB5A3::generateEntry(int i, int r, int g, int b, int a) const
 {
   return m_map[i] =
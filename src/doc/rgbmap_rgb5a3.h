@@ -22,7 +22,9 @@ namespace doc {
 
   class Palette;
 
-  // It acts like a cache for Palette:findBestfit() calls.
+  // It acts like a cache for Palette:findBestfit() calls. Entries are
+  // calculated lazily (the first time a color is mapped), or all of
+  // them at once with precompute().
   class RgbMapRGB5A3 : public RgbMapBase {
     // Bit activated on m_map entries that aren't yet calculated.
     const uint16_t INVALID = 256;
@@ -54,10 +56,14 @@ namespace doc {
       return RgbMapAlgorithm::RGB5A3;
     }
 
+    bool precompute(base::thread_pool* pool) override;
+    bool isPrecomputed() const override { return m_precomputed; }
+
   private:
     int generateEntry(int i, int r, int g, int b, int a) const;
 
     mutable std::vector<uint16_t> m_map;
+    bool m_precomputed = false;
 
     DISABLE_COPYING(RgbMapRGB5A3);
   };
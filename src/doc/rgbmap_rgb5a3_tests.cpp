@@ -0,0 +1,98 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/parallel_for.h"
+#include "base/thread_pool.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+static Palette make_palette(const int ncolors)
+{
+  std::mt19937 gen(ncolors);
+  std::uniform_int_distribution<int> dist(0, 255);
+  Palette pal(0, ncolors);
+  for (int i=0; i<ncolors; ++i)
+    pal.setEntry(i, rgba(dist(gen), dist(gen), dist(gen), 255));
+  return pal;
+}
+
+TEST(RgbMapRGB5A3, PrecomputedSameAsLazy)
+{
+  for (const int ncolors : { 16, 256 }) {
+    const Palette pal = make_palette(ncolors);
+    base::thread_pool pool(4);
+
+    RgbMapRGB5A3 lazy, eager;
+    lazy.regenerateMap(&pal, 0);
+    eager.regenerateMap(&pal, 0);
+    EXPECT_FALSE(eager.isPrecomputed());
+    EXPECT_TRUE(eager.precompute(&pool));
+    EXPECT_TRUE(eager.isPrecomputed());
+
+    for (int r=0; r<256; r+=3)
+      for (int g=0; g<256; g+=5)
+        for (int b=0; b<256; b+=7)
+          for (int a : { 0, 31, 32, 128, 255 })
+            ASSERT_EQ(lazy.mapColor(rgba(r, g, b, a)),
+                      eager.mapColor(rgba(r, g, b, a)));
+  }
+}
+
+TEST(RgbMapRGB5A3, RegenerateInvalidatesPrecomputed)
+{
+  Palette pal = make_palette(64);
+  RgbMapRGB5A3 map;
+  map.regenerateMap(&pal, 0);
+  EXPECT_TRUE(map.precompute(nullptr));
+
+  // Same palette/mask, the map is not regenerated
+  map.regenerateMap(&pal, 0);
+  EXPECT_TRUE(map.isPrecomputed());
+
+  pal.setEntry(1, rgba(1, 2, 3, 255));
+  map.regenerateMap(&pal, 0);
+  EXPECT_FALSE(map.isPrecomputed());
+  EXPECT_EQ(1, map.mapColor(rgba(1, 2, 3, 255)));
+}
+
+TEST(RgbMapRGB5A3, SharedBetweenThreads)
+{
+  const Palette pal = make_palette(64);
+  base::thread_pool pool(4);
+
+  RgbMapRGB5A3 lazy, eager;
+  lazy.regenerateMap(&pal, 0);
+  eager.regenerateMap(&pal, 0);
+  eager.precompute(&pool);
+
+  std::vector<int> result(256*256);
+  base::parallel_for(pool, 0, 256, [&](const int r){
+    for (int g=0; g<256; ++g)
+      result[r*256+g] = eager.mapColor(rgba(r, g, (r+g) & 255, 255));
+  });
+
+  for (int r=0; r<256; ++r)
+    for (int g=0; g<256; ++g)
+      ASSERT_EQ(lazy.mapColor(rgba(r, g, (r+g) & 255, 255)), result[r*256+g]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
+  return RUN_ALL_TESTS();
+}
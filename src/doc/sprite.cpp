@@ -447,24 +447,52 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
   if (!m_rgbMap ||
       m_rgbMap->rgbmapAlgorithm() != mapAlgo ||
       m_rgbMap->fitCriteria() != fitCriteria) {
-    switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
-      case RgbMapAlgorithm::DEFAULT:
-      case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
-      default:
-        m_rgbMap.reset(nullptr);
-        ASSERT(false);
-        return nullptr;
-    }
+    m_rgbMap = newRgbMap(mapAlgo);
+    if (!m_rgbMap)
+      return nullptr;
     m_rgbMap->fitCriteria(fitCriteria);
   }
-  int maskIndex = palette(frame)->findMaskColor();
-  maskIndex = (maskIndex == -1 ? (forLayer == RgbMapFor::OpaqueLayer ? -1: 0):
-                                 maskIndex);
-  m_rgbMap->regenerateMap(palette(frame), maskIndex, fitCriteria);
+  m_rgbMap->regenerateMap(palette(frame),
+                          rgbMapMaskIndex(frame, forLayer),
+                          fitCriteria);
   return m_rgbMap.get();
 }
 
+std::unique_ptr<RgbMap> Sprite::createRgbMap(const frame_t frame,
+                                             const RgbMapFor forLayer,
+                                             const RgbMapAlgorithm mapAlgo,
+                                             const FitCriteria fitCriteria) const
+{
+  std::unique_ptr<RgbMap> rgbmap = newRgbMap(mapAlgo);
+  if (rgbmap) {
+    rgbmap->fitCriteria(fitCriteria);
+    rgbmap->regenerateMap(palette(frame),
+                          rgbMapMaskIndex(frame, forLayer),
+                          fitCriteria);
+  }
+  return rgbmap;
+}
+
+// static
+std::unique_ptr<RgbMap> Sprite::newRgbMap(const RgbMapAlgorithm mapAlgo)
+{
+  switch (mapAlgo) {
+    case RgbMapAlgorithm::RGB5A3: return std::make_unique<RgbMapRGB5A3>();
+    case RgbMapAlgorithm::DEFAULT:
+    case RgbMapAlgorithm::OCTREE: return std::make_unique<OctreeMap>();
+  }
+  ASSERT(false);
+  return nullptr;
+}
+
+int Sprite::rgbMapMaskIndex(const frame_t frame,
+                            const RgbMapFor forLayer) const
+{
+  const int maskIndex = palette(frame)->findMaskColor();
+  return (maskIndex == -1 ? (forLayer == RgbMapFor::OpaqueLayer ? -1: 0):
+                            maskIndex);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Frames
 
@@ -562,13 +590,35 @@ ImageRef Sprite::getImageRef(ObjectId imageId)
 
 CelDataRef Sprite::getCelDataRef(ObjectId celDataId)
 {
-  for (Cel* cel : cels()) {
-    if (cel->dataRef()->id() == celDataId)
-      return cel->dataRef();
+  auto it = m_celDataIndex.find(celDataId);
+  if (it != m_celDataIndex.end()) {
+    CelDataRef celData = it->second.celData.lock();
+    ASSERT(celData && celData->id() == celDataId);
+    return celData;
   }
   return CelDataRef(nullptr);
 }
 
+void Sprite::addCelDataRef(const CelDataRef& celData)
+{
+  ASSERT(celData);
+  CelDataIndexEntry& entry = m_celDataIndex[celData->id()];
+  ASSERT(entry.cels == 0 || entry.celData.lock() == celData);
+  if (entry.cels++ == 0)
+    entry.celData = celData;
+}
+
+void Sprite::removeCelDataRef(const CelData* celData)
+{
+  ASSERT(celData);
+  auto it = m_celDataIndex.find(celData->id());
+  ASSERT(it != m_celDataIndex.end());
+  if (it != m_celDataIndex.end() &&
+      --it->second.cels == 0) {
+    m_celDataIndex.erase(it);
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Images
 
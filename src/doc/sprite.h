@@ -31,6 +31,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #define DOC_SPRITE_MAX_WIDTH  65535
@@ -171,6 +172,15 @@ namespace doc {
                    const RgbMapAlgorithm mapAlgo,
                    const FitCriteria fitCriteria = FitCriteria::DEFAULT) const;
 
+    // Creates a new RgbMap for the palette of the given frame. The
+    // returned map is owned by the caller (it's not the map cached in
+    // the sprite), so several maps can be used at the same time
+    // (e.g. for different palettes or from different threads).
+    std::unique_ptr<RgbMap> createRgbMap(const frame_t frame,
+                                         const RgbMapFor forLayer,
+                                         const RgbMapAlgorithm mapAlgo,
+                                         const FitCriteria fitCriteria = FitCriteria::DEFAULT) const;
+
     ////////////////////////////////////////
     // Frames
 
@@ -199,6 +209,13 @@ namespace doc {
     ImageRef getImageRef(ObjectId imageId);
     CelDataRef getCelDataRef(ObjectId celDataId);
 
+    // Keeps the index of CelData used by getCelDataRef() updated.
+    // Called by LayerImage/LayerGroup/Cel each time a cel is
+    // added/removed from the layers tree of this sprite (or its
+    // CelData is replaced).
+    void addCelDataRef(const CelDataRef& celData);
+    void removeCelDataRef(const CelData* celData);
+
     ////////////////////////////////////////
     // Images
 
@@ -255,6 +272,10 @@ namespace doc {
     }
 
   private:
+    static std::unique_ptr<RgbMap> newRgbMap(const RgbMapAlgorithm mapAlgo);
+    int rgbMapMaskIndex(const frame_t frame,
+                        const RgbMapFor forLayer) const;
+
     Document* m_document;
     ImageSpec m_spec;
     PixelRatio m_pixelRatio;
@@ -273,6 +294,14 @@ namespace doc {
     // Tilesets
     mutable Tilesets* m_tilesets;
 
+    // Index of all CelData used by cels of this sprite (by CelData
+    // ID) with the number of cels using each one (linked cels).
+    struct CelDataIndexEntry {
+      std::weak_ptr<CelData> celData;
+      int cels = 0;
+    };
+    std::unordered_map<ObjectId, CelDataIndexEntry> m_celDataIndex;
+
     // Custom tile management plugin. This can be an ID that specifies
     // a custom plugin that will be used to handle tilesets and
     // tilemaps for this specific sprite. This property is saved
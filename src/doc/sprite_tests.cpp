@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2022 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -193,6 +193,70 @@ TEST(Sprite, CelsRange)
   EXPECT_EQ(3, i);
 }
 
+TEST(Sprite, CelLookups)
+{
+  std::shared_ptr<Sprite> sprPtr(std::make_shared<Sprite>(
+                                   ImageSpec(ColorMode::RGB, 32, 32), 256));
+  Sprite* spr = sprPtr.get();
+  spr->setTotalFrames(10);
+
+  LayerImage* lay1 = new LayerImage(spr);
+  LayerImage* lay2 = new LayerImage(spr);
+  LayerGroup* grp1 = new LayerGroup(spr);
+  spr->root()->addLayer(lay1);
+
+  ImageRef imgA(Image::create(IMAGE_RGB, 32, 32));
+  ImageRef imgC(Image::create(IMAGE_RGB, 32, 32));
+  Cel* celA = new Cel(frame_t(0), imgA);
+  Cel* celB = Cel::MakeLink(frame_t(5), celA);
+  Cel* celC = new Cel(frame_t(2), imgC);
+  lay1->addCel(celA);
+  lay1->addCel(celB);
+  lay2->addCel(celC);           // lay2 isn't in the sprite yet
+
+  EXPECT_EQ(celA, lay1->cel(0));
+  EXPECT_EQ(nullptr, lay1->cel(1));
+  EXPECT_EQ(celB, lay1->cel(5));
+  EXPECT_EQ(nullptr, lay1->cel(6));
+  EXPECT_EQ(nullptr, lay1->cel(-1));
+  EXPECT_EQ(celA->dataRef(), spr->getCelDataRef(celA->data()->id()));
+  EXPECT_EQ(nullptr, spr->getCelDataRef(celC->data()->id()));
+
+  // Move cels
+  lay1->moveCel(celB, 8);
+  EXPECT_EQ(nullptr, lay1->cel(5));
+  EXPECT_EQ(celB, lay1->cel(8));
+  lay1->displaceFrames(0, 1);
+  EXPECT_EQ(nullptr, lay1->cel(0));
+  EXPECT_EQ(celA, lay1->cel(1));
+  EXPECT_EQ(celB, lay1->cel(9));
+
+  // Add layers to the sprite (inside a group)
+  grp1->addLayer(lay2);
+  EXPECT_EQ(nullptr, spr->getCelDataRef(celC->data()->id()));
+  spr->root()->addLayer(grp1);
+  EXPECT_EQ(celC->dataRef(), spr->getCelDataRef(celC->data()->id()));
+
+  // Unlink cel
+  const ObjectId idA = celA->data()->id();
+  celB->setDataRef(std::make_shared<CelData>(*celA->data()));
+  EXPECT_EQ(celA->dataRef(), spr->getCelDataRef(idA));
+  EXPECT_EQ(celB->dataRef(), spr->getCelDataRef(celB->data()->id()));
+
+  // Remove cels
+  lay1->removeCel(celA);
+  EXPECT_EQ(nullptr, spr->getCelDataRef(idA));
+  EXPECT_EQ(nullptr, lay1->cel(1));
+  lay1->addCel(celA);
+  EXPECT_EQ(celA->dataRef(), spr->getCelDataRef(idA));
+
+  // Remove layers
+  spr->root()->removeLayer(grp1);
+  EXPECT_EQ(nullptr, spr->getCelDataRef(celC->data()->id()));
+  EXPECT_EQ(celC, lay2->cel(2));
+  delete grp1;
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,16 +14,93 @@
 #include "doc/layer.h"
 #include "doc/layer_tilemap.h"
 #include "base/mem_utils.h"
+#include "doc/algorithm/flip_image.h"
+#include "doc/image_traits.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
+#include "doc/tile.h"
 
+#include <algorithm>
 #include <memory>
 
 #define TS_TRACE(...) // TRACE(__VA_ARGS__)
 
 namespace doc {
 
+namespace {
+
+// Flags of each flip in the order they are preferred by
+// findTileIndexWithFlags(), and the sequence of flips that must be
+// applied to an image to get the flipped version (this is the same
+// sequence that was used to flip images to find tiles in previous
+// versions, which is relevant for the diagonal flip of non-square
+// tiles).
+struct FlipDef {
+  tile_flags flags;
+  std::vector<algorithm::FlipType> sequence;
+};
+
+const FlipDef kFlips[Tileset::kFlipsCount] = {
+  { 0, { } },
+  { tile_f_xflip, { algorithm::FlipHorizontal } },
+  { tile_f_yflip, { algorithm::FlipVertical } },
+  { tile_f_xflip | tile_f_yflip, { algorithm::FlipVertical,
+                                   algorithm::FlipHorizontal } },
+  { tile_f_dflip, { algorithm::FlipDiagonal } },
+  { tile_f_xflip | tile_f_dflip, { algorithm::FlipHorizontal,
+                                   algorithm::FlipDiagonal } },
+  { tile_f_xflip | tile_f_yflip | tile_f_dflip, { algorithm::FlipHorizontal,
+                                                  algorithm::FlipVertical,
+                                                  algorithm::FlipDiagonal } },
+  { tile_f_yflip | tile_f_dflip, { algorithm::FlipVertical,
+                                   algorithm::FlipDiagonal } },
+};
+
+// splitmix64 finalizer
+inline uint64_t mix_hash(uint64_t x)
+{
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+template<typename ImageTraits>
+void get_image_pixels_templ(const Image* image,
+                            std::vector<color_t>& pixels)
+{
+  const int w = image->width();
+  const int h = image->height();
+  auto it = pixels.begin();
+  for (int y=0; y<h; ++y) {
+    auto p = (const typename ImageTraits::pixel_t*)image->getPixelAddress(0, y);
+    for (int x=0; x<w; ++x, ++it, ++p)
+      *it = *p;
+  }
+}
+
+// Copies the pixels of the image to a flat array (one color_t per
+// pixel, row by row).
+void get_image_pixels(const Image* image,
+                      std::vector<color_t>& pixels)
+{
+  pixels.resize(image->width() * image->height());
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       get_image_pixels_templ<RgbTraits>(image, pixels); break;
+    case IMAGE_GRAYSCALE: get_image_pixels_templ<GrayscaleTraits>(image, pixels); break;
+    case IMAGE_INDEXED:   get_image_pixels_templ<IndexedTraits>(image, pixels); break;
+    case IMAGE_TILEMAP:   get_image_pixels_templ<TilemapTraits>(image, pixels); break;
+    default: {
+      const int w = image->width();
+      for (int i=0; i<int(pixels.size()); ++i)
+        pixels[i] = image->getPixel(i % w, i / w);
+      break;
+    }
+  }
+}
+
+} // anonymous namespace
+
 // static
 UserData Tileset::kNoUserData;
 
@@ -47,7 +124,7 @@ Tileset::Tileset(Sprite* sprite,
   for (tile_index ti=0; ti<ntiles; ++ti) {
     ImageRef tile = makeEmptyTile();
     m_tiles[ti].image = tile;
-    hashImage(ti, tile);
+    hashImage(ti);
   }
 }
 
@@ -127,6 +204,9 @@ void Tileset::resize(const tile_index ntiles)
   m_tiles.resize(ntiles);
   for (tile_index ti=oldSize; ti<ntiles; ++ti)
     m_tiles[ti].image = makeEmptyTile();
+
+  // The flips hash table cannot reference removed tiles
+  m_flipsHash.clear();
 }
 
 void Tileset::remap(const Remap& remap)
@@ -176,9 +256,16 @@ void Tileset::set(const tile_index ti,
 
   preprocess_transparent_pixels(image.get());
   m_tiles[ti].image = image;
+  m_tiles[ti].hasHash = false;
+  m_tiles[ti].hasFlipsHashes = false;
 
   if (!m_hash.empty())
-    hashImage(ti, image);
+    hashImage(ti);
+
+  // Other tiles equal to the previous image could be missing in the
+  // flips hash table, so we re-create it when it's needed (the hash
+  // of each tile is cached anyway).
+  m_flipsHash.clear();
 }
 
 tile_index Tileset::add(const ImageRef& image,
@@ -193,7 +280,9 @@ tile_index Tileset::add(const ImageRef& image,
 
   const tile_index newIndex = tile_index(m_tiles.size()-1);
   if (!m_hash.empty())
-    hashImage(newIndex, image);
+    hashImage(newIndex);
+  if (!m_flipsHash.empty())
+    hashFlippedImage(newIndex);
   return newIndex;
 }
 
@@ -222,8 +311,11 @@ void Tileset::insert(const tile_index ti,
         ++it.second;
 
     // And now we can add the new image with the "ti" index
-    hashImage(ti, image);
+    hashImage(ti);
   }
+
+  // Re-create the flips hash table when it's needed
+  m_flipsHash.clear();
 }
 
 void Tileset::erase(const tile_index ti)
@@ -262,7 +354,7 @@ bool Tileset::findTileIndex(const ImageRef& tileImage,
   auto& h = hashTable(); // Don't use m_hash directly in case that
                          // we've to regenerate the hash table.
 
-  auto it = h.find(tileImage);
+  auto it = h.find(TilesetHashKey(tileImage));
   if (it != h.end()) {
     ti = it->second;
     return true;
@@ -273,6 +365,64 @@ bool Tileset::findTileIndex(const ImageRef& tileImage,
   }
 }
 
+bool Tileset::findTileIndexWithFlags(const ImageRef& tileImage,
+                                     const tile_flags matchFlags,
+                                     tile_index& ti,
+                                     tile_flags& tf)
+{
+  ASSERT(tileImage);
+  ti = notile;
+  tf = 0;
+  if (!tileImage ||
+      tileImage->size() != m_grid.tileSize()) {
+    return false;
+  }
+
+  auto& h = flipsHashTable();
+
+  thread_local std::vector<color_t> pixels;
+  get_image_pixels(tileImage.get(), pixels);
+
+  const int n = int(pixels.size());
+  uint64_t hash = 0;
+  for (int i=0; i<n; ++i)
+    hash += mix_hash(pixels[i] ^ m_flipsPosKeys[i]);
+
+  // Equal tiles are added only once in the table (with the lowest
+  // index), so each flip can match just one tile.
+  int bestFlip = kFlipsCount;
+  thread_local std::vector<color_t> tilePixels;
+  auto range = h.equal_range(hash);
+  for (auto it=range.first; it!=range.second; ++it) {
+    const TilesetFlipsHashItem& item = it->second;
+
+    // Ignore flips that are not allowed, and candidates that are
+    // worse than the best one we've found.
+    if ((kFlips[item.flip].flags & matchFlags) != kFlips[item.flip].flags ||
+        item.flip >= bestFlip) {
+      continue;
+    }
+
+    // Compare the flipped tile pixel by pixel (the hash can collide)
+    get_image_pixels(m_tiles[item.ti].image.get(), tilePixels);
+    const std::vector<uint32_t>& map = m_flipsMap[item.flip];
+    int i = 0;
+    for (; i<n && pixels[map[i]] == tilePixels[i]; ++i)
+      ;
+
+    if (i == n) {
+      bestFlip = item.flip;
+      ti = item.ti;
+    }
+  }
+
+  if (bestFlip < kFlipsCount) {
+    tf = kFlips[bestFlip].flags;
+    return true;
+  }
+  return false;
+}
+
 void Tileset::notifyTileContentChange(const tile_index ti)
 {
 #if 0 // TODO Try to do less work
@@ -301,16 +451,21 @@ void Tileset::notifyTileContentChange(const tile_index ti)
   // re-adding the tile to the hash table.
   removeFromHash(ti, false);
   if (!m_hash.empty())
-    hashImage(ti, m_tiles[ti]);
+    hashImage(ti);
 
 #else // Regenerate the whole hash map (at the moment this is the
       // only way to make it work correctly)
 
   (void)ti;                     // unused
 
-  if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image)
+  if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image) {
     preprocess_transparent_pixels(m_tiles[ti].image.get());
 
+    // The image could be modified without changing its version.
+    m_tiles[ti].hasHash = false;
+    m_tiles[ti].hasFlipsHashes = false;
+  }
+
   rehash();
 
 #endif
@@ -322,8 +477,10 @@ void Tileset::notifyRegenerateEmptyTile()
     return;
 
   ImageRef image = get(doc::notile);
-  if (image)
+  if (image) {
     doc::clear_image(image.get(), image->maskColor());
+    m_tiles[doc::notile].hasFlipsHashes = false;
+  }
   rehash();
 }
 
@@ -357,19 +514,19 @@ void Tileset::assertValidHashTable()
   // array.
   if (m_hash.size() < m_tiles.size()) {
     for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
+      auto it = m_hash.find(TilesetHashKey(m_tiles[ti].image, tileHash(ti)));
       ASSERT(it != m_hash.end());
 
       // If the hash doesn't match, it is because other tile is equal
       // to this one.
       if (it->second != ti) {
-        ASSERT(is_same_image(it->first.get(), m_tiles[it->second].image.get()));
+        ASSERT(is_same_image(it->first.image.get(), m_tiles[it->second].image.get()));
       }
     }
   }
   else if (m_hash.size() == m_tiles.size()) {
     for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti) {
-      auto it = m_hash.find(m_tiles[ti].image);
+      auto it = m_hash.find(TilesetHashKey(m_tiles[ti].image, tileHash(ti)));
       ASSERT(it != m_hash.end());
       ASSERT(it->second == ti);
     }
@@ -380,11 +537,23 @@ void Tileset::assertValidHashTable()
 }
 #endif
 
-void Tileset::hashImage(const tile_index ti,
-                        const ImageRef& tileImage)
+void Tileset::hashImage(const tile_index ti)
+{
+  // Only the first tile with the same image is added to the table
+  m_hash.try_emplace(TilesetHashKey(m_tiles[ti].image, tileHash(ti)), ti);
+}
+
+uint64_t Tileset::tileHash(const tile_index ti)
 {
-  if (m_hash.find(tileImage) == m_hash.end())
-    m_hash[tileImage] = ti;
+  Tile& tile = m_tiles[ti];
+  if (!tile.hasHash ||
+      tile.hashVersion != tile.image->version()) {
+    tile.hash = calculate_image_hash(tile.image.get(),
+                                     tile.image->bounds());
+    tile.hashVersion = tile.image->version();
+    tile.hasHash = true;
+  }
+  return tile.hash;
 }
 
 void Tileset::rehash()
@@ -392,6 +561,7 @@ void Tileset::rehash()
   // Clear the hash table, we'll lazy-rehash it when
   // hashTable()/findTileIndex() is used.
   m_hash.clear();
+  m_flipsHash.clear();
 
   // Reset the compressed data (just in case we have cached the data
   // from a loaded .aseprite file or when saving the file).
@@ -402,13 +572,104 @@ TilesetHashTable& Tileset::hashTable()
 {
   if (m_hash.empty()) {
     // Re-hash/create the whole hash table from scratch
-    tile_index ti = 0;
-    for (auto& tile : m_tiles)
-      hashImage(ti++, tile.image);
+    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti)
+      hashImage(ti);
   }
   return m_hash;
 }
 
+void Tileset::hashFlippedImage(const tile_index ti)
+{
+  const auto& hashes = tileFlipsHashes(ti);
+  for (int flip=0; flip<kFlipsCount; ++flip) {
+    // Only the tile with the lowest index is added when several tiles
+    // are equal (as in hashImage() for the m_hash table)
+    bool found = false;
+    auto range = m_flipsHash.equal_range(hashes[flip]);
+    for (auto it=range.first; it!=range.second; ++it) {
+      TilesetFlipsHashItem& item = it->second;
+      if (item.flip == flip &&
+          is_same_image(m_tiles[item.ti].image.get(),
+                        m_tiles[ti].image.get())) {
+        item.ti = std::min(item.ti, ti);
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      m_flipsHash.emplace(hashes[flip], TilesetFlipsHashItem{ ti, flip });
+  }
+}
+
+// Returns the hash of each flipped version of the "ti" tile (without
+// flipping the tile image). The hash of an image is the sum of
+// mix_hash(pixel ^ key) of each pixel, where "key" is a random value
+// that depends on the pixel position. A pixel "i" of the tile is the
+// pixel "map[i]" of its flipped version, so we can calculate the hash
+// of each flipped version just changing the key of each pixel.
+const std::array<uint64_t, Tileset::kFlipsCount>& Tileset::tileFlipsHashes(const tile_index ti)
+{
+  Tile& tile = m_tiles[ti];
+  if (!tile.hasFlipsHashes ||
+      tile.flipsHashesVersion != tile.image->version()) {
+    createFlipsTables();
+
+    std::vector<color_t> pixels;
+    get_image_pixels(tile.image.get(), pixels);
+
+    tile.flipsHashes.fill(0);
+    for (int i=0; i<int(pixels.size()); ++i) {
+      for (int flip=0; flip<kFlipsCount; ++flip) {
+        tile.flipsHashes[flip] +=
+          mix_hash(pixels[i] ^ m_flipsPosKeys[m_flipsMap[flip][i]]);
+      }
+    }
+    tile.flipsHashesVersion = tile.image->version();
+    tile.hasFlipsHashes = true;
+  }
+  return tile.flipsHashes;
+}
+
+TilesetFlipsHashTable& Tileset::flipsHashTable()
+{
+  if (m_flipsHash.empty()) {
+    createFlipsTables();
+    for (tile_index ti=0; ti<tile_index(m_tiles.size()); ++ti)
+      hashFlippedImage(ti);
+  }
+  return m_flipsHash;
+}
+
+void Tileset::createFlipsTables()
+{
+  if (!m_flipsPosKeys.empty())
+    return;
+
+  const gfx::Size tileSize = m_grid.tileSize();
+  const int n = tileSize.w * tileSize.h;
+
+  // Fixed seed so hashes are the same in each execution
+  uint64_t seed = 0x9e3779b97f4a7c15ull;
+  m_flipsPosKeys.resize(n);
+  for (auto& key : m_flipsPosKeys) {
+    seed += 0x9e3779b97f4a7c15ull;
+    key = mix_hash(seed);
+  }
+
+  // Flip an image where each pixel is its own index to know where
+  // each pixel goes with each flip.
+  ImageRef indexes(Image::create(IMAGE_RGB, tileSize.w, tileSize.h));
+  for (int flip=0; flip<kFlipsCount; ++flip) {
+    for (int i=0; i<n; ++i)
+      indexes->putPixel(i % tileSize.w, i / tileSize.w, color_t(i));
+
+    for (auto flipType : kFlips[flip].sequence)
+      algorithm::flip_image(indexes.get(), indexes->bounds(), flipType);
+
+    get_image_pixels(indexes.get(), m_flipsMap[flip]);
+  }
+}
+
 int Tileset::tilemapsCount() const {
   auto tsi = sprite()->tilesets()->getIndex(this);
   int count = 0;
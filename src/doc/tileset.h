@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,8 +14,10 @@
 #include "doc/object.h"
 #include "doc/tile.h"
 #include "doc/tileset_hash_table.h"
+#include "doc/tileset_usage.h"
 #include "doc/with_user_data.h"
 
+#include <array>
 #include <string>
 #include <vector>
 
@@ -25,9 +27,25 @@ namespace doc {
   class Sprite;
 
   class Tileset : public WithUserData {
+  public:
+    // Number of flags combinations to match flipped tiles (see
+    // findTileIndexWithFlags())
+    static constexpr int kFlipsCount = 8;
+
+  private:
     struct Tile {
       ImageRef image;
       UserData data;
+      // Cached hash of the image pixels (valid while the image
+      // version is the same, see Tileset::tileHash())
+      uint64_t hash = 0;
+      ObjectVersion hashVersion = 0;
+      bool hasHash = false;
+      // Cached hashes of each flipped version of the image (see
+      // Tileset::tileFlipsHashes())
+      std::array<uint64_t, kFlipsCount> flipsHashes;
+      ObjectVersion flipsHashesVersion = 0;
+      bool hasFlipsHashes = false;
       Tile() { }
       Tile(const ImageRef& image,
            const UserData& data) : image(image), data(data) { }
@@ -127,6 +145,20 @@ namespace doc {
     bool findTileIndex(const ImageRef& tileImage,
                        tile_index& ti);
 
+    // Like findTileIndex() but it can match flipped versions of the
+    // tiles too (only flips included in "matchFlags"). Returns the
+    // flags that must be used with the "ti" tile to get the given
+    // "tileImage" in "tf". If several tiles/flips match, the tile
+    // without flips is preferred, then X, Y, XY, D, XD, XYD, and YD
+    // flips (and the lowest tile index).
+    //
+    // Flipped versions of the tiles are hashed without flipping the
+    // tile images, so this needs just one hash table lookup.
+    bool findTileIndexWithFlags(const ImageRef& tileImage,
+                                const tile_flags matchFlags,
+                                tile_index& ti,
+                                tile_flags& tf);
+
     // Must be called when a tile image was modified externally, so
     // the hash elements are re-calculated for that specific tile.
     void notifyTileContentChange(const tile_index ti);
@@ -138,6 +170,14 @@ namespace doc {
     // Returns the number of tilemap layers that are referencing this tileset.
     int tilemapsCount() const;
 
+    // Returns how many times each tile is used in the tilemaps of
+    // the sprite (only tilemaps modified since the last call are
+    // scanned, see TilesetUsage). The vector can be bigger than the
+    // tileset if tilemaps reference non-existent tiles.
+    const std::vector<std::size_t>& tilesHistogram() {
+      return m_usage.histogram(this);
+    }
+
 #ifdef _DEBUG
     void assertValidHashTable();
 #endif
@@ -145,15 +185,26 @@ namespace doc {
   private:
     void removeFromHash(const tile_index ti,
                         const bool adjustIndexes);
-    void hashImage(const tile_index ti,
-                   const ImageRef& tileImage);
+    void hashImage(const tile_index ti);
+    uint64_t tileHash(const tile_index ti);
     void rehash();
     TilesetHashTable& hashTable();
+    void hashFlippedImage(const tile_index ti);
+    const std::array<uint64_t, kFlipsCount>& tileFlipsHashes(const tile_index ti);
+    TilesetFlipsHashTable& flipsHashTable();
+    void createFlipsTables();
 
     Sprite* m_sprite;
     Grid m_grid;
     Tiles m_tiles;
     TilesetHashTable m_hash;
+    TilesetFlipsHashTable m_flipsHash;
+    // For each flip, the index of the pixel of the original tile
+    // that is in each pixel of the flipped tile (m_flipsMap[flip][i])
+    std::vector<uint32_t> m_flipsMap[kFlipsCount];
+    // Random value for each pixel position used to hash tiles
+    std::vector<uint64_t> m_flipsPosKeys;
+    TilesetUsage m_usage;
     std::string m_name;
     int m_baseIndex = 1;
     tile_flags m_matchFlags = 0;
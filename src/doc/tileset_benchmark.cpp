@@ -0,0 +1,314 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tile.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Creates "n" different tiles similar to the ones we can find in
+// a real tileset: all tiles use a few colors from the same palette
+// and share most of their pixels with a base tile (e.g. grass/wall
+// variations).
+std::vector<ImageRef> make_tiles(const PixelFormat pf,
+                                 const int n,
+                                 const int tileSize)
+{
+  std::mt19937 gen(n);
+  std::uniform_int_distribution<int> color(1, 8);
+  std::uniform_int_distribution<int> pos(0, tileSize-1);
+
+  const color_t colors[] = {
+    0, rgba(34, 32, 52, 255), rgba(69, 40, 60, 255),
+    rgba(102, 57, 49, 255), rgba(143, 86, 59, 255),
+    rgba(223, 113, 38, 255), rgba(106, 190, 48, 255),
+    rgba(55, 148, 110, 255), rgba(75, 105, 47, 255)
+  };
+  auto c = [pf, &colors](int i) -> color_t {
+    switch (pf) {
+      case IMAGE_RGB: return colors[i];
+      case IMAGE_GRAYSCALE: return graya(rgba_getg(colors[i]), i ? 255: 0);
+      default: return i;
+    }
+  };
+
+  ImageRef base(Image::create(pf, tileSize, tileSize));
+  for (int y=0; y<tileSize; ++y)
+    for (int x=0; x<tileSize; ++x)
+      put_pixel(base.get(), x, y, c(color(gen)));
+
+  std::vector<ImageRef> tiles;
+  tiles.reserve(n);
+  while (int(tiles.size()) < n) {
+    ImageRef tile(Image::createCopy(base.get()));
+    const int changes = 1 + int(tiles.size()) % 4;
+    for (int i=0; i<changes; ++i)
+      put_pixel(tile.get(), pos(gen), pos(gen), c(color(gen)));
+    preprocess_transparent_pixels(tile.get());
+    tiles.push_back(tile);
+  }
+  return tiles;
+}
+
+std::unique_ptr<Sprite> make_sprite(const PixelFormat pf)
+{
+  return std::make_unique<Sprite>(
+    ImageSpec(ColorMode(pf), 256, 256), 256);
+}
+
+// Creates a sprite with "nlayers" tilemap layers (one cel per
+// layer) of "size"x"size" tiles that use the same tileset.
+std::unique_ptr<Sprite> make_level(const int nlayers,
+                                   const int size,
+                                   const int ntiles)
+{
+  auto spr = make_sprite(IMAGE_RGB);
+  auto tileset = new Tileset(spr.get(), Grid(gfx::Size(16, 16)), ntiles);
+  spr->tilesets()->add(tileset);
+
+  std::mt19937 gen(nlayers);
+  std::uniform_int_distribution<int> tile(0, ntiles-1);
+  for (int i=0; i<nlayers; ++i) {
+    auto layer = new LayerTilemap(spr.get(), 0);
+    spr->root()->addLayer(layer);
+
+    ImageRef tilemap(Image::create(IMAGE_TILEMAP, size, size));
+    for (int y=0; y<size; ++y)
+      for (int x=0; x<size; ++x)
+        put_pixel(tilemap.get(), x, y, doc::tile(tile(gen), 0));
+    layer->addCel(new Cel(0, tilemap));
+  }
+  return spr;
+}
+
+// Simulates a stroke in a tilemap (changes a few tiles of one layer)
+void modify_level(Sprite* spr, const int i)
+{
+  const auto layers = spr->allTilemaps();
+  Image* tilemap = layers[i % layers.size()]->cel(0)->image();
+  for (int j=0; j<16; ++j)
+    put_pixel(tilemap, (i+j) % tilemap->width(), i % tilemap->height(),
+              doc::tile(1 + j, 0));
+  tilemap->incrementVersion();
+}
+
+} // anonymous namespace
+
+// Auto-tile mode: for each tile image we search it in the tileset,
+// and if it's not there we add it.
+void BM_TilesetFindOrAdd(benchmark::State& state)
+{
+  const auto pf = (PixelFormat)state.range(0);
+  const int ntiles = state.range(1);
+  const int tileSize = state.range(2);
+  auto spr = make_sprite(pf);
+  const auto tiles = make_tiles(pf, ntiles, tileSize);
+
+  for (auto _ : state) {
+    Tileset tileset(spr.get(), Grid(gfx::Size(tileSize, tileSize)), 1);
+    tile_index ti;
+    // Each tile is found two times, the first time is added
+    for (int k=0; k<2; ++k) {
+      for (const ImageRef& tile : tiles) {
+        if (!tileset.findTileIndex(tile, ti))
+          tileset.add(tile);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ntiles * 2);
+}
+
+// Searches tiles in an already hashed tileset.
+void BM_TilesetFind(benchmark::State& state)
+{
+  const auto pf = (PixelFormat)state.range(0);
+  const int ntiles = state.range(1);
+  const int tileSize = state.range(2);
+  auto spr = make_sprite(pf);
+  const auto tiles = make_tiles(pf, ntiles, tileSize);
+
+  Tileset tileset(spr.get(), Grid(gfx::Size(tileSize, tileSize)), 1);
+  for (const ImageRef& tile : tiles)
+    tileset.add(ImageRef(Image::createCopy(tile.get())));
+
+  for (auto _ : state) {
+    tile_index ti;
+    for (const ImageRef& tile : tiles) {
+      if (!tileset.findTileIndex(tile, ti)) {
+        state.SkipWithError("Tile not found");
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ntiles);
+}
+
+// Searches flipped versions of the tiles (auto-tile mode with
+// "match flips" enabled in the tileset).
+void BM_TilesetFindWithFlags(benchmark::State& state)
+{
+  const auto pf = (PixelFormat)state.range(0);
+  const int ntiles = state.range(1);
+  const int tileSize = state.range(2);
+  auto spr = make_sprite(pf);
+  const auto tiles = make_tiles(pf, ntiles, tileSize);
+
+  Tileset tileset(spr.get(), Grid(gfx::Size(tileSize, tileSize)), 1);
+  for (const ImageRef& tile : tiles)
+    tileset.add(ImageRef(Image::createCopy(tile.get())));
+
+  // Flip each tile with a different combination of flips
+  std::vector<ImageRef> flipped;
+  flipped.reserve(ntiles);
+  for (const ImageRef& tile : tiles) {
+    ImageRef copy(Image::createCopy(tile.get()));
+    const int i = int(flipped.size());
+    if (i & 1) algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipHorizontal);
+    if (i & 2) algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipVertical);
+    if (i & 4) algorithm::flip_image(copy.get(), copy->bounds(), algorithm::FlipDiagonal);
+    flipped.push_back(copy);
+  }
+
+  const tile_flags matchFlags = (tile_f_xflip | tile_f_yflip | tile_f_dflip);
+  for (auto _ : state) {
+    tile_index ti;
+    tile_flags tf;
+    for (const ImageRef& tile : flipped) {
+      if (!tileset.findTileIndexWithFlags(tile, matchFlags, ti, tf)) {
+        state.SkipWithError("Tile not found");
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * ntiles);
+}
+
+// One tile is modified and then a tile is searched (the whole hash
+// table is re-generated in this case).
+void BM_TilesetContentChange(benchmark::State& state)
+{
+  const auto pf = (PixelFormat)state.range(0);
+  const int ntiles = state.range(1);
+  const int tileSize = state.range(2);
+  auto spr = make_sprite(pf);
+  const auto tiles = make_tiles(pf, ntiles, tileSize);
+
+  Tileset tileset(spr.get(), Grid(gfx::Size(tileSize, tileSize)), 1);
+  for (const ImageRef& tile : tiles)
+    tileset.add(ImageRef(Image::createCopy(tile.get())));
+
+  int i = 0;
+  for (auto _ : state) {
+    const tile_index modified = 1 + (i++ % ntiles);
+    Image* image = tileset.get(modified).get();
+    image->incrementVersion();
+    tileset.notifyTileContentChange(modified);
+
+    tile_index ti;
+    tileset.findTileIndex(tiles[0], ti);
+  }
+}
+
+// Usage of each tile in a level where a stroke modified one layer
+// (auto-tile mode needs this to know which tiles can be removed).
+void BM_TilesetHistogram(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+  const int size = state.range(1);
+  auto spr = make_level(nlayers, size, 1024);
+  Tileset* tileset = spr->tilesets()->get(0);
+  tileset->tilesHistogram();
+
+  int i = 0;
+  for (auto _ : state) {
+    modify_level(spr.get(), i++);
+    benchmark::DoNotOptimize(tileset->tilesHistogram().data());
+  }
+}
+
+// The same as BM_TilesetHistogram but counting all tiles from
+// scratch (to compare with the incremental version).
+void BM_TilesetHistogramFromScratch(benchmark::State& state)
+{
+  const int nlayers = state.range(0);
+  const int size = state.range(1);
+  auto spr = make_level(nlayers, size, 1024);
+  Tileset* tileset = spr->tilesets()->get(0);
+
+  int i = 0;
+  std::vector<std::size_t> histogram;
+  for (auto _ : state) {
+    modify_level(spr.get(), i++);
+
+    histogram.assign(tileset->size(), 0);
+    std::vector<ImageRef> tilemaps;
+    spr->getTilemapsByTileset(tileset, tilemaps);
+    for (const ImageRef& tilemap : tilemaps) {
+      for_each_pixel<TilemapTraits>(
+        tilemap.get(),
+        [&histogram](const tile_t t) {
+          if (t != notile)
+            ++histogram[tile_geti(t)];
+        });
+    }
+    benchmark::DoNotOptimize(histogram.data());
+  }
+}
+
+#define DEFARGS()                                               \
+  ->Args({ IMAGE_RGB, 256, 16 })                                \
+  ->Args({ IMAGE_RGB, 4096, 16 })                               \
+  ->Args({ IMAGE_RGB, 4096, 32 })                               \
+  ->Args({ IMAGE_GRAYSCALE, 4096, 16 })                         \
+  ->Args({ IMAGE_INDEXED, 256, 8 })                             \
+  ->Args({ IMAGE_INDEXED, 4096, 16 })
+
+BENCHMARK(BM_TilesetFindOrAdd)
+  DEFARGS()
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_TilesetFind)
+  DEFARGS()
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_TilesetFindWithFlags)
+  DEFARGS()
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_TilesetContentChange)
+  DEFARGS()
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_TilesetHistogram)
+  ->Args({ 50, 256 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_TilesetHistogramFromScratch)
+  ->Args({ 50, 256 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -14,15 +14,61 @@
 #include "doc/primitives.h"
 #include "doc/tile.h"
 
+#include <cstdint>
 #include <unordered_map>
 
 namespace doc {
 
+  // Key of the TilesetHashTable, a tile image with its hash already
+  // calculated (so the hash of each tile is calculated only once,
+  // and we can compare the whole 64-bit hash before comparing pixels).
+  struct TilesetHashKey {
+    ImageRef image;
+    uint64_t hash;
+
+    TilesetHashKey(const ImageRef& image, const uint64_t hash)
+      : image(image), hash(hash) { }
+
+    explicit TilesetHashKey(const ImageRef& image)
+      : image(image)
+      , hash(calculate_image_hash(image.get(), image->bounds())) { }
+  };
+
+  namespace details {
+
+    struct tileset_hash {
+      size_t operator()(const TilesetHashKey& k) const noexcept {
+        return size_t(k.hash);
+      }
+    };
+
+    struct tileset_eq {
+      bool operator()(const TilesetHashKey& a, const TilesetHashKey& b) const {
+        return (a.hash == b.hash &&
+                is_same_image(a.image.get(), b.image.get()));
+      }
+    };
+
+  }
+
   // A hash table used to match Image pixels data <-> tileset index
-  typedef std::unordered_map<ImageRef,
+  typedef std::unordered_map<TilesetHashKey,
                              tile_index,
-                             details::image_hash,
-                             details::image_eq> TilesetHashTable;
+                             details::tileset_hash,
+                             details::tileset_eq> TilesetHashTable;
+
+  // Element of the TilesetFlipsHashTable: a tile and the index of
+  // the flip (see Tileset::kFlips) that must be applied to the tile
+  // to get an image with the hash of the key.
+  struct TilesetFlipsHashItem {
+    tile_index ti;
+    int flip;
+  };
+
+  // A hash table used to match Image pixels data <-> tileset index +
+  // flags, the key is the hash of each flipped version of each tile.
+  typedef std::unordered_multimap<uint64_t,
+                                  TilesetFlipsHashItem> TilesetFlipsHashTable;
 
 } // namespace doc
 
@@ -0,0 +1,190 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tile.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+#include <memory>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+struct FlipCase {
+  tile_flags flags;
+  std::vector<algorithm::FlipType> sequence;
+};
+
+const FlipCase kFlipCases[] = {
+  { 0, { } },
+  { tile_f_xflip, { algorithm::FlipHorizontal } },
+  { tile_f_yflip, { algorithm::FlipVertical } },
+  { tile_f_xflip | tile_f_yflip, { algorithm::FlipVertical,
+                                   algorithm::FlipHorizontal } },
+  { tile_f_dflip, { algorithm::FlipDiagonal } },
+  { tile_f_xflip | tile_f_dflip, { algorithm::FlipHorizontal,
+                                   algorithm::FlipDiagonal } },
+  { tile_f_xflip | tile_f_yflip | tile_f_dflip, { algorithm::FlipHorizontal,
+                                                  algorithm::FlipVertical,
+                                                  algorithm::FlipDiagonal } },
+  { tile_f_yflip | tile_f_dflip, { algorithm::FlipVertical,
+                                   algorithm::FlipDiagonal } },
+};
+
+ImageRef make_random_tile(const gfx::Size& size, uint32_t& seed)
+{
+  ImageRef image(Image::create(IMAGE_RGB, size.w, size.h));
+  for (int y=0; y<size.h; ++y) {
+    for (int x=0; x<size.w; ++x) {
+      seed = seed * 1664525 + 1013904223;
+      put_pixel(image.get(), x, y, rgba(seed >> 24, seed >> 16, seed >> 8, 255));
+    }
+  }
+  return image;
+}
+
+ImageRef make_flipped(const ImageRef& image, const FlipCase& flipCase)
+{
+  ImageRef copy(Image::createCopy(image.get()));
+  for (auto flipType : flipCase.sequence)
+    algorithm::flip_image(copy.get(), copy->bounds(), flipType);
+  return copy;
+}
+
+const tile_flags kAllFlags = (tile_f_xflip | tile_f_yflip | tile_f_dflip);
+
+} // anonymous namespace
+
+TEST(Tileset, FindTileIndexWithFlags)
+{
+  for (const gfx::Size& tileSize : { gfx::Size(8, 8), gfx::Size(8, 4) }) {
+    auto spr = std::make_unique<Sprite>(ImageSpec(ColorMode::RGB, 32, 32), 256);
+    Tileset tileset(spr.get(), Grid(tileSize), 1);
+
+    uint32_t seed = 1;
+    for (const FlipCase& flipCase : kFlipCases) {
+      // Add a tile that is the flipped version of the image we're
+      // going to search
+      ImageRef image = make_random_tile(tileSize, seed);
+      const tile_index added = tileset.add(make_flipped(image, flipCase));
+
+      tile_index ti;
+      tile_flags tf;
+      EXPECT_TRUE(tileset.findTileIndexWithFlags(image, kAllFlags, ti, tf));
+      EXPECT_EQ(added, ti);
+      EXPECT_EQ(flipCase.flags, tf);
+
+      // Without the required flags the tile cannot be found
+      if (flipCase.flags) {
+        EXPECT_FALSE(tileset.findTileIndexWithFlags(image, 0, ti, tf));
+        EXPECT_EQ(notile, ti);
+      }
+    }
+  }
+}
+
+TEST(Tileset, FindTileIndexWithFlagsPrefersNoFlips)
+{
+  auto spr = std::make_unique<Sprite>(ImageSpec(ColorMode::RGB, 32, 32), 256);
+  Tileset tileset(spr.get(), Grid(gfx::Size(4, 4)), 1);
+
+  uint32_t seed = 2;
+  ImageRef image = make_random_tile(gfx::Size(4, 4), seed);
+  const tile_index flipped = tileset.add(make_flipped(image, kFlipCases[1]));
+
+  tile_index ti;
+  tile_flags tf;
+  EXPECT_TRUE(tileset.findTileIndexWithFlags(image, kAllFlags, ti, tf));
+  EXPECT_EQ(flipped, ti);
+  EXPECT_EQ(tile_f_xflip, tf);
+
+  // Now the same image without flips is in the tileset
+  const tile_index same = tileset.add(ImageRef(Image::createCopy(image.get())));
+  EXPECT_TRUE(tileset.findTileIndexWithFlags(image, kAllFlags, ti, tf));
+  EXPECT_EQ(same, ti);
+  EXPECT_EQ(0, tf);
+
+  // Replace the tile with a different image
+  tileset.set(same, make_random_tile(gfx::Size(4, 4), seed));
+  EXPECT_TRUE(tileset.findTileIndexWithFlags(image, kAllFlags, ti, tf));
+  EXPECT_EQ(flipped, ti);
+  EXPECT_EQ(tile_f_xflip, tf);
+
+  // Modify the content of the flipped tile
+  put_pixel(tileset.get(flipped).get(), 0, 0, rgba(1, 2, 3, 4));
+  tileset.notifyTileContentChange(flipped);
+  EXPECT_FALSE(tileset.findTileIndexWithFlags(image, kAllFlags, ti, tf));
+
+  // The empty tile is found with any combination of flags
+  ImageRef empty(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(empty.get(), 0);
+  EXPECT_TRUE(tileset.findTileIndexWithFlags(empty, kAllFlags, ti, tf));
+  EXPECT_EQ(notile, ti);
+  EXPECT_EQ(0, tf);
+}
+
+TEST(Tileset, TilesHistogram)
+{
+  auto spr = std::make_unique<Sprite>(ImageSpec(ColorMode::RGB, 32, 32), 256);
+  spr->setTotalFrames(2);
+  Tileset* tileset = new Tileset(spr.get(), Grid(gfx::Size(4, 4)), 4);
+  spr->tilesets()->add(tileset);
+
+  auto layer = new LayerTilemap(spr.get(), 0);
+  spr->root()->addLayer(layer);
+
+  using H = std::vector<std::size_t>;
+  EXPECT_EQ(H({ 0, 0, 0, 0 }), tileset->tilesHistogram());
+
+  // Add a cel
+  ImageRef tilemap(Image::create(IMAGE_TILEMAP, 2, 2));
+  clear_image(tilemap.get(), notile);
+  put_pixel(tilemap.get(), 0, 0, tile(1, 0));
+  put_pixel(tilemap.get(), 1, 0, tile(1, tile_f_xflip));
+  put_pixel(tilemap.get(), 1, 1, tile(3, 0));
+  Cel* cel = new Cel(0, tilemap);
+  layer->addCel(cel);
+  EXPECT_EQ(H({ 0, 2, 0, 1 }), tileset->tilesHistogram());
+
+  // Linked cels are counted just once (as they are the same tilemap)
+  Cel* link = Cel::MakeLink(1, cel);
+  layer->addCel(link);
+  EXPECT_EQ(H({ 0, 2, 0, 1 }), tileset->tilesHistogram());
+
+  // Modify the tilemap
+  put_pixel(tilemap.get(), 0, 0, tile(2, 0));
+  put_pixel(tilemap.get(), 0, 1, tile(6, 0)); // Tile outside the tileset
+  tilemap->incrementVersion();
+  EXPECT_EQ(H({ 0, 1, 1, 1, 0, 0, 1 }), tileset->tilesHistogram());
+
+  // Remove the cels
+  layer->removeCel(link);
+  delete link;
+  layer->removeCel(cel);
+  delete cel;
+  EXPECT_EQ(H({ 0, 0, 0, 0 }), tileset->tilesHistogram());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
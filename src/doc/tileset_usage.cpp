@@ -0,0 +1,124 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/tileset_usage.h"
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/cels_range.h"
+#include "doc/image_impl.h"
+#include "doc/layer_tilemap.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+
+#include <algorithm>
+
+namespace doc {
+
+const std::vector<std::size_t>& TilesetUsage::histogram(const Tileset* tileset)
+{
+  const Sprite* sprite = tileset->sprite();
+  if (!sprite) {
+    clear();
+  }
+  else {
+    for (auto& it : m_tilemaps)
+      it.second.used = false;
+
+    for (const Cel* cel : sprite->uniqueCels()) {
+      if (!cel->layer()->isTilemap() ||
+          static_cast<const LayerTilemap*>(cel->layer())->tileset() != tileset)
+        continue;
+
+      const ImageConstRef imageRef = cel->imageConstRef();
+      const Image* image = imageRef.get();
+      Tilemap& tilemap = m_tilemaps[cel->data()->id()];
+      if (tilemap.imageId != image->id() ||
+          tilemap.version != image->version()) {
+        removeCounts(tilemap.counts);
+        countTiles(image, tilemap.counts);
+        addCounts(tilemap.counts);
+
+        tilemap.imageId = image->id();
+        tilemap.version = image->version();
+      }
+      tilemap.used = true;
+    }
+
+    // Remove tilemaps that are not used anymore (removed cels, or
+    // layers that use other tileset now)
+    for (auto it=m_tilemaps.begin(); it!=m_tilemaps.end(); ) {
+      if (!it->second.used) {
+        removeCounts(it->second.counts);
+        it = m_tilemaps.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+
+  // Remove unused tiles outside the tileset
+  std::size_t n = m_histogram.size();
+  while (n > std::size_t(tileset->size()) && m_histogram[n-1] == 0)
+    --n;
+  m_histogram.resize(std::max<std::size_t>(n, tileset->size()), 0);
+
+  return m_histogram;
+}
+
+void TilesetUsage::clear()
+{
+  m_tilemaps.clear();
+  m_histogram.clear();
+}
+
+void TilesetUsage::addCounts(const Counts& counts)
+{
+  for (const auto& c : counts) {
+    if (c.first >= m_histogram.size())
+      m_histogram.resize(c.first+1, 0);
+    m_histogram[c.first] += c.second;
+  }
+}
+
+void TilesetUsage::removeCounts(const Counts& counts)
+{
+  for (const auto& c : counts) {
+    ASSERT(c.first < m_histogram.size());
+    ASSERT(m_histogram[c.first] >= c.second);
+    m_histogram[c.first] -= c.second;
+  }
+}
+
+void TilesetUsage::countTiles(const Image* image, Counts& counts)
+{
+  counts.clear();
+  for_each_pixel<TilemapTraits>(
+    image,
+    [this, &counts](const tile_t t) {
+      if (t == notile)
+        return;
+
+      const tile_index ti = tile_geti(t);
+      if (ti >= m_tmp.size())
+        m_tmp.resize(ti+1, 0);
+      if (m_tmp[ti]++ == 0)
+        counts.push_back(std::make_pair(ti, 0));
+    });
+
+  // Move the counters from the temporary array (and reset it for the
+  // next tilemap)
+  for (auto& c : counts) {
+    c.second = m_tmp[c.first];
+    m_tmp[c.first] = 0;
+  }
+}
+
+} // namespace doc
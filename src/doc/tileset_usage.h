@@ -0,0 +1,66 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TILESET_USAGE_H_INCLUDED
+#define DOC_TILESET_USAGE_H_INCLUDED
+#pragma once
+
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "doc/tile.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace doc {
+
+  class Image;
+  class Tileset;
+
+  // Counts how many times each tile of a tileset is used in the
+  // tilemaps of its sprite (the tilemap image of each unique cel of
+  // the layers that use the tileset).
+  //
+  // The counters are updated incrementally: the tiles used by each
+  // tilemap are cached (with the tilemap image version), so only the
+  // tilemaps that were created, modified, or removed since the last
+  // update are scanned again. This works for any modification (commands,
+  // undo/redo, scripts) as long as the image version is incremented.
+  class TilesetUsage {
+  public:
+    // Updates and returns the counter of each tile. The vector
+    // contains at least tileset->size() elements, and it can contain
+    // more elements if tilemaps reference tiles outside the tileset.
+    const std::vector<std::size_t>& histogram(const Tileset* tileset);
+
+    void clear();
+
+  private:
+    // Tiles used by one tilemap (tile index -> count)
+    using Counts = std::vector<std::pair<tile_index, uint32_t>>;
+
+    struct Tilemap {
+      ObjectId imageId = NullId;
+      ObjectVersion version = 0;
+      Counts counts;
+      bool used = false;
+    };
+
+    void addCounts(const Counts& counts);
+    void removeCounts(const Counts& counts);
+    void countTiles(const Image* image, Counts& counts);
+
+    // Key = ID of the CelData (so linked cels are counted just once)
+    std::unordered_map<ObjectId, Tilemap> m_tilemaps;
+    std::vector<std::size_t> m_histogram;
+    std::vector<uint32_t> m_tmp;
+  };
+
+} // namespace doc
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -27,11 +27,17 @@ namespace filters {
 using namespace doc;
 
 namespace {
+  // Values of each channel of the neighboring pixels to sort them.
+  // These buffers are allocated for each row (instead of being
+  // members of the filter) so the filter can be applied to several
+  // rows at the same time from different threads.
+  typedef std::vector<std::vector<uint8_t> > Channels;
+
   struct GetPixelsDelegateRgba {
-    std::vector<std::vector<uint8_t> >& channel;
+    Channels& channel;
     int c;
 
-    GetPixelsDelegateRgba(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    GetPixelsDelegateRgba(Channels& channel) : channel(channel) { }
 
     void reset() { c = 0; }
 
@@ -46,10 +52,10 @@ namespace {
   };
 
   struct GetPixelsDelegateGrayscale {
-    std::vector<std::vector<uint8_t> >& channel;
+    Channels& channel;
     int c;
 
-    GetPixelsDelegateGrayscale(std::vector<std::vector<uint8_t> >& channel) : channel(channel) { }
+    GetPixelsDelegateGrayscale(Channels& channel) : channel(channel) { }
 
     void reset() { c = 0; }
 
@@ -63,11 +69,11 @@ namespace {
 
   struct GetPixelsDelegateIndexed {
     const Palette* pal;
-    std::vector<std::vector<uint8_t> >& channel;
+    Channels& channel;
     Target target;
     int c;
 
-    GetPixelsDelegateIndexed(const Palette* pal, std::vector<std::vector<uint8_t> >& channel, Target target)
+    GetPixelsDelegateIndexed(const Palette* pal, Channels& channel, Target target)
       : pal(pal), channel(channel), target(target) { }
 
     void reset() { c = 0; }
@@ -94,7 +100,6 @@ MedianFilter::MedianFilter()
   , m_width(1)
   , m_height(1)
   , m_ncolors(0)
-  , m_channel(4)
 {
 }
 
@@ -111,9 +116,6 @@ void MedianFilter::setSize(int width, int height)
   m_width = std::max(1, width);
   m_height = std::max(1, height);
   m_ncolors = width*height;
-
-  for (int c = 0; c < 4; ++c)
-    m_channel[c].resize(m_ncolors);
 }
 
 const char* MedianFilter::getName()
@@ -125,7 +127,8 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
   int color, r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
+  Channels channel(4, std::vector<uint8_t>(m_ncolors));
+  GetPixelsDelegateRgba delegate(channel);
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
     delegate.reset();
@@ -135,29 +138,29 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
     color = get_pixel_fast<RgbTraits>(src, x, y);
 
     if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
+      std::sort(channel[0].begin(), channel[0].end());
+      r = channel[0][m_ncolors/2];
     }
     else
       r = rgba_getr(color);
 
     if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
+      std::sort(channel[1].begin(), channel[1].end());
+      g = channel[1][m_ncolors/2];
     }
     else
       g = rgba_getg(color);
 
     if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
+      std::sort(channel[2].begin(), channel[2].end());
+      b = channel[2][m_ncolors/2];
     }
     else
       b = rgba_getb(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
+      std::sort(channel[3].begin(), channel[3].end());
+      a = channel[3][m_ncolors/2];
     }
     else
       a = rgba_geta(color);
@@ -171,7 +174,8 @@ void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
   int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
+  Channels channel(4, std::vector<uint8_t>(m_ncolors));
+  GetPixelsDelegateGrayscale delegate(channel);
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
     delegate.reset();
@@ -181,15 +185,15 @@ void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
 
     if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
+      std::sort(channel[0].begin(), channel[0].end());
+      k = channel[0][m_ncolors/2];
     }
     else
       k = graya_getv(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
+      std::sort(channel[1].begin(), channel[1].end());
+      a = channel[1][m_ncolors/2];
     }
     else
       a = graya_geta(color);
@@ -205,7 +209,8 @@ void MedianFilter::applyToIndexed(FilterManager* filterMgr)
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
   int color, r, g, b, a;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, filterMgr->getTarget());
+  Channels channel(4, std::vector<uint8_t>(m_ncolors));
+  GetPixelsDelegateIndexed delegate(pal, channel, filterMgr->getTarget());
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
     delegate.reset();
@@ -213,37 +218,37 @@ void MedianFilter::applyToIndexed(FilterManager* filterMgr)
                                           m_tiledMode, delegate);
 
     if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *dst_address = m_channel[0][m_ncolors/2];
+      std::sort(channel[0].begin(), channel[0].end());
+      *dst_address = channel[0][m_ncolors/2];
     }
     else {
       color = get_pixel_fast<IndexedTraits>(src, x, y);
       color = pal->getEntry(color);
 
       if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
+        std::sort(channel[0].begin(), channel[0].end());
+        r = channel[0][m_ncolors/2];
       }
       else
         r = rgba_getr(color);
 
       if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
+        std::sort(channel[1].begin(), channel[1].end());
+        g = channel[1][m_ncolors/2];
       }
       else
         g = rgba_getg(pal->getEntry(color));
 
       if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
+        std::sort(channel[2].begin(), channel[2].end());
+        b = channel[2][m_ncolors/2];
       }
       else
         b = rgba_getb(color);
 
       if (target & TARGET_ALPHA_CHANNEL) {
-        std::sort(m_channel[3].begin(), m_channel[3].end());
-        a = m_channel[3][m_ncolors/2];
+        std::sort(channel[3].begin(), channel[3].end());
+        a = channel[3][m_ncolors/2];
       }
       else
         a = rgba_geta(color);
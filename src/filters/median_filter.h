@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -38,7 +39,6 @@ namespace filters {
     int m_width;
     int m_height;
     int m_ncolors;
-    std::vector<std::vector<uint8_t> > m_channel;
   };
 
 } // namespace filters
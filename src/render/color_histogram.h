@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c)      2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,6 +9,9 @@
 #define RENDER_COLOR_HISTOGRAM_H_INCLUDED
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <limits>
 #include <vector>
 
@@ -39,6 +42,7 @@ namespace render {
     ColorHistogram()
       : m_histogram(RElements*GElements*BElements*AElements, 0)
       , m_useHighPrecision(true) {
+      m_highPrecisionTable.fill(-1);
     }
 
     // Returns the number of points in the specified histogram
@@ -53,29 +57,32 @@ namespace render {
     void addSamples(doc::color_t color, std::size_t count = 1) {
       int i = histogramIndex(color);
 
-      if (m_histogram[i] < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
-        m_histogram[i] += count;
-      else
-        m_histogram[i] = std::numeric_limits<std::size_t>::max();
+      addCount(m_histogram[i], count);
 
       // Accurate colors are used only for less than 256 colors.  If the
       // image has more than 256 colors the m_histogram is used
       // instead.
-      if (m_useHighPrecision) {
-        std::vector<doc::color_t>::iterator it =
-          std::find(m_highPrecision.begin(), m_highPrecision.end(), color);
-
-        // The color is not in the high-precision table
-        if (it == m_highPrecision.end()) {
-          if (m_highPrecision.size() < 256) {
-            m_highPrecision.push_back(color);
-          }
-          else {
-            // In this case we reach the limit for the high-precision histogram.
-            m_useHighPrecision = false;
-          }
-        }
+      if (m_useHighPrecision)
+        addHighPrecisionColor(color);
+    }
+
+    // Adds all the samples of the "other" histogram. Merging the
+    // histograms of consecutive parts of the input (in the same
+    // order) gives the same result as adding all the samples to one
+    // histogram (even the order of the high-precision colors).
+    void merge(const ColorHistogram& other) {
+      for (std::size_t i=0; i<m_histogram.size(); ++i) {
+        if (other.m_histogram[i])
+          addCount(m_histogram[i], other.m_histogram[i]);
+      }
+
+      for (const doc::color_t color : other.m_highPrecision) {
+        if (!m_useHighPrecision)
+          break;
+        addHighPrecisionColor(color);
       }
+      if (!other.m_useHighPrecision)
+        m_useHighPrecision = false;
     }
 
     // Creates a set of entries for the given palette in the given range
@@ -107,6 +114,47 @@ namespace render {
     int highPrecisionSize() { return m_highPrecision.size(); }
 
   private:
+    // Maximum number of colors in the high-precision table, and size
+    // of its hash table (twice the number of colors so the probe
+    // sequences are short).
+    enum {
+      kHighPrecisionColors = 256,
+      kHighPrecisionTableBits = 9,
+      kHighPrecisionTableSize = 1 << kHighPrecisionTableBits,
+    };
+
+    static void addCount(std::size_t& value, const std::size_t count) {
+      if (value < std::numeric_limits<std::size_t>::max()-count) // Avoid overflow
+        value += count;
+      else
+        value = std::numeric_limits<std::size_t>::max();
+    }
+
+    // Adds the color at the end of m_highPrecision if it wasn't added
+    // yet, or disables the high-precision mode if there are too many
+    // colors.
+    void addHighPrecisionColor(const doc::color_t color) {
+      // Linear probing in an open-addressing table where each slot is
+      // an index of m_highPrecision (or -1 if the slot is empty)
+      std::size_t slot =
+        (uint32_t(color * 0x9e3779b1u) >> (32 - kHighPrecisionTableBits));
+      for (int i; (i = m_highPrecisionTable[slot]) >= 0; ) {
+        if (m_highPrecision[i] == color)
+          return;
+        slot = (slot + 1) & (kHighPrecisionTableSize - 1);
+      }
+
+      // The color is not in the high-precision table
+      if (m_highPrecision.size() < kHighPrecisionColors) {
+        m_highPrecisionTable[slot] = int16_t(m_highPrecision.size());
+        m_highPrecision.push_back(color);
+      }
+      else {
+        // In this case we reach the limit for the high-precision histogram.
+        m_useHighPrecision = false;
+      }
+    }
+
     // Converts input color in a index for the histogram. It reduces
     // each 8-bit component to the resolution given in the template
     // parameters.
@@ -132,6 +180,9 @@ namespace render {
     // source images contains less than 256 colors.
     std::vector<doc::color_t> m_highPrecision;
 
+    // Hash table to find colors in m_highPrecision
+    std::array<int16_t, kHighPrecisionTableSize> m_highPrecisionTable;
+
     // True if we can use m_highPrecision still (it means that the
     // number of different samples is less than 256 colors still).
     bool m_useHighPrecision;
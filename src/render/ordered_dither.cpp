@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,11 +11,14 @@
 
 #include "render/ordered_dither.h"
 
+#include "base/parallel_for.h"
 #include "render/dithering.h"
 #include "render/dithering_matrix.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
+#include <thread>
 #include <vector>
 
 namespace render {
@@ -234,14 +237,55 @@ void dither_rgb_image_to_indexed(
   doc::Image* dstImage,
   const doc::RgbMap* rgbmap,
   const doc::Palette* palette,
-  TaskDelegate* delegate)
+  TaskDelegate* delegate,
+  base::thread_pool* pool)
 {
   const int w = srcImage->width();
   const int h = srcImage->height();
 
   algorithm.start(srcImage, dstImage, dithering.factor());
 
-  if (algorithm.dimensions() == 1) {
+  if (algorithm.dimensions() == 1 &&
+      pool && h > 1 &&
+      (!rgbmap || rgbmap->isPrecomputed())) {
+    // Each pixel depends only on its own color and position, so bands
+    // of rows can be converted at the same time.
+    const int kRowsPerBand = 16;
+    const int bands = (h + kRowsPerBand - 1) / kRowsPerBand;
+    const auto callerThread = std::this_thread::get_id();
+    std::atomic<bool> canceled(false);
+    std::atomic<int> doneRows(0);
+
+    base::parallel_for(*pool, 0, bands, [&](const int band){
+      if (canceled)
+        return;
+
+      const DitheringMatrix matrix = dithering.matrix();
+      const int y1 = band * kRowsPerBand;
+      const int y2 = std::min(y1 + kRowsPerBand, h);
+      for (int y=y1; y<y2; ++y) {
+        auto srcIt = doc::get_pixel_address_fast<doc::RgbTraits>(srcImage, 0, y);
+        auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, y);
+        for (int x=0; x<w; ++x, ++srcIt, ++dstIt) {
+          *dstIt = algorithm.ditherRgbPixelToIndex(
+            matrix, *srcIt, x, y, rgbmap, palette);
+        }
+      }
+      doneRows += y2 - y1;
+
+      if (delegate && std::this_thread::get_id() == callerThread) {
+        if (!delegate->continueTask())
+          canceled = true;
+        else
+          delegate->notifyTaskProgress(double(doneRows) / double(h));
+      }
+    });
+
+    if (canceled)
+      return;
+  }
+  else if (algorithm.dimensions() == 1) {
+    const DitheringMatrix matrix = dithering.matrix();
     const doc::LockImageBits<doc::RgbTraits> srcBits(srcImage);
     doc::LockImageBits<doc::IndexedTraits> dstBits(dstImage);
     auto srcIt = srcBits.begin();
@@ -252,7 +296,7 @@ void dither_rgb_image_to_indexed(
         ASSERT(srcIt != srcBits.end());
         ASSERT(dstIt != dstBits.end());
         *dstIt = algorithm.ditherRgbPixelToIndex(
-          dithering.matrix(), *srcIt, x, y, rgbmap, palette);
+          matrix, *srcIt, x, y, rgbmap, palette);
 
         if (delegate) {
           if (!delegate->continueTask())
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,10 @@
 #include "gfx/size.h"
 #include "render/task_delegate.h"
 
+namespace base {
+  class thread_pool;
+}
+
 namespace render {
 
   class Dithering;
@@ -77,6 +81,11 @@ namespace render {
     int m_transparentIndex;
   };
 
+  // Converts the RGB "srcImage" to the indexed "dstImage". If a
+  // thread pool is given, 1D algorithms (ordered dithering) process
+  // bands of rows in parallel when the "rgbmap" can be shared between
+  // threads (it's nullptr or it's precomputed), and the "delegate" is
+  // only used from the calling thread.
   void dither_rgb_image_to_indexed(
     DitheringAlgorithmBase& algorithm,
     const Dithering& dithering,
@@ -84,7 +93,8 @@ namespace render {
     doc::Image* dstImage,
     const doc::RgbMap* rgbmap,
     const doc::Palette* palette,
-    TaskDelegate* delegate = nullptr);
+    TaskDelegate* delegate = nullptr,
+    base::thread_pool* pool = nullptr);
 
 } // namespace render
 
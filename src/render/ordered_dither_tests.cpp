@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,12 @@
 
 #include <gtest/gtest.h>
 
+#include "base/thread_pool.h"
+#include "doc/algorithm/random_image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap_rgb5a3.h"
+#include "render/dithering.h"
 #include "render/dithering_matrix.h"
 #include "render/ordered_dither.h"
 
@@ -65,8 +71,37 @@ TEST(BayerMatrix, CheckD8)
       EXPECT_EQ(expected[c++], matrix(i, j));
 }
 
+TEST(OrderedDither, ParallelSameAsSerial)
+{
+  ImageRef src(Image::create(IMAGE_RGB, 97, 131));
+  doc::algorithm::random_image(src.get());
+
+  Palette pal(0, 16);
+  for (int i=0; i<16; ++i)
+    pal.setEntry(i, rgba(i*16, 255-i*16, (i*64) & 255, 255));
+
+  RgbMapRGB5A3 rgbmap;
+  rgbmap.regenerateMap(&pal, 0);
+  rgbmap.precompute(nullptr);
+
+  base::thread_pool pool(3);
+  const Dithering dithering(DitheringAlgorithm::Ordered, BayerMatrix(8));
+
+  for (const RgbMap* map : { (const RgbMap*)nullptr, (const RgbMap*)&rgbmap }) {
+    OrderedDither2 dither(0);
+    ImageRef serial(Image::create(IMAGE_INDEXED, src->width(), src->height()));
+    ImageRef parallel(Image::create(IMAGE_INDEXED, src->width(), src->height()));
+    dither_rgb_image_to_indexed(dither, dithering, src.get(), serial.get(),
+                                map, &pal);
+    dither_rgb_image_to_indexed(dither, dithering, src.get(), parallel.get(),
+                                map, &pal, nullptr, &pool);
+    EXPECT_TRUE(is_same_image(serial.get(), parallel.get()));
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
   return RUN_ALL_TESTS();
 }
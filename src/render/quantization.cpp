@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "render/quantization.h"
 
+#include "base/parallel_for.h"
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/octree_map.h"
@@ -25,9 +26,11 @@
 #include "render/task_delegate.h"
 
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <map>
 #include <memory>
+#include <thread>
 #include <vector>
 
 namespace render {
@@ -44,14 +47,12 @@ Palette* create_palette_from_sprite(
   TaskDelegate* delegate,
   const bool newBlend,
   RgbMapAlgorithm mapAlgo,
-  const bool calculateWithTransparent)
+  const bool calculateWithTransparent,
+  base::thread_pool* pool)
 {
    if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT)
      mapAlgo = doc::RgbMapAlgorithm::OCTREE;
 
-  PaletteOptimizer optimizer;
-  OctreeMap octreemap;
-
   // Transparent color is needed if we have transparent layers
   int maskIndex;
   if ((sprite->backgroundLayer() && sprite->allLayersCount() == 1) ||
@@ -73,66 +74,94 @@ Palette* create_palette_from_sprite(
   if (!palette)
     palette = new Palette(fromFrame, 256);
 
-  // Add a flat image with the current sprite's frame rendered
-  ImageRef flat_image(Image::create(IMAGE_RGB,
-      sprite->width(), sprite->height()));
-
-  render::Render render;
-  render.setNewBlend(newBlend);
-
-  // Feed the optimizer with all rendered frames
-  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-    render.renderSprite(flat_image.get(), sprite, frame);
-
-    switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3:
-        optimizer.feedWithImage(flat_image.get(), withAlpha);
-        break;
-      case RgbMapAlgorithm::OCTREE:
-        octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor);
-        break;
-      default:
-        ASSERT(false);
-        break;
+  // The frames are split in consecutive ranges, each range is
+  // rendered and fed to its own optimizer/octree in parallel, and
+  // then they are merged in order (so the result is the same as
+  // feeding all frames to just one optimizer/octree). The number of
+  // ranges is limited because each PaletteOptimizer uses a big
+  // histogram.
+  const int kMaxRanges = 8;
+  const int nframes = toFrame - fromFrame + 1;
+  const int nranges =
+    (pool ? std::max(1, std::min({ int(pool->size())+1, nframes, kMaxRanges })): 1);
+
+  // The octree is always fed with 8 levels, so we don't need to feed
+  // it again if the 7 levels map has less colors than the palette
+  // (see OctreeMap::makePaletteFromDeepMap()).
+  const int octreeDeep = 8;
+
+  std::vector<PaletteOptimizer> optimizers(
+    mapAlgo == RgbMapAlgorithm::RGB5A3 ? nranges: 0);
+  std::vector<OctreeMap> octreemaps(
+    mapAlgo == RgbMapAlgorithm::OCTREE ? nranges: 0);
+
+  const auto callerThread = std::this_thread::get_id();
+  std::atomic<bool> canceled(false);
+  std::atomic<int> doneFrames(0);
+
+  auto feedRange = [&](const int i) {
+    // Add a flat image with the current sprite's frame rendered
+    ImageRef flat_image(Image::create(IMAGE_RGB,
+        sprite->width(), sprite->height()));
+
+    render::Render render;
+    render.setNewBlend(newBlend);
+
+    // Feed the optimizer with all rendered frames of this range
+    const frame_t frameA = fromFrame + frame_t(nframes * i / nranges);
+    const frame_t frameB = fromFrame + frame_t(nframes * (i+1) / nranges);
+    for (frame_t frame=frameA; frame<frameB && !canceled; ++frame) {
+      render.renderSprite(flat_image.get(), sprite, frame);
+
+      switch (mapAlgo) {
+        case RgbMapAlgorithm::RGB5A3:
+          optimizers[i].feedWithImage(flat_image.get(), withAlpha);
+          break;
+        case RgbMapAlgorithm::OCTREE:
+          octreemaps[i].feedWithImage(flat_image.get(), withAlpha, maskColor, octreeDeep);
+          break;
+        default:
+          ASSERT(false);
+          break;
+      }
+      ++doneFrames;
+
+      // The delegate is used only from the calling thread
+      if (delegate && std::this_thread::get_id() == callerThread) {
+        if (!delegate->continueTask())
+          canceled = true;
+        else
+          delegate->notifyTaskProgress(double(doneFrames) / double(nframes));
+      }
     }
+  };
 
-    if (delegate) {
-      if (!delegate->continueTask())
-        return nullptr;
+  if (nranges > 1)
+    base::parallel_for(*pool, 0, nranges, feedRange);
+  else
+    feedRange(0);
 
-      delegate->notifyTaskProgress(
-        double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-    }
-  }
+  if (canceled)
+    return nullptr;
 
   switch (mapAlgo) {
 
     case RgbMapAlgorithm::RGB5A3: {
+      for (int i=1; i<nranges; ++i)
+        optimizers[0].merge(optimizers[i]);
+
       // Generate an optimized palette
-      optimizer.calculate(palette, maskIndex);
+      optimizers[0].calculate(palette, maskIndex);
       break;
     }
 
     case RgbMapAlgorithm::OCTREE:
       // TODO check calculateWithTransparent flag
 
-      if (!octreemap.makePalette(palette, palette->size())) {
-        // We can use an 8-bit deep octree map, instead of 7-bit of the
-        // first attempt.
-        octreemap = OctreeMap();
-        for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-          render.renderSprite(flat_image.get(), sprite, frame);
-          octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor , 8);
-          if (delegate) {
-            if (!delegate->continueTask())
-              return nullptr;
-
-            delegate->notifyTaskProgress(
-              double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-          }
-        }
-        octreemap.makePalette(palette, palette->size(), 8);
-      }
+      for (int i=1; i<nranges; ++i)
+        octreemaps[0].merge(octreemaps[i]);
+
+      octreemaps[0].makePaletteFromDeepMap(palette, palette->size());
       break;
   }
 
@@ -149,7 +178,8 @@ Image* convert_pixel_format(
   const bool is_background,
   const color_t new_mask_color,
   rgba_to_graya_func toGray,
-  TaskDelegate* delegate)
+  TaskDelegate* delegate,
+  base::thread_pool* pool)
 {
   if (!new_image)
     new_image = Image::create(pixelFormat, image->width(), image->height());
@@ -177,7 +207,7 @@ Image* convert_pixel_format(
     if (dither)
       dither_rgb_image_to_indexed(
         *dither, dithering,
-        image, new_image, rgbmap, palette, delegate);
+        image, new_image, rgbmap, palette, delegate, pool);
     return new_image;
   }
 
@@ -473,6 +503,13 @@ void PaletteOptimizer::feedWithRgbaColor(color_t color)
   m_histogram.addSamples(color, 1);
 }
 
+void PaletteOptimizer::merge(const PaletteOptimizer& other)
+{
+  m_histogram.merge(other.m_histogram);
+  if (other.m_withAlpha)
+    m_withAlpha = true;
+}
+
 void PaletteOptimizer::calculate(Palette* palette, int maskIndex)
 {
   bool addMask;
@@ -1,5 +1,5 @@
 // Aseprite Rener Library
-// Copyright (c) 2019-2021  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,6 +16,10 @@
 
 #include <vector>
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Image;
   class Palette;
@@ -35,6 +39,10 @@ namespace render {
                        const gfx::Rect& bounds,
                        const bool withAlpha);
     void feedWithRgbaColor(doc::color_t color);
+
+    // Adds the colors fed to "other" (see ColorHistogram::merge()).
+    void merge(const PaletteOptimizer& other);
+
     void calculate(doc::Palette* palette, int maskIndex);
     bool isHighPrecision() { return m_histogram.isHighPrecision(); }
     int highPrecisionSize() { return m_histogram.highPrecisionSize(); }
@@ -44,7 +52,10 @@ namespace render {
     bool m_withAlpha = false;
   };
 
-  // Creates a new palette suitable to quantize the given RGB sprite to Indexed color.
+  // Creates a new palette suitable to quantize the given RGB sprite to
+  // Indexed color. The thread pool (if it's given) is used to render
+  // and feed consecutive ranges of frames in parallel (the result is
+  // the same palette).
   doc::Palette* create_palette_from_sprite(
     const doc::Sprite* sprite,
     const doc::frame_t fromFrame,
@@ -54,10 +65,13 @@ namespace render {
     TaskDelegate* delegate,
     const bool newBlend,
     RgbMapAlgorithm mapAlgo,
-    const bool calculateWithTransparent = true);
+    const bool calculateWithTransparent = true,
+    base::thread_pool* pool = nullptr);
 
   // Changes the image pixel format. The dithering method is used only
-  // when you want to convert from RGB to Indexed.
+  // when you want to convert from RGB to Indexed. The thread pool (if
+  // it's given) is used to convert bands of rows in parallel with
+  // ordered dithering (see dither_rgb_image_to_indexed()).
   Image* convert_pixel_format(
     const doc::Image* src,
     doc::Image* dst,         // Can be NULL to create a new image
@@ -68,7 +82,8 @@ namespace render {
     bool is_background,
     doc::color_t new_mask_color,
     doc::rgba_to_graya_func toGray = nullptr,
-    TaskDelegate* delegate = nullptr);
+    TaskDelegate* delegate = nullptr,
+    base::thread_pool* pool = nullptr);
 
 } // namespace render
 
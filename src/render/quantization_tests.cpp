@@ -0,0 +1,164 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "base/thread_pool.h"
+#include "doc/cel.h"
+#include "doc/document.h"
+#include "doc/image_ref.h"
+#include "doc/layer.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "render/quantization.h"
+#include "render/render.h"
+
+#include <memory>
+
+using namespace doc;
+using namespace render;
+
+namespace {
+
+// Creates a sprite with one image per frame. Each frame uses
+// "colorsPerFrame" colors (some of them used in the previous frame
+// too, so the order of the colors depends on the order of frames).
+Sprite* make_sprite(const int nframes, const int colorsPerFrame)
+{
+  const int w = 32, h = 24;
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
+  spr->setTotalFrames(nframes);
+
+  LayerImage* layer = static_cast<LayerImage*>(spr->root()->firstLayer());
+  for (frame_t frame=0; frame<nframes; ++frame) {
+    ImageRef image;
+    if (frame == 0)
+      image = layer->cel(0)->imageRef();
+    else {
+      image.reset(Image::create(IMAGE_RGB, w, h));
+      layer->addCel(new Cel(frame, image));
+    }
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        const int i = frame*colorsPerFrame/2 + (x + y*w) % colorsPerFrame;
+        put_pixel(image.get(), x, y,
+                  (x == y ? 0: // Transparent pixels
+                   rgba((i*37) & 255, (i*11 + frame) & 255, (i*5) & 255,
+                        128 + (i & 127))));
+      }
+    }
+  }
+  return spr;
+}
+
+// Previous implementation of create_palette_from_sprite() (feeding
+// all frames sequentially, and the octree twice if it's needed)
+void create_palette_sequentially(const Sprite* sprite,
+                                 const bool withAlpha,
+                                 Palette* palette,
+                                 const RgbMapAlgorithm mapAlgo)
+{
+  const color_t maskColor = sprite->transparentColor();
+  ImageRef flat(Image::create(IMAGE_RGB, sprite->width(), sprite->height()));
+  render::Render render;
+
+  if (mapAlgo == RgbMapAlgorithm::RGB5A3) {
+    PaletteOptimizer optimizer;
+    for (frame_t frame=0; frame<sprite->totalFrames(); ++frame) {
+      render.renderSprite(flat.get(), sprite, frame);
+      optimizer.feedWithImage(flat.get(), withAlpha);
+    }
+    optimizer.calculate(palette, 0);
+  }
+  else {
+    OctreeMap octreemap;
+    for (frame_t frame=0; frame<sprite->totalFrames(); ++frame) {
+      render.renderSprite(flat.get(), sprite, frame);
+      octreemap.feedWithImage(flat.get(), withAlpha, maskColor);
+    }
+    if (!octreemap.makePalette(palette, palette->size())) {
+      octreemap = OctreeMap();
+      for (frame_t frame=0; frame<sprite->totalFrames(); ++frame) {
+        render.renderSprite(flat.get(), sprite, frame);
+        octreemap.feedWithImage(flat.get(), withAlpha, maskColor, 8);
+      }
+      octreemap.makePalette(palette, palette->size(), 8);
+    }
+  }
+}
+
+} // anonymous namespace
+
+TEST(Quantization, CreatePaletteFromSpriteInParallel)
+{
+  base::thread_pool pool(3);
+
+  for (const auto mapAlgo : { RgbMapAlgorithm::RGB5A3,
+                              RgbMapAlgorithm::OCTREE }) {
+    // Few colors (high-precision/8-levels octree) and a lot of colors
+    for (const int colorsPerFrame : { 7, 40, 500 }) {
+      for (const int nframes : { 1, 2, 5, 12 }) {
+        for (const bool withAlpha : { false, true }) {
+          std::shared_ptr<Document> doc = std::make_shared<Document>();
+          Sprite* spr = make_sprite(nframes, colorsPerFrame);
+          doc->sprites().add(spr);
+
+          Palette expected(0, 256);
+          create_palette_sequentially(spr, withAlpha, &expected, mapAlgo);
+
+          for (base::thread_pool* p : { (base::thread_pool*)nullptr, &pool }) {
+            Palette palette(0, 256);
+            ASSERT_EQ(&palette,
+                      create_palette_from_sprite(
+                        spr, 0, spr->lastFrame(), withAlpha, &palette,
+                        nullptr, false, mapAlgo, true, p));
+            ASSERT_EQ(expected.size(), palette.size());
+            EXPECT_TRUE(expected == palette)
+              << "colors=" << colorsPerFrame << " frames=" << nframes
+              << " withAlpha=" << withAlpha << " pool=" << (p != nullptr);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(Quantization, ColorHistogramMerge)
+{
+  // Adding colors in two histograms and merging them must give the
+  // same high-precision colors (in the same order)
+  for (const int ncolors : { 10, 200, 256, 257, 300 }) {
+    ColorHistogram<5, 6, 5, 5> all, a, b;
+    for (int i=0; i<ncolors*2; ++i) {
+      const int k = (i*7) % ncolors;
+      const color_t c = rgba(k & 255, k >> 8, (i*3) & 1, 255);
+      all.addSamples(c);
+      (i < ncolors ? a: b).addSamples(c);
+    }
+    a.merge(b);
+    EXPECT_EQ(all.isHighPrecision(), a.isHighPrecision());
+    EXPECT_EQ(all.highPrecisionSize(), a.highPrecisionSize());
+
+    Palette palAll(0, 256), palMerged(0, 256);
+    EXPECT_EQ(all.createOptimizedPalette(&palAll),
+              a.createOptimizedPalette(&palMerged));
+    EXPECT_TRUE(palAll == palMerged);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  Palette::initBestfit();
+  return RUN_ALL_TESTS();
+}
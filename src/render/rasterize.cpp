@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -39,13 +39,14 @@ void rasterize(
   int opacity;
   opacity = MUL_UN8(cel->opacity(), cel->layer()->opacity(), t);
 
-  if (cel->image()->pixelFormat() == IMAGE_TILEMAP) {
+  const doc::ImageConstRef celImage = cel->imageConstRef();
+  if (celImage->pixelFormat() == IMAGE_TILEMAP) {
     render::Render render;
     render.renderCel(
       dst,
       cel,
       sprite,
-      cel->image(),
+      celImage.get(),
       cel->layer(),
       sprite->palette(cel->frame()),
       gfx::RectF(cel->bounds()),
@@ -55,10 +56,10 @@ void rasterize(
   }
   else {
     if (clear)
-      copy_image(dst, cel->image(), x+cel->x(), y+cel->y());
+      copy_image(dst, celImage.get(), x+cel->x(), y+cel->y());
     else
       composite_image(
-        dst, cel->image(),
+        dst, celImage.get(),
         sprite->palette(cel->frame()),
         x+cel->x(),
         y+cel->y(),
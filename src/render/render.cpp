@@ -11,8 +11,10 @@
 
 #include "render/render.h"
 
+#include "base/parallel_for.h"
 #include "doc/blend_internals.h"
 #include "doc/blend_mode.h"
+#include "doc/blend_span.h"
 #include "doc/doc.h"
 #include "doc/image_impl.h"
 #include "doc/layer_tilemap.h"
@@ -23,7 +25,9 @@
 #include "gfx/clip.h"
 #include "gfx/region.h"
 
+#include <algorithm>
 #include <cmath>
+#include <type_traits>
 
 #define TRACE_RENDER_CEL(...) // TRACE
 
@@ -34,6 +38,25 @@ namespace {
 //////////////////////////////////////////////////////////////////////
 // Scaled composite
 
+// Returns true if we can blend whole scanlines with the span blenders
+// (which use SIMD instructions when available).
+template<class DstTraits, class SrcTraits>
+constexpr bool has_span_blender()
+{
+  return (std::is_same_v<DstTraits, SrcTraits> &&
+          (DstTraits::color_mode == ColorMode::RGB ||
+           DstTraits::color_mode == ColorMode::GRAYSCALE));
+}
+
+template<class Traits>
+auto get_span_blender(const BlendMode blendMode, const bool newBlend)
+{
+  if constexpr (Traits::color_mode == ColorMode::RGB)
+    return get_rgba_span_blender(blendMode, newBlend);
+  else
+    return get_graya_span_blender(blendMode, newBlend);
+}
+
 template<class DstTraits, class SrcTraits>
 void composite_image_without_scale(
   Image* dst, const Image* src, const Palette* pal,
@@ -50,8 +73,6 @@ void composite_image_without_scale(
   ASSERT(DstTraits::pixel_format == dst->pixelFormat());
   ASSERT(SrcTraits::pixel_format == src->pixelFormat());
 
-  BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
-
   gfx::Clip area(areaF);
   if (!area.clip(dst->width(), dst->height(),
                  src->width(), src->height()))
@@ -63,6 +84,20 @@ void composite_image_without_scale(
 
   ASSERT(!srcBounds.isEmpty());
 
+  if constexpr (has_span_blender<DstTraits, SrcTraits>()) {
+    using pixel_t = typename DstTraits::pixel_t;
+    const auto span = get_span_blender<DstTraits>(blendMode, newBlend);
+    const color_t maskColor = src->maskColor();
+    for (int y=0; y<srcBounds.h; ++y) {
+      span((pixel_t*)dst->getPixelAddress(dstBounds.x, dstBounds.y+y),
+           (const pixel_t*)src->getPixelAddress(srcBounds.x, srcBounds.y+y),
+           srcBounds.w, opacity, maskColor);
+    }
+    return;
+  }
+
+  BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
+
   // Lock all necessary bits
   const LockImageBits<SrcTraits> srcBits(src, srcBounds);
   LockImageBits<DstTraits> dstBits(dst, dstBounds);
@@ -508,6 +543,27 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
   }
 }
 
+// Returns true if the composition path selected by
+// get_fastest_composition_path() for the given projection maps each
+// destination pixel to the source pixels using only its absolute
+// position, i.e. rendering an area in several pieces gives exactly
+// the same result as rendering it in one pass.
+bool is_tile_invariant_composition_path(const Projection& proj,
+                                        const bool finegrain)
+{
+  if (finegrain || !proj.zoom().isSimpleZoomLevel())
+    return false;
+  else if (proj.applyX(1) == 1 && proj.applyY(1) == 1)
+    return true;
+  else if (proj.scaleX() >= 1.0 && proj.scaleY() >= 1.0)
+    return true;
+  else if (((proj.removeX(1) > 1) && (proj.removeX(1) & 1)) ||
+           ((proj.removeY(1) > 1) && (proj.removeY(1) & 1)))
+    return false;
+  else
+    return true;
+}
+
 bool has_visible_reference_layers(const LayerGroup* group)
 {
   for (const Layer* child : group->layers()) {
@@ -544,6 +600,8 @@ Render::Render()
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_threadPool(nullptr)
+  , m_tileSize(kDefaultTileSize)
 {
 }
 
@@ -631,6 +689,14 @@ void Render::disableOnionskin()
   m_onionskin.type(OnionskinType::NONE);
 }
 
+void Render::setThreadPool(base::thread_pool* pool,
+                           const int tileSize)
+{
+  ASSERT(!pool || tileSize > 0);
+  m_threadPool = pool;
+  m_tileSize = std::max(1, tileSize);
+}
+
 void Render::renderSprite(
   Image* dstImage,
   const Sprite* sprite,
@@ -685,6 +751,11 @@ void Render::renderSprite(
 {
   m_sprite = sprite;
 
+  if (m_threadPool && canRenderInTiles(dstImage, area)) {
+    renderSpriteInTiles(dstImage, sprite, frame, gfx::Clip(area));
+    return;
+  }
+
   CompositeImageFunc compositeImage =
     getImageComposition(
       dstImage->pixelFormat(),
@@ -763,6 +834,81 @@ void Render::renderSprite(
   }
 }
 
+bool Render::canRenderInTiles(
+  const Image* dstImage,
+  const gfx::ClipF& area)
+{
+  // Tilemap destinations use tile coordinates instead of pixels
+  if (dstImage->pixelFormat() == IMAGE_TILEMAP)
+    return false;
+
+  // Only integer areas can be split without rounding differences
+  const gfx::Clip intArea(area);
+  if (gfx::ClipF(intArea).dst != area.dst ||
+      gfx::ClipF(intArea).src != area.src ||
+      gfx::ClipF(intArea).size != area.size)
+    return false;
+
+  // The checkered background is aligned to the dstImage origin
+  // instead of area.dst, so each tile (rendered in its own image)
+  // would get a different pattern.
+  if (m_bg.type == BgType::CHECKERED &&
+      (intArea.dst.x != 0 || intArea.dst.y != 0))
+    return false;
+
+  // Nothing to gain if the whole area fits in one tile
+  if (intArea.size.w <= m_tileSize &&
+      intArea.size.h <= m_tileSize)
+    return false;
+
+  return is_tile_invariant_composition_path(
+    m_proj, needsFinegrainComposition(m_sprite->root()));
+}
+
+void Render::renderSpriteInTiles(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::Clip& area)
+{
+  const gfx::Rect dstBounds =
+    gfx::Rect(area.dst, area.size).createIntersection(dstImage->bounds());
+  if (dstBounds.isEmpty())
+    return;
+
+  const int cols = (dstBounds.w + m_tileSize - 1) / m_tileSize;
+  const int rows = (dstBounds.h + m_tileSize - 1) / m_tileSize;
+
+  base::parallel_for(
+    *m_threadPool, 0, cols*rows,
+    [this, dstImage, sprite, frame, &area, &dstBounds, cols](const int i) {
+      const gfx::Rect tileBounds =
+        gfx::Rect(dstBounds.x + (i % cols) * m_tileSize,
+                  dstBounds.y + (i / cols) * m_tileSize,
+                  m_tileSize, m_tileSize).createIntersection(dstBounds);
+
+      // Each tile is rendered in its own image so workers never
+      // write in the same memory (renderSprite() can touch pixels
+      // of the whole dstImage, e.g. with the checkered background).
+      ImageSpec spec = dstImage->spec();
+      spec.setSize(tileBounds.size());
+      ImageRef tileImage(Image::create(spec));
+
+      // Copy of this Render with its own temporal state
+      Render tileRender(*this);
+      tileRender.m_threadPool = nullptr;
+      tileRender.m_tmpBuf.reset();
+      tileRender.renderSprite(
+        tileImage.get(), sprite, frame,
+        gfx::Clip(0, 0,
+                  area.src.x + tileBounds.x - area.dst.x,
+                  area.src.y + tileBounds.y - area.dst.y,
+                  tileBounds.w, tileBounds.h));
+
+      copy_image(dstImage, tileImage.get(), tileBounds.x, tileBounds.y);
+    });
+}
+
 void Render::renderSpriteLayers(Image* dstImage,
                                 const gfx::ClipF& area,
                                 frame_t frame,
@@ -1061,6 +1207,7 @@ void Render::renderPlan(
         if (cel) {
           Palette* pal = m_sprite->palette(frame);
           const Image* celImage = nullptr;
+          ImageConstRef celImageRef; // Keeps the lazy image in memory
           gfx::RectF celBounds;
 
           // Is the 'm_previewImage' set to be used with this layer?
@@ -1074,7 +1221,8 @@ void Render::renderPlan(
           }
           // If not, we use the original cel-image from the images' stock
           else {
-            celImage = cel->image();
+            celImageRef = cel->imageConstRef();
+            celImage = celImageRef.get();
             if (layer->isReference())
               celBounds = cel->boundsF();
             else
@@ -1341,17 +1489,13 @@ void Render::renderImage(
     tileFlags);
 }
 
-CompositeImageFunc Render::getImageComposition(
-  const PixelFormat dstFormat,
-  const PixelFormat srcFormat,
-  const Layer* layer,
-  const tile_flags tileFlags)
+// True if we need blending pixel by pixel. If this is false we can
+// blend src+dst one time and repeat the resulting color in dst image
+// n-times (where n is the zoom scale).
+bool Render::needsFinegrainComposition(const Layer* layer) const
 {
-  // True if we need blending pixel by pixel. If this is false we can
-  // blend src+dst one time and repeat the resulting color in dst
-  // image n-times (where n is the zoom scale).
   double intpart;
-  const bool finegrain =
+  return
     (!m_bg.zoom && (m_bg.stripeSize.w < m_proj.applyX(1) ||
                     m_bg.stripeSize.h < m_proj.applyY(1) ||
                     std::modf(double(m_bg.stripeSize.w) / m_proj.applyX(1.0), &intpart) != 0.0 ||
@@ -1359,6 +1503,15 @@ CompositeImageFunc Render::getImageComposition(
     (layer &&
      layer->isGroup() &&
      has_visible_reference_layers(static_cast<const LayerGroup*>(layer)));
+}
+
+CompositeImageFunc Render::getImageComposition(
+  const PixelFormat dstFormat,
+  const PixelFormat srcFormat,
+  const Layer* layer,
+  const tile_flags tileFlags)
+{
+  const bool finegrain = needsFinegrainComposition(layer);
 
   switch (srcFormat) {
 
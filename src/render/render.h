@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -24,6 +24,10 @@
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Cel;
   class Image;
@@ -55,6 +59,10 @@ namespace render {
     };
 
   public:
+    // Default size of each tile in the tiled mode (256x256 RGBA
+    // pixels = 256 KB, fits in the L2 cache of most CPUs).
+    static constexpr int kDefaultTileSize = 256;
+
     Render();
 
     void setRefLayersVisiblity(const bool visible);
@@ -86,6 +94,14 @@ namespace render {
     void setOnionskin(const OnionskinOptions& options);
     void disableOnionskin();
 
+    // Sets a thread pool to render sprites in tiles of tileSize x
+    // tileSize pixels composited in parallel. The result is the same
+    // as rendering the whole area in one pass (when we cannot warrant
+    // that, e.g. with non-simple zoom levels, we use the serial path
+    // anyway). Use nullptr to disable the tiled mode.
+    void setThreadPool(base::thread_pool* pool,
+                       const int tileSize = kDefaultTileSize);
+
     void renderSprite(
       Image* dstImage,
       const Sprite* sprite,
@@ -139,6 +155,16 @@ namespace render {
       const BlendMode blendMode);
 
   private:
+    bool canRenderInTiles(
+      const Image* dstImage,
+      const gfx::ClipF& area);
+
+    void renderSpriteInTiles(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::Clip& area);
+
     void renderSpriteLayers(
       Image* dstImage,
       const gfx::ClipF& area,
@@ -194,6 +220,8 @@ namespace render {
       const BlendMode blendMode,
       const tile_flags tileFlags = notile);
 
+    bool needsFinegrainComposition(const Layer* layer) const;
+
     CompositeImageFunc getImageComposition(
       const PixelFormat dstFormat,
       const PixelFormat srcFormat,
@@ -224,6 +252,8 @@ namespace render {
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
     ImageBufferPtr m_tmpBuf;
+    base::thread_pool* m_threadPool;
+    int m_tileSize;
   };
 
   void composite_image(Image* dst,
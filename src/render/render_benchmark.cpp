@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,6 +10,7 @@
 
 #include "render/render.h"
 
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
@@ -19,6 +20,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <memory>
+
 using namespace doc;
 using namespace render;
 
@@ -26,6 +29,13 @@ static void Bm_Render(benchmark::State& state)
 {
   const int w = state.range(0);
   const int h = state.range(1);
+  const int threads = state.range(2);
+  const int tileSize = state.range(3);
+
+  // threads=0 means the serial path (without tiles)
+  std::unique_ptr<base::thread_pool> pool;
+  if (threads > 0)
+    pool = std::make_unique<base::thread_pool>(threads);
 
   Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
   LayerImage* lay1 = static_cast<LayerImage*>(spr->root()->firstLayer());
@@ -65,6 +75,7 @@ static void Bm_Render(benchmark::State& state)
     bg.color2 = rgba(200, 200, 200, 255);
     bg.stripeSize = gfx::Size(16, 16);
     render.setBgOptions(bg);
+    render.setThreadPool(pool.get(), tileSize);
     render.renderSprite(
       dst.get(), spr, frame_t(0),
       gfx::Clip(0, 0, 0, 0, w, h));
@@ -72,11 +83,21 @@ static void Bm_Render(benchmark::State& state)
 }
 
 BENCHMARK(Bm_Render)
-  ->Args({ 256, 256 })
-  ->Args({ 1024, 256 })
-  ->Args({ 256, 1024 })
-  ->Args({ 1024, 1024 })
-  ->Args({ 4096, 4096 })
+  ->Args({ 256, 256, 0, 0 })
+  ->Args({ 1024, 256, 0, 0 })
+  ->Args({ 256, 1024, 0, 0 })
+  ->Args({ 1024, 1024, 0, 0 })
+  ->Args({ 2048, 2048, 0, 0 })
+  ->Args({ 4096, 4096, 0, 0 })
   ->Unit(benchmark::kMicrosecond);
 
+BENCHMARK(Bm_Render)
+  ->ArgNames({ "w", "h", "threads", "tile" })
+  ->ArgsProduct({
+      { 2048 }, { 2048 },
+      { 1, 2, 4, 8 },
+      { 64, 128, 256, 512 } })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,12 +13,14 @@
 
 #include "render/render.h"
 
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/document.h"
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
+#include "doc/sprite.h"
 
 #include <memory>
 
@@ -277,6 +279,76 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TYPED_TEST(RenderAllModes, TiledRenderingIsSameAsSerial)
+{
+  using ImageTraits = TypeParam;
+  const int w = 300, h = 200;
+
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  Sprite* spr = Sprite::MakeStdSprite(ImageSpec((ColorMode)ImageTraits::color_mode, w, h));
+  doc->sprites().add(spr);
+
+  LayerImage* lay1 = static_cast<LayerImage*>(spr->root()->firstLayer());
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(lay2);
+  lay2->setOpacity(128);
+  lay2->setBlendMode(BlendMode::MULTIPLY);
+
+  ImageRef img2(Image::create(spr->pixelFormat(), w-20, h-30));
+  lay2->addCel(new Cel(frame_t(0), img2));
+  lay2->cel(0)->setPosition(gfx::Point(13, 7));
+
+  Image* img1 = lay1->cel(0)->image();
+  for (int y=0; y<img1->height(); ++y)
+    for (int x=0; x<img1->width(); ++x)
+      put_pixel(img1, x, y, (x*7 + y*13) & ImageTraits::max_value);
+  for (int y=0; y<img2->height(); ++y)
+    for (int x=0; x<img2->width(); ++x)
+      put_pixel(img2.get(), x, y, (x*x + y*3) & ImageTraits::max_value);
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.colorPixelFormat = spr->pixelFormat();
+  bg.color1 = (ImageTraits::color_mode == ColorMode::RGB ? rgba(128, 128, 128, 255):
+               ImageTraits::color_mode == ColorMode::GRAYSCALE ? graya(128, 255): 1);
+  bg.color2 = (ImageTraits::color_mode == ColorMode::RGB ? rgba(64, 64, 64, 255):
+               ImageTraits::color_mode == ColorMode::GRAYSCALE ? graya(64, 255): 2);
+  bg.stripeSize = gfx::Size(16, 16);
+
+  base::thread_pool pool(3);
+
+  for (const Zoom& zoom : { Zoom(1, 1), Zoom(2, 1), Zoom(3, 1), Zoom(1, 2) }) {
+    for (const BgType bgType : { BgType::CHECKERED, BgType::NONE }) {
+      // The checkered background can be rendered in tiles only when
+      // the area starts at the origin of the destination image.
+      const gfx::Clip area(bgType == BgType::NONE ? 5: 0,
+                           bgType == BgType::NONE ? 3: 0,
+                           10, 20,
+                           zoom.apply(w)-30, zoom.apply(h)-40);
+
+      std::unique_ptr<Image> expected(Image::create(spr->pixelFormat(), zoom.apply(w), zoom.apply(h)));
+      std::unique_ptr<Image> result(Image::create(spr->pixelFormat(), zoom.apply(w), zoom.apply(h)));
+      clear_image(expected.get(), 0);
+      clear_image(result.get(), 0);
+
+      bg.type = bgType;
+
+      Render render;
+      render.setBgOptions(bg);
+      render.setProjection(Projection(PixelRatio(1, 1), zoom));
+      render.renderSprite(expected.get(), spr, frame_t(0), area);
+
+      for (int tileSize : { 1, 17, 64 }) {
+        render.setThreadPool(&pool, tileSize);
+        render.renderSprite(result.get(), spr, frame_t(0), area);
+        EXPECT_TRUE(is_same_image(expected.get(), result.get()))
+          << "zoom=" << zoom.scale() << " tileSize=" << tileSize;
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
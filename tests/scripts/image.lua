@@ -534,3 +534,85 @@ do
                     2, 3 })
 
 end
+
+-- Bulk operations: mapColors/mapChannels/countColors/findColor and
+-- drawImage() with a source rectangle
+do
+  local r = rgba(255, 0, 0)
+  local g = rgba(0, 255, 0)
+  local b = rgba(0, 0, 255)
+  local k = rgba(0, 0, 0)
+
+  local rgb = Image(3, 2)
+  array_to_pixels({ r, g, b,
+                    r, r, k }, rgb)
+
+  -- Count/find colors
+  local counts = rgb:countColors()
+  expect_eq(3, counts[r])
+  expect_eq(1, counts[g])
+  expect_eq(1, counts[b])
+  expect_eq(1, counts[k])
+  expect_eq(nil, counts[rgba(1, 2, 3)])
+
+  counts = rgb:countColors(Rectangle(1, 0, 2, 2))
+  expect_eq(1, counts[r])
+  expect_eq(1, counts[g])
+  expect_eq(nil, counts[rgba(1, 2, 3)])
+
+  expect_eq(Point(2, 0), rgb:findColor(b))
+  expect_eq(Point(1, 1), rgb:findColor(r, Rectangle(1, 0, 2, 2)))
+  expect_eq(nil, rgb:findColor(rgba(1, 2, 3)))
+
+  -- Map colors
+  rgb:mapColors({ [r]=b, [b]=Color(255, 0, 0) })
+  expect_img(rgb, { b, g, r,
+                    b, b, k })
+
+  rgb:mapColors({ [b]=g }, Rectangle(0, 1, 2, 1))
+  expect_img(rgb, { b, g, r,
+                    g, g, k })
+
+  -- Map channels
+  local inv = {}
+  for i=1,256 do inv[i] = 255-(i-1) end
+  rgb:mapChannels({ red=inv, green=inv, blue=inv })
+  expect_img(rgb, { rgba(255, 255, 0), rgba(255, 0, 255), rgba(0, 255, 255),
+                    rgba(255, 0, 255), rgba(255, 0, 255), rgba(255, 255, 255) })
+
+  -- Indexed images
+  local idx = Image(3, 1, ColorMode.INDEXED)
+  array_to_pixels({ 1, 2, 1 }, idx)
+  idx:mapColors({ [1]=5, [2]=1 })
+  expect_img(idx, { 5, 1, 5 })
+  counts = idx:countColors()
+  expect_eq(2, counts[5])
+  expect_eq(1, counts[1])
+
+  -- drawImage() with a source rectangle
+  local src = Image(2, 2)
+  array_to_pixels({ r, g,
+                    b, k }, src)
+  local dst = Image(2, 2)
+  dst:clear(k)
+  dst:drawImage(src, Point(0, 0), 255, BlendMode.SRC, Rectangle(1, 0, 1, 2))
+  expect_img(dst, { g, k,
+                    k, k })
+  dst:drawImage(src, 1, 1, 255, BlendMode.SRC, Rectangle(0, 1, 1, 1))
+  expect_img(dst, { g, k,
+                    k, b })
+end
+
+-- Bulk operations in a cel image can be undone
+do
+  local spr = Sprite(2, 2, ColorMode.INDEXED)
+  local cel = spr.cels[1]
+  array_to_pixels({ 1, 2,
+                    2, 1 }, cel.image)
+  cel.image:mapColors({ [1]=3 })
+  expect_img(cel.image, { 3, 2,
+                          2, 3 })
+  app.undo()
+  expect_img(cel.image, { 1, 2,
+                          2, 1 })
+end
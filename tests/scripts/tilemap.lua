@@ -652,6 +652,48 @@ do
   assert(i:getPixel(8, 7) ~= 0)
 end
 
+----------------------------------------------------------------------
+-- Tests AUTO mode with tiles referenced from a script with drawPixel()
+----------------------------------------------------------------------
+
+do
+  local spr = Sprite(8, 4, ColorMode.INDEXED)
+  spr.gridBounds = Rectangle(0, 0, 4, 4)
+  app.command.ConvertLayer{ to="tilemap" }
+  local ts = spr.layers[1].tileset
+  app.useTool{ points={ Point(0, 0) }, color=1, tool="pencil", tilesetMode=TilesetMode.AUTO }
+  app.useTool{ points={ Point(4, 0) }, color=2, tool="pencil", tilesetMode=TilesetMode.AUTO }
+  expect_img(spr.cels[1].image, { 1, 2 })
+  expect_eq(3, #ts)
+
+  -- Now the tile 1 is used twice (and the tile 2 is unused)
+  spr.cels[1].image:drawPixel(1, 0, 1)
+  expect_img(spr.cels[1].image, { 1, 1 })
+
+  -- The tile 1 cannot be modified in place (it's used by the other
+  -- tilemap cell), so a new tile is created for the first cell
+  app.useTool{ points={ Point(1, 1) }, color=3, tool="pencil", tilesetMode=TilesetMode.AUTO }
+  expect_img(spr.cels[1].image, { 3, 1 })
+  expect_eq(4, #ts)
+  expect_img(ts:getTile(1), { 1,0,0,0,
+                              0,0,0,0,
+                              0,0,0,0,
+                              0,0,0,0 })
+  expect_img(ts:getTile(3), { 1,0,0,0,
+                              0,3,0,0,
+                              0,0,0,0,
+                              0,0,0,0 })
+
+  -- Going back to the tile 1 removes the unused tile 3
+  app.useTool{ points={ Point(1, 1) }, color=0, tool="pencil", tilesetMode=TilesetMode.AUTO }
+  expect_img(spr.cels[1].image, { 1, 1 })
+  expect_eq(3, #ts)
+  expect_img(ts:getTile(1), { 1,0,0,0,
+                              0,0,0,0,
+                              0,0,0,0,
+                              0,0,0,0 })
+end
+
 -----------------------------------------------------------------------
 -- Test CanvasSize with tilemaps when we trim out content
 -----------------------------------------------------------------------